@@ -0,0 +1,83 @@
+#!/bin/bash
+#
+# Use `test/smpp_sim' to measure SMPP throughput and latency end to end,
+# through the smpp driver, bearerbox and smsbox.
+
+set -e
+
+case "$1" in
+--fast) times=1000; shift ;;
+*) times=20000 ;;
+esac
+
+. benchmarks/functions.inc
+
+url="http://localhost:13013/cgi-bin/sendsms?username=tester&password=foobar"
+url="$url&to=456&dlr-mask=3&dlr-url=http%3A%2F%2Flocalhost%3A13080%2Fdlr"
+
+function gather_data {
+    name="$1"
+    shift
+    rm -f bench_smpp_*.log
+
+    test/smpp_sim -v 1 -m $times -u "$url" -n $times -H 13080 -s 2 \
+	-o bench_smpp-$name.dat "$@" 2> bench_smpp_sim.log &
+    simpid=$!
+    sleep 1
+    gw/bearerbox -v 4 benchmarks/bench_smpp.conf &
+    bbpid=$!
+    sleep 1
+    gw/smsbox -v 4 benchmarks/bench_smpp.conf &
+
+    wait $simpid
+    kill -INT $bbpid
+    wait
+
+    check_for_errors bench_smpp_sim.log
+}
+
+function analyze_logs {
+    awk '{ print int($2) }' bench_smpp-$1.dat | sort -n | uniq -c |
+	awk '{ print $2, $1 }' > bench_smpp-$1-rate.dat
+    sort -n -k 2 bench_smpp-$1.dat | awk '{ print $2, $3 }' \
+	> bench_smpp-$1-latency.dat
+
+    awk -v name="$1" '
+	/INFO: Throughput:/ { tput = $(NF-1) }
+	/INFO: Latency:/ {
+	    gsub(",", "")
+	    p50 = $(NF-7); p90 = $(NF-5); p99 = $(NF-3); max = $(NF-1)
+	}
+	END {
+	    printf "<row><entry>%s</entry><entry>%s</entry>", name, tput
+	    printf "<entry>%s</entry><entry>%s</entry>", p50, p90
+	    printf "<entry>%s</entry><entry>%s</entry></row>\n", p99, max
+	}' bench_smpp_sim.log >> bench_smpp-results.txt
+}
+
+function make_graphs {
+    plot benchmarks/bench_smpp_"$1" \
+	"time (s)" "messages/s (Hz)" \
+	"bench_smpp-$1-rate.dat" "completed"
+
+    plot benchmarks/bench_smpp_latency_"$1" \
+	"time (s)" "latency (s)" \
+	"bench_smpp-$1-latency.dat" ""
+}
+
+function run {
+    gather_data "$@"
+    analyze_logs "$1"
+    make_graphs "$1"
+}
+
+rm -f bench_smpp-results.txt
+run immediate
+run slow_smsc -d 0.05 -D 1
+run errors -d 0.01 -e 5
+sed -e "s/#TIMES#/$times/g" \
+    -e "/#RESULTS#/r bench_smpp-results.txt" -e "/#RESULTS#/d" \
+    benchmarks/bench_smpp.txt
+
+rm -f bench_smpp*.log
+rm -f bench_smpp*.dat bench_smpp-results.txt
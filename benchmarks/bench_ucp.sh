@@ -0,0 +1,83 @@
+#!/bin/bash
+#
+# Use `test/ucp_sim' to measure UCP/EMI throughput and latency end to end,
+# through the emi driver, bearerbox and smsbox.
+
+set -e
+
+case "$1" in
+--fast) times=1000; shift ;;
+*) times=20000 ;;
+esac
+
+. benchmarks/functions.inc
+
+url="http://localhost:13013/cgi-bin/sendsms?username=tester&password=foobar"
+url="$url&to=456&dlr-mask=3&dlr-url=http%3A%2F%2Flocalhost%3A13080%2Fdlr"
+
+function gather_data {
+    name="$1"
+    shift
+    rm -f bench_ucp_*.log
+
+    test/ucp_sim -v 1 -m $times -u "$url" -n $times -H 13080 -s 2 \
+	-o bench_ucp-$name.dat "$@" 2> bench_ucp_sim.log &
+    simpid=$!
+    sleep 1
+    gw/bearerbox -v 4 benchmarks/bench_ucp.conf &
+    bbpid=$!
+    sleep 1
+    gw/smsbox -v 4 benchmarks/bench_ucp.conf &
+
+    wait $simpid
+    kill -INT $bbpid
+    wait
+
+    check_for_errors bench_ucp_sim.log
+}
+
+function analyze_logs {
+    awk '{ print int($2) }' bench_ucp-$1.dat | sort -n | uniq -c |
+	awk '{ print $2, $1 }' > bench_ucp-$1-rate.dat
+    sort -n -k 2 bench_ucp-$1.dat | awk '{ print $2, $3 }' \
+	> bench_ucp-$1-latency.dat
+
+    awk -v name="$1" '
+	/INFO: Throughput:/ { tput = $(NF-1) }
+	/INFO: Latency:/ {
+	    gsub(",", "")
+	    p50 = $(NF-7); p90 = $(NF-5); p99 = $(NF-3); max = $(NF-1)
+	}
+	END {
+	    printf "<row><entry>%s</entry><entry>%s</entry>", name, tput
+	    printf "<entry>%s</entry><entry>%s</entry>", p50, p90
+	    printf "<entry>%s</entry><entry>%s</entry></row>\n", p99, max
+	}' bench_ucp_sim.log >> bench_ucp-results.txt
+}
+
+function make_graphs {
+    plot benchmarks/bench_ucp_"$1" \
+	"time (s)" "messages/s (Hz)" \
+	"bench_ucp-$1-rate.dat" "completed"
+
+    plot benchmarks/bench_ucp_latency_"$1" \
+	"time (s)" "latency (s)" \
+	"bench_ucp-$1-latency.dat" ""
+}
+
+function run {
+    gather_data "$@"
+    analyze_logs "$1"
+    make_graphs "$1"
+}
+
+rm -f bench_ucp-results.txt
+run immediate
+run slow_smsc -d 0.05 -D 1
+run errors -d 0.01 -e 5
+sed -e "s/#TIMES#/$times/g" \
+    -e "/#RESULTS#/r bench_ucp-results.txt" -e "/#RESULTS#/d" \
+    benchmarks/bench_ucp.txt
+
+rm -f bench_ucp*.log
+rm -f bench_ucp*.dat bench_ucp-results.txt
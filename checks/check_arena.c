@@ -0,0 +1,251 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * check_arena.c - check that gwlib/gw-arena.c works with Octstr, List and
+ * Dict, and that what outlives an arena does not pin its blocks
+ */
+
+#include <string.h>
+
+#include "gwlib/gwlib.h"
+
+#define NUM_ITEMS (10*1000)
+#define NUM_THREADS (4)
+
+static gw_queue_t *passed;
+
+
+static void check_string(Octstr *os, long i) {
+	Octstr *expected;
+
+	expected = octstr_format("item %ld", i);
+	octstr_append_char(expected, '.');
+	if (octstr_compare(os, expected) != 0)
+		panic(0, "string <%s> should be <%s>", octstr_get_cstr(os),
+		      octstr_get_cstr(expected));
+	octstr_destroy(expected);
+}
+
+
+/* Create strings and lists in an arena, some of which outlive it */
+static void creator(void *arg) {
+	gw_arena_t *arena;
+	Octstr *os;
+	List *list;
+	long i;
+
+	arena = gw_arena_begin();
+	for (i = 0; i < NUM_ITEMS; ++i) {
+		os = octstr_format("item %ld", i);
+		octstr_append_char(os, '.');
+		list = gwlist_create();
+		gwlist_append(list, octstr_create("x"));
+		gwlist_append(list, os);
+		if (i % 3 == 0)
+			gw_queue_produce(passed, list);
+		else
+			gwlist_destroy(list, octstr_destroy_item);
+	}
+	gw_arena_end(arena);
+	gw_queue_remove_producer(passed);
+}
+
+
+/* Destroy what the creators passed on, after growing it off the arena */
+static void destroyer(void *arg) {
+	Octstr *os;
+	List *list;
+	long i;
+
+	while ((list = gw_queue_consume(passed)) != NULL) {
+		os = gwlist_get(list, 1);
+		for (i = 0; i < 100; ++i)
+			gwlist_append(list, octstr_imm("more"));
+		octstr_append(os, octstr_imm(" and then some more"));
+		octstr_truncate(os, octstr_len(os) - 19);
+		gwlist_delete(list, 2, 100);
+		gwlist_destroy(list, octstr_destroy_item);
+	}
+}
+
+
+static void main_for_threads(void) {
+	long i;
+
+	passed = gw_queue_create(0);
+	for (i = 0; i < NUM_THREADS; ++i) {
+		gw_queue_add_producer(passed);
+		gwthread_create(creator, NULL);
+	}
+	for (i = 0; i < NUM_THREADS; ++i)
+		gwthread_create(destroyer, NULL);
+	gwthread_join_every(creator);
+	gwthread_join_every(destroyer);
+	gw_queue_destroy(passed, NULL);
+}
+
+
+static void main_for_scopes(void) {
+	gw_arena_t *outer, *inner;
+	Octstr *kept[3], *big;
+	List *list;
+	long i;
+
+	outer = gw_arena_begin();
+	kept[0] = octstr_format("item %ld", 0L);
+	inner = gw_arena_begin();
+	kept[1] = octstr_format("item %ld", 1L);
+	list = gwlist_create();
+	for (i = 0; i < NUM_ITEMS; ++i)
+		gwlist_append(list, octstr_format("item %ld", i));
+	/* larger than a block */
+	big = octstr_create("");
+	for (i = 0; i < NUM_ITEMS; ++i)
+		octstr_append_decimal(big, i);
+	gw_arena_end(inner);
+	kept[2] = octstr_cat(kept[0], octstr_imm("."));
+	gw_arena_end(outer);
+
+	for (i = 0; i < 3; ++i) {
+		if (i < 2)
+			octstr_append_char(kept[i], '.');
+		check_string(kept[i], i == 2 ? 0 : i);
+		octstr_destroy(kept[i]);
+	}
+	for (i = 0; i < NUM_ITEMS; ++i) {
+		octstr_append_char(gwlist_get(list, i), '.');
+		check_string(gwlist_get(list, i), i);
+	}
+	gwlist_destroy(list, octstr_destroy_item);
+	if (octstr_len(big) != 38890)
+		panic(0, "big string has wrong length %ld", octstr_len(big));
+	octstr_destroy(big);
+}
+
+
+/*
+ * Copies and table entries made in an arena are kept after it ended.
+ * They must not keep any of its blocks allocated.
+ */
+static void main_for_escapes(void) {
+	gw_arena_t *arena, *suspended;
+	Dict *dict;
+	List *kept, *headers, *escaped, *keys;
+	Octstr *os;
+	long i;
+
+	dict = dict_create(NUM_ITEMS / 10, octstr_destroy_item);
+	kept = gwlist_create();
+
+	arena = gw_arena_begin();
+	headers = http_create_empty_headers();
+	for (i = 0; i < NUM_ITEMS; ++i) {
+		os = octstr_format("item %ld", i);
+		octstr_append_char(os, '.');
+		dict_put(dict, os, octstr_duplicate(os));
+		gwlist_append(kept, octstr_duplicate(os));
+		if (i < 100)
+			http_header_add(headers, "X-Item", octstr_get_cstr(os));
+		octstr_destroy(os);
+	}
+	gwlist_append(kept, http_header_duplicate(headers));
+	http_destroy_headers(headers);
+	suspended = gw_arena_suspend();
+	escaped = gwlist_create();
+	gwlist_append(escaped, octstr_format("item %ld.", 0L));
+	gw_arena_resume(suspended);
+	gw_arena_end(arena);
+
+	if (gw_arena_blocks() != 0)
+		panic(0, "%ld arena blocks pinned by what was kept",
+		      gw_arena_blocks());
+
+	for (i = 0; i < NUM_ITEMS; ++i)
+		check_string(gwlist_get(kept, i), i);
+	headers = gwlist_get(kept, NUM_ITEMS);
+	if (gwlist_len(headers) != 100)
+		panic(0, "%ld headers kept, should be 100", gwlist_len(headers));
+	gwlist_delete(kept, NUM_ITEMS, 1);
+	http_destroy_headers(headers);
+	gwlist_destroy(kept, octstr_destroy_item);
+	keys = dict_keys(dict);
+	if (gwlist_len(keys) != NUM_ITEMS)
+		panic(0, "%ld keys kept, should be %d", gwlist_len(keys), NUM_ITEMS);
+	for (i = 0; i < NUM_ITEMS; ++i) {
+		os = gwlist_get(keys, i);
+		if (octstr_compare(os, dict_get(dict, os)) != 0)
+			panic(0, "value of key <%s> changed", octstr_get_cstr(os));
+	}
+	gwlist_destroy(keys, octstr_destroy_item);
+	dict_destroy(dict);
+	check_string(gwlist_get(escaped, 0), 0);
+	gwlist_destroy(escaped, octstr_destroy_item);
+}
+
+
+int main(void) {
+	gwlib_init();
+	log_set_output_level(GW_INFO);
+	main_for_scopes();
+	main_for_escapes();
+	main_for_threads();
+	if (gw_arena_blocks() != 0)
+		panic(0, "%ld arena blocks left after all was destroyed",
+		      gw_arena_blocks());
+	gwlib_shutdown();
+	return 0;
+}
@@ -0,0 +1,224 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+
+/*
+ * check_http_lazy.c - check the lazy HTTPRequest accessors of gwlib/http.c
+ */
+
+#include <string.h>
+
+#include "gwlib/gwlib.h"
+
+#define PORT (8043)
+
+static char *requests[] = {
+	"GET /cgi-bin/sendsms?user=a%20b&text=hi&flag HTTP/1.1\r\n"
+	"Host: localhost\r\n"
+	"X-Folded: one\r\n"
+	" two\r\n"
+	"accept: text/plain\r\n"
+	"Accept: text/html\r\n"
+	"Connection: close\r\n"
+	"\r\n",
+
+	"POST /post HTTP/1.1\r\n"
+	"Content-Length: 5\r\n"
+	"Connection: close\r\n"
+	"\r\n"
+	"hello",
+
+	"POST /chunked HTTP/1.1\r\n"
+	"Transfer-Encoding: chunked\r\n"
+	"Connection: close\r\n"
+	"\r\n"
+	"5\r\nhello\r\n6\r\n world\r\n0\r\n"
+	"X-Trailer: t\r\n"
+	"\r\n",
+};
+
+#define NUM_REQUESTS (sizeof(requests) / sizeof(requests[0]))
+
+
+/* Send the requests one at a time, each after the previous was answered */
+static void client_thread(void *arg) {
+	Connection *conn;
+	Octstr *line;
+	long i;
+
+	for (i = 0; i < NUM_REQUESTS; ++i) {
+		conn = conn_open_tcp(octstr_imm("127.0.0.1"), PORT, NULL);
+		if (conn == NULL)
+			panic(0, "cannot connect to port %d", PORT);
+		conn_write(conn, octstr_imm(requests[i]));
+		while ((line = conn_read_line(conn)) == NULL)
+			if (conn_wait(conn, -1) != 0 || conn_eof(conn))
+				panic(0, "no reply to request %ld", i);
+		octstr_destroy(line);
+		conn_destroy(conn);
+	}
+}
+
+
+static void check_value(Octstr *value, char *expected, char *what) {
+	if (expected == NULL) {
+		if (value != NULL)
+			panic(0, "%s is <%s>, should be missing", what,
+			      octstr_get_cstr(value));
+	} else if (value == NULL)
+		panic(0, "%s is missing, should be <%s>", what, expected);
+	else if (octstr_str_compare(value, expected) != 0)
+		panic(0, "%s is <%s>, should be <%s>", what,
+		      octstr_get_cstr(value), expected);
+}
+
+
+/* Same for a header, which the caller gets a copy of */
+static void check_header(HTTPRequest *req, char *name, char *expected) {
+	Octstr *value;
+
+	value = http_request_header(req, name);
+	check_value(value, expected, name);
+	octstr_destroy(value);
+}
+
+
+/* Headers looked up before the list exists, then from the list */
+static void check_get(HTTPRequest *req) {
+	List *headers;
+
+	if (http_request_method(req) != HTTP_METHOD_GET)
+		panic(0, "GET request has method %d", http_request_method(req));
+	check_value(http_request_ip(req), "127.0.0.1", "ip");
+	check_value(http_request_path(req), "/cgi-bin/sendsms", "path");
+	check_value(http_request_body(req), NULL, "GET body");
+	check_header(req, "ACCEPT", "text/plain");
+	check_header(req, "X-Folded", "one two");
+	check_header(req, "Content-Length", NULL);
+	check_value(http_request_cgi_variable(req, "user"), "a b", "user");
+	check_value(http_request_cgi_variable(req, "text"), "hi", "text");
+	check_value(http_request_cgi_variable(req, "flag"), "", "flag");
+	check_value(http_request_cgi_variable(req, "none"), NULL, "none");
+	if (gwlist_len(http_request_cgivars(req)) != 3)
+		panic(0, "GET request has %ld CGI variables, should be 3",
+		      gwlist_len(http_request_cgivars(req)));
+
+	headers = http_request_headers(req);
+	if (gwlist_len(headers) != 5)
+		panic(0, "GET request has %ld headers, should be 5",
+		      gwlist_len(headers));
+	if (http_request_headers(req) != headers)
+		panic(0, "header list created twice");
+	if (!http_type_accepted(headers, "text/html"))
+		panic(0, "second Accept header lost");
+	check_header(req, "X-Folded", "one two");
+}
+
+
+static void check_post(HTTPRequest *req) {
+	if (http_request_method(req) != HTTP_METHOD_POST)
+		panic(0, "POST request has method %d", http_request_method(req));
+	check_value(http_request_path(req), "/post", "path");
+	check_value(http_request_body(req), "hello", "POST body");
+	check_header(req, "content-length", "5");
+	if (gwlist_len(http_request_cgivars(req)) != 0)
+		panic(0, "POST request without query has CGI variables");
+}
+
+
+/* Trailers are found before and after the header list is created */
+static void check_chunked(HTTPRequest *req) {
+	check_value(http_request_path(req), "/chunked", "path");
+	check_value(http_request_body(req), "hello world", "chunked body");
+	check_header(req, "X-Trailer", "t");
+	if (gwlist_len(http_request_headers(req)) != 3)
+		panic(0, "chunked request has %ld headers, should be 3",
+		      gwlist_len(http_request_headers(req)));
+	check_header(req, "X-Trailer", "t");
+}
+
+
+int main(void) {
+	void (*checks[NUM_REQUESTS])(HTTPRequest *) =
+		{ check_get, check_post, check_chunked };
+	HTTPClient *client;
+	HTTPRequest *req;
+	List *headers;
+	long i;
+
+	gwlib_init();
+	log_set_output_level(GW_INFO);
+
+	if (http_open_port(PORT, 0) == -1)
+		panic(0, "cannot open port %d", PORT);
+	gwthread_create(client_thread, NULL);
+
+	headers = http_create_empty_headers();
+	for (i = 0; i < NUM_REQUESTS; ++i) {
+		client = http_accept_request_lazy(PORT, &req);
+		if (client == NULL)
+			panic(0, "request %ld not accepted", i);
+		checks[i](req);
+		http_send_reply(client, HTTP_OK, headers, octstr_imm(""));
+		http_request_destroy(req);
+	}
+	http_destroy_headers(headers);
+
+	gwthread_join_every(client_thread);
+	http_close_all_ports();
+	gwlib_shutdown();
+	return 0;
+}
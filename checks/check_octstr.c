@@ -58,6 +58,7 @@
  * check_octstr.c - checking of octet string functions
  */
 
+#include <ctype.h>
 #include <string.h>
 
 #include "gwlib/gwlib.h"
@@ -111,11 +112,100 @@ static void check_comparisons(void)
 }
 
 
+/*
+ * More C strings than the old fixed immutables table could hold, looked
+ * up from several threads at once. Every thread must get the same Octstr
+ * for the same C string.
+ */
+#define NUM_IMM 5000
+#define NUM_IMM_THREADS 4
+
+static char imm_strings[NUM_IMM][8];
+static Octstr *imm_seen[NUM_IMM_THREADS][NUM_IMM];
+
+static void imm_thread(void *arg)
+{
+    long t, i, j;
+
+    t = *(long *) arg;
+    for (i = 0; i < NUM_IMM; ++i) {
+	j = (i + t * 997) % NUM_IMM;
+	imm_seen[t][j] = octstr_imm(imm_strings[j]);
+    }
+}
+
+static void check_immutables(void)
+{
+    long ids[NUM_IMM_THREADS], threads[NUM_IMM_THREADS];
+    long i, t;
+
+    for (i = 0; i < NUM_IMM; ++i)
+	sprintf(imm_strings[i], "%ld", i);
+    for (t = 0; t < NUM_IMM_THREADS; ++t) {
+	ids[t] = t;
+	threads[t] = gwthread_create(imm_thread, &ids[t]);
+    }
+    for (t = 0; t < NUM_IMM_THREADS; ++t)
+	gwthread_join(threads[t]);
+
+    for (i = 0; i < NUM_IMM; ++i) {
+	if (octstr_str_compare(imm_seen[0][i], imm_strings[i]) != 0)
+	    panic(0, "octstr_imm(\"%s\") has the wrong content", imm_strings[i]);
+	for (t = 1; t < NUM_IMM_THREADS; ++t)
+	    if (imm_seen[t][i] != imm_seen[0][i])
+		panic(0, "octstr_imm(\"%s\") is not unique", imm_strings[i]);
+	if (octstr_imm(imm_strings[i]) != imm_seen[0][i])
+	    panic(0, "octstr_imm(\"%s\") changed", imm_strings[i]);
+    }
+}
+
+
+/*
+ * Duplicates share the data of the original until one of them changes.
+ * Modify one side in various ways and check the other one is unchanged.
+ */
+static void check_sharing(void)
+{
+    static const char *text = "The quick brown fox jumps over the lazy dog";
+    Octstr *orig, *dup, *dup2;
+    int i;
+
+    orig = octstr_create(text);
+    for (i = 0; i < 9; ++i) {
+	dup = (i % 2) ? octstr_duplicate(orig)
+	              : octstr_copy(orig, 0, octstr_len(orig));
+	dup2 = octstr_duplicate(dup);
+	switch (i) {
+	case 0: octstr_append_cstr(dup, " again"); break;
+	case 1: octstr_set_char(dup, 0, 't'); break;
+	case 2: octstr_delete(dup, 0, 4); break;
+	case 3: octstr_insert_data(dup, 4, "very ", 5); break;
+	case 4: octstr_truncate(dup, 3); break;
+	case 5: octstr_binary_to_hex(dup, 0); break;
+	case 6: octstr_url_encode(dup); break;
+	case 7: octstr_convert_range(dup, 0, octstr_len(dup), toupper); break;
+	case 8: octstr_destroy(orig); orig = octstr_duplicate(dup2); break;
+	}
+	if (octstr_str_compare(orig, text) != 0)
+	    panic(0, "Modifying a duplicate (case %d) changed the original", i);
+	if (octstr_str_compare(dup2, text) != 0)
+	    panic(0, "Modifying a duplicate (case %d) changed its duplicate", i);
+	if (i != 8 && octstr_str_compare(dup, text) == 0)
+	    panic(0, "Duplicate (case %d) was not modified", i);
+	octstr_destroy(dup);
+	octstr_destroy(dup2);
+    }
+    octstr_destroy(orig);
+}
+
+
 int main(void)
 {
     gwlib_init();
     log_set_output_level(GW_INFO);
     check_comparisons();
+    check_immutables();
+    check_sharing();
     gwlib_shutdown();
     return 0;
 }
@@ -0,0 +1,216 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * check_prioqueue.c - check the level queues of gwlib/gw-prioqueue.c
+ */
+
+#include <string.h>
+
+#include "gwlib/gwlib.h"
+#include "gwlib/gw-prioqueue.h"
+
+#define NUM_LEVELS (5)
+#define NUM_PRODUCERS (4)
+#define NUM_CONSUMERS (2)
+#define NUM_ITEMS_PER_PRODUCER (100*1000)
+
+typedef struct {
+	long producer;
+	long num;
+	int level;
+} Item;
+
+struct producer_info {
+	gw_prioqueue_t *queue;
+	long id;
+};
+
+static char received[NUM_PRODUCERS * NUM_ITEMS_PER_PRODUCER];
+static long last_num[NUM_CONSUMERS][NUM_PRODUCERS][NUM_LEVELS];
+static Item items[NUM_PRODUCERS * NUM_ITEMS_PER_PRODUCER];
+static gw_prioqueue_t *queue;
+static Counter *consumer_ids;
+static int order_errors;
+
+
+/* level of an item, with some outside the range of the queue */
+static int item_level(const void *a) {
+	return ((const Item *) a)->level - 1;
+}
+
+
+static void producer(void *arg) {
+	struct producer_info *info = arg;
+	Item *item;
+	long i;
+
+	for (i = 0; i < NUM_ITEMS_PER_PRODUCER; ++i) {
+		item = &items[info->id * NUM_ITEMS_PER_PRODUCER + i];
+		item->producer = info->id;
+		item->num = i;
+		item->level = (i * 7 + info->id) % NUM_LEVELS;
+		gw_prioqueue_produce(info->queue, item);
+	}
+	gw_prioqueue_remove_producer(info->queue);
+}
+
+
+/*
+ * Each consumer must see the items of a producer and level in order.
+ */
+static void consumer(void *arg) {
+	long id;
+	Item *item;
+
+	id = counter_increase(consumer_ids);
+	while ((item = gw_prioqueue_consume(queue)) != NULL) {
+		received[item->producer * NUM_ITEMS_PER_PRODUCER + item->num]++;
+		if (item->num < last_num[id][item->producer][item->level])
+			order_errors = 1;
+		last_num[id][item->producer][item->level] = item->num;
+	}
+}
+
+
+static void main_for_producer_and_consumer(void) {
+	struct producer_info tab[NUM_PRODUCERS];
+	long i, errors;
+
+	queue = gw_prioqueue_create_levels(NUM_LEVELS - 2, item_level);
+	consumer_ids = counter_create();
+	memset(received, 0, sizeof(received));
+	memset(last_num, 0, sizeof(last_num));
+	order_errors = 0;
+
+	for (i = 0; i < NUM_PRODUCERS; ++i) {
+		tab[i].queue = queue;
+		tab[i].id = i;
+		gw_prioqueue_add_producer(queue);
+	}
+	for (i = 0; i < NUM_CONSUMERS; ++i)
+		gwthread_create(consumer, NULL);
+	for (i = 0; i < NUM_PRODUCERS; ++i)
+		gwthread_create(producer, tab + i);
+
+	gwthread_join_every(producer);
+	gwthread_join_every(consumer);
+
+	if (gw_prioqueue_len(queue) != 0)
+		panic(0, "%ld items left in queue", gw_prioqueue_len(queue));
+
+	errors = 0;
+	for (i = 0; i < NUM_PRODUCERS * NUM_ITEMS_PER_PRODUCER; ++i) {
+		if (received[i] != 1) {
+			error(0, "Item %ld received %d times.", i, received[i]);
+			errors = 1;
+		}
+	}
+	if (errors)
+		panic(0, "Not all items were received exactly once.");
+	if (order_errors)
+		panic(0, "Items of a producer were consumed out of order.");
+
+	counter_destroy(consumer_ids);
+	gw_prioqueue_destroy(queue, NULL);
+}
+
+
+/*
+ * Items come out by level, highest first, and in insertion order
+ * within a level.
+ */
+static void main_for_order(void) {
+	gw_prioqueue_t *q;
+	Item tab[100], *item, *prev;
+	long i;
+
+	q = gw_prioqueue_create_levels(NUM_LEVELS, item_level);
+	for (i = 0; i < 100; ++i) {
+		tab[i].num = i;
+		tab[i].level = 1 + (i * 3) % NUM_LEVELS;
+		gw_prioqueue_insert(q, &tab[i]);
+	}
+	if (gw_prioqueue_len(q) != 100)
+		panic(0, "queue has wrong length %ld", gw_prioqueue_len(q));
+	/* tab[3] is the first of level NUM_LEVELS */
+	if (gw_prioqueue_get(q) != &tab[3])
+		panic(0, "queue does not start with the first item of the highest level");
+
+	prev = NULL;
+	while ((item = gw_prioqueue_remove(q)) != NULL) {
+		if (prev != NULL && (item->level > prev->level ||
+		    (item->level == prev->level && item->num < prev->num)))
+			panic(0, "item %ld (level %d) came after item %ld (level %d)",
+			      item->num, item->level, prev->num, prev->level);
+		prev = item;
+	}
+	if (gw_prioqueue_len(q) != 0)
+		panic(0, "empty queue has length %ld", gw_prioqueue_len(q));
+
+	gw_prioqueue_insert(q, &tab[0]);
+	gw_prioqueue_destroy(q, NULL);
+}
+
+
+int main(void) {
+	gwlib_init();
+	log_set_output_level(GW_INFO);
+	main_for_order();
+	main_for_producer_and_consumer();
+	gwlib_shutdown();
+	return 0;
+}
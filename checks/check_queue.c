@@ -0,0 +1,213 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * check_queue.c - check that gwlib/gw-queue.c works
+ */
+
+#include <string.h>
+#include <sched.h>
+
+#include "gwlib/gwlib.h"
+
+#define NUM_PRODUCERS (4)
+#define NUM_CONSUMERS (4)
+#define NUM_ITEMS_PER_PRODUCER (100*1000)
+#define BATCH (16)
+
+typedef struct {
+	long producer;
+	long num;
+} Item;
+
+struct producer_info {
+	gw_queue_t *queue;
+	long id;
+};
+
+static char received[NUM_PRODUCERS * NUM_ITEMS_PER_PRODUCER];
+static long last_num[NUM_CONSUMERS][NUM_PRODUCERS];
+static Item items[NUM_PRODUCERS * NUM_ITEMS_PER_PRODUCER];
+static gw_queue_t *queue;
+static Counter *consumer_ids;
+static int order_errors;
+
+
+static void producer(void *arg) {
+	struct producer_info *info = arg;
+	Item *item;
+	long i;
+
+	for (i = 0; i < NUM_ITEMS_PER_PRODUCER; ++i) {
+		item = &items[info->id * NUM_ITEMS_PER_PRODUCER + i];
+		item->producer = info->id;
+		item->num = i;
+		while (gw_queue_produce(info->queue, item) == -1)
+			sched_yield();
+	}
+	gw_queue_remove_producer(info->queue);
+}
+
+
+/*
+ * Half of the consumers take items one by one, the other half in
+ * batches. Each of them must see the items of a producer in order.
+ */
+static void consumer(void *arg) {
+	void *batch[BATCH];
+	long id, n, i;
+	Item *item;
+
+	id = counter_increase(consumer_ids);
+	for (;;) {
+		if (id % 2) {
+			n = gw_queue_consume_batch(queue, batch, BATCH);
+		} else {
+			batch[0] = gw_queue_consume(queue);
+			n = (batch[0] != NULL);
+		}
+		if (n == 0)
+			break;
+		for (i = 0; i < n; ++i) {
+			item = batch[i];
+			received[item->producer * NUM_ITEMS_PER_PRODUCER + item->num]++;
+			if (item->num < last_num[id][item->producer])
+				order_errors = 1;
+			last_num[id][item->producer] = item->num;
+		}
+	}
+}
+
+
+static void main_for_producer_and_consumer(long bound) {
+	struct producer_info tab[NUM_PRODUCERS];
+	long i, errors;
+
+	queue = gw_queue_create(bound);
+	consumer_ids = counter_create();
+	memset(received, 0, sizeof(received));
+	memset(last_num, 0, sizeof(last_num));
+	order_errors = 0;
+
+	for (i = 0; i < NUM_PRODUCERS; ++i) {
+		tab[i].queue = queue;
+		tab[i].id = i;
+		gw_queue_add_producer(queue);
+	}
+	for (i = 0; i < NUM_CONSUMERS; ++i)
+		gwthread_create(consumer, NULL);
+	for (i = 0; i < NUM_PRODUCERS; ++i)
+		gwthread_create(producer, tab + i);
+
+	gwthread_join_every(producer);
+	gwthread_join_every(consumer);
+
+	if (gw_queue_len(queue) != 0)
+		panic(0, "%ld items left in queue", gw_queue_len(queue));
+
+	errors = 0;
+	for (i = 0; i < NUM_PRODUCERS * NUM_ITEMS_PER_PRODUCER; ++i) {
+		if (received[i] != 1) {
+			error(0, "Item %ld received %d times.", i, received[i]);
+			errors = 1;
+		}
+	}
+	if (errors)
+		panic(0, "Not all items were received exactly once.");
+	if (order_errors)
+		panic(0, "Items of a producer were consumed out of order.");
+
+	counter_destroy(consumer_ids);
+	gw_queue_destroy(queue, NULL);
+}
+
+
+static void main_for_bounded(void) {
+	static char *item = "item";
+	gw_queue_t *q;
+	long i;
+
+	q = gw_queue_create(3);
+	for (i = 0; i < 4; ++i)
+		if (gw_queue_produce(q, item) == -1)
+			panic(0, "bounded queue refused item %ld", i);
+	if (gw_queue_produce(q, item) != -1)
+		panic(0, "bounded queue took more items than its size");
+	if (gw_queue_len(q) != 4)
+		panic(0, "bounded queue has wrong length %ld", gw_queue_len(q));
+	while (gw_queue_extract(q) != NULL)
+		;
+	gw_queue_add_producer(q);
+	if (gw_queue_timed_consume(q, 1) != NULL)
+		panic(0, "timed consume returned an item from an empty queue");
+	gw_queue_remove_producer(q);
+	if (gw_queue_consume(q) != NULL)
+		panic(0, "consume did not return NULL without producers");
+	gw_queue_destroy(q, NULL);
+}
+
+
+int main(void) {
+	gwlib_init();
+	log_set_output_level(GW_INFO);
+	main_for_bounded();
+	/* unbounded, with items spilling over the ring */
+	main_for_producer_and_consumer(0);
+	/* small bounded ring, producers retry when it is full */
+	main_for_producer_and_consumer(64);
+	gwlib_shutdown();
+	return 0;
+}
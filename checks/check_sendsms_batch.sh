@@ -0,0 +1,91 @@
+#!/bin/sh
+#
+# Use `test/fakesmsc' to test the batch sendsms service in smsbox.
+
+set -e
+#set -x
+
+host=127.0.0.1
+interval=0
+loglevel=0
+sendsmsport=13013
+username=tester
+password=foobar
+
+url="http://$host:$sendsmsport/cgi-bin/sendsms-batch?\
+username=$username&password=$password"
+
+gw/bearerbox -v $loglevel gw/smskannel.conf > check_sendsms_batch_bb.log 2>&1 &
+bbpid=$!
+
+sleep 2
+
+test/fakesmsc -H $host -r 20000 -i $interval -m 0 '123 234 text nop' \
+    > check_sendsms_batch_smsc.log 2>&1 &
+
+sleep 1
+gw/smsbox -v $loglevel gw/smskannel.conf > check_sendsms_batch_sms.log 2>&1 &
+
+sleep 2
+
+# JSON: two good messages and one without receiver
+echo "Content-Type: application/json" > check_sendsms_batch.hdr
+cat > check_sendsms_batch.body <<EOF
+[{"from": "123", "to": "234", "text": "batch one"},
+ {"from": "123", "to": ["234"], "text": "batch two"},
+ {"from": "123", "text": "batch none"}]
+EOF
+
+test/test_http -H check_sendsms_batch.hdr -B check_sendsms_batch.body $url \
+    >> check_sendsms_batch.log 2>&1
+sleep 2
+
+if [ 2 -ne `grep -c 'Batch message [01] Status: 202 ' check_sendsms_batch_sms.log` ] ||
+   [ 1 -ne `grep -c 'Batch message 2 Status: 400 Answer: <Missing receiver' \
+       check_sendsms_batch_sms.log` ] ||
+   [ 1 -ne `grep -c 'Got message .*: <123 234 text batch one>' check_sendsms_batch_smsc.log` ] ||
+   [ 1 -ne `grep -c 'Got message .*: <123 234 text batch two>' check_sendsms_batch_smsc.log` ] ||
+   grep 'text batch none' check_sendsms_batch_smsc.log >/dev/null
+then
+	echo check_sendsms_batch.sh failed with JSON batch 1>&2
+	echo See check_sendsms_batch*.log for info 1>&2
+	exit 1
+fi
+
+# XML: one good message and one without receiver
+echo "Content-Type: text/xml" > check_sendsms_batch.hdr
+cat > check_sendsms_batch.body <<EOF
+<messages>
+ <message><from>123</from><to>234</to><text>batch three</text></message>
+ <message><from>123</from><text>batch none</text></message>
+</messages>
+EOF
+
+test/test_http -H check_sendsms_batch.hdr -B check_sendsms_batch.body $url \
+    >> check_sendsms_batch.log 2>&1
+sleep 2
+
+if [ 3 -ne `grep -c 'Batch message [01] Status: 202 ' check_sendsms_batch_sms.log` ] ||
+   [ 2 -ne `grep -c 'Batch message [12] Status: 400 Answer: <Missing receiver' \
+       check_sendsms_batch_sms.log` ] ||
+   [ 1 -ne `grep -c 'Got message .*: <123 234 text batch three>' check_sendsms_batch_smsc.log` ]
+then
+	echo check_sendsms_batch.sh failed with XML batch 1>&2
+	echo See check_sendsms_batch*.log for info 1>&2
+	exit 1
+fi
+
+kill -INT $bbpid
+wait
+
+# Do we panic when going down ?
+if grep 'PANIC:' check_sendsms_batch*.log >/dev/null
+then
+	echo check_sendsms_batch.sh failed when going down 1>&2
+	echo See check_sendsms_batch*.log for info 1>&2
+	exit 1
+fi
+
+rm -f check_sendsms_batch*.log check_sendsms_batch.hdr check_sendsms_batch.body
+
+exit 0
@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# Use `test/smpp_sim' to test SMPP binds run on the event loops: bind,
+# traffic with asynchronous receipts, reconnect after the SMS center went
+# away, and shutdown.
+
+set -e
+#set -x
+
+times=50
+
+url="http://localhost:13013/cgi-bin/sendsms?username=tester&password=foobar"
+url="$url&to=456&dlr-mask=3&dlr-url=http%3A%2F%2Flocalhost%3A13080%2Fdlr"
+
+run_sim() {
+    test/smpp_sim -v 0 -m $times -u "$url" -n $times -H 13080 -s 2 -t 10 \
+        > check_smpp_loops_sim.log 2>&1
+    if ! grep "Messages completed: `expr $times \* 2` of " \
+            check_smpp_loops_sim.log >/dev/null
+    then
+        echo check_smpp_loops.sh failed in $1 run 1>&2
+        echo See check_smpp_loops*.log for info 1>&2
+        kill -INT $bbpid
+        exit 1
+    fi
+    cat check_smpp_loops_sim.log >> check_smpp_loops_sims.log
+}
+
+gw/bearerbox -v 0 test/smpp_loops.conf > /dev/null 2>&1 &
+bbpid=$!
+sleep 1
+gw/smsbox -v 0 test/smpp_loops.conf > /dev/null 2>&1 &
+
+run_sim first
+# the binds reconnect to the next simulator
+run_sim second
+
+kill -INT $bbpid
+wait
+
+if grep 'PANIC:' check_smpp_loops*.log >/dev/null ||
+   grep 'sessions left on event loop' check_smpp_loops_bb.log >/dev/null ||
+   ! grep 'SMSCConn SMPP:.* shut down.' check_smpp_loops_bb.log >/dev/null
+then
+    echo check_smpp_loops.sh failed when going down 1>&2
+    echo See check_smpp_loops*.log for info 1>&2
+    exit 1
+fi
+
+rm -f check_smpp_loops*.log
+
+exit 0
@@ -0,0 +1,164 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * check_wheel.c - check that gwlib/gw-wheel.c expires entries in time
+ */
+
+#include <stdlib.h>
+
+#include "gwlib/gwlib.h"
+#include "gwlib/gw-wheel.h"
+
+#define NUM_ENTRIES (20*1000)
+
+static struct gw_wheel_entry entries[NUM_ENTRIES];
+static int expired[NUM_ENTRIES];
+
+
+/* Spread the intervals over all levels of the wheel, and beyond */
+static long random_interval(void)
+{
+	switch (gw_rand() % 5) {
+	case 0: return gw_rand() % 64;
+	case 1: return gw_rand() % 4096;
+	case 2: return gw_rand() % (4096 * 64);
+	case 3: return gw_rand() % (4096 * 4096);
+	default: return gw_rand() % (4096L * 4096 * 16);
+	}
+}
+
+
+static long random_step(void)
+{
+	switch (gw_rand() % 4) {
+	case 0: return 1;
+	case 1: return gw_rand() % 100;
+	case 2: return gw_rand() % 100000;
+	default: return gw_rand() % 10000000;
+	}
+}
+
+
+/* Return the earliest expiry of all entries in the wheel */
+static long earliest(void)
+{
+	long i, e;
+
+	e = -1;
+	for (i = 0; i < NUM_ENTRIES; ++i)
+		if (entries[i].next != NULL && (e == -1 || entries[i].elapses < e))
+			e = entries[i].elapses;
+	return e;
+}
+
+
+int main(void)
+{
+	gw_wheel_t *wheel;
+	struct gw_wheel_entry *entry;
+	long i, now, prev, steps, next, e;
+
+	gwlib_init();
+
+	now = 1000000000 + gw_rand() % 1000000;
+	wheel = gw_wheel_create(now);
+	for (i = 0; i < NUM_ENTRIES; ++i) {
+		entries[i].elapses = now + random_interval();
+		entries[i].owner = &expired[i];
+		gw_wheel_insert(wheel, &entries[i]);
+	}
+
+	for (steps = 0; gw_wheel_len(wheel) > 0; ++steps) {
+		/* move some entries, like timers that are started again */
+		for (i = 0; i < 10; ++i) {
+			entry = &entries[gw_rand() % NUM_ENTRIES];
+			if (entry->next == NULL)
+				continue;
+			gw_wheel_remove(wheel, entry);
+			entry->elapses = now + random_interval();
+			gw_wheel_insert(wheel, entry);
+		}
+
+		if (steps % 100 == 0) {
+			next = gw_wheel_next(wheel);
+			e = earliest();
+			if (next == -1 || next > e)
+				panic(0, "next time %ld is after the first expiry %ld",
+				      next, e);
+		}
+
+		prev = now;
+		now += random_step();
+		while ((entry = gw_wheel_expire(wheel, now)) != NULL) {
+			if (entry->elapses > now || entry->elapses < prev)
+				panic(0, "entry for %ld expired between %ld and %ld",
+				      entry->elapses, prev, now);
+			if (++*(int *) entry->owner != 1)
+				panic(0, "entry expired twice");
+		}
+	}
+
+	for (i = 0; i < NUM_ENTRIES; ++i)
+		if (expired[i] != 1)
+			panic(0, "entry %ld never expired", i);
+	if (gw_wheel_next(wheel) != -1 || gw_wheel_any(wheel) != NULL)
+		panic(0, "empty wheel has entries");
+
+	gw_wheel_destroy(wheel);
+	gwlib_shutdown();
+	return 0;
+}
@@ -284,6 +284,12 @@
 /* Define version of used libpcre */
 #define LIBPCRE_VERSION "8.38"
 
+/* Define if you have and want to use PCRE2 for the gw_regex_* functions */
+/* #undef HAVE_PCRE2 */
+
+/* Define version of used libpcre2 */
+/* #undef LIBPCRE2_VERSION */
+
 /* Define if you have pthread_spinlock_t type and spinlock support. */
 /* #undef HAVE_PTHREAD_SPINLOCK_T */
 
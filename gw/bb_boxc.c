@@ -82,14 +82,24 @@
 
 #define SMSBOX_MAX_PENDING 100
 
+/* how many messages a box sender thread takes off its queue at once */
+#define BOXC_SEND_BATCH 16
+
+/*
+ * Weight of a new sample in the smsbox ack latency average, and the
+ * latency assumed for a box we got no ack from yet.
+ */
+#define ACK_LATENCY_WEIGHT  0.2
+#define ACK_LATENCY_DEFAULT 0.01
+
 /* passed from bearerbox core */
 
 extern volatile sig_atomic_t bb_status;
 extern volatile sig_atomic_t restart;
-extern List *incoming_sms;
-extern List *outgoing_sms;
-extern List *incoming_wdp;
-extern List *outgoing_wdp;
+extern gw_queue_t *incoming_sms;
+extern gw_queue_t *outgoing_sms;
+extern gw_queue_t *incoming_wdp;
+extern gw_queue_t *outgoing_wdp;
 
 extern List *flow_threads;
 extern List *suspended;
@@ -129,6 +139,19 @@ static Counter *boxid;
 
 /* sms_to_smsboxes thread-id */
 static long sms_dequeue_thread;
+/* we hold a producer of incoming_sms for it, see release_sms_dequeue() */
+static int sms_dequeue_held;
+
+/*
+ * MO messages that found no box with free capacity on their route, keyed
+ * by smsbox-id (anonymous_route for any non-identified smsbox). They are
+ * passed to such a box by boxc_ready() as soon as it can take more, so
+ * the dequeue thread never spins or sleeps on them.
+ */
+static Dict *parked_routes;
+static Mutex *parked_lock;
+static Counter *parked_count;   /* changed under parked_lock only */
+static Octstr *anonymous_route;
 
 
 typedef struct _boxc {
@@ -138,11 +161,13 @@ typedef struct _boxc {
     int               load;
     time_t        connect_time;
     Octstr        *client_ip;
-    List            *incoming;
-    List            *retry;   	/* If sending fails */
-    List            *outgoing;
+    gw_queue_t      *incoming;
+    volatile long   batched;  /* taken off incoming by boxc_sender, not sent */
+    gw_queue_t      *retry;   	/* If sending fails */
+    gw_queue_t      *outgoing;
     Dict           *sent;
     Semaphore *pending;
+    double        ack_latency; /* moving average of seconds until ack */
     volatile sig_atomic_t alive;
     Octstr        *boxc_id; /* identifies the connected smsbox instance */
     /* used to mark connection usable or still waiting for ident. msg */
@@ -150,12 +175,30 @@ typedef struct _boxc {
 } Boxc;
 
 
+/* message in Boxc->sent waiting for its ack */
+typedef struct {
+    Msg *msg;
+    double sent_at;
+} SentMsg;
+
+
+/*
+ * Messages routed to the box and not yet sent to it: those in its queue
+ * and those boxc_sender has already taken into its batch.
+ */
+static long boxc_queued(Boxc *boxc)
+{
+    return gw_queue_len(boxc->incoming) + boxc->batched;
+}
+
+
 /* forward declaration */
 static void sms_to_smsboxes(void *arg);
 static int send_msg(Boxc *boxconn, Msg *pmsg);
 static void boxc_sent_push(Boxc*, Msg*);
 static void boxc_sent_pop(Boxc*, Msg*, Msg**);
 static void boxc_gwlist_destroy(List *list);
+static void boxc_ready(Boxc *conn);
 
 
 /*-------------------------------------------------
@@ -335,15 +378,15 @@ static void boxc_receiver(void *arg)
 
             if (conn->routable == 0) {
                 conn->routable = 1;
-                /* wakeup the dequeue thread */
-                gwthread_wakeup(sms_dequeue_thread);
+                /* release messages waiting for this route */
+                boxc_ready(conn);
             }
         } else if (msg_type(msg) == wdp_datagram && conn->is_wap) {
             debug("bb.boxc", 0, "boxc_receiver: got wdp from wapbox");
 
             /* XXX we should block these in SHUTDOWN phase too, but
                we need ack/nack msgs implemented first. */
-            gwlist_produce(conn->outgoing, msg);
+            gw_queue_produce(conn->outgoing, msg);
 
         } else if (msg_type(msg) == sms && conn->is_wap) {
             debug("bb.boxc", 0, "boxc_receiver: got sms from wapbox");
@@ -353,8 +396,8 @@ static void boxc_receiver(void *arg)
 
             if (conn->routable == 0) {
                 conn->routable = 1;
-                /* wakeup the dequeue thread */
-                gwthread_wakeup(sms_dequeue_thread);
+                /* release messages waiting for this route */
+                boxc_ready(conn);
             }
         } else {
             if (msg_type(msg) == heartbeat) {
@@ -368,7 +411,7 @@ static void boxc_receiver(void *arg)
                     Msg *orig;
                     boxc_sent_pop(conn, msg, &orig);
                     if (orig != NULL) /* retry this message */
-                        gwlist_append(conn->retry, orig);
+                        gw_queue_produce(conn->retry, orig);
                 } else {
                     boxc_sent_pop(conn, msg, NULL);
                     store_save(msg);
@@ -436,8 +479,8 @@ static void boxc_receiver(void *arg)
                 }
 
                 conn->routable = 1;
-                /* wakeup the dequeue thread */
-                gwthread_wakeup(sms_dequeue_thread);
+                /* release messages waiting for this route */
+                boxc_ready(conn);
             }
             else
                 warning(0, "boxc_receiver: unknown msg received from <%s>, "
@@ -480,17 +523,27 @@ static int send_msg(Boxc *boxconn, Msg *pmsg)
 }
 
 
+static double boxc_time(void)
+{
+    return gw_clock_mono_ns() / 1e9;
+}
+
+
 static void boxc_sent_push(Boxc *conn, Msg *m)
 {
     Octstr *os;
     char id[UUID_STR_LEN + 1];
+    SentMsg *sent;
 
     if (conn->is_wap || !conn->sent || !m || msg_type(m) != sms)
         return;
 
     uuid_unparse(m->sms.id, id);
     os = octstr_create(id);
-    dict_put(conn->sent, os, msg_duplicate(m));
+    sent = gw_malloc(sizeof(*sent));
+    sent->msg = msg_duplicate(m);
+    sent->sent_at = boxc_time();
+    dict_put(conn->sent, os, sent);
     semaphore_down(conn->pending);
     octstr_destroy(os);
 }
@@ -504,7 +557,9 @@ static void boxc_sent_pop(Boxc *conn, Msg *m, Msg **orig)
 {
     Octstr *os;
     char id[UUID_STR_LEN + 1];
+    SentMsg *sent;
     Msg *msg;
+    double latency;
 
     if (conn->is_wap || !conn->sent || !m || (msg_type(m) != ack && msg_type(m) != sms))
         return;
@@ -514,14 +569,25 @@ static void boxc_sent_pop(Boxc *conn, Msg *m, Msg **orig)
 
     uuid_unparse((msg_type(m) == sms ? m->sms.id : m->ack.id), id);
     os = octstr_create(id);
-    msg = dict_remove(conn->sent, os);
+    sent = dict_remove(conn->sent, os);
     octstr_destroy(os);
-    if (!msg) {
+    if (!sent) {
         error(0, "BOXC: Got ack for nonexistend message!");
         msg_dump(m, 0);
         return;
     }
     semaphore_up(conn->pending);
+
+    /* keep track of how fast this box acks, see route_to_boxc() */
+    if (msg_type(m) == ack) {
+        latency = boxc_time() - sent->sent_at;
+        if (conn->ack_latency > 0)
+            latency = ACK_LATENCY_WEIGHT * latency +
+                      (1 - ACK_LATENCY_WEIGHT) * conn->ack_latency;
+        conn->ack_latency = (latency > 0 ? latency : 1e-6);
+    }
+    msg = sent->msg;
+    gw_free(sent);
     if (orig == NULL)
         msg_destroy(msg);
     else
@@ -532,21 +598,31 @@ static void boxc_sent_pop(Boxc *conn, Msg *m, Msg **orig)
 static void boxc_sender(void *arg)
 {
     Msg *msg;
+    Msg *batch[BOXC_SEND_BATCH];
+    long i, n;
     Boxc *conn = arg;
 
     gwlist_add_producer(flow_threads);
 
+    n = i = 0;
     while (bb_status != BB_DEAD && conn->alive) {
 
         /*
          * Make sure there's no data left in the outgoing connection before
-         * doing the potentially blocking gwlist_consume()s
+         * doing the potentially blocking consume or boxc_sent_push()
          */
         conn_flush(conn->conn);
 
         gwlist_consume(suspended);	/* block here if suspended */
 
-        if ((msg = gwlist_consume(conn->incoming)) == NULL) {
+        /* refill the local batch in one go once it has been sent */
+        if (i == n) {
+            i = 0;
+            n = gw_queue_consume_batch(conn->incoming, (void **) batch,
+                                       BOXC_SEND_BATCH);
+            conn->batched = n;
+        }
+        if (n == 0) {
             /* tell sms/wapbox to die */
             msg = msg_create(admin);
             msg->admin.command = restart ? cmd_restart : cmd_shutdown;
@@ -554,22 +630,31 @@ static void boxc_sender(void *arg)
             msg_destroy(msg);
             break;
         }
+        msg = batch[i++];
+        conn->batched = n - i;
         if (msg_type(msg) == heartbeat) {
             debug("bb.boxc", 0, "boxc_sender: catch an heartbeat - we are alive");
             msg_destroy(msg);
             continue;
         }
+        /* we took one off the queue, parked messages may fit now */
+        boxc_ready(conn);
         boxc_sent_push(conn, msg);
         if (!conn->alive || send_msg(conn, msg) == -1) {
             /* we got message here */
             boxc_sent_pop(conn, msg, NULL);
-            gwlist_produce(conn->retry, msg);
+            gw_queue_produce(conn->retry, msg);
             break;
         }
         msg_destroy(msg);
         debug("bb.boxc", 0, "boxc_sender: sent message to <%s>",
                octstr_get_cstr(conn->client_ip));
     }
+    /* hand back whatever of the batch we did not get to send */
+    while (i < n)
+        gw_queue_produce(conn->retry, batch[i++]);
+    conn->batched = 0;
+
     /* the client closes the connection, after that die in receiver */
     /* conn->alive = 0; */
 
@@ -591,13 +676,15 @@ static Boxc *boxc_create(int fd, Octstr *ip, int ssl)
     boxc = gw_malloc(sizeof(Boxc));
     boxc->is_wap = 0;
     boxc->load = 0;
+    boxc->batched = 0;
     boxc->conn = conn_wrap_fd(fd, ssl);
     boxc->id = counter_increase(boxid);
     boxc->client_ip = ip;
     boxc->alive = 1;
-    boxc->connect_time = time(NULL);
+    boxc->connect_time = gw_clock_mono();
     boxc->boxc_id = NULL;
     boxc->routable = 0;
+    boxc->ack_latency = 0;
     return boxc;
 }
 
@@ -666,13 +753,14 @@ static void run_smsbox(void *arg)
     Boxc *newconn;
     long sender;
     Msg *msg;
+    SentMsg *sent;
     List *keys;
     Octstr *key;
 
     gwlist_add_producer(flow_threads);
     newconn = arg;
-    newconn->incoming = gwlist_create();
-    gwlist_add_producer(newconn->incoming);
+    newconn->incoming = gw_queue_create(0);
+    gw_queue_add_producer(newconn->incoming);
     newconn->retry = incoming_sms;
     newconn->outgoing = outgoing_sms;
     newconn->sent = dict_create(smsbox_max_pending, NULL);
@@ -694,9 +782,9 @@ static void run_smsbox(void *arg)
     gwlist_append(smsbox_list, newconn);
     gw_rwlock_unlock(smsbox_list_rwlock);
 
-    gwlist_add_producer(newconn->outgoing);
+    gw_queue_add_producer(newconn->outgoing);
     boxc_receiver(newconn);
-    gwlist_remove_producer(newconn->outgoing);
+    gw_queue_remove_producer(newconn->outgoing);
 
     /* remove us from smsbox routing list */
     gw_rwlock_wrlock(smsbox_list_rwlock);
@@ -717,8 +805,8 @@ static void run_smsbox(void *arg)
      * check if we in the shutdown phase and sms dequeueing thread
      *   has removed the producer already
      */
-    if (gwlist_producer_count(newconn->incoming) > 0)
-        gwlist_remove_producer(newconn->incoming);
+    if (gw_queue_producer_count(newconn->incoming) > 0)
+        gw_queue_remove_producer(newconn->incoming);
 
     /* check if we are still waiting for ack's and semaphore locked */
     if (dict_key_count(newconn->sent) >= smsbox_max_pending)
@@ -729,29 +817,27 @@ static void run_smsbox(void *arg)
     /* put not acked msgs into incoming queue */
     keys = dict_keys(newconn->sent);
     while((key = gwlist_extract_first(keys)) != NULL) {
-        msg = dict_remove(newconn->sent, key);
-        gwlist_produce(incoming_sms, msg);
+        sent = dict_remove(newconn->sent, key);
+        gw_queue_produce(incoming_sms, sent->msg);
+        gw_free(sent);
         octstr_destroy(key);
     }
     gw_assert(gwlist_len(keys) == 0);
     gwlist_destroy(keys, octstr_destroy_item);
 
     /* clear our send queue */
-    while((msg = gwlist_extract_first(newconn->incoming)) != NULL) {
-        gwlist_produce(incoming_sms, msg);
+    while((msg = gw_queue_extract(newconn->incoming)) != NULL) {
+        gw_queue_produce(incoming_sms, msg);
     }
 
 cleanup:
-    gw_assert(gwlist_len(newconn->incoming) == 0);
-    gwlist_destroy(newconn->incoming, NULL);
+    gw_assert(gw_queue_len(newconn->incoming) == 0);
+    gw_queue_destroy(newconn->incoming, NULL);
     gw_assert(dict_key_count(newconn->sent) == 0);
     dict_destroy(newconn->sent);
     semaphore_destroy(newconn->pending);
     boxc_destroy(newconn);
 
-    /* wakeup the dequeueing thread */
-    gwthread_wakeup(sms_dequeue_thread);
-
     gwlist_remove_producer(flow_threads);
 }
 
@@ -760,7 +846,7 @@ cleanup:
 static void run_wapbox(void *arg)
 {
     Boxc *newconn;
-    List *newlist;
+    gw_queue_t *newlist;
     long sender;
 
     gwlist_add_producer(flow_threads);
@@ -775,9 +861,9 @@ static void run_wapbox(void *arg)
 
     debug("bb", 0, "setting up systems for new wapbox");
 
-    newlist = gwlist_create();
+    newlist = gw_queue_create(0);
     /* this is released by the sender/receiver if it exits */
-    gwlist_add_producer(newlist);
+    gw_queue_add_producer(newlist);
 
     newconn->incoming = newlist;
     newconn->retry = incoming_wdp;
@@ -790,26 +876,26 @@ static void run_wapbox(void *arg)
 	    goto cleanup;
     }
     gwlist_append(wapbox_list, newconn);
-    gwlist_add_producer(newconn->outgoing);
+    gw_queue_add_producer(newconn->outgoing);
     boxc_receiver(newconn);
 
     /* cleanup after receiver has exited */
 
-    gwlist_remove_producer(newconn->outgoing);
+    gw_queue_remove_producer(newconn->outgoing);
     gwlist_lock(wapbox_list);
     gwlist_delete_equal(wapbox_list, newconn);
     gwlist_unlock(wapbox_list);
 
-    while (gwlist_producer_count(newlist) > 0)
-	    gwlist_remove_producer(newlist);
+    while (gw_queue_producer_count(newlist) > 0)
+	    gw_queue_remove_producer(newlist);
 
     newconn->alive = 0;
 
     gwthread_join(sender);
 
 cleanup:
-    gw_assert(gwlist_len(newlist) == 0);
-    gwlist_destroy(newlist, NULL);
+    gw_assert(gw_queue_len(newlist) == 0);
+    gw_queue_destroy(newlist, NULL);
     boxc_destroy(newconn);
 
     gwlist_remove_producer(flow_threads);
@@ -938,7 +1024,7 @@ static void wdp_to_wapboxes(void *arg)
 
 	    gwlist_consume(suspended);	/* block here if suspended */
 
-	    if ((msg = gwlist_consume(incoming_wdp)) == NULL)
+	    if ((msg = gw_queue_consume(incoming_wdp)) == NULL)
 	         break;
 
 	    gw_assert(msg_type(msg) == wdp_datagram);
@@ -949,7 +1035,7 @@ static void wdp_to_wapboxes(void *arg)
 	        msg_destroy(msg);
 	        continue;
 	    }
-	    gwlist_produce(conn->incoming, msg);
+	    gw_queue_produce(conn->incoming, msg);
     }
     debug("bb", 0, "wdp_to_wapboxes: destroying lists");
     while((ap = gwlist_extract_first(route_info)) != NULL)
@@ -961,7 +1047,7 @@ static void wdp_to_wapboxes(void *arg)
     gwlist_lock(wapbox_list);
     for(i=0; i < gwlist_len(wapbox_list); i++) {
 	    conn = gwlist_get(wapbox_list, i);
-	    gwlist_remove_producer(conn->incoming);
+	    gw_queue_remove_producer(conn->incoming);
 	    conn->alive = 0;
     }
     gwlist_unlock(wapbox_list);
@@ -971,8 +1057,22 @@ static void wdp_to_wapboxes(void *arg)
 }
 
 
+/*
+ * smsbox_start() holds a producer of incoming_sms for sms_to_smsboxes, so
+ * it sleeps in gw_queue_consume() even while no smsc is up. Drop it when
+ * we shut down, once the smsc module is gone too the thread exits.
+ */
+static void release_sms_dequeue(void)
+{
+    if (sms_dequeue_held) {
+        sms_dequeue_held = 0;
+        gw_queue_remove_producer(incoming_sms);
+    }
+}
+
+
 static void wait_for_connections(int fd, void (*function) (void *arg),
-    	    	    	    	 List *waited, int ssl)
+    	    	    	    	 gw_queue_t *waited, int ssl)
 {
     int ret;
     int timeout = 10; /* 10 sec. */
@@ -988,7 +1088,9 @@ static void wait_for_connections(int fd, void (*function) (void *arg),
          *           Otherwise we wait here for ever!
          */
         if (bb_status == BB_SHUTDOWN) {
-            ret = gwlist_wait_until_nonempty(waited);
+            if (waited == incoming_sms)
+                release_sms_dequeue();
+            ret = gw_queue_wait_until_nonempty(waited);
             if (ret == -1 || !timeout)
                 break;
             else
@@ -1038,7 +1140,8 @@ static void smsboxc_run(void *arg)
     gwlist_remove_producer(smsbox_list);
 
     /* continue avalanche */
-    gwlist_remove_producer(outgoing_sms);
+    gw_queue_remove_producer(outgoing_sms);
+    release_sms_dequeue();
 
     /* all connections do the same, so that all must remove() before it
      * is completely over
@@ -1052,6 +1155,16 @@ static void smsboxc_run(void *arg)
     gwthread_wakeup(sms_dequeue_thread);
     gwthread_join(sms_dequeue_thread);
 
+    gw_assert(dict_key_count(parked_routes) == 0);
+    dict_destroy(parked_routes);
+    parked_routes = NULL;
+    mutex_destroy(parked_lock);
+    parked_lock = NULL;
+    counter_destroy(parked_count);
+    parked_count = NULL;
+    octstr_destroy(anonymous_route);
+    anonymous_route = NULL;
+
     gwlist_destroy(smsbox_list, NULL);
     smsbox_list = NULL;
     gw_rwlock_destroy(smsbox_list_rwlock);
@@ -1090,7 +1203,7 @@ static void wapboxc_run(void *arg)
 
     /* continue avalanche */
 
-    gwlist_remove_producer(outgoing_wdp);
+    gw_queue_remove_producer(outgoing_wdp);
 
 
     /* wait for all connections to die and then remove list
@@ -1274,7 +1387,15 @@ int smsbox_start(Cfg *cfg)
     /* load the defined smsbox routing rules */
     init_smsbox_routes(cfg);
 
-    gwlist_add_producer(outgoing_sms);
+    parked_routes = dict_create(16, (void(*)(void *)) boxc_gwlist_destroy);
+    parked_lock = mutex_create();
+    parked_count = counter_create();
+    anonymous_route = octstr_create("");
+
+    gw_queue_add_producer(outgoing_sms);
+    /* keeps sms_to_smsboxes blocked on incoming_sms until we shut down */
+    gw_queue_add_producer(incoming_sms);
+    sms_dequeue_held = 1;
     gwlist_add_producer(smsbox_list);
 
     smsbox_running = 1;
@@ -1330,7 +1451,7 @@ int wapbox_start(Cfg *cfg)
 	    info(0, "Box connection allowed IPs defined without any denied...");
 
     wapbox_list = gwlist_create();	/* have a list of connections */
-    gwlist_add_producer(outgoing_wdp);
+    gw_queue_add_producer(outgoing_wdp);
     if (!boxid)
         boxid = counter_create();
 
@@ -1353,7 +1474,7 @@ Octstr *boxc_status(int status_type)
     time_t orig, t;
     Boxc *bi;
 
-    orig = time(NULL);
+    orig = gw_clock_mono();
 
     /*
      * XXX: this will cause segmentation fault if this is called
@@ -1432,7 +1553,7 @@ Octstr *boxc_status(int status_type)
                     "\t\t<ssl>%s</ssl>\n\t</box>",
                     (bi->boxc_id ? octstr_get_cstr(bi->boxc_id) : ""),
 		            octstr_get_cstr(bi->client_ip),
-		            gwlist_len(bi->incoming) + dict_key_count(bi->sent),
+		            boxc_queued(bi) + dict_key_count(bi->sent),
 		            t/3600/24, t/3600%24, t/60%60, t%60,
 #ifdef HAVE_LIBSSL
                     conn_get_ssl(bi->conn) != NULL ? "yes" : "no"
@@ -1443,7 +1564,7 @@ Octstr *boxc_status(int status_type)
             else
                 octstr_format_append(tmp, "%ssmsbox:%s, IP %s (%ld queued), (on-line %ldd %ldh %ldm %lds) %s %s",
                     ws, (bi->boxc_id ? octstr_get_cstr(bi->boxc_id) : "(none)"),
-                    octstr_get_cstr(bi->client_ip), gwlist_len(bi->incoming) + dict_key_count(bi->sent),
+                    octstr_get_cstr(bi->client_ip), boxc_queued(bi) + dict_key_count(bi->sent),
 		            t/3600/24, t/3600%24, t/60%60, t%60,
 #ifdef HAVE_LIBSSL
                     conn_get_ssl(bi->conn) != NULL ? "using SSL" : "",
@@ -1478,7 +1599,7 @@ int boxc_incoming_wdp_queue(void)
 	    gwlist_lock(wapbox_list);
 	    for(i=0; i < gwlist_len(wapbox_list); i++) {
 	        boxc = gwlist_get(wapbox_list, i);
-	        q += gwlist_len(boxc->incoming);
+	        q += boxc_queued(boxc);
 	    }
 	    gwlist_unlock(wapbox_list);
     }
@@ -1500,237 +1621,314 @@ void boxc_cleanup(void)
 
 
 /*
- * Route the incoming message to one of the following input queues:
- *   a specific smsbox conn
- *   a random smsbox conn if no shortcut routing and msg->sms.boxc_id match
- *
- * BEWARE: All logic inside here should be fast, hence speed processing
- * optimized, because every single MO message passes this function and we
- * have to ensure that no unncessary overhead is done.
+ * Put msg into the global incoming queue for the dequeue thread, unless
+ * max-incoming-sms-qlength is reached. Returns 0 if queued, -1 otherwise.
  */
-int route_incoming_to_boxc(Msg *msg)
+static int queue_incoming_sms(Msg *msg)
 {
-    Boxc *bc = NULL;
-    Octstr *s, *r, *rs, *boxc_id = NULL;
-    long len, b, i;
-    int full_found = 0;
+    if (max_incoming_sms_qlength < 0 ||
+        max_incoming_sms_qlength > gw_queue_len(incoming_sms) + counter_value(parked_count)) {
+        gw_queue_produce(incoming_sms, msg);
+        return 0;
+    }
+    return -1;
+}
 
-    gw_assert(msg_type(msg) == sms);
 
-    /* msg_dump(msg, 0); */
+/*
+ * Return the smsbox-id msg has to be routed to, or NULL if any anonymous
+ * smsbox will do. Shortcode routes have a higher priority than smsc-id
+ * routes, the combined <shortcode>:<smsc-id> route the highest one.
+ */
+static Octstr *route_boxc_id(Msg *msg)
+{
+    Octstr *s, *r, *rs, *os;
+
+    if (octstr_len(msg->sms.boxc_id) > 0)
+        return msg->sms.boxc_id;
+
+    os = octstr_format("%s:%s",
+                       octstr_get_cstr(msg->sms.receiver),
+                       octstr_get_cstr(msg->sms.smsc_id));
+    s = (msg->sms.smsc_id ? dict_get(smsbox_by_smsc, msg->sms.smsc_id) : NULL);
+    r = (msg->sms.receiver ? dict_get(smsbox_by_receiver, msg->sms.receiver) : NULL);
+    rs = (os ? dict_get(smsbox_by_smsc_receiver, os) : NULL);
+    octstr_destroy(os);
+
+    if (rs)
+        return rs;
+    else if (r)
+        return r;
+    return s;
+}
+
+
+/*
+ * Pass msg to a random smsbox connection serving boxc_id (or any anonymous
+ * one if boxc_id is NULL), as long as it has space. Returns 1 if msg was
+ * queued to a box, 0 if there is no box for this route and -1 if all of
+ * them are full.
+ */
+static int route_to_boxc(Msg *msg, Octstr *boxc_id)
+{
+    Boxc *bc = NULL, *c;
+    List *list;
+    long len, b, i;
+    int full_found = 0;
+    double wait, best = 0;
 
-    /* Check we have at least one smsbox connected! */
     gw_rwlock_rdlock(smsbox_list_rwlock);
     if (gwlist_len(smsbox_list) == 0) {
         gw_rwlock_unlock(smsbox_list_rwlock);
-    	warning(0, "smsbox_list empty!");
-        if (max_incoming_sms_qlength < 0 || max_incoming_sms_qlength > gwlist_len(incoming_sms)) {
-            gwlist_produce(incoming_sms, msg);
-            return 0;
-        } else {
-            return -1;
-        }
-    }
-
-    /*
-     * Do we have a specific smsbox-id route to pass this msg to?
-     */
-    if (octstr_len(msg->sms.boxc_id) > 0) {
-        boxc_id = msg->sms.boxc_id;
-    } else {
-        /*
-         * Check if we have a "smsbox-route" for this msg.
-         * Where the shortcode route has a higher priority then the smsc-id rule.
-         * Highest priority has the combined <shortcode>:<smsc-id> route.
-         */
-        Octstr *os = octstr_format("%s:%s",
-                                   octstr_get_cstr(msg->sms.receiver),
-                                   octstr_get_cstr(msg->sms.smsc_id));
-        s = (msg->sms.smsc_id ? dict_get(smsbox_by_smsc, msg->sms.smsc_id) : NULL);
-        r = (msg->sms.receiver ? dict_get(smsbox_by_receiver, msg->sms.receiver) : NULL);
-        rs = (os ? dict_get(smsbox_by_smsc_receiver, os) : NULL);
-        octstr_destroy(os);
-
-        if (rs)
-            boxc_id = rs;
-        else if (r)
-            boxc_id = r;
-        else if (s)
-            boxc_id = s;
+        warning(0, "smsbox_list empty!");
+        return 0;
     }
 
-    /* We have a specific smsbox-id to use */
     if (boxc_id != NULL) {
-
-        List *boxc_id_list = dict_get(smsbox_by_id, boxc_id);
-        if (gwlist_len(boxc_id_list) == 0) {
+        list = dict_get(smsbox_by_id, boxc_id);
+        if (gwlist_len(list) == 0) {
             /*
              * something is wrong, this was the smsbox connection we used
              * for sending, so it seems this smsbox is gone
              */
+            gw_rwlock_unlock(smsbox_list_rwlock);
             warning(0, "Could not route message to smsbox id <%s>, smsbox is gone!",
                     octstr_get_cstr(boxc_id));
-            gw_rwlock_unlock(smsbox_list_rwlock);
-            if (max_incoming_sms_qlength < 0 || max_incoming_sms_qlength > gwlist_len(incoming_sms)) {
-                gwlist_produce(incoming_sms, msg);
-                return 0;
-            } else {
-                return -1;
-            }
-        }
-        
-        /* 
-         * Take random smsbox from list, as long as it has space we will use it,
-         * otherwise check the next one.
-         */
-        len = gwlist_len(boxc_id_list);
-        b = gw_rand() % len;
-
-        for (i = 0; i < len; i++) {
-            bc = gwlist_get(boxc_id_list, (i+b) % len);
-
-            if (bc != NULL && max_incoming_sms_qlength > 0 &&
-                    gwlist_len(bc->incoming) > max_incoming_sms_qlength) {
-                bc = NULL;
-            }
-
-            if (bc != NULL) {
-                break;
-            }
-        }
-
-        if (bc != NULL) {
-            bc->load++;
-            gwlist_produce(bc->incoming, msg);
-            gw_rwlock_unlock(smsbox_list_rwlock);
-            return 1; /* we are done */
-        }
-        else {
-            /*
-             * we have routing defined, but no smsbox connected at the moment.
-             * put msg into global incoming queue and wait until smsbox with
-             * such boxc_id connected.
-             */
-            gw_rwlock_unlock(smsbox_list_rwlock);
-            if (max_incoming_sms_qlength < 0 || max_incoming_sms_qlength > gwlist_len(incoming_sms)) {
-                gwlist_produce(incoming_sms, msg);
-                return 0;
-            } else {
-                return -1;
-            }
+            return 0;
         }
-    }
+    } else
+        list = smsbox_list;
 
     /*
-     * Ok, none of the specific routing things applied previously, 
-     * so route it to a random smsbox.
-     * Take random smsbox from list, as long as it has space we will 
-     * use it, therwise check the next one.
+     * Take the smsbox with space that will get to this msg first, i.e.
+     * the least outstanding messages weighted by its ack latency, so a
+     * slow box gets less traffic long before its max-pending is reached.
+     * Start at a random one so that equal boxes share the load.
      */
-    len = gwlist_len(smsbox_list);
+    len = gwlist_len(list);
     b = gw_rand() % len;
 
     for (i = 0; i < len; i++) {
-        bc = gwlist_get(smsbox_list, (i+b) % len);
+        c = gwlist_get(list, (i+b) % len);
 
-        if (bc->boxc_id != NULL || bc->routable == 0)
-            bc = NULL;
+        if (boxc_id == NULL && (c->boxc_id != NULL || c->routable == 0))
+            continue;
 
-        if (bc != NULL && max_incoming_sms_qlength > 0 &&
-            gwlist_len(bc->incoming) > max_incoming_sms_qlength) {
+        if (max_incoming_sms_qlength > 0 &&
+            boxc_queued(c) > max_incoming_sms_qlength) {
             full_found = 1;
-            bc = NULL;
+            continue;
         }
 
-        if (bc != NULL) {
-            break;
+        wait = (boxc_queued(c) + dict_key_count(c->sent) + 1) *
+               (c->ack_latency > 0 ? c->ack_latency : ACK_LATENCY_DEFAULT);
+        if (bc == NULL || wait < best) {
+            bc = c;
+            best = wait;
         }
     }
 
     if (bc != NULL) {
         bc->load++;
-        gwlist_produce(bc->incoming, msg);
+        gw_queue_produce(bc->incoming, msg);
     }
 
     gw_rwlock_unlock(smsbox_list_rwlock);
 
-    if (bc == NULL && full_found == 0) {
+    if (bc != NULL)
+        return 1;
+    if (full_found == 0 && boxc_id == NULL)
         warning(0, "smsbox_list empty!");
-        if (max_incoming_sms_qlength < 0 || max_incoming_sms_qlength > gwlist_len(incoming_sms)) {
-            gwlist_produce(incoming_sms, msg);
-               return 0;
-         } else {
-             return -1;
-         }
-    } else if (bc == NULL && full_found == 1) {
+    return (full_found ? -1 : 0);
+}
+
+
+/*
+ * Route the incoming message to one of the following input queues:
+ *   a specific smsbox conn
+ *   a random smsbox conn if no shortcut routing and msg->sms.boxc_id match
+ *
+ * BEWARE: All logic inside here should be fast, hence speed processing
+ * optimized, because every single MO message passes this function and we
+ * have to ensure that no unncessary overhead is done.
+ */
+int route_incoming_to_boxc(Msg *msg)
+{
+    Octstr *boxc_id;
+    List *parked;
+    int ret;
+
+    gw_assert(msg_type(msg) == sms);
+
+    /* msg_dump(msg, 0); */
+
+    gw_rwlock_rdlock(smsbox_list_rwlock);
+    boxc_id = route_boxc_id(msg);
+    gw_rwlock_unlock(smsbox_list_rwlock);
+
+    /*
+     * A route with parked messages gets this one parked behind them, so
+     * it does not overtake them. Like route_or_park(), hold the lock while
+     * trying the route so boxc_ready() can't release the parked ones
+     * in between.
+     */
+    mutex_lock(parked_lock);
+    parked = (counter_value(parked_count) > 0 ?
+              dict_get(parked_routes, boxc_id ? boxc_id : anonymous_route) : NULL);
+    if (gwlist_len(parked) > 0) {
+        if (max_incoming_sms_qlength >= 0 &&
+            max_incoming_sms_qlength <= gw_queue_len(incoming_sms) + counter_value(parked_count)) {
+            mutex_unlock(parked_lock);
+            return -1;
+        }
+        gwlist_append(parked, msg);
+        counter_increase(parked_count);
+        mutex_unlock(parked_lock);
+        return 0;
+    }
+    ret = route_to_boxc(msg, boxc_id);
+    mutex_unlock(parked_lock);
+    if (ret == 1)
+        return 1; /* we are done */
+
+    /* all anonymous smsboxes are full, let the caller deal with it */
+    if (ret == -1 && boxc_id == NULL)
         return -1;
+
+    /*
+     * we have no smsbox (with space) for this route at the moment.
+     * put msg into global incoming queue, the dequeue thread parks it
+     * until a box for this route is ready.
+     */
+    return queue_incoming_sms(msg);
+}
+
+
+/*
+ * Called whenever conn may accept more messages, i.e. it got routable or
+ * took a message off its queue. Moves as many of the messages parked for
+ * its route as fit straight into its queue, keeping their order.
+ */
+static void boxc_ready(Boxc *conn)
+{
+    Octstr *route;
+    List *parked;
+    long n;
+    Msg *msg;
+
+    if (conn->is_wap || conn->routable == 0)
+        return;
+
+    route = (conn->boxc_id ? conn->boxc_id : anonymous_route);
+
+    /*
+     * Always take the lock, else we could miss a message route_or_park()
+     * is just about to park because it saw us not ready yet.
+     */
+    mutex_lock(parked_lock);
+    parked = (counter_value(parked_count) > 0 ? dict_get(parked_routes, route) : NULL);
+    if (parked != NULL) {
+        n = gwlist_len(parked);
+        /* route_to_boxc() allows one above the limit, so do we */
+        if (max_incoming_sms_qlength > 0 &&
+            n > max_incoming_sms_qlength + 1 - boxc_queued(conn))
+            n = max_incoming_sms_qlength + 1 - boxc_queued(conn);
+        if (n > 0)
+            debug("bb.boxc", 0, "boxc_ready: passing %ld parked messages to <%s>",
+                  n, octstr_get_cstr(conn->client_ip));
+        for (; n > 0; n--) {
+            msg = gwlist_extract_first(parked);
+            conn->load++;
+            gw_queue_produce(conn->incoming, msg);
+            counter_decrease(parked_count);
+        }
+        if (gwlist_len(parked) == 0)
+            gwlist_destroy(dict_remove(parked_routes, route), NULL);
     }
+    mutex_unlock(parked_lock);
+}
 
-    return 1;
+
+/*
+ * Route msg to an smsbox or park it for its route. A route which has
+ * parked messages gets any new ones parked too, so their order is kept.
+ */
+static void route_or_park(Msg *msg)
+{
+    Octstr *boxc_id;
+    List *parked;
+
+    gw_rwlock_rdlock(smsbox_list_rwlock);
+    boxc_id = route_boxc_id(msg);
+    gw_rwlock_unlock(smsbox_list_rwlock);
+
+    /*
+     * Hold the lock while trying the route, a box getting ready meanwhile
+     * will wait for us and then release what we parked.
+     */
+    mutex_lock(parked_lock);
+    parked = dict_get(parked_routes, boxc_id ? boxc_id : anonymous_route);
+    if (gwlist_len(parked) == 0 && route_to_boxc(msg, boxc_id) == 1) {
+        mutex_unlock(parked_lock);
+        return;
+    }
+    if (parked == NULL) {
+        parked = gwlist_create();
+        dict_put(parked_routes, boxc_id ? boxc_id : anonymous_route, parked);
+    }
+    gwlist_append(parked, msg);
+    counter_increase(parked_count);
+    mutex_unlock(parked_lock);
 }
 
 
 static void sms_to_smsboxes(void *arg)
 {
-    Msg *newmsg, *startmsg, *msg;
+    Msg *msg;
+    List *keys, *parked;
+    Octstr *key;
     long i, len;
-    int ret = -1;
     Boxc *boxc;
 
     gwlist_add_producer(flow_threads);
 
-    newmsg = startmsg = msg = NULL;
-
     while (bb_status != BB_SHUTDOWN && bb_status != BB_DEAD) {
 
-        if (newmsg == startmsg) {
-            /* check if we are in shutdown phase */
-            if (gwlist_producer_count(smsbox_list) == 0)
-                break;
-
-            if (ret == 0 || ret == -1) {
-                /* debug("", 0, "time to sleep"); */
-                gwthread_sleep(60.0);
-                /* debug("", 0, "wake up list len %ld", gwlist_len(incoming_sms)); */
-                /* shutdown ? */
-                if (gwlist_producer_count(smsbox_list) == 0 && gwlist_len(smsbox_list) == 0)
-                    break;
-            }
-            startmsg = msg = gwlist_consume(incoming_sms);
-            /* debug("", 0, "gwlist_consume done 1"); */
-            newmsg = NULL;
-        }
-        else {
-            newmsg = msg = gwlist_consume(incoming_sms);
-
-            /* Back at the first message? */
-            if (newmsg == startmsg) {
-                gwlist_insert(incoming_sms, 0, msg);
-                continue;
-            }
-        }
-
-        if (msg == NULL)
+        /*
+         * blocks until a message arrives, parked ones don't come back here.
+         * We hold a producer of incoming_sms ourself, so NULL means shutdown.
+         */
+        if ((msg = gw_queue_consume(incoming_sms)) == NULL)
             break;
 
         gw_assert(msg_type(msg) == sms);
 
-        /* debug("bb.sms", 0, "sms_boxc_router: handling message (%p vs %p)",
-	          msg, startmsg); */
+        route_or_park(msg);
 
-        ret = route_incoming_to_boxc(msg);
-        if (ret == 1)
-            startmsg = newmsg = NULL;
-        else if (ret == -1) {
-            gwlist_produce(incoming_sms, msg);
-        }
+        /* check if we are in shutdown phase */
+        if (gwlist_producer_count(smsbox_list) == 0 && gwlist_len(smsbox_list) == 0)
+            break;
     }
 
+    /* give the parked messages back, they are still in the store */
+    mutex_lock(parked_lock);
+    keys = dict_keys(parked_routes);
+    while ((key = gwlist_extract_first(keys)) != NULL) {
+        parked = dict_remove(parked_routes, key);
+        while ((msg = gwlist_extract_first(parked)) != NULL)
+            gw_queue_produce(incoming_sms, msg);
+        gwlist_destroy(parked, NULL);
+        octstr_destroy(key);
+    }
+    gwlist_destroy(keys, NULL);
+    counter_set(parked_count, 0);
+    mutex_unlock(parked_lock);
+
     gw_rwlock_rdlock(smsbox_list_rwlock);
     len = gwlist_len(smsbox_list);
     for (i=0; i < len; i++) {
         boxc = gwlist_get(smsbox_list, i);
-        gwlist_remove_producer(boxc->incoming);
+        gw_queue_remove_producer(boxc->incoming);
     }
     gw_rwlock_unlock(smsbox_list_rwlock);
 
@@ -1738,6 +1936,12 @@ static void sms_to_smsboxes(void *arg)
 }
 
 
+int boxc_parked_sms_queue(void)
+{
+    return (parked_count != NULL ? counter_value(parked_count) : 0);
+}
+
+
 /*
  * Simple wrapper to allow the named smsbox Lists to be
  * destroyed when the smsbox_by_id Dict is destroyed
@@ -70,6 +70,7 @@
 
 #include "gwlib/gwlib.h"
 #include "bearerbox.h"
+#include "numhash.h"
 
 /* passed from bearerbox core */
 
@@ -86,6 +87,12 @@ static Octstr *ha_status_pw;
 static Octstr *ha_allow_ip;
 static Octstr *ha_deny_ip;
 
+/*
+ * HTTP status of the reply being made. httpd_serve() sets it to HTTP_OK
+ * and commands may change it; only httpadmin_run calls httpd_serve().
+ */
+static int ha_reply_status;
+
 
 /*---------------------------------------------------------
  * static functions
@@ -347,6 +354,47 @@ static Octstr *httpd_reload_lists(List *cgivars, int status_type)
         return octstr_create("Black/white lists re-loaded");
 }
 
+static Octstr *httpd_update_list(List *cgivars, int add)
+{
+    Octstr *reply;
+    Octstr *list, *number;
+    if ((reply = httpd_check_authorization(cgivars, 0))!= NULL) return reply;
+    if ((reply = httpd_check_status())!= NULL) return reply;
+
+    /* check if list and number are given */
+    list = http_cgi_variable(cgivars, "list");
+    number = http_cgi_variable(cgivars, "number");
+    if (list == NULL || number == NULL)
+        return octstr_create("List or number not given");
+    if (!numhash_check_number(number)) {
+        ha_reply_status = HTTP_BAD_REQUEST;
+        return octstr_format("Invalid number `%s', only digits and an "
+                             "optional leading `+' are allowed",
+                             octstr_get_cstr(number));
+    }
+
+    switch (bb_update_list(list, number, add)) {
+    case 1:
+        return octstr_format("Number `%s' %s list `%s'", octstr_get_cstr(number),
+                             add ? "added to" : "removed from", octstr_get_cstr(list));
+    case 0:
+        return octstr_format("Number `%s' %s list `%s'", octstr_get_cstr(number),
+                             add ? "already in" : "not in", octstr_get_cstr(list));
+    default:
+        return octstr_format("Could not update list `%s'", octstr_get_cstr(list));
+    }
+}
+
+static Octstr *httpd_add_to_list(List *cgivars, int status_type)
+{
+    return httpd_update_list(cgivars, 1);
+}
+
+static Octstr *httpd_remove_from_list(List *cgivars, int status_type)
+{
+    return httpd_update_list(cgivars, 0);
+}
+
 static Octstr *httpd_remove_message(List *cgivars, int status_type)
 {
     Octstr *reply;
@@ -387,14 +435,16 @@ static struct httpd_command {
     { "add-smsc", httpd_add_smsc },
     { "remove-smsc", httpd_remove_smsc },
     { "reload-lists", httpd_reload_lists },
+    { "add-to-list", httpd_add_to_list },
+    { "remove-from-list", httpd_remove_from_list },
     { "remove-message", httpd_remove_message },
     { NULL , NULL } /* terminate list */
 };
 
-static void httpd_serve(HTTPClient *client, Octstr *ourl, List *headers,
-    	    	    	Octstr *body, List *cgivars)
+static void httpd_serve(HTTPClient *client, HTTPRequest *req)
 {
-    Octstr *reply, *final_reply, *url;
+    Octstr *reply, *final_reply, *url, *ourl;
+    List *headers, *cgivars;
     char *content_type;
     char *header, *footer;
     int status_type;
@@ -402,6 +452,9 @@ static void httpd_serve(HTTPClient *client, Octstr *ourl, List *headers,
     long pos;
 
     reply = final_reply = NULL; /* for compiler please */
+    ourl = http_request_path(req);
+    headers = http_request_headers(req);
+    cgivars = http_request_cgivars(req);
     url = octstr_duplicate(ourl);
 
     /* Set default reply format according to client
@@ -447,6 +500,7 @@ static void httpd_serve(HTTPClient *client, Octstr *ourl, List *headers,
         octstr_destroy(tmp);
     }
 
+    ha_reply_status = HTTP_OK;
     for (i=0; httpd_commands[i].command != NULL; i++) {
         if (octstr_str_compare(url, httpd_commands[i].command) == 0) {
             reply = httpd_commands[i].function(cgivars, status_type);
@@ -492,42 +546,38 @@ static void httpd_serve(HTTPClient *client, Octstr *ourl, List *headers,
     
     /* debug("bb.http", 0, "Result: '%s'", octstr_get_cstr(final_reply));
      */
-    http_destroy_headers(headers);
     headers = gwlist_create();
     http_header_add(headers, "Content-Type", content_type);
 
-    http_send_reply(client, HTTP_OK, headers, final_reply);
+    http_send_reply(client, ha_reply_status, headers, final_reply);
 
     octstr_destroy(url);
-    octstr_destroy(ourl);
-    octstr_destroy(body);
     octstr_destroy(reply);
     octstr_destroy(final_reply);
     http_destroy_headers(headers);
-    http_destroy_cgiargs(cgivars);
 }
 
 static void httpadmin_run(void *arg)
 {
     HTTPClient *client;
-    Octstr *ip, *url, *body;
-    List *headers, *cgivars;
+    HTTPRequest *req;
+    Octstr *ip;
 
     while(bb_status != BB_DEAD) {
 	if (bb_status == BB_SHUTDOWN)
 	    bb_shutdown();
-    	client = http_accept_request(ha_port, &ip, &url, &headers, &body, 
-	    	    	    	     &cgivars);
+    	client = http_accept_request_lazy(ha_port, &req);
 	if (client == NULL)
 	    break;
+	/* denied requests are dropped before the rest is parsed */
+	ip = http_request_ip(req);
 	if (is_allowed_ip(ha_allow_ip, ha_deny_ip, ip) == 0) {
 	    info(0, "HTTP admin tried from denied host <%s>, disconnected",
 		 octstr_get_cstr(ip));
 	    http_close_client(client);
-	    continue;
-	}
-        httpd_serve(client, url, headers, body, cgivars);
-	octstr_destroy(ip);
+	} else
+	    httpd_serve(client, req);
+	http_request_destroy(req);
     }
 
     httpadmin_running = 0;
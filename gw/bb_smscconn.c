@@ -97,8 +97,8 @@
 /* passed from bearerbox core */
 
 extern volatile sig_atomic_t bb_status;
-extern List *incoming_sms;
-extern List *outgoing_sms;
+extern gw_queue_t *incoming_sms;
+extern gw_queue_t *outgoing_sms;
 
 extern Counter *incoming_sms_counter;
 extern Counter *outgoing_sms_counter;
@@ -118,6 +118,8 @@ extern List *isolated;
 extern long max_outgoing_sms_qlength;
 /* incoming sms queue control */
 extern long max_incoming_sms_qlength;
+extern long incoming_sms_high_watermark;
+extern long incoming_sms_low_watermark;
 
 /* configuration filename */
 extern Octstr *cfg_filename;
@@ -185,7 +187,7 @@ static void concat_handling_clear_old_parts(int force);
 void bb_smscconn_ready(SMSCConn *conn)
 {
     gwlist_add_producer(flow_threads);
-    gwlist_add_producer(incoming_sms);
+    gw_queue_add_producer(incoming_sms);
 }
 
 
@@ -201,7 +203,7 @@ void bb_smscconn_killed(void)
     /* NOTE: after status has been set to SMSCCONN_DEAD, bearerbox
      *   is free to release/delete 'conn'
      */
-    gwlist_remove_producer(incoming_sms);
+    gw_queue_remove_producer(incoming_sms);
     gwlist_remove_producer(flow_threads);
 }
 
@@ -234,9 +236,9 @@ static void handle_split(SMSCConn *conn, Msg *msg, long reason)
                 return;
             }
             msg->sms.resend_try = (msg->sms.resend_try > 0 ? msg->sms.resend_try + 1 : 1);
-            time(&msg->sms.resend_time);
+            msg->sms.resend_time = gw_clock_now();
         }
-        gwlist_produce(outgoing_sms, msg);
+        gw_queue_produce(outgoing_sms, msg);
         return;
     case SMSCCONN_FAILED_DISCARDED:
     case SMSCCONN_FAILED_REJECTED:
@@ -352,13 +354,13 @@ void bb_smscconn_send_failed(SMSCConn *conn, Msg *sms, int reason, Octstr *reply
                break;
            }
            sms->sms.resend_try = (sms->sms.resend_try > 0 ? sms->sms.resend_try + 1 : 1);
-           time(&sms->sms.resend_time);
+           sms->sms.resend_time = gw_clock_now();
        }
-       gwlist_produce(outgoing_sms, sms);
+       gw_queue_produce(outgoing_sms, sms);
        break;
        
     case SMSCCONN_FAILED_SHUTDOWN:
-        gwlist_produce(outgoing_sms, sms);
+        gw_queue_produce(outgoing_sms, sms);
         break;
 
     default:
@@ -625,6 +627,45 @@ long bb_smscconn_receive(SMSCConn *conn, Msg *sms)
     return bb_smscconn_receive_internal(conn, sms);
 }
 
+/*
+ * Receive side backpressure. Once the incoming queue has reached the high
+ * watermark, SMSC modules refuse or stop reading MO and DLR until it has
+ * drained to the low watermark again.
+ */
+static volatile int incoming_throttled = 0;
+
+int smsc2_receive_throttled(void)
+{
+    long len;
+
+    if (incoming_sms_high_watermark < 0)
+        return 0;
+
+    len = gw_queue_len(incoming_sms) + boxc_parked_sms_queue();
+    if (!incoming_throttled && len >= incoming_sms_high_watermark) {
+        incoming_throttled = 1;
+        warning(0, "Incoming queue reached %ld messages, throttling SMSC receivers.", len);
+    } else if (incoming_throttled && len <= incoming_sms_low_watermark) {
+        incoming_throttled = 0;
+        info(0, "Incoming queue drained to %ld messages, SMSC receivers resumed.", len);
+    }
+
+    return incoming_throttled;
+}
+
+
+int smsc2_receive_is_throttled(void)
+{
+    return incoming_throttled;
+}
+
+
+int bb_smscconn_receive_throttled(SMSCConn *conn)
+{
+    return smsc2_receive_throttled();
+}
+
+
 int bb_reload_smsc_groups()
 {
     debug("bb.sms", 0, "Reloading smsc groups list from config resource");
@@ -652,14 +693,14 @@ static void sms_router(void *arg)
 {
     Msg *msg, *startmsg, *newmsg;
     long ret;
-    time_t concat_mo_check;
+    long concat_mo_check;
 
     gwlist_add_producer(flow_threads);
     gwthread_wakeup(MAIN_THREAD_ID);
 
     startmsg = newmsg = NULL;
     ret = SMSCCONN_SUCCESS;
-    concat_mo_check = time(NULL);
+    concat_mo_check = gw_clock_mono();
 
     while(bb_status != BB_SHUTDOWN && bb_status != BB_DEAD) {
 
@@ -669,16 +710,16 @@ static void sms_router(void *arg)
                 double sleep_time = (sms_resend_frequency / 2 > 1 ? sms_resend_frequency / 2 : sms_resend_frequency);
                 debug("bb.sms", 0, "sms_router: time to sleep %.2f secs.", sleep_time);
                 gwthread_sleep(sleep_time);
-                debug("bb.sms", 0, "sms_router: gwlist_len = %ld", gwlist_len(outgoing_sms));
+                debug("bb.sms", 0, "sms_router: queue length = %ld", gw_queue_len(outgoing_sms));
             }
-            startmsg = msg = gwlist_timed_consume(outgoing_sms, concatenated_mo_timeout);
+            startmsg = msg = gw_queue_timed_consume(outgoing_sms, concatenated_mo_timeout);
             newmsg = NULL;
         } else {
-            newmsg = msg = gwlist_timed_consume(outgoing_sms, concatenated_mo_timeout);
+            newmsg = msg = gw_queue_timed_consume(outgoing_sms, concatenated_mo_timeout);
         }
 
-        if (difftime(time(NULL), concat_mo_check) > concatenated_mo_timeout) {
-            concat_mo_check = time(NULL);
+        if (gw_clock_mono() - concat_mo_check > concatenated_mo_timeout) {
+            concat_mo_check = gw_clock_mono();
             concat_handling_clear_old_parts(0);
         }
 
@@ -692,10 +733,10 @@ static void sms_router(void *arg)
                   msg, startmsg);
 
         /* handle delayed msgs */
-        if (msg->sms.resend_try > 0 && difftime(time(NULL), msg->sms.resend_time) < sms_resend_frequency &&
+        if (msg->sms.resend_try > 0 && gw_clock_now() - msg->sms.resend_time < sms_resend_frequency &&
             bb_status != BB_SHUTDOWN && bb_status != BB_DEAD) {
             debug("bb.sms", 0, "re-queing SMS not-yet-to-be resent");
-            gwlist_produce(outgoing_sms, msg);
+            gw_queue_produce(outgoing_sms, msg);
             ret = SMSCCONN_QUEUED;
             continue;
         }
@@ -715,7 +756,7 @@ static void sms_router(void *arg)
             break;
         case SMSCCONN_FAILED_QFULL:
             debug("bb.sms", 0, "Routing failed, re-queuing.");
-            gwlist_produce(outgoing_sms, msg);
+            gw_queue_produce(outgoing_sms, msg);
             break;
         case SMSCCONN_FAILED_EXPIRED:
             debug("bb.sms", 0, "Routing failed, expired.");
@@ -918,6 +959,9 @@ int smsc2_start(Cfg *cfg)
     if (smpp_pdu_init(cfg) == -1)
         panic(0, "Connot start with PDU init failed.");
 
+    if (smsc_smpp_loops_init(cfg) == -1)
+        panic(0, "Cannot start SMPP event loops.");
+
     smsc_groups = cfg_get_multi_group(cfg, octstr_imm("smsc"));
     gwlist_add_producer(smsc_list);
     for (i = 0; i < gwlist_len(smsc_groups) && 
@@ -936,7 +980,7 @@ int smsc2_start(Cfg *cfg)
     if ((router_thread = gwthread_create(sms_router, NULL)) == -1)
 	panic(0, "Failed to start a new thread for SMS routing");
     
-    gwlist_add_producer(incoming_sms);
+    gw_queue_add_producer(incoming_sms);
     smsc_running = 1;
     return 0;
 }
@@ -1163,63 +1207,78 @@ int smsc2_add_smsc(Octstr *id)
     return 0;
 }
 
+/*
+ * Replace the list in 'list' with a fresh copy from 'url'. Lookups hold
+ * the read lock, so they see either the old or the new list as a whole.
+ * Numbers added or removed through the admin interface since the list
+ * was loaded are carried over to the new one.
+ */
+static int reload_list(Numhash **list, Octstr *url, const char *name)
+{
+    Numhash *tmp, *old;
+
+    if (url == NULL)
+        return 1;
+
+    if ((tmp = numhash_create(octstr_get_cstr(url))) == NULL) {
+        error(0, "Unable to reload %s.", name);
+        return -1;
+    }
+    gw_rwlock_wrlock(&white_black_list_lock);
+    old = *list;
+    if (old != NULL)
+        numhash_apply_changes(tmp, old);
+    *list = tmp;
+    gw_rwlock_unlock(&white_black_list_lock);
+    numhash_destroy(old);
+
+    return 1;
+}
+
 int smsc2_reload_lists(void)
 {
-    Numhash *tmp;
     int rc = 1;
 
-    if (white_list_sender_url != NULL) {
-        tmp = numhash_create(octstr_get_cstr(white_list_sender_url));
-        if (white_list_sender == NULL) {
-            error(0, "Unable to reload white_list."),
-            rc = -1;
-        } else {
-        	gw_rwlock_wrlock(&white_black_list_lock);
-        	numhash_destroy(white_list_sender);
-        	white_list_sender = tmp;
-        	gw_rwlock_unlock(&white_black_list_lock);
-        }
-    }
+    if (reload_list(&white_list_sender, white_list_sender_url, "white-list-sender") == -1)
+        rc = -1;
+    if (reload_list(&black_list_sender, black_list_sender_url, "black-list-sender") == -1)
+        rc = -1;
+    if (reload_list(&white_list_receiver, white_list_receiver_url, "white-list-receiver") == -1)
+        rc = -1;
+    if (reload_list(&black_list_receiver, black_list_receiver_url, "black-list-receiver") == -1)
+        rc = -1;
 
-    if (black_list_sender_url != NULL) {
-        tmp = numhash_create(octstr_get_cstr(black_list_sender_url));
-        if (black_list_sender == NULL) {
-            error(0, "Unable to reload black_list");
-            rc = -1;
-        } else {
-        	gw_rwlock_wrlock(&white_black_list_lock);
-        	numhash_destroy(black_list_sender);
-        	black_list_sender = tmp;
-        	gw_rwlock_unlock(&white_black_list_lock);
-        }
-    }
+    return rc;
+}
 
-    if (white_list_receiver_url != NULL) {
-        tmp = numhash_create(octstr_get_cstr(white_list_receiver_url));
-        if (white_list_receiver == NULL) {
-            error(0, "Unable to reload white_list."),
-            rc = -1;
-        } else {
-            gw_rwlock_wrlock(&white_black_list_lock);
-            numhash_destroy(white_list_receiver);
-            white_list_receiver = tmp;
-            gw_rwlock_unlock(&white_black_list_lock);
-        }
-    }
+int smsc2_update_list(Octstr *name, Octstr *number, int add)
+{
+    Numhash *list;
+    int rc;
 
-    if (black_list_receiver_url != NULL) {
-        tmp = numhash_create(octstr_get_cstr(black_list_receiver_url));
-        if (black_list_receiver == NULL) {
-            error(0, "Unable to reload black_list");
-            rc = -1;
-        } else {
-            gw_rwlock_wrlock(&white_black_list_lock);
-            numhash_destroy(black_list_receiver);
-            black_list_sender = tmp;
-            gw_rwlock_unlock(&white_black_list_lock);
-        }
-    }
+    gw_rwlock_wrlock(&white_black_list_lock);
+    if (octstr_str_compare(name, "white-list-sender") == 0)
+        list = white_list_sender;
+    else if (octstr_str_compare(name, "black-list-sender") == 0)
+        list = black_list_sender;
+    else if (octstr_str_compare(name, "white-list-receiver") == 0)
+        list = white_list_receiver;
+    else if (octstr_str_compare(name, "black-list-receiver") == 0)
+        list = black_list_receiver;
+    else
+        list = NULL;
+
+    if (list == NULL)
+        rc = -1;
+    else if (add)
+        rc = numhash_add_number(list, number);
+    else
+        rc = numhash_remove_number(list, number);
+    gw_rwlock_unlock(&white_black_list_lock);
 
+    if (rc == 1)
+        info(0, "%s number <%s> %s %s.", add ? "Added" : "Removed",
+             octstr_get_cstr(number), add ? "to" : "from", octstr_get_cstr(name));
     return rc;
 }
 
@@ -1294,7 +1353,7 @@ int smsc2_shutdown(void)
      * receive thingies? Is this guaranteed by setting bb_status
      * to shutdown before calling these?
      */
-    gwlist_remove_producer(incoming_sms);
+    gw_queue_remove_producer(incoming_sms);
 
     /* shutdown low levele PDU things */
     smpp_pdu_shutdown();
@@ -1321,6 +1380,7 @@ void smsc2_cleanup(void)
     gwlist_destroy(smsc_list, NULL);
     smsc_list = NULL;
     gw_rwlock_unlock(&smsc_list_lock);
+    smsc_smpp_loops_shutdown();
     gwlist_destroy(smsc_groups, NULL);
     octstr_destroy(unified_prefix);    
     numhash_destroy(white_list_sender);
@@ -1723,7 +1783,7 @@ long smsc2_rout(Msg *msg, int resend)
     }
 
     /* check if validity period has expired */
-    if (msg->sms.validity != SMS_PARAM_UNDEFINED && time(NULL) > msg->sms.validity) {
+    if (msg->sms.validity != SMS_PARAM_UNDEFINED && gw_clock_now() > msg->sms.validity) {
         bb_smscconn_send_failed(NULL, msg_duplicate(msg), SMSCCONN_FAILED_EXPIRED, octstr_create("validity expired"));
         return SMSCCONN_FAILED_EXPIRED;
     }
@@ -1820,7 +1880,7 @@ long smsc2_rout(Msg *msg, int resend)
     	 * and 80% for new msgs. So we can guarantee that old msgs find
     	 * place in the SMSC's queue.
     	 */
-    	if (gwlist_len(outgoing_sms) > 0) {
+    	if (gw_queue_len(outgoing_sms) > 0) {
     		max_queue = (resend ? max_outgoing_sms_qlength :
     		max_outgoing_sms_qlength * 0.8);
     	} else
@@ -1865,7 +1925,7 @@ long smsc2_rout(Msg *msg, int resend)
     			bo_load = stat.load;
     		}
     	}
-    	queue_length += gwlist_len(outgoing_sms);
+    	queue_length += gw_queue_len(outgoing_sms);
     	if (max_outgoing_sms_qlength > 0 && !resend &&
     	    queue_length > gwlist_len(smsc_list) * max_outgoing_sms_qlength) {
     		gw_rwlock_unlock(&smsc_list_lock);
@@ -1885,8 +1945,8 @@ long smsc2_rout(Msg *msg, int resend)
         ret = smscconn_send(best_ok, msg);
     else if (bad_found) {
         gw_rwlock_unlock(&smsc_list_lock);
-        if (max_outgoing_sms_qlength < 0 || gwlist_len(outgoing_sms) < max_outgoing_sms_qlength) {
-            gwlist_produce(outgoing_sms, msg);
+        if (max_outgoing_sms_qlength < 0 || gw_queue_len(outgoing_sms) < max_outgoing_sms_qlength) {
+            gw_queue_produce(outgoing_sms, msg);
             return SMSCCONN_QUEUED;
         }
         debug("bb.sms", 0, "bad_found queue full");
@@ -1983,7 +2043,7 @@ typedef struct ConcatMsg {
     int total_parts;
     int num_parts;
     Octstr *udh; /* normalized UDH */
-    time_t trecv;
+    long trecv;
     Octstr *key; /* in dict. */
     int ack;     /* set to the type of ack to send when deleting. */
     /* array of parts */
@@ -2070,7 +2130,7 @@ static void concat_handling_clear_old_parts(int force)
         mutex_lock(concat_lock);
         x = dict_get(incoming_concat_msgs, key);
         octstr_destroy(key);
-        if (x == NULL || (!force && difftime(time(NULL), x->trecv) < concatenated_mo_timeout)) {
+        if (x == NULL || (!force && gw_clock_mono() - x->trecv < concatenated_mo_timeout)) {
             mutex_unlock(concat_lock);
             continue;
         }
@@ -2233,7 +2293,7 @@ static int concat_handling_check_and_handle(Msg **pmsg, Octstr *smscid)
         cmsg->parts[part -1] = msg;
         cmsg->num_parts++;
         /* always update receive time so we have it from last part and don't timeout */
-        cmsg->trecv = time(NULL);
+        cmsg->trecv = gw_clock_mono();
     }
 
     if (cmsg->num_parts < cmsg->total_parts) {  /* wait for more parts. */
@@ -125,4 +125,11 @@ enum {
 long bb_smscconn_receive(SMSCConn *conn, Msg *sms);
 
 
+/* returns 1 if bearerbox can not take more incoming messages right now.
+ * SMSC Connections should then refuse MO and DLR with a temporary error,
+ * or stop reading them, until it returns 0 again; bb_smscconn_receive
+ * would drop them once the queue limit is reached. */
+int bb_smscconn_receive_throttled(SMSCConn *conn);
+
+
 #endif
@@ -81,11 +81,11 @@
 
 /* global variables; included to other modules as needed */
 
-List *incoming_sms;
-List *outgoing_sms;
+gw_queue_t *incoming_sms;
+gw_queue_t *outgoing_sms;
 
-List *incoming_wdp;
-List *outgoing_wdp;
+gw_queue_t *incoming_wdp;
+gw_queue_t *outgoing_wdp;
 
 Counter *incoming_sms_counter;
 Counter *outgoing_sms_counter;
@@ -97,6 +97,8 @@ Counter *outgoing_wdp_counter;
 /* incoming/outgoing sms queue control */
 long max_incoming_sms_qlength;
 long max_outgoing_sms_qlength;
+long incoming_sms_high_watermark;
+long incoming_sms_low_watermark;
 
 
 Load *outgoing_sms_load;
@@ -262,7 +264,7 @@ static void wdp_router(void *arg)
     
     while (bb_status != BB_DEAD) {
 
-        if ((msg = gwlist_consume(outgoing_wdp)) == NULL)
+        if ((msg = gw_queue_consume(outgoing_wdp)) == NULL)
             break;
 
         gw_assert(msg_type(msg) == wdp_datagram);
@@ -505,10 +507,10 @@ static Cfg *init_bearerbox(Cfg *cfg)
 
     /* if all seems to be OK by the first glimpse, real start-up */
 
-    outgoing_sms = gwlist_create();
-    incoming_sms = gwlist_create();
-    outgoing_wdp = gwlist_create();
-    incoming_wdp = gwlist_create();
+    outgoing_sms = gw_queue_create(0);
+    incoming_sms = gw_queue_create(0);
+    outgoing_wdp = gw_queue_create(0);
+    incoming_wdp = gw_queue_create(0);
 
     outgoing_sms_counter = counter_create();
     incoming_sms_counter = counter_create();
@@ -557,6 +559,20 @@ static Cfg *init_bearerbox(Cfg *cfg)
         cfg_get_integer(&max_incoming_sms_qlength, grp,
                                   octstr_imm("sms-incoming-queue-limit")) == -1)
         max_incoming_sms_qlength = -1;
+
+    /*
+     * SMSC receivers are throttled above the high watermark until the
+     * queue is back at the low one. Default to the queue limit, so the
+     * SMSCs are told to back off rather than messages being dropped.
+     */
+    if (cfg_get_integer(&incoming_sms_high_watermark, grp,
+                        octstr_imm("sms-incoming-queue-high-watermark")) == -1)
+        incoming_sms_high_watermark = max_incoming_sms_qlength;
+    if (cfg_get_integer(&incoming_sms_low_watermark, grp,
+                        octstr_imm("sms-incoming-queue-low-watermark")) == -1 ||
+            incoming_sms_low_watermark > incoming_sms_high_watermark)
+        incoming_sms_low_watermark = (incoming_sms_high_watermark < 0 ? -1 :
+                                      incoming_sms_high_watermark / 2);
         
     if (cfg_get_integer(&max_outgoing_sms_qlength, grp,
                                   octstr_imm("sms-outgoing-queue-limit")) == -1)
@@ -614,31 +630,31 @@ static void empty_msg_lists(void)
     Msg *msg;
 
 #ifndef NO_WAP
-    if (gwlist_len(incoming_wdp) > 0 || gwlist_len(outgoing_wdp) > 0)
+    if (gw_queue_len(incoming_wdp) > 0 || gw_queue_len(outgoing_wdp) > 0)
         warning(0, "Remaining WDP: %ld incoming, %ld outgoing",
-                gwlist_len(incoming_wdp), gwlist_len(outgoing_wdp));
+                gw_queue_len(incoming_wdp), gw_queue_len(outgoing_wdp));
 
     info(0, "Total WDP messages: received %ld, sent %ld",
          counter_value(incoming_wdp_counter),
          counter_value(outgoing_wdp_counter));
 #endif
     
-    while ((msg = gwlist_extract_first(incoming_wdp)) != NULL)
+    while ((msg = gw_queue_extract(incoming_wdp)) != NULL)
         msg_destroy(msg);
-    while ((msg = gwlist_extract_first(outgoing_wdp)) != NULL)
+    while ((msg = gw_queue_extract(outgoing_wdp)) != NULL)
         msg_destroy(msg);
 
-    gwlist_destroy(incoming_wdp, NULL);
-    gwlist_destroy(outgoing_wdp, NULL);
+    gw_queue_destroy(incoming_wdp, NULL);
+    gw_queue_destroy(outgoing_wdp, NULL);
 
     counter_destroy(incoming_wdp_counter);
     counter_destroy(outgoing_wdp_counter);
     
 #ifndef NO_SMS
     /* XXX we should record these so that they are not forever lost... */
-    if (gwlist_len(incoming_sms) > 0 || gwlist_len(outgoing_sms) > 0)
+    if (gw_queue_len(incoming_sms) > 0 || gw_queue_len(outgoing_sms) > 0)
         debug("bb", 0, "Remaining SMS: %ld incoming, %ld outgoing",
-              gwlist_len(incoming_sms), gwlist_len(outgoing_sms));
+              gw_queue_len(incoming_sms), gw_queue_len(outgoing_sms));
 
     info(0, "Total SMS messages: received %ld, dlr %ld, sent %ld, dlr %ld",
          counter_value(incoming_sms_counter),
@@ -647,8 +663,8 @@ static void empty_msg_lists(void)
          counter_value(outgoing_dlr_counter));
 #endif
 
-    gwlist_destroy(incoming_sms, msg_destroy_item);
-    gwlist_destroy(outgoing_sms, msg_destroy_item);
+    gw_queue_destroy(incoming_sms, msg_destroy_item);
+    gw_queue_destroy(outgoing_sms, msg_destroy_item);
     
     counter_destroy(incoming_sms_counter);
     counter_destroy(incoming_dlr_counter);
@@ -673,11 +689,11 @@ static void dispatch_into_queue(Msg *msg)
         case mt_push:
         case mt_reply:
         case report_mt:
-            gwlist_append(outgoing_sms, msg);
+            gw_queue_produce(outgoing_sms, msg);
             break;
         case mo:
         case report_mo:
-            gwlist_append(incoming_sms, msg);
+            gw_queue_produce(incoming_sms, msg);
             break;
         default:
             uuid_unparse(msg->sms.id, id);
@@ -697,7 +713,7 @@ int main(int argc, char **argv)
     bb_status = BB_RUNNING;
     
     gwlib_init();
-    start_time = time(NULL);
+    start_time = gw_clock_mono();
 
     suspended = gwlist_create();
     isolated = gwlist_create();
@@ -961,6 +977,11 @@ int bb_reload_lists(void)
     return smsc2_reload_lists();
 }
 
+int bb_update_list(Octstr *name, Octstr *number, int add)
+{
+    return smsc2_update_list(name, number, add);
+}
+
 int bb_remove_message(Octstr *message_id)
 {
     Msg *msg;
@@ -983,6 +1004,60 @@ int bb_remove_message(Octstr *message_id)
 #define append_status(r, s, f, x) { s = f(x); octstr_append(r, s); \
                                     octstr_destroy(s); }
 
+static Octstr *memory_status(int status_type)
+{
+    struct gw_slab_stats stats[32];
+    Octstr *tmp;
+    char *lb, *ws;
+    long i, n;
+    int para;
+
+    if ((lb = bb_status_linebreak(status_type)) == NULL)
+        return octstr_create("Un-supported format");
+
+    if (status_type == BBSTATUS_HTML)
+        ws = "&nbsp;&nbsp;&nbsp;&nbsp;";
+    else if (status_type == BBSTATUS_TEXT)
+        ws = "    ";
+    else
+        ws = "";
+    para = (status_type == BBSTATUS_HTML || status_type == BBSTATUS_WML);
+
+    n = gw_slab_stats(stats, sizeof(stats) / sizeof(stats[0]));
+    if (status_type == BBSTATUS_XML)
+        tmp = octstr_create("<memory>\n\t<allocator>");
+    else
+        tmp = octstr_format("%sMemory: ", para ? "<p>" : "");
+    octstr_append(tmp, gwmem_type());
+    if (status_type == BBSTATUS_XML)
+        octstr_append_cstr(tmp, "</allocator>\n");
+    else
+        octstr_format_append(tmp, " allocator%s", lb);
+
+    for (i = 0; i < n; i++) {
+        if (status_type == BBSTATUS_XML)
+            octstr_format_append(tmp, "\t<cache>\n\t\t<name>%s</name>\n"
+                "\t\t<size>%ld</size>\n\t\t<live>%ld</live>\n"
+                "\t\t<high>%ld</high>\n\t\t<total>%ld</total>\n\t</cache>\n",
+                stats[i].name, (long) stats[i].size, stats[i].live,
+                stats[i].high, stats[i].total);
+        else
+            octstr_format_append(tmp, "%s%s: %ld live (%ld at most), "
+                "%ld allocated, %ld bytes each%s", ws, stats[i].name,
+                stats[i].live, stats[i].high, stats[i].total,
+                (long) stats[i].size, lb);
+    }
+
+    if (para)
+        octstr_append_cstr(tmp, "</p>");
+    if (status_type == BBSTATUS_XML)
+        octstr_append_cstr(tmp, "</memory>\n");
+    else
+        octstr_append_cstr(tmp, "\n\n");
+    return tmp;
+}
+
+
 Octstr *bb_print_status(int status_type)
 {
     char *s, *lb;
@@ -993,7 +1068,7 @@ Octstr *bb_print_status(int status_type)
     if ((lb = bb_status_linebreak(status_type)) == NULL)
         return octstr_create("Un-supported format");
 
-    t = time(NULL) - start_time;
+    t = gw_clock_mono() - start_time;
     
     if (bb_status == BB_RUNNING)
         s = "running";
@@ -1015,6 +1090,7 @@ Octstr *bb_print_status(int status_type)
                "(%ld queued)</p>\n\n"
                " <p>SMS: received %ld (%ld queued), sent %ld "
                "(%ld queued), store size %ld<br>\n"
+               " SMS: receiving %s, watermarks %ld/%ld<br>\n"
                " SMS: inbound (%.2f,%.2f,%.2f) msg/sec, "
                "outbound (%.2f,%.2f,%.2f) msg/sec</p>\n\n"
                " <p>DLR: received %ld, sent %ld<br>\n"
@@ -1029,6 +1105,7 @@ Octstr *bb_print_status(int status_type)
                "   <p>SMS: received %ld (%ld queued)<br/>\n"
                "      SMS: sent %ld (%ld queued)<br/>\n"
                "      SMS: store size %ld<br/>\n"
+               "      SMS: receiving %s, watermarks %ld/%ld<br/>\n"
                "      SMS: inbound (%.2f,%.2f,%.2f) msg/sec<br/>\n"
                "      SMS: outbound (%.2f,%.2f,%.2f) msg/sec</p>\n"
                "   <p>DLR: received %ld<br/>\n"
@@ -1047,6 +1124,7 @@ Octstr *bb_print_status(int status_type)
                "\t<sms>\n\t\t<received><total>%ld</total><queued>%ld</queued>"
                "</received>\n\t\t<sent><total>%ld</total><queued>%ld</queued>"
                "</sent>\n\t\t<storesize>%ld</storesize>\n\t\t"
+               "<receiving><state>%s</state><high>%ld</high><low>%ld</low></receiving>\n\t\t"
                "<inbound>%.2f,%.2f,%.2f</inbound>\n\t\t"
                "<outbound>%.2f,%.2f,%.2f</outbound>\n\t\t"
                "</sms>\n"
@@ -1060,6 +1138,7 @@ Octstr *bb_print_status(int status_type)
         frmt = "%s\n\nStatus: %s, uptime %ldd %ldh %ldm %lds\n\n"
                "WDP: received %ld (%ld queued), sent %ld (%ld queued)\n\n"
                "SMS: received %ld (%ld queued), sent %ld (%ld queued), store size %ld\n"
+               "SMS: receiving %s, watermarks %ld/%ld\n"
                "SMS: inbound (%.2f,%.2f,%.2f) msg/sec, "
                "outbound (%.2f,%.2f,%.2f) msg/sec\n\n"
                "DLR: received %ld, sent %ld\n"
@@ -1072,11 +1151,13 @@ Octstr *bb_print_status(int status_type)
         octstr_get_cstr(version),
         s, t/3600/24, t/3600%24, t/60%60, t%60,
         counter_value(incoming_wdp_counter),
-        gwlist_len(incoming_wdp) + boxc_incoming_wdp_queue(),
-        counter_value(outgoing_wdp_counter), gwlist_len(outgoing_wdp) + udp_outgoing_queue(),
-        counter_value(incoming_sms_counter), gwlist_len(incoming_sms),
-        counter_value(outgoing_sms_counter), gwlist_len(outgoing_sms),
+        gw_queue_len(incoming_wdp) + boxc_incoming_wdp_queue(),
+        counter_value(outgoing_wdp_counter), gw_queue_len(outgoing_wdp) + udp_outgoing_queue(),
+        counter_value(incoming_sms_counter), gw_queue_len(incoming_sms) + boxc_parked_sms_queue(),
+        counter_value(outgoing_sms_counter), gw_queue_len(outgoing_sms),
         store_messages(),
+        smsc2_receive_is_throttled() ? "throttled" : "open",
+        incoming_sms_high_watermark, incoming_sms_low_watermark,
         load_get(incoming_sms_load,0), load_get(incoming_sms_load,1), load_get(incoming_sms_load,2),
         load_get(outgoing_sms_load,0), load_get(outgoing_sms_load,1), load_get(outgoing_sms_load,2),
         counter_value(incoming_dlr_counter), counter_value(outgoing_dlr_counter),
@@ -1088,6 +1169,7 @@ Octstr *bb_print_status(int status_type)
     
     append_status(ret, str, boxc_status, status_type);
     append_status(ret, str, smsc2_status, status_type);
+    append_status(ret, str, memory_status, status_type);
     octstr_append_cstr(ret, footer);
     
     return ret;
@@ -115,6 +115,9 @@ Octstr *boxc_status(int status_type);
 /* tell total number of messages in separate wapbox incoming queues */
 int boxc_incoming_wdp_queue(void);
 
+/* tell number of MO messages parked until an smsbox for their route is ready */
+int boxc_parked_sms_queue(void);
+
 /* Clean up after box connections have died. */
 void boxc_cleanup(void);
 
@@ -159,6 +162,14 @@ void smsc2_cleanup(void); /* final clean-up */
 
 Octstr *smsc2_status(int status_type);
 
+/* return 1 while SMSC receivers are throttled because the incoming queue
+ * went over sms-incoming-queue-high-watermark, 0 otherwise */
+int smsc2_receive_throttled(void);
+
+/* the throttling state as last set by smsc2_receive_throttled, without
+ * checking the queue again; for status reports */
+int smsc2_receive_is_throttled(void);
+
 /* function to route outgoing SMS'es
  *
  * If finds a good one, puts into it and returns SMSCCONN_SUCCESS
@@ -177,6 +188,9 @@ int smsc2_add_smsc(Octstr *id);   /* add a new smsc */
 int smsc2_remove_smsc(Octstr *id);   /* remove a specific smsc */
 
 int smsc2_reload_lists(void); /* reload blacklists */
+/* add (add != 0) or remove a number of the named white/black list.
+ * Return 1 if changed, 0 if nothing to do, -1 on error */
+int smsc2_update_list(Octstr *name, Octstr *number, int add);
 
 
 /*---------------
@@ -221,6 +235,7 @@ int bb_remove_smsc(Octstr *id);
 int bb_restart_smsc(Octstr *id);
 int bb_remove_message(Octstr *id);
 int bb_reload_lists(void);
+int bb_update_list(Octstr *name, Octstr *number, int add);
 int bb_reload_smsc_groups(void);
 
 /* return string of current status */
@@ -96,6 +96,33 @@
 /* Our callback functions */
 static struct dlr_storage *handles = NULL;
 
+/*
+ * Asynchronous resolver stage, see dlr_resolve(). Each thread owns one
+ * queue and requests are sharded over the queues by their timestamp, so
+ * all reports for one message are looked up in the order they arrived.
+ */
+struct dlr_resolve_item {
+    Octstr *smsc;
+    Octstr *ts;
+    Octstr *dst;
+    int typ;
+    int use_dst;
+    List *pending;
+    dlr_resolved_cb *done;
+    void *context;
+};
+
+static long resolver_threads = 0;
+static long resolver_queue_limit = -1;
+static List **resolver_queues = NULL;
+static long *resolver_thread_ids = NULL;
+static Counter *resolver_queued = NULL;
+/* read locked while queueing, write locked to stop the threads */
+static RWLock *resolver_lock = NULL;
+
+static void dlr_resolver_start(void);
+static void dlr_resolver_stop(void);
+
 /*
  * Function to allocate a new struct dlr_entry entry
  * and initialize it to zero
@@ -291,6 +318,15 @@ void dlr_init(Cfg* cfg)
 
     /* cleanup */
     octstr_destroy(dlr_type);
+
+    if (cfg_get_integer(&resolver_threads, grp, octstr_imm("dlr-resolver-threads")) == -1 ||
+            resolver_threads < 0)
+        resolver_threads = 0;
+    if (cfg_get_integer(&resolver_queue_limit, grp, octstr_imm("dlr-resolver-queue-limit")) == -1)
+        resolver_queue_limit = -1;
+    resolver_lock = gw_rwlock_create();
+    if (resolver_threads > 0)
+        dlr_resolver_start();
 }
 
 /*
@@ -298,6 +334,10 @@ void dlr_init(Cfg* cfg)
  */
 void dlr_shutdown()
 {
+    dlr_resolver_stop();
+    gw_rwlock_destroy(resolver_lock);
+    resolver_lock = NULL;
+
     if (handles != NULL && handles->dlr_shutdown != NULL)
         handles->dlr_shutdown();
 }
@@ -498,6 +538,149 @@ void dlr_flush(void)
 }
 
 
+/*
+ * Asynchronous DLR resolution.
+ */
+
+static void resolve_item_destroy(struct dlr_resolve_item *item)
+{
+    octstr_destroy(item->smsc);
+    octstr_destroy(item->ts);
+    octstr_destroy(item->dst);
+    gw_free(item);
+}
+
+
+static void resolve_item_run(struct dlr_resolve_item *item)
+{
+    Msg *msg;
+    List *pending = item->pending;
+
+    msg = dlr_find(item->smsc, item->ts, item->dst, item->typ, item->use_dst);
+    item->done(msg, item->context);
+    resolve_item_destroy(item);
+
+    /* the caller may be waiting on this, so it has to be the last access */
+    if (pending != NULL)
+        gwlist_remove_producer(pending);
+}
+
+
+static void resolver_thread(void *arg)
+{
+    List *queue = arg;
+    struct dlr_resolve_item *item;
+
+    while ((item = gwlist_consume(queue)) != NULL) {
+        counter_decrease(resolver_queued);
+        resolve_item_run(item);
+    }
+}
+
+
+static void dlr_resolver_start(void)
+{
+    long i;
+
+    if (resolver_queues != NULL || resolver_threads <= 0)
+        return;
+
+    resolver_queued = counter_create();
+    resolver_queues = gw_malloc(resolver_threads * sizeof(*resolver_queues));
+    resolver_thread_ids = gw_malloc(resolver_threads * sizeof(*resolver_thread_ids));
+    for (i = 0; i < resolver_threads; i++) {
+        resolver_queues[i] = gwlist_create();
+        gwlist_add_producer(resolver_queues[i]);
+        resolver_thread_ids[i] = gwthread_create(resolver_thread, resolver_queues[i]);
+        if (resolver_thread_ids[i] == -1)
+            panic(0, "DLR: could not start resolver thread");
+    }
+    info(0, "DLR resolving asynchronously with %ld threads.", resolver_threads);
+}
+
+
+static void dlr_resolver_stop(void)
+{
+    long i, n;
+
+    if (resolver_queues == NULL)
+        return;
+
+    /* nobody may queue from now on, the threads finish what is queued */
+    gw_rwlock_wrlock(resolver_lock);
+    n = resolver_threads;
+    resolver_threads = 0;
+    for (i = 0; i < n; i++)
+        gwlist_remove_producer(resolver_queues[i]);
+    gw_rwlock_unlock(resolver_lock);
+    for (i = 0; i < n; i++) {
+        gwthread_join(resolver_thread_ids[i]);
+        gwlist_destroy(resolver_queues[i], NULL);
+    }
+    gw_free(resolver_queues);
+    gw_free(resolver_thread_ids);
+    counter_destroy(resolver_queued);
+    resolver_queues = NULL;
+    resolver_thread_ids = NULL;
+    resolver_queued = NULL;
+}
+
+
+int dlr_resolver_enabled(void)
+{
+    return resolver_threads > 0;
+}
+
+
+void dlr_resolve(const Octstr *smsc, const Octstr *ts, const Octstr *dst,
+                 int typ, int use_dst, List *pending,
+                 dlr_resolved_cb *done, void *context)
+{
+    struct dlr_resolve_item *item;
+
+    gw_assert(done != NULL);
+
+    item = gw_malloc(sizeof(*item));
+    item->smsc = octstr_duplicate(smsc);
+    item->ts = octstr_duplicate(ts);
+    item->dst = octstr_duplicate(dst);
+    item->typ = typ;
+    item->use_dst = use_dst;
+    item->pending = pending;
+    item->done = done;
+    item->context = context;
+
+    if (pending != NULL)
+        gwlist_add_producer(pending);
+
+    /*
+     * Resolve in the caller if the stage is off or full. The latter bounds
+     * the number of receipts that were acknowledged but not resolved yet
+     * and slows the SMSC down to the speed of the DLR storage.
+     */
+    if (resolver_lock != NULL) {
+        gw_rwlock_rdlock(resolver_lock);
+        if (resolver_threads > 0 && (resolver_queue_limit < 0 ||
+                counter_value(resolver_queued) < resolver_queue_limit)) {
+            counter_increase(resolver_queued);
+            gwlist_produce(resolver_queues[octstr_hash_key(item->ts) % resolver_threads], item);
+            item = NULL;
+        }
+        gw_rwlock_unlock(resolver_lock);
+    }
+
+    if (item != NULL)
+        resolve_item_run(item);
+}
+
+
+void dlr_resolve_wait(List *pending)
+{
+    /* every request is a producer, consume returns once all are done */
+    gwlist_consume(pending);
+}
+
+
 Msg* create_dlr_from_msg(const Octstr *smsc, const Msg *msg, const Octstr *reply, long stat)
 {
     Msg *dlrmsg;
@@ -122,6 +122,29 @@ const char* dlr_type(void);
  */
 Msg* create_dlr_from_msg(const Octstr *smsc, const Msg *msg, const Octstr *reply, long stat);
 
+/*
+ * Asynchronous DLR resolution. dlr_find() may block on the storage, so
+ * SMSC modules can acknowledge a receipt first and queue the lookup to a
+ * pool of resolver threads (core group 'dlr-resolver-threads'). The
+ * callback gets the dlr_find() result, which may be NULL, and owns it.
+ * If the pool is disabled or its queue is full the lookup is done, and
+ * the callback called, right away from within dlr_resolve().
+ *
+ * If pending is not NULL every request is one of its producers until its
+ * callback has returned; dlr_resolve_wait() blocks until there are none
+ * left, which a module has to do before freeing what the callbacks use.
+ * gwlist_producer_count(pending) tells how many are outstanding.
+ */
+typedef void dlr_resolved_cb(Msg *msg, void *context);
+
+void dlr_resolve(const Octstr *smsc, const Octstr *ts, const Octstr *dst,
+                 int type, int use_dst, List *pending,
+                 dlr_resolved_cb *done, void *context);
+void dlr_resolve_wait(List *pending);
+
+/* return true if lookups are resolved by the resolver threads */
+int dlr_resolver_enabled(void);
+
 /*
  * Yet not used functions.
  */
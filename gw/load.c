@@ -67,7 +67,7 @@
 struct load_entry {
     float prev;
     float curr;
-    time_t last;
+    long last;      /* see gw_clock_mono */
     int interval;
     int dirty;
 };
@@ -117,7 +117,7 @@ int load_add_interval(Load *load, int interval)
     entry->prev = entry->curr = 0.0;
     entry->interval = interval;
     entry->dirty = 1;
-    time(&entry->last);
+    entry->last = gw_clock_mono();
     
     load->entries = gw_realloc(load->entries, sizeof(struct load*) * (load->len + 1));
     load->entries[load->len] = entry;
@@ -147,13 +147,13 @@ void load_destroy(Load *load)
 
 void load_increase_with(Load *load, unsigned long value)
 {
-    time_t now;
+    long now;
     int i;
     
     if (load == NULL)
         return;
     gw_rwlock_wrlock(load->lock);
-    time(&now);
+    now = gw_clock_mono();
     for (i = 0; i < load->len; i++) {
         struct load_entry *entry = load->entries[i];
         /* check for special case, load over whole live time */
@@ -177,7 +177,7 @@ void load_increase_with(Load *load, unsigned long value)
 float load_get(Load *load, int pos)
 {
     float ret;
-    time_t now;
+    long now;
     struct load_entry *entry;
 
     if (load == NULL || pos >= load->len) {
@@ -187,13 +187,13 @@ float load_get(Load *load, int pos)
     /* first maybe rotate load */
     load_increase_with(load, 0);
     
-    time(&now);
+    now = gw_clock_mono();
     gw_rwlock_rdlock(load->lock);
     entry = load->entries[pos];
     if (load->heuristic && !entry->dirty) {
         ret = entry->prev;
     } else {
-        time_t diff = (now - entry->last);
+        long diff = (now - entry->last);
         if (diff == 0) diff = 1;
         ret = entry->curr/diff;
     }
@@ -90,12 +90,15 @@ static char *type_as_str(Msg *msg);
  * Implementations of the exported functions.
  */
 
+static gw_slab_t *msg_slab;
+#define MSG_SLAB (gw_slab_get(&msg_slab, "Msg", sizeof(Msg)))
+
 Msg *msg_create_real(enum msg_type type, const char *file, long line,
                      const char *func)
 {
     Msg *msg;
 
-    msg = gw_malloc_trace(sizeof(Msg), file, line, func);
+    msg = gw_slab_alloc_trace(MSG_SLAB, file, line, func);
 
     msg->type = type;
 #define INTEGER(name) p->name = MSG_PARAM_UNDEFINED;
@@ -141,7 +144,7 @@ void msg_destroy(Msg *msg)
 #define MSG(type, stmt) { struct type *p = &msg->type; stmt }
 #include "msg-decl.h"
 
-    gw_free(msg);
+    gw_slab_free(msg_slab, msg);
 }
 
 void msg_destroy_item(void *msg)
@@ -71,129 +71,129 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "gwlib/gwlib.h"
 #include "numhash.h"
 
 
-#define NUMHASH_AUTO_HASH -1
+/*
+ * The numbers are kept as a sorted array of unique keys, either in
+ * allocated memory or, for number set files, in the mapped file itself.
+ * Numbers added or removed later on are kept in two small sorted arrays
+ * of their own, so that the (possibly huge, possibly read-only) main
+ * array is never touched after creation.
+ */
+struct numhash_table {
+    long long	*keys;
+    long	number_total;
+    void	*map;		/* mapped number set file, if any */
+    size_t	map_size;
+    long long	*added;
+    long	added_total;
+    long	added_size;
+    long long	*removed;
+    long	removed_total;
+    long	removed_size;
+}; /* Numhash */
 
-/* set of pre-calculated prime numbers for hash generation... */
 
-static int primes[] = {
-  101, 503, 1009, 2003, 3001, 5003, 7001,
-  10007, 20011, 30011, 40009, 50021, 60013, 70001, 80021, 90001,
-  100003, 150001, 200003, 300007, 400009, 500009, 600011, 700001,
-  800011, 900001, 1000003, 1100009, 1200007, 1300021, 1400017, 1500007,
-  1600033, 1700021, 1800017, 1900009, 2000003, 3000017, 4000037, 5000111,
-  6000101, 7000127, 8000051, -1
+/*
+ * Header of a number set file, followed by 'count' sorted unique keys.
+ * Everything is in host byte order; 'byte_order' tells if it is ours.
+ */
+#define NUMSET_MAGIC "KANNELNS"
+#define NUMSET_BYTE_ORDER 0x0102030405060708LL
+
+struct numset_header {
+    char	magic[8];
+    long long	byte_order;
+    long long	precision;
+    long long	count;
 };
 
-struct numhash_table {
-  struct numhash_number *numbers;
-  long			number_total;
-  long			table_size;
-  struct numhash_number	**hash;
-  long			hash_size;
-}; /* Numhash */
 
-struct numhash_number {
-  long long		key;	/* (hopefully) unique key */
-  struct numhash_number	*next;	/* next in hash table, if any */
-};
+static int	precision = 19;		/* the precision (last numbers) used */
 
 
-struct nh_entry {
-    Numhash		*hash;
-    struct nh_entry	*next;
-};
-    
-struct numhashes {
-    struct nh_entry	*first;
-    struct nh_entry 	*last;
-}; /* Multitable */
+static int key_compare(const void *a, const void *b)
+{
+    long long ka = *(const long long *) a, kb = *(const long long *) b;
 
+    return (ka > kb) - (ka < kb);
+}
 
-static int	precision = 19;		/* the precision (last numbers) used */
 
 /*
- * add new item (number) to hash table
+ * Find the position of 'key' in the sorted array, or where it would be
+ * inserted. The loop has no data dependent branches, the compiler turns
+ * the halving into conditional moves.
  */
-static int add_item(Numhash *table, struct numhash_number *nro)
+static long key_position(const long long *keys, long n, long long key)
 {
-    if (table->hash[nro->key % table->hash_size]) {    /* conflict */
-	struct numhash_number *ptr = table->hash[nro->key % table->hash_size];
-
-	if (ptr->key == nro->key)
-	    goto duplicate;
+    const long long *base = keys;
+    long half;
+
+    if (n == 0)
+        return 0;
+    while (n > 1) {
+        half = n / 2;
+        base = (base[half] <= key) ? base + half : base;
+        n -= half;
+    }
+    return (base - keys) + (*base < key);
+}
 
-	while(ptr->next) {
-	    ptr = ptr->next;
-	    if (ptr->key == nro->key)
-		goto duplicate;
-	}
-	ptr->next = nro;				/* put as last of the linkage */
-    } else
-	table->hash[nro->key % table->hash_size] = nro;
 
-    return 0;
+static int key_search(const long long *keys, long n, long long key)
+{
+    long pos = key_position(keys, n, key);
 
-duplicate:
-    warning(0, "Duplicate number %lld!", nro->key);
-    return -1;
+    return pos < n && keys[pos] == key;
 }
 
-/* Add a new number to number list and hash
- * Return 0 if all went ok, -1 if out of room
- */
-static int numhash_add_number(Numhash *table, char *nro)
+
+/* insert into a sorted delta array, return 0 if it was there already */
+static int delta_insert(long long **keys, long *total, long *size, long long key)
 {
-    struct numhash_number *newnro;
+    long pos = key_position(*keys, *total, key);
 
-    if (table->number_total == table->table_size) {
-	error(0, "Table limit %ld reached, cannot add %s!",
-	      table->table_size, nro);
-	return -1;
+    if (pos < *total && (*keys)[pos] == key)
+        return 0;
+    if (*total == *size) {
+        *size = *size ? *size * 2 : 64;
+        *keys = gw_realloc(*keys, *size * sizeof(long long));
     }
-    newnro =  &table->numbers[table->number_total++]; /* take the next free */
+    memmove(*keys + pos + 1, *keys + pos, (*total - pos) * sizeof(long long));
+    (*keys)[pos] = key;
+    (*total)++;
+    return 1;
+}
 
-    newnro->key = numhash_get_char_key(nro);
-    newnro->next = NULL;
 
-    add_item(table, newnro);
+/* delete from a sorted delta array, return 0 if it wasn't there */
+static int delta_delete(long long *keys, long *total, long long key)
+{
+    long pos = key_position(keys, *total, key);
 
-    return 0;
+    if (pos >= *total || keys[pos] != key)
+        return 0;
+    memmove(keys + pos, keys + pos + 1, (*total - pos - 1) * sizeof(long long));
+    (*total)--;
+    return 1;
 }
 
 
-/* Init the number table and hash table with given sizes
- */
-static Numhash *numhash_init(int max_numbers, int hash_size)
+static Numhash *numhash_init(void)
 {
-    Numhash	*ntable = NULL;
+    Numhash	*ntable;
 
     ntable = gw_malloc(sizeof(Numhash));
-
-    if (hash_size > 0)
-	ntable->hash_size = hash_size;
-    else if (hash_size == NUMHASH_AUTO_HASH) {
-	int i;
-	for(i=0 ; primes[i] > 0; i++) {
-	    ntable->hash_size = primes[i];
-	    if (ntable->hash_size > max_numbers)
-		break;
-	}
-    } else {
-	gw_free(ntable);
-	return NULL;
-    }
-    ntable->hash = gw_malloc(ntable->hash_size * sizeof(struct numhash_number *));
-    memset(ntable->hash, 0, sizeof(struct numhash_number *) * ntable->hash_size);
-
-    ntable->table_size = max_numbers;
-    ntable->numbers = gw_malloc(ntable->table_size * sizeof(struct numhash_number));
-
-    ntable->number_total = 0;
+    memset(ntable, 0, sizeof(Numhash));
 
     /* set our accuracy according to the size of long int
      * Ok, we call this many times if we use multiple tables, but
@@ -208,6 +208,158 @@ static Numhash *numhash_init(int max_numbers, int hash_size)
 }
 
 
+/*
+ * Map a number set file. Return NULL if it isn't one, or is broken.
+ */
+static Numhash *numhash_map(const char *file, int fd, size_t size)
+{
+    Numhash *table;
+    struct numset_header *hdr;
+    void *map;
+    long i;
+
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        error(errno, "Cannot map number set file <%s>", file);
+        return NULL;
+    }
+    hdr = map;
+    table = numhash_init();
+    if (hdr->byte_order != NUMSET_BYTE_ORDER || hdr->precision != precision ||
+            hdr->count < 0 ||
+            (size - sizeof(*hdr)) / sizeof(long long) < (size_t) hdr->count) {
+        error(0, "Number set file <%s> was made on another architecture "
+                 "or is truncated", file);
+        munmap(map, size);
+        gw_free(table);
+        return NULL;
+    }
+#ifdef MADV_WILLNEED
+    madvise(map, size, MADV_WILLNEED);
+#endif
+    table->map = map;
+    table->map_size = size;
+    table->keys = (long long *) (hdr + 1);
+    table->number_total = hdr->count;
+
+    /* lookups are binary searches, they need sorted unique keys */
+    for (i = 1; i < table->number_total; i++) {
+        if (table->keys[i - 1] >= table->keys[i]) {
+            error(0, "Number set file <%s> is not sorted at number %ld",
+                  file, i);
+            numhash_destroy(table);
+            return NULL;
+        }
+    }
+
+    info(0, "Mapped number set <%s> with total of %ld numbers", file,
+         table->number_total);
+    return table;
+}
+
+
+/*
+ * Parse a list of numbers into a new table, see numhash.h for the format.
+ */
+static Numhash *numhash_parse(Octstr *body, const char *seek_url)
+{
+    char *data, *ptr, numbuf[100];
+    int loc;
+    long i, j, lines = 0, size;
+    Numhash *table;
+
+    ptr = data = octstr_get_cstr(body);
+    while(*ptr) {
+	if (*ptr == '\n') lines++;
+	ptr++;
+    }
+    debug("numhash", 0, "Total %ld lines in %s", lines, seek_url);
+
+    table = numhash_init();
+    size = lines + 10;
+    table->keys = gw_malloc(size * sizeof(long long));
+
+    /* now, parse the number information */
+
+    while((ptr = strchr(data, '\n'))) {	/* each line is ended with linefeed */
+	*ptr = '\0';
+	while(*data != '\0' && isspace(*data))
+	    data++;
+	if (*data != '#') {
+	    loc = 0;
+	    while (*data != '\0' && loc < (int) sizeof(numbuf) - 1) {
+		if (isdigit(*data))
+		    numbuf[loc++] = *data;
+		else if (*data == ' ' || *data == '+' || *data == '-')
+			;
+		else break;
+		data++;
+	    }
+	    if (loc) {
+		numbuf[loc] = '\0';
+		if (table->number_total < size)
+		    table->keys[table->number_total++] = numhash_get_char_key(numbuf);
+	    }
+	    else
+		warning(0, "Corrupted line '%s'", data);
+	}
+	data = ptr+1;	/* next row... */
+    }
+
+    /* sort and drop the duplicates */
+    qsort(table->keys, table->number_total, sizeof(long long), key_compare);
+    for (i = j = 0; i < table->number_total; i++) {
+        if (j > 0 && table->keys[j - 1] == table->keys[i])
+            warning(0, "Duplicate number %lld!", table->keys[i]);
+        else
+            table->keys[j++] = table->keys[i];
+    }
+    table->number_total = j;
+    if (j > 0)
+        table->keys = gw_realloc(table->keys, j * sizeof(long long));
+
+    info(0, "Read from <%s> total of %ld numbers", seek_url, table->number_total);
+    return table;
+}
+
+
+static Octstr *numhash_fetch(const char *seek_url)
+{
+    List	*request_headers, *reply_headers;
+    Octstr	*url, *final_url, *reply_body;
+    Octstr	*type, *charset;
+    int		status;
+
+    url = octstr_create(seek_url);
+    request_headers = http_create_empty_headers();
+    status = http_get_real(HTTP_METHOD_GET, url, request_headers, &final_url,
+			    &reply_headers, &reply_body);
+    octstr_destroy(url);
+    octstr_destroy(final_url);
+    http_destroy_headers(request_headers);
+
+    if (status != HTTP_OK) {
+	http_destroy_headers(reply_headers);
+	octstr_destroy(reply_body);
+	error(0, "Cannot load numhash!");
+	return NULL;
+    }
+    http_header_get_content_type(reply_headers, &type, &charset);
+    octstr_destroy(charset);
+    http_destroy_headers(reply_headers);
+
+    if (octstr_str_compare(type, "text/plain") != 0) {
+        octstr_destroy(reply_body);
+        error(0, "Strange content type <%s> for numhash - expecting 'text/plain'"
+                 ", operatiom fails", octstr_get_cstr(type));
+        octstr_destroy(type);
+        return NULL;
+    }
+    octstr_destroy(type);
+
+    return reply_body;
+}
+
 
 /*------------------------------------------------------
  * PUBLIC FUNCTIONS
@@ -227,14 +379,86 @@ int numhash_find_number(Numhash *table, Octstr *nro)
 
 int numhash_find_key(Numhash *table, long long key)
 {
-    struct numhash_number *ptr;
+    if (table->removed_total > 0 &&
+            key_search(table->removed, table->removed_total, key))
+        return 0;
+    if (table->added_total > 0 &&
+            key_search(table->added, table->added_total, key))
+        return 1;
+    return key_search(table->keys, table->number_total, key);
+}
 
-    ptr = table->hash[key % table->hash_size];
-    while (ptr) {
-	if (ptr->key == key) return 1;
-	ptr = ptr->next;
-    }
-    return 0;	/* not found */
+
+static int add_key(Numhash *table, long long key)
+{
+    if (delta_delete(table->removed, &table->removed_total, key))
+        return 1;
+    if (key_search(table->keys, table->number_total, key))
+        return 0;
+    return delta_insert(&table->added, &table->added_total,
+                        &table->added_size, key);
+}
+
+
+static int remove_key(Numhash *table, long long key)
+{
+    if (delta_delete(table->added, &table->added_total, key))
+        return 1;
+    if (!key_search(table->keys, table->number_total, key))
+        return 0;
+    return delta_insert(&table->removed, &table->removed_total,
+                        &table->removed_size, key);
+}
+
+
+int numhash_check_number(Octstr *nro)
+{
+    long start;
+
+    if (nro == NULL)
+        return 0;
+    start = (octstr_get_char(nro, 0) == '+' ? 1 : 0);
+    return octstr_len(nro) > start &&
+           octstr_check_range(nro, start, octstr_len(nro) - start, gw_isdigit);
+}
+
+
+int numhash_add_number(Numhash *table, Octstr *nro)
+{
+    long long key;
+
+    if (!numhash_check_number(nro))
+        return -1;
+    key = numhash_get_key(nro);
+    if (key < 0)
+        return -1;
+
+    return add_key(table, key);
+}
+
+
+int numhash_remove_number(Numhash *table, Octstr *nro)
+{
+    long long key;
+
+    if (!numhash_check_number(nro))
+        return -1;
+    key = numhash_get_key(nro);
+    if (key < 0)
+        return -1;
+
+    return remove_key(table, key);
+}
+
+
+void numhash_apply_changes(Numhash *to, Numhash *from)
+{
+    long i;
+
+    for (i = 0; i < from->added_total; i++)
+        add_key(to, from->added[i]);
+    for (i = 0; i < from->removed_total; i++)
+        remove_key(to, from->removed[i]);
 }
 
 
@@ -276,118 +500,117 @@ void numhash_destroy(Numhash *table)
 {
     if (table == NULL)
 	return;
-    gw_free(table->numbers);
-    gw_free(table->hash);
+    if (table->map != NULL)
+        munmap(table->map, table->map_size);
+    else
+        gw_free(table->keys);
+    gw_free(table->added);
+    gw_free(table->removed);
     gw_free(table);
 }
 
 
-double numhash_hash_fill(Numhash *table, int *longest)
+long numhash_size(Numhash *table)
 {
-    int i, l, max = 0, tot = 0;
-    struct numhash_number *ptr;
-
-    for (i=0; i < table->hash_size; i++)
-	if (table->hash[i]) {
-	    tot++;
-	    ptr = table->hash[i];
-	    for (l=0; ptr->next; ptr = ptr->next)
-		l++;
-	    if (l > max)
-		max = l;
-	}
-
-    if (longest != NULL)
-	*longest = max;
-
-    return (double)(tot*100.0/(table->hash_size));
-}
-
-
-int numhash_size(Numhash *table)
-{
-    return table->number_total;
+    return table->number_total + table->added_total - table->removed_total;
 }
 
 
 Numhash *numhash_create(const char *seek_url)
 {
-    int		loc, lines = 0;
-    List	*request_headers, *reply_headers;
-    Octstr	*url, *final_url, *reply_body;
-    Octstr	*type, *charset;
-
-    char *data, *ptr, numbuf[100];
-    int		status;
-    Numhash	*table;
-
-    url = octstr_create(seek_url);
-    request_headers = http_create_empty_headers();
-    status = http_get_real(HTTP_METHOD_GET, url, request_headers, &final_url,
-			    &reply_headers, &reply_body);
-    octstr_destroy(url);
-    octstr_destroy(final_url);
-    http_destroy_headers(request_headers);
-
-    if (status != HTTP_OK) {
-	http_destroy_headers(reply_headers);
-	octstr_destroy(reply_body);
-	error(0, "Cannot load numhash!");
-	return NULL;
+    Octstr *body;
+    Numhash *table;
+    const char *file;
+    struct stat st;
+    char magic[sizeof(NUMSET_MAGIC) - 1];
+    int fd;
+
+    if (strncmp(seek_url, "file://", 7) != 0) {
+        if ((body = numhash_fetch(seek_url)) == NULL)
+            return NULL;
+        table = numhash_parse(body, seek_url);
+        octstr_destroy(body);
+        return table;
     }
-    http_header_get_content_type(reply_headers, &type, &charset);
-    octstr_destroy(charset);
-    http_destroy_headers(reply_headers);
 
-    if (octstr_str_compare(type, "text/plain") != 0) {
-        octstr_destroy(reply_body);
-        error(0, "Strange content type <%s> for numhash - expecting 'text/plain'"
-                 ", operatiom fails", octstr_get_cstr(type));
-        octstr_destroy(type);
+    file = seek_url + 7;
+    if ((fd = open(file, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+        error(errno, "Cannot open number list <%s>", file);
+        if (fd != -1)
+            close(fd);
         return NULL;
     }
-    octstr_destroy(type);
-
-    ptr = data = octstr_get_cstr(reply_body);
-    while(*ptr) {
-	if (*ptr == '\n') lines++;
-	ptr++;
+    if (st.st_size >= (off_t) sizeof(struct numset_header) &&
+            read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+            memcmp(magic, NUMSET_MAGIC, sizeof(magic)) == 0) {
+        table = numhash_map(file, fd, st.st_size);
+        close(fd);
+        return table;
     }
-    debug("numhash", 0, "Total %d lines in %s", lines, seek_url);
+    close(fd);
 
-    table = numhash_init(lines+10, NUMHASH_AUTO_HASH);  	/* automatic hash */
+    if ((body = octstr_read_file(file)) == NULL)
+        return NULL;
+    table = numhash_parse(body, seek_url);
+    octstr_destroy(body);
+    return table;
+}
 
-    /* now, parse the number information */
 
-    lines = 0;
+int numhash_save(Numhash *table, const char *file)
+{
+    struct numset_header hdr;
+    Octstr *tmp;
+    FILE *f;
+    long i, j, k, n;
+    long long key;
 
-    while((ptr = strchr(data, '\n'))) {	/* each line is ended with linefeed */
-	*ptr = '\0';
-	while(*data != '\0' && isspace(*data))
-	    data++;
-	if (*data != '#') {
-	    loc = 0;
-	    while (*data != '\0') {
-		if (isdigit(*data))
-		    numbuf[loc++] = *data;
-		else if (*data == ' ' || *data == '+' || *data == '-')
-			;
-		else break;
-		data++;
-	    }
-	    if (loc) {
-		numbuf[loc] = '\0';
-		numhash_add_number(table, numbuf);
-		lines++;
-	    }
-	    else
-		warning(0, "Corrupted line '%s'", data);
-	}
-	data = ptr+1;	/* next row... */
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, NUMSET_MAGIC, sizeof(hdr.magic));
+    hdr.byte_order = NUMSET_BYTE_ORDER;
+    hdr.precision = precision;
+    hdr.count = numhash_size(table);
+
+    tmp = octstr_format("%s.new", file);
+    if ((f = fopen(octstr_get_cstr(tmp), "w")) == NULL) {
+        error(errno, "Cannot create number set file <%s>", octstr_get_cstr(tmp));
+        octstr_destroy(tmp);
+        return -1;
+    }
+    fwrite(&hdr, sizeof(hdr), 1, f);
+
+    /* merge the deltas into the main array on the way out */
+    i = j = k = n = 0;
+    while (i < table->number_total || j < table->added_total) {
+        if (j >= table->added_total ||
+                (i < table->number_total && table->keys[i] < table->added[j]))
+            key = table->keys[i++];
+        else
+            key = table->added[j++];
+        while (k < table->removed_total && table->removed[k] < key)
+            k++;
+        if (k < table->removed_total && table->removed[k] == key)
+            continue;
+        fwrite(&key, sizeof(key), 1, f);
+        n++;
     }
-    octstr_destroy(reply_body);
 
-    info(0, "Read from <%s> total of %ld numbers", seek_url, table->number_total);
-    return table;
+    if (fflush(f) != 0 || ferror(f) || fsync(fileno(f)) != 0 || n != hdr.count) {
+        error(errno, "Cannot write number set file <%s>", octstr_get_cstr(tmp));
+        fclose(f);
+        unlink(octstr_get_cstr(tmp));
+        octstr_destroy(tmp);
+        return -1;
+    }
+    fclose(f);
+
+    /* readers mapping the old file keep it until they unmap it */
+    if (rename(octstr_get_cstr(tmp), file) == -1) {
+        error(errno, "Cannot rename <%s> to <%s>", octstr_get_cstr(tmp), file);
+        unlink(octstr_get_cstr(tmp));
+        octstr_destroy(tmp);
+        return -1;
+    }
+    octstr_destroy(tmp);
+    return 0;
 }
-
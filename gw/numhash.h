@@ -69,12 +69,18 @@
  * specially with telephone number black lists
  *
  * USAGE:
- *  the system is not very dynamic; if you want to resize the table
- *  or hash, you must first nuke all old data and then recreate it
+ *  the numbers are kept as a sorted array of keys, which is searched
+ *  with binary search. Single numbers can be added or removed later;
+ *  those changes live next to the array until the table is recreated.
+ *  Lists can also be saved in a binary number set file, which is then
+ *  mapped into memory as it is instead of being parsed.
+ *
+ *  The functions do no locking, callers changing a table that others
+ *  read must serialize that themselves.
  *
  * MEMORY NEEDED:  (approximated)
  *
- * 2* (sizeof(long long)+sizeof(void *)) bytes per number
+ * sizeof(long long) bytes per number, none for mapped number set files
  */
 
 #ifndef NUMHASH_H
@@ -97,6 +103,11 @@ typedef struct numhash_table Numhash;
 /* get numbers from 'url' and create a new database out of them
  * Return NULL if cannot open database or other error, error is logged
  *
+ * 'url' is fetched via HTTP, unless it is a file:// URL. A local file
+ * may be a text list as below or a number set file made by
+ * numhash_save(), which is mapped into memory. A number set file whose
+ * numbers are not sorted is rejected.
+ *
  * Numbers to datafile are saved as follows:
  *  - one number per line
  *  - number might have white spaces, '+' and '-' signs
@@ -113,6 +124,12 @@ Numhash *numhash_create(const char *url);
 /* destroy hash and all numbers in it */
 void numhash_destroy(Numhash *table);
 
+/* write all numbers of the table, including numbers added or removed
+ * since, to 'file' as a number set file. The file is written under a
+ * temporary name and renamed, so a reader never maps a partial file.
+ * Return 0 if all went ok, -1 on error */
+int numhash_save(Numhash *table, const char *file);
+
 /* check if the number is in database, return 1 if found, 0 if not,
  * -1 on error */
 int numhash_find_number(Numhash *table, Octstr *nro);
@@ -120,16 +137,26 @@ int numhash_find_number(Numhash *table, Octstr *nro);
 /* if we already have the key */
 int numhash_find_key(Numhash *table, long long key);
 
+/* return 1 if nro is a number we can store: digits with an optional
+ * leading '+', at least one digit. 0 otherwise */
+int numhash_check_number(Octstr *nro);
+
+/* add or remove a single number. Return 1 if the table changed, 0 if
+ * the number was in (add) or not in (remove) already, -1 on error or if
+ * numhash_check_number() refuses the number */
+int numhash_add_number(Numhash *table, Octstr *nro);
+int numhash_remove_number(Numhash *table, Octstr *nro);
+
+/* add and remove the numbers that were added to and removed from 'from'
+ * since it was created to 'to' as well, e.g. when a list is reloaded */
+void numhash_apply_changes(Numhash *to, Numhash *from);
+
 /* if we want to know the key */
 long long numhash_get_key(Octstr *nro);
 long long numhash_get_char_key(char *nro);
 
 
-/* Return hash fill percent. If 'longest' != NULL, set as longest
- * trail in hash */
-double numhash_hash_fill(Numhash *table, int *longest);
-
 /* return number of numbers in hash */
-int numhash_size(Numhash *table);
+long numhash_size(Numhash *table);
 
 #endif
@@ -392,27 +392,13 @@ List *sms_split(Msg *orig, Octstr *header, Octstr *footer,
 }
 
 
-int sms_priority_compare(const void *a, const void *b)
+int sms_priority_level(const void *a)
 {
-    int ret;
-    Msg *msg1 = (Msg*)a, *msg2 = (Msg*)b;
-    gw_assert(msg_type(msg1) == sms);
-    gw_assert(msg_type(msg2) == sms);
-    
-    if (msg1->sms.priority > msg2->sms.priority)
-        ret = 1;
-    else if (msg1->sms.priority < msg2->sms.priority)
-        ret = -1;
-    else {
-        if (msg1->sms.time > msg2->sms.time)
-            ret = 1;
-        else if (msg1->sms.time < msg2->sms.time)
-            ret = -1;
-        else
-            ret = 0;
-    }
-    
-    return ret;
+    Msg *msg = (Msg*)a;
+    gw_assert(msg_type(msg) == sms);
+
+    /* SMS_PARAM_UNDEFINED is -1 */
+    return msg->sms.priority + 1;
 }
 
 
@@ -197,10 +197,15 @@ List *sms_split(Msg *orig, Octstr *header, Octstr *footer,
 void prepend_catenation_udh(Msg *sms, int part_no, int num_messages, int msg_sequence);
 
 /**
- * Compare priority and time of two sms's.
- * @return -1 of a < b; 0 a = b; 1 a > b
+ * Number of priority levels of sms's, for gw_prioqueue_create_levels:
+ * undefined priority, and priorities 0 to 3.
  */
-int sms_priority_compare(const void *a, const void *b);
+#define SMS_PRIORITY_LEVELS 5
+
+/**
+ * Return the priority level of an sms, 0 for undefined priority.
+ */
+int sms_priority_level(const void *a);
 
 /*
  * Re-encode an SMSmessage , based on the 'charset' that defines the content
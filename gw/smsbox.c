@@ -58,6 +58,7 @@
  * smsbox.c - main program of the smsbox
  */
 
+#include <ctype.h>
 #include <errno.h>
 #include <unistd.h>
 #include <signal.h>
@@ -69,6 +70,7 @@
 #include <libxml/parser.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
+#include <libxml/xmlreader.h>
 
 #include "gwlib/gwlib.h"
 #include "gwlib/regex.h"
@@ -121,6 +123,7 @@ static Octstr *smsbox_id = NULL;
 static Octstr *sendsms_url = NULL;
 static Octstr *sendota_url = NULL;
 static Octstr *xmlrpc_url = NULL;
+static Octstr *sendsms_batch_url = NULL;
 static Octstr *bb_host;
 static Octstr *accepted_chars = NULL;
 static int only_try_http = 0;
@@ -141,7 +144,7 @@ static long max_http_retries = HTTP_MAX_RETRIES;
 static long http_queue_delay = HTTP_RETRY_DELAY;
 static Octstr *ppg_service_name = NULL;
 
-static List *smsbox_requests = NULL;      /* the inbound request queue */
+static gw_queue_t *smsbox_requests = NULL;      /* the inbound request queue */
 static List *smsbox_http_requests = NULL; /* the outbound HTTP request queue */
 
 /* Timerset for the HTTP retry mechanism. */
@@ -159,6 +162,34 @@ static int immediate_sendsms_reply = 0;
 static Dict *client_dict = NULL;
 static List *sendsms_reply_hdrs = NULL;
 
+/*
+ * A sendsms batch request and its messages. The HTTP reply is sent
+ * once all messages have been read from the request body and, for
+ * delayed replies, bearerbox has acknowledged all accepted messages.
+ */
+typedef struct {
+    HTTPClient *client;
+    Mutex *lock;
+    int json;           /* reply with JSON, otherwise XML */
+    int reading;        /* still reading messages from the body */
+    long pending;       /* accepted messages waiting for an ACK */
+    int status;         /* HTTP status of the reply */
+    Octstr *error;      /* why the rest of the body was not handled */
+    List *items;        /* BatchItem, in request order */
+} SendsmsBatch;
+
+typedef struct {
+    SendsmsBatch *batch;
+    Octstr *id;
+    int status;
+    Octstr *answer;
+} BatchItem;
+
+/* for delayed batch answers. Dict key is uuid, value is BatchItem */
+static Dict *batch_dict = NULL;
+
+static void batch_item_ack(BatchItem *item, int status, Octstr *answer);
+
 /***********************************************************************
  * Communication with the bearerbox.
  */
@@ -179,12 +210,44 @@ static void identify_to_bearerbox(void)
     write_to_bearerbox(msg);
 }
 
+/*
+ * Map the ACK bearerbox sent for a message to the HTTP status and answer
+ * for the sendsms client.
+ */
+static int ack_to_http_status(Msg *msg, Octstr **answer)
+{
+    /* XXX  this should be fixed so that we really wait for DLR
+     *      SMSC accept/deny before doing this - but that is far
+     *      more slower, a bit more complex, and is done later on
+     */
+
+    switch (msg->ack.nack) {
+      case ack_success:
+        *answer = octstr_create("0: Accepted for delivery");
+        return HTTP_ACCEPTED;
+      case ack_buffered:
+        *answer = octstr_create("3: Queued for later delivery");
+        return HTTP_ACCEPTED;
+      case ack_failed:
+        *answer = octstr_create("Not routable. Do not try again.");
+        return HTTP_FORBIDDEN;
+      case ack_failed_tmp:
+        *answer = octstr_create("Temporal failure, try again later.");
+        return HTTP_SERVICE_UNAVAILABLE;
+      default:
+	error(0, "Strange reply from bearerbox!");
+        *answer = octstr_create("Temporal failure, try again later.");
+        return HTTP_SERVICE_UNAVAILABLE;
+    }
+}
+
 /*
  * Handle delayed reply to HTTP sendsms client, if any
  */
 static void delayed_http_reply(Msg *msg)
 {
     HTTPClient *client;
+    BatchItem *item;
     Octstr *os, *answer;
     char id[UUID_STR_LEN + 1];
     int status;
@@ -194,39 +257,18 @@ static void delayed_http_reply(Msg *msg)
     debug("sms.http", 0, "Got ACK (%ld) of %s", msg->ack.nack, octstr_get_cstr(os));
     client = dict_remove(client_dict, os);
     if (client == NULL) {
-        debug("sms.http", 0, "No client - multi-send or ACK to pull-reply");
+        item = dict_remove(batch_dict, os);
         octstr_destroy(os);
+        if (item == NULL) {
+            debug("sms.http", 0, "No client - multi-send or ACK to pull-reply");
+            return;
+        }
+        status = ack_to_http_status(msg, &answer);
+        batch_item_ack(item, status, answer);
         return;
     }
-    /* XXX  this should be fixed so that we really wait for DLR
-     *      SMSC accept/deny before doing this - but that is far
-     *      more slower, a bit more complex, and is done later on
-     */
-
-    switch (msg->ack.nack) {
-      case ack_success:
-        status = HTTP_ACCEPTED;
-        answer = octstr_create("0: Accepted for delivery");
-        break;
-      case ack_buffered:
-        status = HTTP_ACCEPTED;
-        answer = octstr_create("3: Queued for later delivery");
-        break;
-      case ack_failed:
-        status = HTTP_FORBIDDEN;
-        answer = octstr_create("Not routable. Do not try again.");
-        break;
-      case ack_failed_tmp:
-        status = HTTP_SERVICE_UNAVAILABLE;
-        answer = octstr_create("Temporal failure, try again later.");
-        break;
-      default:
-	error(0, "Strange reply from bearerbox!");
-        status = HTTP_SERVICE_UNAVAILABLE;
-        answer = octstr_create("Temporal failure, try again later.");
-        break;
-    }
 
+    status = ack_to_http_status(msg, &answer);
     http_send_reply(client, status, sendsms_reply_hdrs, answer);
 
     octstr_destroy(answer);
@@ -236,8 +278,8 @@ static void delayed_http_reply(Msg *msg)
 
 /*
  * Read an Msg from the bearerbox and send it to the proper receiver
- * via a List. At the moment all messages are sent to the smsbox_requests
- * List.
+ * via a queue. At the moment all messages are sent to the smsbox_requests
+ * queue.
  */
 static void read_messages_from_bearerbox(void)
 {
@@ -280,7 +322,7 @@ static void read_messages_from_bearerbox(void)
 	    if (total == 0)
 		start = time(NULL);
 	    total++;
-	    gwlist_produce(smsbox_requests, msg);
+	    gw_queue_produce(smsbox_requests, msg);
 	} else if (msg_type(msg) == ack) {
 	    if (!immediate_sendsms_reply)
 		delayed_http_reply(msg);
@@ -1650,8 +1692,10 @@ static void obey_request_thread(void *arg)
     URLTranslation *trans;
     Octstr *p;
     int ret, dreport=0;
+    gw_arena_t *arena;
 
-    while ((msg = gwlist_consume(smsbox_requests)) != NULL) {
+    while ((msg = gw_queue_consume(smsbox_requests)) != NULL) {
+        arena = gw_arena_begin();
 
     	if (msg->sms.sms_type == report_mo)
     	    dreport = 1;
@@ -1687,6 +1731,7 @@ static void obey_request_thread(void *arg)
             write_to_bearerbox(mack);
 
     	    msg_destroy(msg);
+    	    gw_arena_end(arena);
     	    continue;
     	}
 
@@ -1805,6 +1850,7 @@ error:
         write_to_bearerbox(mack); /* implicit msg_destroy */
 
         msg_destroy(msg);
+        gw_arena_end(arena);
     }
 }
 
@@ -1949,8 +1995,13 @@ static Octstr* store_uuid(Msg *msg)
 
 
 
+/*
+ * Check and send one sendsms request. If item is not NULL, the message
+ * is part of a batch and its ACK is delivered to the batch instead of
+ * replying to client.
+ */
 static Octstr *smsbox_req_handle(URLTranslation *t, Octstr *client_ip,
-				 HTTPClient *client,
+				 HTTPClient *client, BatchItem *item,
 				 Octstr *from, Octstr *to, Octstr *text, 
 				 Octstr *charset, Octstr *udh, Octstr *smsc,
 				 int mclass, int mwi, int coding, int compress, 
@@ -2296,9 +2347,22 @@ static Octstr *smsbox_req_handle(URLTranslation *t, Octstr *client_ip,
      */
     failed_id = gwlist_create();
 
+    if (item != NULL) {
+        char id[UUID_STR_LEN + 1];
+
+        uuid_unparse(msg->sms.id, id);
+        item->id = octstr_create(id);
+    }
+
     if (!immediate_sendsms_reply) {
         stored_uuid = store_uuid(msg);
-        dict_put(client_dict, stored_uuid, client);
+        if (item != NULL) {
+            mutex_lock(item->batch->lock);
+            item->batch->pending++;
+            mutex_unlock(item->batch->lock);
+            dict_put(batch_dict, stored_uuid, item);
+        } else
+            dict_put(client_dict, stored_uuid, client);
     }
 
     while ((receiv = gwlist_extract_first(allowed)) != NULL) {
@@ -2371,8 +2435,15 @@ transmit_error:
     *status = HTTP_INTERNAL_SERVER_ERROR;
     returnerror = octstr_create("Sending failed.");
 
-    if (!immediate_sendsms_reply)
-        dict_remove(client_dict, stored_uuid);
+    if (!immediate_sendsms_reply) {
+        if (item == NULL)
+            dict_remove(client_dict, stored_uuid);
+        else if (dict_remove(batch_dict, stored_uuid) != NULL) {
+            mutex_lock(item->batch->lock);
+            item->batch->pending--;
+            mutex_unlock(item->batch->lock);
+        }
+    }
 
     /* 
      * Append all receivers to the returned body in case this is
@@ -2459,13 +2530,14 @@ static URLTranslation *authorise_user(List *list, Octstr *client_ip)
 
 
 /*
- * Create and send an SMS message from an HTTP request.
+ * Create and send an SMS message from CGI parameters for an already
+ * authorised sendsms user.
  * Args: args contains the CGI parameters
  */
-static Octstr *smsbox_req_sendsms(List *args, Octstr *client_ip, int *status,
-				  HTTPClient *client)
+static Octstr *smsbox_req_sendsms_args(URLTranslation *t, List *args,
+                                       Octstr *client_ip, int *status,
+                                       HTTPClient *client, BatchItem *item)
 {
-    URLTranslation *t = NULL;
     Octstr *tmp_string;
     Octstr *from, *to, *charset, *text, *udh, *smsc, *dlr_url, *account;
     Octstr *binfo, *meta_data;
@@ -2476,13 +2548,6 @@ static Octstr *smsbox_req_sendsms(List *args, Octstr *client_ip, int *status,
     mclass = mwi = coding = compress = validity = deferred = dlr_mask = 
         pid = alt_dcs = rpi = priority = SMS_PARAM_UNDEFINED;
  
-    /* check the username and password */
-    t = authorise_user(args, client_ip);
-    if (t == NULL) {
-	*status = HTTP_FORBIDDEN;
-	return octstr_create("Authorization failed for sendsms");
-    }
-    
     udh = http_cgi_variable(args, "udh");
     text = http_cgi_variable(args, "text");
     charset = http_cgi_variable(args, "charset");
@@ -2563,7 +2628,7 @@ static Octstr *smsbox_req_sendsms(List *args, Octstr *client_ip, int *status,
 	return octstr_create("Empty receiver number not allowed, rejected");
     }
 
-    return smsbox_req_handle(t, client_ip, client, from, to, text, charset, udh,
+    return smsbox_req_handle(t, client_ip, client, item, from, to, text, charset, udh,
 			     smsc, mclass, mwi, coding, compress, validity, 
 			     deferred, status, dlr_mask, dlr_url, account,
 			     pid, alt_dcs, rpi, NULL, binfo, priority, meta_data);
@@ -2571,6 +2636,26 @@ static Octstr *smsbox_req_sendsms(List *args, Octstr *client_ip, int *status,
 }
 
 
+/*
+ * Create and send an SMS message from an HTTP request.
+ * Args: args contains the CGI parameters
+ */
+static Octstr *smsbox_req_sendsms(List *args, Octstr *client_ip, int *status,
+				  HTTPClient *client)
+{
+    URLTranslation *t = NULL;
+
+    /* check the username and password */
+    t = authorise_user(args, client_ip);
+    if (t == NULL) {
+	*status = HTTP_FORBIDDEN;
+	return octstr_create("Authorization failed for sendsms");
+    }
+
+    return smsbox_req_sendsms_args(t, args, client_ip, status, client, NULL);
+}
+
+
 /*
  * Create and send an SMS message from an HTTP request.
  * Args: args contains the CGI parameters
@@ -2666,7 +2751,7 @@ static Octstr *smsbox_sendsms_post(List *headers, Octstr *body,
 	}
 
 	if (ret == NULL)
-	    ret = smsbox_req_handle(t, client_ip, client, from, to, body, charset,
+	    ret = smsbox_req_handle(t, client_ip, client, NULL, from, to, body, charset,
 				    udh, smsc, mclass, mwi, coding, compress, 
 				    validity, deferred, status, dlr_mask, 
 				    dlr_url, account, pid, alt_dcs, rpi, tolist,
@@ -3150,22 +3235,768 @@ error:
 }
 
 
+/***********************************************************************
+ * Batch sendsms: many messages in one POST body.
+ *
+ * The body is either a JSON array of objects or an XML document of the
+ * form <messages><message>...</message>...</messages>. The members of
+ * an object (child elements of <message>) have the same names and
+ * meaning as the sendsms CGI variables; CGI variables given in the URL
+ * apply to all messages that don't set them. The user is authorised once
+ * for the whole request and each message is sent to bearerbox as soon as
+ * it has been read from the body. The HTTP server hands us the whole
+ * body and the result of every message is kept until the reply is sent,
+ * so memory still grows with the size of the batch.
+ */
+
+static SendsmsBatch *batch_create(HTTPClient *client, int json)
+{
+    SendsmsBatch *batch;
+
+    batch = gw_malloc(sizeof(*batch));
+    batch->client = client;
+    batch->lock = mutex_create();
+    batch->json = json;
+    batch->reading = 1;
+    batch->pending = 0;
+    batch->status = HTTP_ACCEPTED;
+    batch->error = NULL;
+    batch->items = gwlist_create();
+
+    return batch;
+}
+
+
+static void batch_item_destroy(void *p)
+{
+    BatchItem *item = p;
+
+    octstr_destroy(item->id);
+    octstr_destroy(item->answer);
+    gw_free(item);
+}
+
+
+static void batch_destroy(SendsmsBatch *batch)
+{
+    gwlist_destroy(batch->items, batch_item_destroy);
+    octstr_destroy(batch->error);
+    mutex_destroy(batch->lock);
+    gw_free(batch);
+}
+
+
+static BatchItem *batch_item_create(SendsmsBatch *batch)
+{
+    BatchItem *item;
+
+    item = gw_malloc(sizeof(*item));
+    item->batch = batch;
+    item->id = NULL;
+    item->status = HTTP_ACCEPTED;
+    item->answer = NULL;
+    gwlist_append(batch->items, item);
+
+    return item;
+}
+
+
+static void json_append_string(Octstr *os, Octstr *str)
+{
+    long i;
+    int c;
+
+    octstr_append_char(os, '"');
+    for (i = 0; i < octstr_len(str); i++) {
+        c = octstr_get_char(str, i);
+        if (c == '"' || c == '\\')
+            octstr_format_append(os, "\\%c", c);
+        else if (c < 0x20)
+            octstr_format_append(os, "\\u%04x", c);
+        else
+            octstr_append_char(os, c);
+    }
+    octstr_append_char(os, '"');
+}
+
+
+static void xml_append_string(Octstr *os, Octstr *str)
+{
+    long i;
+    int c;
+
+    for (i = 0; i < octstr_len(str); i++) {
+        c = octstr_get_char(str, i);
+        if (c == '&')
+            octstr_append_cstr(os, "&amp;");
+        else if (c == '<')
+            octstr_append_cstr(os, "&lt;");
+        else if (c == '>')
+            octstr_append_cstr(os, "&gt;");
+        else
+            octstr_append_char(os, c);
+    }
+}
+
+
+/*
+ * Send the reply with the results of all messages and destroy the batch.
+ */
+static void batch_send_reply(SendsmsBatch *batch)
+{
+    List *headers;
+    Octstr *reply;
+    BatchItem *item;
+    long i;
+
+    headers = http_create_empty_headers();
+    http_header_add(headers, "Content-type",
+                    batch->json ? "application/json" : "text/xml");
+    http_header_add(headers, "Pragma", "no-cache");
+    http_header_add(headers, "Cache-Control", "no-cache");
+
+    reply = octstr_create(batch->json ? "[" : "<results>");
+    for (i = 0; i < gwlist_len(batch->items); i++) {
+        item = gwlist_get(batch->items, i);
+        if (item->status != HTTP_ACCEPTED && batch->status == HTTP_ACCEPTED)
+            batch->status = HTTP_OK;
+        debug("sms.http", 0, "Batch message %ld Status: %d Answer: <%s>", i,
+              item->status, item->answer ? octstr_get_cstr(item->answer) : "");
+        if (batch->json) {
+            octstr_append_cstr(reply, i > 0 ? ",{\"id\":" : "{\"id\":");
+            json_append_string(reply, item->id ? item->id : octstr_imm(""));
+            octstr_format_append(reply, ",\"status\":%d,\"message\":", item->status);
+            json_append_string(reply, item->answer ? item->answer : octstr_imm(""));
+            octstr_append_char(reply, '}');
+        } else {
+            octstr_append_cstr(reply, "<result><id>");
+            xml_append_string(reply, item->id);
+            octstr_format_append(reply, "</id><status>%d</status><message>",
+                                 item->status);
+            xml_append_string(reply, item->answer);
+            octstr_append_cstr(reply, "</message></result>");
+        }
+    }
+    if (batch->error != NULL) {
+        /* report what stopped us reading as a last entry */
+        if (batch->json) {
+            octstr_append_cstr(reply, i > 0 ? ",{\"error\":" : "{\"error\":");
+            json_append_string(reply, batch->error);
+            octstr_append_char(reply, '}');
+        } else {
+            octstr_append_cstr(reply, "<error>");
+            xml_append_string(reply, batch->error);
+            octstr_append_cstr(reply, "</error>");
+        }
+    }
+    octstr_append_cstr(reply, batch->json ? "]" : "</results>");
+
+    debug("sms.http", 0, "Batch of %ld messages done, status %d",
+          gwlist_len(batch->items), batch->status);
+    http_send_reply(batch->client, batch->status, headers, reply);
+
+    octstr_destroy(reply);
+    http_destroy_headers(headers);
+    batch_destroy(batch);
+}
+
+
+/*
+ * Called when bearerbox has acknowledged a message of the batch.
+ */
+static void batch_item_ack(BatchItem *item, int status, Octstr *answer)
+{
+    SendsmsBatch *batch = item->batch;
+    int done;
+
+    mutex_lock(batch->lock);
+    octstr_destroy(item->answer);
+    item->answer = answer;
+    item->status = status;
+    batch->pending--;
+    done = !batch->reading && batch->pending == 0;
+    mutex_unlock(batch->lock);
+
+    if (done)
+        batch_send_reply(batch);
+}
+
+
+/*
+ * bearerbox is gone, so the ACKs the batches wait for will not come.
+ * Fail the messages still waiting and, if reply is set, answer their
+ * batches, otherwise just close the connections.
+ */
+static void batch_abort_pending(int reply)
+{
+    SendsmsBatch *batch;
+    BatchItem *item;
+    List *keys;
+    Octstr *key;
+    int done;
+
+    keys = dict_keys(batch_dict);
+    while ((key = gwlist_extract_first(keys)) != NULL) {
+        item = dict_remove(batch_dict, key);
+        octstr_destroy(key);
+        if (item == NULL)
+            continue;
+        if (reply) {
+            batch_item_ack(item, HTTP_SERVICE_UNAVAILABLE,
+                           octstr_create("Temporal failure, try again later."));
+            continue;
+        }
+        batch = item->batch;
+        mutex_lock(batch->lock);
+        batch->pending--;
+        done = !batch->reading && batch->pending == 0;
+        mutex_unlock(batch->lock);
+        if (done) {
+            http_close_client(batch->client);
+            batch_destroy(batch);
+        }
+    }
+    gwlist_destroy(keys, octstr_destroy_item);
+}
+
+
+/*
+ * All messages have been read from the body. Reply now, unless we are
+ * still waiting for bearerbox to acknowledge some of them.
+ */
+static void batch_finish(SendsmsBatch *batch)
+{
+    int done;
+
+    mutex_lock(batch->lock);
+    batch->reading = 0;
+    done = batch->pending == 0;
+    mutex_unlock(batch->lock);
+
+    if (done)
+        batch_send_reply(batch);
+}
+
+
+/*
+ * Send one message of the batch. fields are the values given for this
+ * message, defaults the ones that apply to all messages.
+ */
+static void batch_send_message(SendsmsBatch *batch, URLTranslation *t,
+                               List *fields, List *defaults, Octstr *client_ip)
+{
+    BatchItem *item;
+    List *args;
+    Octstr *answer;
+    long i;
+    int status;
+
+    mutex_lock(batch->lock);
+    item = batch_item_create(batch);
+    mutex_unlock(batch->lock);
+
+    /* http_cgi_variable returns the first match, so our own fields win */
+    args = gwlist_create();
+    for (i = 0; i < gwlist_len(fields); i++)
+        gwlist_append(args, gwlist_get(fields, i));
+    for (i = 0; i < gwlist_len(defaults); i++)
+        gwlist_append(args, gwlist_get(defaults, i));
+
+    if (http_cgi_variable(args, "to") == NULL) {
+        status = HTTP_BAD_REQUEST;
+        answer = octstr_create("Missing receiver number, rejected");
+    } else
+        answer = smsbox_req_sendsms_args(t, args, client_ip, &status, NULL, item);
+    gwlist_destroy(args, NULL);
+
+    /*
+     * If bearerbox has to acknowledge the message first, the answer
+     * comes with the ACK (which may have arrived already).
+     */
+    if (!immediate_sendsms_reply && status == HTTP_ACCEPTED) {
+        octstr_destroy(answer);
+        return;
+    }
+    mutex_lock(batch->lock);
+    octstr_destroy(item->answer);
+    item->answer = answer;
+    item->status = status;
+    mutex_unlock(batch->lock);
+}
+
+
+/*
+ * Add a field of a batch message. Several receivers are joined to one
+ * multi-cast "to" value, for everything else the first value counts.
+ */
+static void batch_add_field(List *fields, Octstr *name, Octstr *value)
+{
+    HTTPCGIVar *v;
+    long i;
+
+    for (i = 0; i < gwlist_len(fields); i++) {
+        v = gwlist_get(fields, i);
+        if (octstr_compare(v->name, name) != 0)
+            continue;
+        if (octstr_str_compare(name, "to") == 0)
+            octstr_format_append(v->value, " %S", value);
+        octstr_destroy(name);
+        octstr_destroy(value);
+        return;
+    }
+
+    v = gw_malloc(sizeof(*v));
+    v->name = name;
+    v->value = value;
+    gwlist_append(fields, v);
+}
+
+
+/*
+ * A minimal pull parser for the JSON body. We only need strings, numbers,
+ * booleans and arrays of those as member values.
+ */
+static void json_skip_blanks(Octstr *body, long *pos)
+{
+    while (*pos < octstr_len(body) && isspace(octstr_get_char(body, *pos)))
+        (*pos)++;
+}
+
+
+static int json_next_char(Octstr *body, long *pos)
+{
+    json_skip_blanks(body, pos);
+    return octstr_get_char(body, *pos);
+}
+
+
+/*
+ * Read the 4 hex digits of a \u escape at pos. Return -1 if there are none.
+ */
+static long json_read_hex4(Octstr *body, long pos)
+{
+    long i, value;
+    int c;
+
+    value = 0;
+    for (i = 0; i < 4; i++) {
+        c = octstr_get_char(body, pos + i);
+        if (c == -1 || !isxdigit(c))
+            return -1;
+        value = value * 16 + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+    }
+    return value;
+}
+
+
+static void append_utf8(Octstr *str, long c)
+{
+    if (c < 0x80)
+        octstr_append_char(str, c);
+    else if (c < 0x800) {
+        octstr_append_char(str, 0xc0 | (c >> 6));
+        octstr_append_char(str, 0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+        octstr_append_char(str, 0xe0 | (c >> 12));
+        octstr_append_char(str, 0x80 | ((c >> 6) & 0x3f));
+        octstr_append_char(str, 0x80 | (c & 0x3f));
+    } else {
+        octstr_append_char(str, 0xf0 | (c >> 18));
+        octstr_append_char(str, 0x80 | ((c >> 12) & 0x3f));
+        octstr_append_char(str, 0x80 | ((c >> 6) & 0x3f));
+        octstr_append_char(str, 0x80 | (c & 0x3f));
+    }
+}
+
+
+static Octstr *json_read_string(Octstr *body, long *pos)
+{
+    Octstr *str;
+    long start, c, low;
+
+    if (octstr_get_char(body, *pos) != '"')
+        return NULL;
+    (*pos)++;
+
+    str = octstr_create("");
+    for (;;) {
+        /* copy runs of plain characters in one go */
+        start = *pos;
+        while ((c = octstr_get_char(body, *pos)) != '"' && c != '\\' && c >= 0x20)
+            (*pos)++;
+        octstr_append_data(str, octstr_get_cstr(body) + start, *pos - start);
+        (*pos)++;
+        if (c == '"')
+            break;
+        if (c != '\\')
+            goto error;
+
+        switch ((c = octstr_get_char(body, (*pos)++))) {
+        case '"': case '\\': case '/':
+            octstr_append_char(str, c);
+            break;
+        case 'b': octstr_append_char(str, '\b'); break;
+        case 'f': octstr_append_char(str, '\f'); break;
+        case 'n': octstr_append_char(str, '\n'); break;
+        case 'r': octstr_append_char(str, '\r'); break;
+        case 't': octstr_append_char(str, '\t'); break;
+        case 'u':
+            if ((c = json_read_hex4(body, *pos)) == -1)
+                goto error;
+            *pos += 4;
+            /* surrogate pair */
+            if (c >= 0xd800 && c < 0xdc00 &&
+                octstr_get_char(body, *pos) == '\\' &&
+                octstr_get_char(body, *pos + 1) == 'u' &&
+                (low = json_read_hex4(body, *pos + 2)) >= 0xdc00 && low < 0xe000) {
+                c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+                *pos += 6;
+            }
+            append_utf8(str, c);
+            break;
+        default:
+            goto error;
+        }
+    }
+    return str;
+
+error:
+    octstr_destroy(str);
+    return NULL;
+}
+
+
+/*
+ * Read a member value. Return NULL for errors, the value "null" is
+ * returned as an empty string with *is_null set.
+ */
+static Octstr *json_read_value(Octstr *body, long *pos, int *is_null)
+{
+    Octstr *value, *elem;
+    long start;
+    int c;
+
+    *is_null = 0;
+    c = json_next_char(body, pos);
+    if (c == '"')
+        return json_read_string(body, pos);
+
+    if (c == '[') {
+        /* array of receivers (or other values), joined with blanks */
+        (*pos)++;
+        value = octstr_create("");
+        if (json_next_char(body, pos) == ']') {
+            (*pos)++;
+            return value;
+        }
+        for (;;) {
+            if (json_next_char(body, pos) == '[' ||
+                (elem = json_read_value(body, pos, is_null)) == NULL) {
+                octstr_destroy(value);
+                return NULL;
+            }
+            if (octstr_len(value) > 0)
+                octstr_append_char(value, ' ');
+            octstr_append(value, elem);
+            octstr_destroy(elem);
+            c = json_next_char(body, pos);
+            (*pos)++;
+            if (c == ']')
+                break;
+            if (c != ',') {
+                octstr_destroy(value);
+                return NULL;
+            }
+        }
+        *is_null = 0;
+        return value;
+    }
+
+    /* number or literal */
+    start = *pos;
+    while ((c = octstr_get_char(body, *pos)) != -1 &&
+           (isalnum(c) || c == '-' || c == '+' || c == '.'))
+        (*pos)++;
+    value = octstr_copy(body, start, *pos - start);
+    if (octstr_str_compare(value, "true") == 0) {
+        octstr_destroy(value);
+        return octstr_create("1");
+    }
+    if (octstr_str_compare(value, "false") == 0) {
+        octstr_destroy(value);
+        return octstr_create("0");
+    }
+    if (octstr_str_compare(value, "null") == 0) {
+        *is_null = 1;
+        octstr_truncate(value, 0);
+        return value;
+    }
+    if (octstr_len(value) == 0 ||
+        strspn(octstr_get_cstr(value), "0123456789-+.eE") != octstr_len(value)) {
+        octstr_destroy(value);
+        return NULL;
+    }
+    return value;
+}
+
+
+/*
+ * Read one JSON object into a list of HTTPCGIVar. Return NULL for errors.
+ */
+static List *json_read_object(Octstr *body, long *pos)
+{
+    List *fields;
+    Octstr *name, *value;
+    int c, is_null;
+
+    if (json_next_char(body, pos) != '{')
+        return NULL;
+    (*pos)++;
+
+    fields = gwlist_create();
+    if (json_next_char(body, pos) == '}') {
+        (*pos)++;
+        return fields;
+    }
+    for (;;) {
+        json_skip_blanks(body, pos);
+        if ((name = json_read_string(body, pos)) == NULL)
+            goto error;
+        if (json_next_char(body, pos) != ':') {
+            octstr_destroy(name);
+            goto error;
+        }
+        (*pos)++;
+        if ((value = json_read_value(body, pos, &is_null)) == NULL) {
+            octstr_destroy(name);
+            goto error;
+        }
+        if (is_null) {
+            octstr_destroy(name);
+            octstr_destroy(value);
+        } else
+            batch_add_field(fields, name, value);
+
+        c = json_next_char(body, pos);
+        (*pos)++;
+        if (c == '}')
+            return fields;
+        if (c != ',')
+            goto error;
+    }
+
+error:
+    http_destroy_cgiargs(fields);
+    return NULL;
+}
+
+
+/*
+ * Read and send the messages of a JSON body one by one. Return NULL
+ * if the whole body was read, otherwise the reason why not.
+ */
+static Octstr *batch_read_json(SendsmsBatch *batch, URLTranslation *t,
+                               Octstr *body, List *defaults, Octstr *client_ip)
+{
+    List *fields;
+    long pos;
+    int c;
+
+    pos = 0;
+    if (json_next_char(body, &pos) != '[')
+        return octstr_create("JSON body must be an array of messages");
+    pos++;
+
+    if (json_next_char(body, &pos) == ']')
+        pos++;
+    else {
+        for (;;) {
+            if ((fields = json_read_object(body, &pos)) == NULL)
+                return octstr_format("JSON syntax error in message at offset %ld", pos);
+            batch_send_message(batch, t, fields, defaults, client_ip);
+            http_destroy_cgiargs(fields);
+
+            c = json_next_char(body, &pos);
+            pos++;
+            if (c == ']')
+                break;
+            if (c != ',')
+                return octstr_format("JSON syntax error at offset %ld", pos - 1);
+        }
+    }
+
+    if (json_next_char(body, &pos) != -1)
+        return octstr_format("Garbage after JSON array at offset %ld", pos);
+    return NULL;
+}
+
+
+/*
+ * Read and send the messages of a XML body one by one. We use the
+ * libxml2 reader interface, which doesn't build a document tree.
+ */
+static Octstr *batch_read_xml(SendsmsBatch *batch, URLTranslation *t,
+                              Octstr *body, List *defaults, Octstr *client_ip)
+{
+    xmlTextReaderPtr reader;
+    const xmlChar *name;
+    xmlChar *text;
+    List *fields = NULL;
+    Octstr *reason = NULL;
+    int ret = 0, type, depth;
+
+    reader = xmlReaderForMemory(octstr_get_cstr(body), octstr_len(body),
+                                NULL, NULL, XML_PARSE_NONET);
+    if (reader == NULL)
+        return octstr_create("Could not parse XML body");
+
+    while (reason == NULL && (ret = xmlTextReaderRead(reader)) == 1) {
+        type = xmlTextReaderNodeType(reader);
+        depth = xmlTextReaderDepth(reader);
+        name = xmlTextReaderConstLocalName(reader);
+
+        if (type == XML_READER_TYPE_ELEMENT) {
+            if (depth == 0 && xmlStrcmp(name, BAD_CAST "messages") != 0)
+                reason = octstr_create("XML body must have a <messages> root element");
+            else if (depth == 1) {
+                if (xmlStrcmp(name, BAD_CAST "message") != 0)
+                    reason = octstr_format("Unexpected element <%s>", name);
+                else if (xmlTextReaderIsEmptyElement(reader)) {
+                    fields = gwlist_create();
+                    batch_send_message(batch, t, fields, defaults, client_ip);
+                    http_destroy_cgiargs(fields);
+                    fields = NULL;
+                } else
+                    fields = gwlist_create();
+            } else if (depth == 2 && fields != NULL) {
+                text = xmlTextReaderReadString(reader);
+                batch_add_field(fields, octstr_create((char *) name),
+                                octstr_create(text ? (char *) text : ""));
+                xmlFree(text);
+            }
+        } else if (type == XML_READER_TYPE_END_ELEMENT && depth == 1 &&
+                   fields != NULL) {
+            batch_send_message(batch, t, fields, defaults, client_ip);
+            http_destroy_cgiargs(fields);
+            fields = NULL;
+        }
+    }
+    if (reason == NULL && ret != 0)
+        reason = octstr_create("XML syntax error");
+
+    http_destroy_cgiargs(fields);
+    xmlFreeTextReader(reader);
+    return reason;
+}
+
+
+/*
+ * Handle a batch sendsms request. Return NULL if the reply is (or will
+ * be) sent by the batch, otherwise the answer for the client.
+ */
+static Octstr *smsbox_sendsms_batch(List *headers, Octstr *body, List *args,
+                                    Octstr *client_ip, int *status,
+                                    HTTPClient *client)
+{
+    URLTranslation *t;
+    SendsmsBatch *batch;
+    Octstr *type, *charset, *user, *pass, *reason;
+    HTTPCGIVar *v;
+    List *defaults;
+    gw_arena_t *arena;
+    int json;
+
+    http_header_get_content_type(headers, &type, &charset);
+    if (octstr_case_compare(type, octstr_imm("application/json")) == 0)
+        json = 1;
+    else if (octstr_case_compare(type, octstr_imm("text/xml")) == 0 ||
+             octstr_case_compare(type, octstr_imm("application/xml")) == 0)
+        json = 0;
+    else {
+        octstr_destroy(type);
+        octstr_destroy(charset);
+        *status = HTTP_UNSUPPORTED_MEDIA_TYPE;
+        return octstr_create("Unsupported content-type, rejected");
+    }
+    octstr_destroy(type);
+    octstr_destroy(charset);
+
+    /* authorise once, by CGI variables or X-Kannel headers */
+    if (http_cgi_variable(args, "username") != NULL ||
+        http_cgi_variable(args, "user") != NULL)
+        t = authorise_user(args, client_ip);
+    else {
+        user = http_header_find_first(headers, "X-Kannel-Username");
+        pass = http_header_find_first(headers, "X-Kannel-Password");
+        t = authorise_username(user, pass, client_ip);
+        octstr_destroy(user);
+        octstr_destroy(pass);
+    }
+    if (t == NULL) {
+        *status = HTTP_FORBIDDEN;
+        return octstr_create("Authorization failed for sendsms");
+    }
+
+    /* bodies are UTF-8, unless the URL says otherwise */
+    defaults = args;
+    v = NULL;
+    if (http_cgi_variable(args, "charset") == NULL) {
+        v = gw_malloc(sizeof(*v));
+        v->name = octstr_create("charset");
+        v->value = octstr_create("UTF-8");
+        gwlist_append(defaults, v);
+    }
+
+    /*
+     * the batch and the answers of its items are kept until bearerbox
+     * has acked every message, so they must not come from the arena
+     */
+    arena = gw_arena_suspend();
+    batch = batch_create(client, json);
+    if (json)
+        reason = batch_read_json(batch, t, body, defaults, client_ip);
+    else
+        reason = batch_read_xml(batch, t, body, defaults, client_ip);
+    if (reason != NULL) {
+        error(0, "sendsms batch: %s", octstr_get_cstr(reason));
+        batch->error = reason;
+        batch->status = HTTP_BAD_REQUEST;
+    }
+    info(0, "sendsms batch of %ld messages from <%s>",
+         gwlist_len(batch->items), octstr_get_cstr(client_ip));
+
+    *status = HTTP_ACCEPTED;
+    batch_finish(batch);
+    gw_arena_resume(arena);
+    return NULL;
+}
+
+
 static void sendsms_thread(void *arg)
  {
     HTTPClient *client;
+    HTTPRequest *req;
     Octstr *ip, *url, *body, *answer;
-    List *hdrs, *args;
     int status;
+    gw_arena_t *arena;
     
     for (;;) {
-    	/* reset request wars */
-    	ip = url = body = answer = NULL;
-    	hdrs = args = NULL;
-
-        client = http_accept_request(sendsms_port, &ip, &url, &hdrs, &body, &args);
+        client = http_accept_request_lazy(sendsms_port, &req);
         if (client == NULL)
             break;
 
+        /* most of what the request allocates is gone when it is answered */
+        arena = gw_arena_begin();
+
+        /*
+         * the request owns these; headers and CGI variables are only
+         * parsed by the branches that use them
+         */
+        ip = http_request_ip(req);
+        url = http_request_path(req);
+        body = http_request_body(req);
+        answer = NULL;
+
         info(0, "smsbox: Got HTTP request <%s> from <%s>",
                 octstr_get_cstr(url), octstr_get_cstr(ip));
 
@@ -3181,9 +4012,11 @@ static void sendsms_thread(void *arg)
              * related routine handle the checking
              */
             if (body == NULL)
-                answer = smsbox_req_sendsms(args, ip, &status, client);
+                answer = smsbox_req_sendsms(http_request_cgivars(req), ip,
+                                           &status, client);
             else
-                answer = smsbox_sendsms_post(hdrs, body, ip, &status, client);
+                answer = smsbox_sendsms_post(http_request_headers(req), body,
+                                             ip, &status, client);
         }
         /* XML-RPC */
         else if (octstr_compare(url, xmlrpc_url) == 0) {
@@ -3194,14 +4027,30 @@ static void sendsms_thread(void *arg)
                 answer = octstr_create("Incomplete request.");
                 status = HTTP_BAD_REQUEST;
             } else
-                answer = smsbox_xmlrpc_post(hdrs, body, ip, &status);
+                answer = smsbox_xmlrpc_post(http_request_headers(req), body,
+                                            ip, &status);
+        }
+        /* sendsms batch */
+        else if (octstr_compare(url, sendsms_batch_url) == 0) {
+            /*
+             * batch requests need to have a POST body
+             */
+            if (body == NULL) {
+                answer = octstr_create("Incomplete request.");
+                status = HTTP_BAD_REQUEST;
+            } else
+                answer = smsbox_sendsms_batch(http_request_headers(req), body,
+                                              http_request_cgivars(req), ip,
+                                              &status, client);
         }
         /* sendota */
         else if (octstr_compare(url, sendota_url) == 0) {
             if (body == NULL)
-                answer = smsbox_req_sendota(args, ip, &status, client);
+                answer = smsbox_req_sendota(http_request_cgivars(req), ip,
+                                           &status, client);
             else
-                answer = smsbox_sendota_post(hdrs, body, ip, &status, client);
+                answer = smsbox_sendota_post(http_request_headers(req), body,
+                                             ip, &status, client);
         }
         /* add aditional URI compares here */
         else {
@@ -3212,18 +4061,17 @@ static void sendsms_thread(void *arg)
         debug("sms.http", 0, "Status: %d Answer: <%s>", status,
                 octstr_get_cstr(answer));
 
-        octstr_destroy(ip);
-        octstr_destroy(url);
-        http_destroy_headers(hdrs);
-        octstr_destroy(body);
-        http_destroy_cgiargs(args);
+        http_request_destroy(req);
 
-        if (immediate_sendsms_reply || status != HTTP_ACCEPTED)
+        if (answer == NULL)
+            debug("sms.http", 0, "Batch reply - sent when all messages are done");
+        else if (immediate_sendsms_reply || status != HTTP_ACCEPTED)
             http_send_reply(client, status, sendsms_reply_hdrs, answer);
         else {
             debug("sms.http", 0, "Delayed reply - wait for bearerbox");
         }
         octstr_destroy(answer);
+        gw_arena_end(arena);
     }
 
 }
@@ -3429,6 +4277,8 @@ static Cfg *init_smsbox(Cfg *cfg)
         xmlrpc_url = octstr_imm("/cgi-bin/xmlrpc");
     if ((sendota_url = cfg_get(grp, octstr_imm("sendota-url"))) == NULL)
         sendota_url = octstr_imm("/cgi-bin/sendota");
+    if ((sendsms_batch_url = cfg_get(grp, octstr_imm("sendsms-batch-url"))) == NULL)
+        sendsms_batch_url = octstr_imm("/cgi-bin/sendsms-batch");
 
     global_sender = cfg_get(grp, octstr_imm("global-sender"));
     accepted_chars = cfg_get(grp, octstr_imm("sendsms-chars"));
@@ -3583,6 +4433,7 @@ int main(int argc, char **argv)
 	panic(0, "urltrans_add_cfg failed");
 
     client_dict = dict_create(32, NULL);
+    batch_dict = dict_create(1024, NULL);
     sendsms_reply_hdrs = http_create_empty_headers();
     http_header_add(sendsms_reply_hdrs, "Content-type", "text/html");
     http_header_add(sendsms_reply_hdrs, "Pragma", "no-cache");
@@ -3590,10 +4441,10 @@ int main(int argc, char **argv)
 
 
     caller = http_caller_create();
-    smsbox_requests = gwlist_create();
+    smsbox_requests = gw_queue_create(0);
     smsbox_http_requests = gwlist_create();
     timerset = gw_timerset_create();
-    gwlist_add_producer(smsbox_requests);
+    gw_queue_add_producer(smsbox_requests);
     gwlist_add_producer(smsbox_http_requests);
     num_outstanding_requests = counter_create();
     catenated_sms_counter = counter_create();
@@ -3615,9 +4466,12 @@ int main(int argc, char **argv)
     info(0, GW_NAME " smsbox terminating.");
 
     heartbeat_stop(ALL_HEARTBEATS);
+    batch_abort_pending(1);
     http_close_all_ports();
     gwthread_join_every(sendsms_thread);
-    gwlist_remove_producer(smsbox_requests);
+    /* batches started while we were closing the ports */
+    batch_abort_pending(0);
+    gw_queue_remove_producer(smsbox_requests);
     gwlist_remove_producer(smsbox_http_requests);
     gwthread_join_every(obey_request_thread);
     http_caller_signal_shutdown(caller);
@@ -3627,9 +4481,9 @@ int main(int argc, char **argv)
     close_connection_to_bearerbox();
     alog_close();
     urltrans_destroy(translations);
-    gw_assert(gwlist_len(smsbox_requests) == 0);
+    gw_assert(gw_queue_len(smsbox_requests) == 0);
     gw_assert(gwlist_len(smsbox_http_requests) == 0);
-    gwlist_destroy(smsbox_requests, NULL);
+    gw_queue_destroy(smsbox_requests, NULL);
     gwlist_destroy(smsbox_http_requests, NULL);
     http_caller_destroy(caller);
     gw_timerset_destroy(timerset);
@@ -3642,6 +4496,7 @@ int main(int argc, char **argv)
     octstr_destroy(sendsms_url);
     octstr_destroy(sendota_url);
     octstr_destroy(xmlrpc_url);
+    octstr_destroy(sendsms_batch_url);
     octstr_destroy(reply_emptymessage);
     octstr_destroy(reply_requestfailed);
     octstr_destroy(reply_couldnotfetch);
@@ -3656,6 +4511,7 @@ int main(int argc, char **argv)
     cfg_destroy(cfg);
 
     dict_destroy(client_dict); 
+    dict_destroy(batch_dict);
     http_destroy_headers(sendsms_reply_hdrs);
 
     /* 
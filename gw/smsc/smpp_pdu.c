@@ -79,10 +79,19 @@ struct smpp_tlv {
     enum { SMPP_TLV_OCTETS = 0, SMPP_TLV_NULTERMINATED = 1, SMPP_TLV_INTEGER = 2 } type;
 };
 
-/* Dict(smsc_id, Dict(tag, tlv)) */
-static Dict *tlvs_by_tag;
-/* Dict(smsc_id, Dict(tag_name, tlv)) */
-static Dict *tlvs_by_name;
+/*
+ * Configured TLVs of one smsc-id, with the default ones merged in, so
+ * that a PDU needs a single table lookup and then integer compares.
+ */
+struct smpp_tlv_table {
+    Dict *by_name;              /* Dict(tag_name, tlv) */
+    struct smpp_tlv **by_tag;   /* sorted by tag */
+    long num;
+};
+
+/* Dict(smsc_id, smpp_tlv_table) */
+static Dict *tlv_tables;
+static struct smpp_tlv_table *default_tlv_table;
 static List *tlvs;
 static int initialized;
 
@@ -95,70 +104,104 @@ static void smpp_tlv_destroy(struct smpp_tlv *tlv)
     gw_free(tlv);
 }
 
-static struct smpp_tlv *smpp_tlv_get_by_name(Octstr *smsc_id, Octstr *name)
+
+static struct smpp_tlv_table *smpp_tlv_table_create(void)
+{
+    struct smpp_tlv_table *table = gw_malloc(sizeof(*table));
+
+    table->by_name = dict_create(32, NULL);
+    table->by_tag = NULL;
+    table->num = 0;
+
+    return table;
+}
+
+
+static void smpp_tlv_table_destroy(void *p)
+{
+    struct smpp_tlv_table *table = p;
+
+    if (table == NULL)
+        return;
+    dict_destroy(table->by_name);
+    gw_free(table->by_tag);
+    gw_free(table);
+}
+
+
+static struct smpp_tlv *smpp_tlv_table_find_tag(struct smpp_tlv_table *table, long tag)
 {
-    struct smpp_tlv *res = NULL;
-    Dict *tmp_dict;
+    long lo, hi, mid;
 
-    if (tlvs_by_name == NULL || name == NULL)
+    if (table == NULL)
         return NULL;
 
-    if (smsc_id != NULL) {
-        tmp_dict = dict_get(tlvs_by_name, smsc_id);
-        if (tmp_dict != NULL)
-            res = dict_get(tmp_dict, name);
+    lo = 0;
+    hi = table->num - 1;
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (table->by_tag[mid]->tag == tag)
+            return table->by_tag[mid];
+        if (table->by_tag[mid]->tag < tag)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
     }
-    if (res == NULL) {
-        /* try default smsc_id */
-        smsc_id = octstr_imm(DEFAULT_SMSC_ID);
-        tmp_dict = dict_get(tlvs_by_name, smsc_id);
-        if (tmp_dict != NULL)
-            res = dict_get(tmp_dict, name);
-    }
-    return res;
+    return NULL;
+}
+
+
+/* insert tlv into by_tag, keeping it sorted */
+static void smpp_tlv_table_insert_tag(struct smpp_tlv_table *table, struct smpp_tlv *tlv)
+{
+    long i;
+
+    table->by_tag = gw_realloc(table->by_tag, (table->num + 1) * sizeof(*table->by_tag));
+    for (i = table->num; i > 0 && table->by_tag[i - 1]->tag > tlv->tag; i--)
+        table->by_tag[i] = table->by_tag[i - 1];
+    table->by_tag[i] = tlv;
+    table->num++;
 }
 
-static struct smpp_tlv *smpp_tlv_get_by_tag(Octstr *smsc_id, long tag)
+
+/* return the table for smsc_id, falling back to the default one */
+static struct smpp_tlv_table *smpp_tlv_table_get(Octstr *smsc_id)
 {
-    struct smpp_tlv *res = NULL;
-    Dict *tmp_dict;
-    Octstr *tmp;
+    struct smpp_tlv_table *table = NULL;
 
-    if (tlvs_by_tag == NULL)
+    if (tlv_tables == NULL)
         return NULL;
+    if (smsc_id != NULL)
+        table = dict_get(tlv_tables, smsc_id);
 
-    tmp = octstr_format("%ld", tag);
+    return (table != NULL ? table : default_tlv_table);
+}
 
-    if (smsc_id != NULL) {
-        tmp_dict = dict_get(tlvs_by_tag, smsc_id);
-        if (tmp_dict != NULL)
-            res = dict_get(tmp_dict, tmp);
-    }
-    if (res == NULL) {
-        /* try default smsc_id */
-        smsc_id = octstr_imm(DEFAULT_SMSC_ID);
-        tmp_dict = dict_get(tlvs_by_tag, smsc_id);
-        if (tmp_dict != NULL)
-            res = dict_get(tmp_dict, tmp);
-    }
 
-    octstr_destroy(tmp);
+static struct smpp_tlv *smpp_tlv_get_by_name(struct smpp_tlv_table *table, Octstr *name)
+{
+    if (table == NULL || name == NULL)
+        return NULL;
 
-    return res;
+    return dict_get(table->by_name, name);
 }
 
+
 int smpp_pdu_init(Cfg *cfg)
 {
     CfgGroup *grp;
-    List *l;
+    List *l, *ids;
+    Octstr *id;
+    long i;
 
     if (initialized)
         return 0;
 
     l = cfg_get_multi_group(cfg, octstr_imm("smpp-tlv"));
     tlvs = gwlist_create();
-    tlvs_by_tag = dict_create(1024, (void(*)(void*))dict_destroy);
-    tlvs_by_name = dict_create(1024, (void(*)(void*))dict_destroy);
+    tlv_tables = dict_create(1024, smpp_tlv_table_destroy);
+    default_tlv_table = smpp_tlv_table_create();
+    dict_put(tlv_tables, octstr_imm(DEFAULT_SMSC_ID), default_tlv_table);
     while (l != NULL && (grp = gwlist_extract_first(l)) != NULL) {
         struct smpp_tlv *tlv;
         Octstr *tmp, *smsc_id;
@@ -211,49 +254,65 @@ int smpp_pdu_init(Cfg *cfg)
             gwlist_produce(l2, octstr_create(DEFAULT_SMSC_ID));
         }
         while(l2 != NULL && (smsc_id = gwlist_extract_first(l2)) != NULL) {
-            Dict *tmp_dict;
+            struct smpp_tlv_table *table;
 
             debug("sms.smpp", 0, "adding smpp-tlv for smsc-id=%s", octstr_get_cstr(smsc_id));
 
-            tmp_dict = dict_get(tlvs_by_name, smsc_id);
-            if (tmp_dict == NULL) {
-                tmp_dict = dict_create(1024, NULL);
-                dict_put(tlvs_by_name, smsc_id, tmp_dict);
+            table = dict_get(tlv_tables, smsc_id);
+            if (table == NULL) {
+                table = smpp_tlv_table_create();
+                dict_put(tlv_tables, smsc_id, table);
             }
             /* put into dict */
-            if (!dict_put_once(tmp_dict, tlv->name, tlv)) {
+            if (!dict_put_once(table->by_name, tlv->name, tlv)) {
                 error(0, "SMPP: Double TLV name %s found.", octstr_get_cstr(tlv->name));
+                gwlist_destroy(l2, octstr_destroy_item);
                 octstr_destroy(smsc_id);
                 goto failed;
             }
-
-            tmp_dict = dict_get(tlvs_by_tag, smsc_id);
-            if (tmp_dict == NULL) {
-                tmp_dict = dict_create(1024, NULL);
-                dict_put(tlvs_by_tag, smsc_id, tmp_dict);
-            }
-            tmp = octstr_format("%ld", tlv->tag);
-            if (!dict_put_once(tmp_dict, tmp, tlv)) {
-                error(0, "SMPP: Double TLV tag %s found.", octstr_get_cstr(tmp));
+            if (smpp_tlv_table_find_tag(table, tlv->tag) != NULL) {
+                error(0, "SMPP: Double TLV tag %ld found.", tlv->tag);
                 gwlist_destroy(l2, octstr_destroy_item);
-                octstr_destroy(tmp);
                 octstr_destroy(smsc_id);
                 goto failed;
             }
-            octstr_destroy(tmp);
+            smpp_tlv_table_insert_tag(table, tlv);
             octstr_destroy(smsc_id);
         }
         gwlist_destroy(l2, octstr_destroy_item);
     }
     gwlist_destroy(l, NULL);
 
+    /*
+     * Merge the default TLVs into every smsc-id table, a name or tag
+     * configured for the smsc-id itself takes precedence.
+     */
+    ids = dict_keys(tlv_tables);
+    while ((id = gwlist_extract_first(ids)) != NULL) {
+        struct smpp_tlv_table *table = dict_get(tlv_tables, id);
+
+        if (table != default_tlv_table) {
+            for (i = 0; i < default_tlv_table->num; i++) {
+                struct smpp_tlv *tlv = default_tlv_table->by_tag[i];
+
+                if (dict_get(table->by_name, tlv->name) == NULL)
+                    dict_put(table->by_name, tlv->name, tlv);
+                if (smpp_tlv_table_find_tag(table, tlv->tag) == NULL)
+                    smpp_tlv_table_insert_tag(table, tlv);
+            }
+        }
+        octstr_destroy(id);
+    }
+    gwlist_destroy(ids, NULL);
+
     initialized = 1;
     return 0;
 
 failed:
     gwlist_destroy(tlvs, (void(*)(void*))smpp_tlv_destroy);
-    dict_destroy(tlvs_by_tag);
-    dict_destroy(tlvs_by_name);
+    dict_destroy(tlv_tables);
+    tlv_tables = NULL;
+    default_tlv_table = NULL;
     return -1;
 }
 
@@ -266,9 +325,9 @@ int smpp_pdu_shutdown(void)
     initialized = 0;
     gwlist_destroy(tlvs, (void(*)(void*))smpp_tlv_destroy);
     tlvs = NULL;
-    dict_destroy(tlvs_by_tag);
-    dict_destroy(tlvs_by_name);
-    tlvs_by_tag = tlvs_by_name = NULL;
+    dict_destroy(tlv_tables);
+    tlv_tables = NULL;
+    default_tlv_table = NULL;
 
     return 0;
 }
@@ -276,15 +335,17 @@ int smpp_pdu_shutdown(void)
 
 static long decode_integer(Octstr *os, long pos, int octets)
 {
+    const unsigned char *data;
     unsigned long u;
     int i;
 
     if (octstr_len(os) < pos + octets) 
         return -1;
 
+    data = (const unsigned char *) octstr_get_cstr(os) + pos;
     u = 0;
     for (i = 0; i < octets; ++i)
-    	u = (u << 8) | octstr_get_char(os, pos + i);
+    	u = (u << 8) | data[i];
 
     return u;
 }
@@ -292,10 +353,14 @@ static long decode_integer(Octstr *os, long pos, int octets)
 
 static void append_encoded_integer(Octstr *os, unsigned long u, long octets)
 {
+    unsigned char buf[sizeof(unsigned long)];
     long i;
 
+    gw_assert(octets <= (long) sizeof(buf));
+
     for (i = 0; i < octets; ++i)
-    	octstr_append_char(os, (u >> ((octets - i - 1) * 8)) & 0xFF);
+    	buf[i] = (u >> ((octets - i - 1) * 8)) & 0xFF;
+    octstr_append_data(os, (char *) buf, octets);
 }
 
 
@@ -344,11 +409,20 @@ static int is_defined_field(long type, const char *field_name)
     return 0;
 }
 
+static gw_slab_t *pdu_slab;
+#define PDU_SLAB (gw_slab_get(&pdu_slab, "SMPP_PDU", sizeof(SMPP_PDU)))
+
+/*
+ * Size hint of the per PDU TLV Dict. Few PDUs carry more than a handful
+ * of TLVs; dict_create() doubles the hint, so this is 16 buckets.
+ */
+#define PDU_TLV_SIZE_HINT 8
+
 SMPP_PDU *smpp_pdu_create(unsigned long type, unsigned long seq_no)
 {
     SMPP_PDU *pdu;
 
-    pdu = gw_malloc(sizeof(*pdu));
+    pdu = gw_slab_alloc(PDU_SLAB);
     pdu->type = type;
 
     switch (type) {
@@ -356,7 +430,7 @@ SMPP_PDU *smpp_pdu_create(unsigned long type, unsigned long seq_no)
     #define TLV_INTEGER(name, octets) p->name = -1;
     #define TLV_NULTERMINATED(name, max_len) p->name = NULL;
     #define TLV_OCTETS(name, min_len, max_len) p->name = NULL;
-    #define OPTIONAL_END p->tlv = dict_create(1024, octstr_destroy_item);
+    #define OPTIONAL_END p->tlv = dict_create(PDU_TLV_SIZE_HINT, octstr_destroy_item);
     #define INTEGER(name, octets) p->name = 0;
     #define NULTERMINATED(name, max_octets) p->name = NULL;
     #define OCTETS(name, field_giving_octetst) p->name = NULL;
@@ -371,7 +445,7 @@ SMPP_PDU *smpp_pdu_create(unsigned long type, unsigned long seq_no)
     #include "smpp_pdu.def"
     default:
         error(0, "Unknown SMPP_PDU type, internal error.");
-        gw_free(pdu);
+        gw_slab_free(pdu_slab, pdu);
         return NULL;
     }
 
@@ -398,19 +472,32 @@ void smpp_pdu_destroy(SMPP_PDU *pdu)
     default:
         error(0, "Unknown SMPP_PDU type, internal error while destroying.");
     }
-    gw_free(pdu);
+    gw_slab_free(pdu_slab, pdu);
+}
+
+
+SMPP_TLV_Table *smpp_pdu_tlv_table(Octstr *smsc_id)
+{
+    return smpp_tlv_table_get(smsc_id);
 }
 
 
 Octstr *smpp_pdu_pack(Octstr *smsc_id, SMPP_PDU *pdu)
 {
-    Octstr *os;
-    Octstr *temp;
+    return smpp_pdu_pack_table(smpp_tlv_table_get(smsc_id), pdu);
+}
+
 
-    os = octstr_create("");
+Octstr *smpp_pdu_pack_table(SMPP_TLV_Table *tlv_table, SMPP_PDU *pdu)
+{
+    Octstr *os;
+    long len;
 
     gw_assert(pdu != NULL);
 
+    /* room for the command_length, filled in at the end */
+    os = octstr_create_from_data("\0\0\0\0", 4);
+
     /*
      * Fix lengths of octet string fields.
      */
@@ -458,13 +545,13 @@ Octstr *smpp_pdu_pack(Octstr *smsc_id, SMPP_PDU *pdu)
             } \
         }
     #define OPTIONAL_END \
-        if (p->tlv != NULL) { \
+        if (p->tlv != NULL && dict_key_count(p->tlv) > 0) { \
             Octstr *key; \
             List *keys; \
             struct smpp_tlv *tlv; \
             keys = dict_keys(p->tlv); \
             while(keys != NULL && (key = gwlist_extract_first(keys)) != NULL) { \
-                tlv = smpp_tlv_get_by_name(smsc_id, key); \
+                tlv = smpp_tlv_get_by_name(tlv_table, key); \
                 if (tlv == NULL) { \
                     if (!is_defined_field(pdu->type, octstr_get_cstr(key))) \
                         error(0, "SMPP: Unknown TLV `%s', don't send.", octstr_get_cstr(key)); \
@@ -511,15 +598,14 @@ Octstr *smpp_pdu_pack(Octstr *smsc_id, SMPP_PDU *pdu)
         append_encoded_integer(os, p->name, octets);
     #define NULTERMINATED(name, max_octets) \
         if (p->name != NULL) { \
-            if (octstr_len(p->name) >= max_octets) { \
+            len = octstr_len(p->name); \
+            if (len >= max_octets) { \
                 warning(0, "SMPP: PDU element <%s> too long " \
                         "(length is %ld, should be %d)", \
-                        #name, octstr_len(p->name), max_octets-1); \
-                temp = octstr_copy(p->name, 0, max_octets-1); \
-            } else \
-                temp = octstr_duplicate(p->name); \
-            octstr_append(os, temp); \
-            octstr_destroy(temp); \
+                        #name, len, max_octets-1); \
+                len = max_octets-1; \
+            } \
+            octstr_append_data(os, octstr_get_cstr(p->name), len); \
         } \
         octstr_append_char(os, '\0');
     #define OCTETS(name, field_giving_octets) \
@@ -532,16 +618,23 @@ Octstr *smpp_pdu_pack(Octstr *smsc_id, SMPP_PDU *pdu)
         break;
     }
 
-    temp = octstr_create("");
-    append_encoded_integer(temp, octstr_len(os) + 4, 4);
-    octstr_insert(os, temp, 0);
-    octstr_destroy(temp);
+    len = octstr_len(os);
+    octstr_set_char(os, 0, (len >> 24) & 0xFF);
+    octstr_set_char(os, 1, (len >> 16) & 0xFF);
+    octstr_set_char(os, 2, (len >> 8) & 0xFF);
+    octstr_set_char(os, 3, len & 0xFF);
 
     return os;
 }
 
 
 SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
+{
+    return smpp_pdu_unpack_table(smpp_tlv_table_get(smsc_id), data_without_len);
+}
+
+
+SMPP_PDU *smpp_pdu_unpack_table(SMPP_TLV_Table *tlv_table, Octstr *data_without_len)
 {
     SMPP_PDU *pdu;
     unsigned long type;
@@ -577,7 +670,7 @@ SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
                 opt_len = decode_integer(data_without_len, pos, 2); pos += 2;  \
                 debug("sms.smpp", 0, "Optional parameter length read as %ld", opt_len); \
                 /* check configured TLVs */ \
-                tlv = smpp_tlv_get_by_tag(smsc_id, opt_tag); \
+                tlv = smpp_tlv_table_find_tag(tlv_table, opt_tag); \
                 if (tlv != NULL) debug("sms.smpp", 0, "Found configured optional parameter `%s'", octstr_get_cstr(tlv->name));
     #define TLV_INTEGER(mname, octets) \
                 if (SMPP_##mname == opt_tag) { \
@@ -725,7 +818,7 @@ void smpp_pdu_dump(Octstr *smsc_id, SMPP_PDU *pdu)
             struct smpp_tlv *tlv; \
             keys = dict_keys(p->tlv); \
             while(keys != NULL && (key = gwlist_extract_first(keys)) != NULL) { \
-                tlv = smpp_tlv_get_by_name(smsc_id, key); \
+                tlv = smpp_tlv_get_by_name(smpp_tlv_table_get(smsc_id), key); \
                 if (tlv != NULL) { \
                     octstr_dump_short(dict_get(p->tlv, key), 2, octstr_get_cstr(key)); \
                 } \
@@ -776,7 +869,7 @@ void smpp_pdu_dump_line(Octstr *smsc_id, SMPP_PDU *pdu)
             struct smpp_tlv *tlv; \
             keys = dict_keys(p->tlv); \
             while(keys != NULL && (key = gwlist_extract_first(keys)) != NULL) { \
-                tlv = smpp_tlv_get_by_name(smsc_id, key); \
+                tlv = smpp_tlv_get_by_name(smpp_tlv_table_get(smsc_id), key); \
                 if (tlv != NULL) { \
                     Octstr *val = dict_get(p->tlv, key); \
                     octstr_format_append(str, " [%E:%d:%E]", key, octstr_len(val), val); \
@@ -236,6 +236,16 @@ void smpp_pdu_destroy(SMPP_PDU *pdu);
 int smpp_pdu_is_valid(SMPP_PDU *pdu); /* XXX */
 Octstr *smpp_pdu_pack(Octstr *smsc_id, SMPP_PDU *pdu);
 SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len);
+
+/*
+ * Configured TLVs of one smsc-id. The table stays valid until
+ * smpp_pdu_shutdown, so a connection can look it up once and pack and
+ * unpack with it instead of finding it by smsc_id for every PDU.
+ */
+typedef struct smpp_tlv_table SMPP_TLV_Table;
+SMPP_TLV_Table *smpp_pdu_tlv_table(Octstr *smsc_id);
+Octstr *smpp_pdu_pack_table(SMPP_TLV_Table *tlv_table, SMPP_PDU *pdu);
+SMPP_PDU *smpp_pdu_unpack_table(SMPP_TLV_Table *tlv_table, Octstr *data_without_len);
 void smpp_pdu_dump(Octstr *smsc_id, SMPP_PDU *pdu);
 void smpp_pdu_dump_line(Octstr *smsc_id, SMPP_PDU *pdu);
 
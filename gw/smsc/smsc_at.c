@@ -1375,7 +1375,7 @@ reconnect:
 
     mutex_lock(conn->flow_mutex);
     conn->status = SMSCCONN_ACTIVE;
-    conn->connect_time = time(NULL);
+    conn->connect_time = gw_clock_mono();
     mutex_unlock(conn->flow_mutex);
     bb_smscconn_connected(conn);
 
@@ -1440,7 +1440,6 @@ reconnect:
     octstr_destroy(privdata->rawtcp_host);
     gw_prioqueue_destroy(privdata->outgoing_queue, NULL);
     gwlist_destroy(privdata->pending_incoming_messages, octstr_destroy_item);
-    load_destroy(privdata->load);
     gw_free(conn->data);
     conn->data = NULL;
     mutex_lock(conn->flow_mutex);
@@ -1524,7 +1523,7 @@ int smsc_at2_create(SMSCConn *conn, CfgGroup *cfg)
 
     privdata = gw_malloc(sizeof(PrivAT2data));
     memset(privdata, 0, sizeof(PrivAT2data));
-    privdata->outgoing_queue = gw_prioqueue_create(sms_priority_compare);
+    privdata->outgoing_queue = gw_prioqueue_create_levels(SMS_PRIORITY_LEVELS, sms_priority_level);
     privdata->pending_incoming_messages = gwlist_create();
 
     privdata->configfile = cfg_get_configfile(cfg);
@@ -1632,13 +1631,10 @@ int smsc_at2_create(SMSCConn *conn, CfgGroup *cfg)
     if (cfg_get_integer((long *) &privdata->max_error_count,  cfg, octstr_imm("max-error-count")) == -1)
         privdata->max_error_count = -1;
 
-    privdata->load = load_create_real(0);
-    load_add_interval(privdata->load, 1);
-
     conn->data = privdata;
     conn->name = octstr_format("AT2[%s]", octstr_get_cstr(privdata->name));
     conn->status = SMSCCONN_CONNECTING;
-    conn->connect_time = time(NULL);
+    conn->connect_time = gw_clock_mono();
 
     privdata->shutdown = 0;
 
@@ -2215,12 +2211,14 @@ static void at2_send_messages(PrivAT2data *privdata)
     if (privdata->modem->enable_mms && gw_prioqueue_len(privdata->outgoing_queue) > 1)                  
         at2_send_modem_command(privdata, "AT+CMMS=2", 0, 0);
 
-    if (privdata->conn->throughput > 0 && load_get(privdata->load, 0) >= privdata->conn->throughput) {
-      debug("bb.sms.at2", 0, "AT2[%s]: throughput limit exceeded (load: %.02f, throughput: %.02f)",
-            octstr_get_cstr(privdata->conn->id), load_get(privdata->load, 0), privdata->conn->throughput);
+    if (gw_prioqueue_len(privdata->outgoing_queue) == 0)
+        return;
+
+    if (privdata->conn->shaper != NULL && !gw_shaper_take(privdata->conn->shaper)) {
+      debug("bb.sms.at2", 0, "AT2[%s]: throughput limit exceeded (throughput: %.02f)",
+            octstr_get_cstr(privdata->conn->id), privdata->conn->throughput);
     } else {
       if ((msg = gw_prioqueue_remove(privdata->outgoing_queue))) {                 
-          load_increase(privdata->load);
           at2_send_one_message(privdata, msg);
       }
     }
@@ -151,7 +151,6 @@ typedef struct PrivAT2data {
     int rawtcp_port;
     int is_serial; /* false if device is rawtcp */ 
     int use_telnet; /* use telnet escape sequences */
-    Load *load;
  } PrivAT2data;
 
 
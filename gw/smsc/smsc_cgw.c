@@ -506,7 +506,7 @@ int smsc_cgw_create(SMSCConn *conn, CfgGroup *cfg)
     privdata->shutdown = 0;
 
     conn->status = SMSCCONN_CONNECTING;
-    conn->connect_time = time(NULL);
+    conn->connect_time = gw_clock_mono();
 
     if (privdata->rport > 0 && (privdata->receiver_thread = gwthread_create(cgw_listener, conn)) == -1)
         goto error;
@@ -722,7 +722,7 @@ static Connection *cgw_open_send_connection(SMSCConn *conn)
         if (conn->status != SMSCCONN_ACTIVE) {
             mutex_lock(conn->flow_mutex);
             conn->status = SMSCCONN_ACTIVE;
-            conn->connect_time = time(NULL);
+            conn->connect_time = gw_clock_mono();
             mutex_unlock(conn->flow_mutex);
             bb_smscconn_connected(conn);
         }
@@ -112,13 +112,14 @@ typedef struct privdata {
     Octstr  *inbuffer;
     List    *received;
 
-    time_t  next_ping;
+    long    next_ping;
 
     List *outgoing_queue;
     SMSCConn *conn;
     int io_thread;
     int quitting;
     List *stopped; /* list-trick for suspend/isolate */
+    List *dlr_pending;    /* status reports handed to dlr_resolve() */
 
 } PrivData;
 
@@ -1557,7 +1558,7 @@ static struct packet *cimd2_get_packet(PrivData *pdata, Octstr **ts)
         *ts = packet_get_parm(packet,P_MC_TIMESTAMP);
 
     if (pdata->keepalive > 0)
-        pdata->next_ping = time(NULL) + pdata->keepalive;
+        pdata->next_ping = gw_clock_mono() + pdata->keepalive;
 
     return packet;
 }
@@ -1948,6 +1949,7 @@ static void cimd2_destroy(PrivData *pdata)
     gwlist_destroy(pdata->received, msg_destroy_item);
     gwlist_destroy(pdata->outgoing_queue, NULL);
     gwlist_destroy(pdata->stopped, NULL);
+    gwlist_destroy(pdata->dlr_pending, NULL);
 
     gw_free(pdata);
 }
@@ -2019,10 +2021,24 @@ static int cimd2_receive_msg(SMSCConn *conn, Msg **msg)
          * way. */
         return 0;
     }
-    
+
+    /*
+     * CIMD2 has no negative response to a delivery, so while bearerbox
+     * is backlogged leave them unread. The SMSC waits for our response
+     * before it delivers more. Submits and keepalives still read the
+     * socket and accept what has arrived by then.
+     */
+    if (bb_smscconn_receive_throttled(conn)) {
+        if (pdata->keepalive > 0 && pdata->next_ping < gw_clock_mono()) {
+            if (cimd2_send_alive(conn) < 0)
+		return -1;
+        }
+        return 0;
+    }
+
     ret = read_available(pdata->socket, 0);
     if (ret == 0) {
-        if (pdata->keepalive > 0 && pdata->next_ping < time(NULL)) {
+        if (pdata->keepalive > 0 && pdata->next_ping < gw_clock_mono()) {
             if (cimd2_send_alive(conn) < 0)
 		return -1;
         }
@@ -2081,6 +2097,31 @@ static int cimd2_receive_msg(SMSCConn *conn, Msg **msg)
 
 
 
+/*
+ * A status report waiting for its DLR lookup.
+ */
+struct cimd2_dlr {
+    SMSCConn *conn;
+    Octstr *msgdata;
+};
+
+
+static void cimd2_dlr_resolved(Msg *msg, void *context)
+{
+    struct cimd2_dlr *dlr = context;
+
+    if (msg != NULL) {
+        msg->sms.msgdata = dlr->msgdata;
+        dlr->msgdata = NULL;
+        octstr_destroy(msg->sms.smsc_id);
+        msg->sms.smsc_id = octstr_duplicate(dlr->conn->id);
+        bb_smscconn_receive(dlr->conn, msg);
+    }
+    octstr_destroy(dlr->msgdata);
+    gw_free(dlr);
+}
+
+
 static Msg *cimd2_accept_delivery_report_message(struct packet *request,
 						 SMSCConn *conn)
 {
@@ -2113,7 +2154,21 @@ static Msg *cimd2_accept_delivery_report_message(struct packet *request,
     default:
         code = 0;
     }
-    if(code)
+    if (code && conn->dlr_async && dlr_resolver_enabled()) {
+        /* the report is acked anyway, pass it on once it is resolved */
+        PrivData *pdata = conn->data;
+        struct cimd2_dlr *dlr = gw_malloc(sizeof(*dlr));
+
+        dlr->conn = conn;
+        dlr->msgdata = packet_get_parm(request, P_USER_DATA);
+        if (!dlr->msgdata) {
+            dlr->msgdata = statuscode;
+            statuscode = NULL;
+        }
+        dlr_resolve(conn->name, timestamp, destination, code, 1,
+                    pdata->dlr_pending, cimd2_dlr_resolved, dlr);
+        msg = NULL;
+    } else if(code)
         msg = dlr_find(conn->name, timestamp, destination, code, 1);
     else
         msg = NULL;
@@ -2188,7 +2243,7 @@ static void io_thread (void *arg)
             } 
             mutex_lock(conn->flow_mutex);
             conn->status = SMSCCONN_ACTIVE;
-            conn->connect_time = time(NULL);
+            conn->connect_time = gw_clock_mono();
             bb_smscconn_connected(conn);
             mutex_unlock(conn->flow_mutex);
         }
@@ -2206,6 +2261,22 @@ static void io_thread (void *arg)
  
         /* send messages */
         do {
+            /*
+             * obey throughput speed limit, if any. Don't wait for the token
+             * here, that would stop reading; let the idle sleep below end
+             * when it is due instead.
+             */
+            if (conn->shaper != NULL && gwlist_len(pdata->outgoing_queue) > 0 &&
+                !gw_shaper_take(conn->shaper)) {
+                if (sleep > 0) {
+                    sleep = gw_shaper_delay(conn->shaper);
+                    if (sleep >= 2.0)
+                        sleep = 1.999999;
+                    else if (sleep <= 0)
+                        sleep = 0.0001;
+                }
+                break;
+            }
             msg = gwlist_extract_first(pdata->outgoing_queue);
             if (msg) {
                 sleep = 0;
@@ -2278,6 +2349,7 @@ static int cimd2_shutdown_cb (SMSCConn *conn, int finish_sending)
         gwthread_wakeup(pdata->io_thread);
         gwthread_join(pdata->io_thread);
     }
+    dlr_resolve_wait(pdata->dlr_pending);
 
     cimd2_close_socket(pdata);
     cimd2_destroy(pdata); 
@@ -2335,6 +2407,7 @@ int smsc_cimd2_create(SMSCConn *conn, CfgGroup *grp)
     pdata->receive_seq = 0;
     pdata->outgoing_queue = gwlist_create();
     pdata->stopped = gwlist_create();
+    pdata->dlr_pending = gwlist_create();
     gwlist_add_producer(pdata->outgoing_queue);
 
     if (conn->is_stopped)
@@ -2391,7 +2464,7 @@ int smsc_cimd2_create(SMSCConn *conn, CfgGroup *grp)
       debug("bb.sms.cimd2", 0, "CIMD2[%s]: Keepalive set to %ld seconds", 
             octstr_get_cstr(conn->id),
             pdata->keepalive);
-        pdata->next_ping = time(NULL) + pdata->keepalive;
+        pdata->next_ping = gw_clock_mono() + pdata->keepalive;
     }
 
     maxlen = parm_maxlen(P_USER_IDENTITY);
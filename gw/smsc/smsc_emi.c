@@ -92,11 +92,14 @@
 
 #define EMI2_MAX_TRN 100
 
+struct emi2_session;
+
 typedef struct privdata {
     Octstr	*name;
     gw_prioqueue_t *outgoing_queue;
     long	receiver_thread;
-    long	sender_thread;
+    struct emi2_session *sessions;
+    int		num_sessions;	/* Main connections sending from outgoing_queue */
     int		shutdown;	  /* Internal signal to shut down */
     int		listening_socket; /* File descriptor */
     int		send_socket;
@@ -107,33 +110,53 @@ typedef struct privdata {
     Octstr	*allow_ip, *deny_ip;
     Octstr	*host, *alt_host, *username, *password;
     Octstr	*my_number;	/* My number if we want to force one */
-    int		unacked;	/* Sent messages not acked */
-    struct {
-	time_t	sendtime;	/* When we sent out a message with a given
-				 * TRN. Is 0 if the TRN slot is currently free. */
-	int     sendtype;	/* OT of message, undefined if time == 0 */
-	Msg     *sendmsg; 	/* Corresponding message for OT == 51 */
-    } slots[EMI2_MAX_TRN];
     int		keepalive; 	/* Seconds to send a Keepalive Command (OT=31) */
     int		flowcontrol;	/* 0=Windowing, 1=Stop-and-Wait */
     int		waitack;	/* Seconds to wait to ack */
     int		waitack_expire;	/* What to do on waitack expire */
     int		window;		/* In windowed flow-control, the window size */
-    int         can_write;      /* write = 1, read = 0, for stop-and-wait flow control */
-    int         priv_nexttrn;   /* next TRN, this should never be accessed directly.
-				 * use int emi2_next_trn (SMSCConn *conn) instead.
-				 */
-    time_t	last_activity_time; /* the last time something was sent over the main
-				     * SMSC connection
-				     */
-    time_t      check_time;
     int         idle_timeout;   /* Seconds a Main connection to the SMSC is allowed to be idle.
 				   If 0, no idle timeout is in effect */
     Octstr   *npid; /* Notification PID value */
     Octstr   *nadc; /* Notification Address */
     int alt_charset; /* Alternative GSM charset, defined via values in gwlib/alt_charsets.h */
+    List *dlr_pending;    /* OP/53 notifications handed to dlr_resolve() */
 } PrivData;
 
+/*
+ * A sent operation waiting for its ack, indexed by its TRN. Busy slots
+ * are also linked in the order they were sent, so expired ones are
+ * found without scanning the whole table.
+ */
+struct emi2_slot {
+    long	sendtime;	/* When we sent out a message with a given
+				 * TRN (gw_clock_mono). Is 0 if the TRN slot
+				 * is currently free. */
+    int		sendtype;	/* OT of message, undefined if time == 0 */
+    Msg		*sendmsg; 	/* Corresponding message for OT == 51 */
+    struct emi2_slot *prev, *next;
+};
+
+/*
+ * One main connection to the SMSC with its own sender thread and TRN
+ * space. All sessions of a connection send from the same queue.
+ */
+struct emi2_session {
+    SMSCConn	*conn;
+    long	thread;
+    int		connected;
+    int		unacked;	/* Sent messages not acked */
+    int         can_write;      /* write = 1, read = 0, for stop-and-wait flow control */
+    long	last_activity_time; /* the last time something was sent over the main
+				     * SMSC connection (gw_clock_mono)
+				     */
+    long        check_time;
+    struct emi2_slot slots[EMI2_MAX_TRN];
+    struct emi2_slot *oldest, *newest;	/* busy slots in sending order */
+    int		free_trn[EMI2_MAX_TRN];	/* free TRNs, least recently used first */
+    int		free_first, free_count;
+};
+
 typedef enum {
     EMI2_SENDREQ,  /* somebody asked this driver to send a SMS message */
     EMI2_SMSCREQ,  /* the SMSC wants something from us */
@@ -143,35 +166,133 @@ typedef enum {
 
 #define PRIVDATA(conn) ((PrivData *)((conn)->data))
 
-#define SLOTBUSY(conn,i) (PRIVDATA(conn)->slots[(i)].sendtime != 0)
+#define SLOTBUSY(session,i) ((session)->slots[(i)].sendtime != 0)
+
+#define CONNECTIONIDLE(session)								\
+((session)->unacked == 0 &&								\
+ (PRIVDATA((session)->conn)->idle_timeout ?						\
+  ((session)->last_activity_time + PRIVDATA((session)->conn)->idle_timeout) <= gw_clock_mono():0))
+
+#define emi2_can_send(session)						\
+(((session)->can_write || !PRIVDATA((session)->conn)->flowcontrol) &&	\
+ ((session)->unacked < PRIVDATA((session)->conn)->window) &&		\
+ (!PRIVDATA((session)->conn)->shutdown))
 
-#define CONNECTIONIDLE(conn)								\
-((PRIVDATA(conn)->unacked == 0) &&							\
- (PRIVDATA(conn)->idle_timeout ?							\
-  (PRIVDATA(conn)->last_activity_time + PRIVDATA(conn)->idle_timeout) <= time(0):0))
+#define emi2_needs_keepalive(session)						\
+(emi2_can_send(session) &&							\
+ (PRIVDATA((session)->conn)->keepalive > 0) &&					\
+ (gw_clock_mono() > ((session)->last_activity_time + PRIVDATA((session)->conn)->keepalive)))
 
-#define emi2_can_send(conn)					\
-((PRIVDATA(conn)->can_write || !PRIVDATA(conn)->flowcontrol) &&	\
- (PRIVDATA(conn)->unacked < PRIVDATA(conn)->window) &&		\
- (!PRIVDATA(conn)->shutdown))
 
-#define emi2_needs_keepalive(conn)							\
-(emi2_can_send(conn) &&									\
- (PRIVDATA(conn)->keepalive > 0) &&							\
- (time(NULL) > (PRIVDATA(conn)->last_activity_time + PRIVDATA(conn)->keepalive)))
+static void emi2_session_init(struct emi2_session *session, SMSCConn *conn)
+{
+    int i;
+
+    session->conn = conn;
+    session->thread = -1;
+    session->connected = 0;
+    session->unacked = 0;
+    session->can_write = 1;
+    session->last_activity_time = 0;
+    session->check_time = 0;
+    session->oldest = session->newest = NULL;
+    for (i = 0; i < EMI2_MAX_TRN; i++) {
+	session->slots[i].sendtime = 0;
+	session->free_trn[i] = i;
+    }
+    session->free_first = 0;
+    session->free_count = EMI2_MAX_TRN;
+}
+
 
 /*
- * Send an EMI message and update the last_activity_time field.
+ * Occupy the next free TRN for an operation of type ot and return it,
+ * or -1 if all TRNs are in use.
  */
-static int emi2_emimsg_send(SMSCConn *conn, Connection *server, struct emimsg *emimsg)
+static int emi2_slot_take(struct emi2_session *session, int ot, Msg *msg)
 {
-    int result = emimsg_send(server, emimsg, PRIVDATA(conn)->name);
+    struct emi2_slot *slot;
+    int trn;
+
+    if (session->free_count == 0)
+	return -1;
+    trn = session->free_trn[session->free_first];
+    session->free_first = (session->free_first + 1) % EMI2_MAX_TRN;
+    session->free_count--;
+
+    slot = &session->slots[trn];
+    slot->sendtype = ot;
+    slot->sendmsg = msg;
+    slot->sendtime = gw_clock_mono();
+    slot->next = NULL;
+    slot->prev = session->newest;
+    if (session->newest != NULL)
+	session->newest->next = slot;
+    else
+	session->oldest = slot;
+    session->newest = slot;
+    session->unacked++;
+
+    return trn;
+}
 
-    if (result >= 0 && emimsg->or == 'O' && ( emimsg->ot == 31 || emimsg->ot == 51)) {
-	PRIVDATA(conn)->last_activity_time = time (NULL);
+
+static void emi2_slot_release(struct emi2_session *session, int trn)
+{
+    struct emi2_slot *slot = &session->slots[trn];
+
+    if (slot->prev != NULL)
+	slot->prev->next = slot->next;
+    else
+	session->oldest = slot->next;
+    if (slot->next != NULL)
+	slot->next->prev = slot->prev;
+    else
+	session->newest = slot->prev;
+    slot->sendtime = 0;
+
+    session->free_trn[(session->free_first + session->free_count) % EMI2_MAX_TRN] = trn;
+    session->free_count++;
+    session->unacked--;
+}
+
+
+/*
+ * Derive the connection status from its sessions. Called with
+ * conn->flow_mutex locked.
+ */
+static void emi2_update_status(SMSCConn *conn)
+{
+    PrivData *privdata = conn->data;
+    int i;
+
+    for (i = 0; i < privdata->num_sessions; i++) {
+	if (privdata->sessions[i].connected) {
+	    conn->status = SMSCCONN_ACTIVE;
+	    return;
+	}
     }
+    conn->status = SMSCCONN_RECONNECTING;
+}
 
-    return result;
+
+static void emi2_wakeup_senders(PrivData *privdata)
+{
+    int i;
+
+    for (i = 0; i < privdata->num_sessions; i++)
+	if (privdata->sessions[i].thread != -1)
+	    gwthread_wakeup(privdata->sessions[i].thread);
+}
+
+/*
+ * Send an EMI message over the given connection. This does not touch
+ * last_activity_time; callers sending OT 31 or 51 operations set it on
+ * their session themselves.
+ */
+static int emi2_emimsg_send(SMSCConn *conn, Connection *server, struct emimsg *emimsg)
+{
+    return emimsg_send(server, emimsg, PRIVDATA(conn)->name);
 }
 
 /* Wait for a message of type 'ot', sent with TRN 0, to be acked.
@@ -181,12 +302,12 @@ static int emi2_emimsg_send(SMSCConn *conn, Connection *server, struct emimsg *e
  * -2 for negative NACK. */
 static int wait_for_ack(PrivData *privdata, Connection *server, int ot, int t)
 {
-    time_t timeout_time;
+    long timeout_time;
     int time_left;
     Octstr *str;
     struct emimsg *emimsg;
 
-    timeout_time = time(NULL) + t;
+    timeout_time = gw_clock_mono() + t;
     while (1) {
 	str = conn_read_packet(server, 2, 3);
 	if (conn_eof(server)) {
@@ -215,7 +336,7 @@ static int wait_for_ack(PrivData *privdata, Connection *server, int ot, int t)
 	    emimsg_destroy(emimsg);
 	    octstr_destroy(str);
 	}
-	time_left = timeout_time - time(NULL);
+	time_left = timeout_time - gw_clock_mono();
 	if (time_left < 0 || privdata->shutdown)
 	    return 0;
 	conn_wait(server, time_left);
@@ -264,8 +385,9 @@ static struct emimsg *make_emi60(PrivData *privdata)
 }
 
 
-static Connection *open_send_connection(SMSCConn *conn)
+static Connection *open_send_connection(struct emi2_session *session)
 {
+    SMSCConn *conn = session->conn;
     PrivData *privdata = conn->data;
     int result, alt_host, do_alt_host;
     struct emimsg *emimsg;
@@ -279,12 +401,15 @@ static Connection *open_send_connection(SMSCConn *conn)
     alt_host = 0;
 
     mutex_lock(conn->flow_mutex);
-    conn->status = SMSCCONN_RECONNECTING;
+    session->connected = 0;
+    emi2_update_status(conn);
     mutex_unlock(conn->flow_mutex);
 
     while (!privdata->shutdown) {
 
-    while ((msg = gw_prioqueue_remove(privdata->outgoing_queue))) {
+    /* other sessions may still be sending the queue */
+    while (conn->status != SMSCCONN_ACTIVE &&
+           (msg = gw_prioqueue_remove(privdata->outgoing_queue))) {
         bb_smscconn_send_failed(conn, msg,
                          SMSCCONN_FAILED_TEMPORARILY, NULL);
     }
@@ -366,13 +491,15 @@ static Connection *open_send_connection(SMSCConn *conn)
             connect_error = 1;
             continue;
         }
-        privdata->last_activity_time = 0; /* to force keepalive after login */
-        privdata->can_write = 1;
+        session->last_activity_time = 0; /* to force keepalive after login */
+        session->can_write = 1;
     }
 
 	mutex_lock(conn->flow_mutex);
+	session->connected = 1;
+	if (conn->status != SMSCCONN_ACTIVE)
+	    conn->connect_time = gw_clock_mono();
 	conn->status = SMSCCONN_ACTIVE;
-	conn->connect_time = time(NULL);
 	mutex_unlock(conn->flow_mutex);
 	bb_smscconn_connected(conn);
 	return server;
@@ -573,6 +700,44 @@ static struct emimsg *msg_to_emimsg(Msg *msg, int trn, PrivData *privdata)
 }
 
 
+/*
+ * An OP/53 delivery notification waiting for its DLR lookup.
+ */
+struct emi2_dlr {
+    SMSCConn *conn;
+    Octstr *amsg;
+    int alphanumeric;   /* MT=3 */
+};
+
+
+static void emi2_dlr_resolved(Msg *msg, void *context)
+{
+    struct emi2_dlr *dlr = context;
+    PrivData *privdata = dlr->conn->data;
+
+    if (msg != NULL) {
+        /*
+         * Recode the msg structure with the given msgdata.
+         * Note: the DLR URL is delivered in msg->sms.dlr_url already.
+         */
+        if (dlr->amsg == NULL)
+            msg->sms.msgdata = octstr_create("Delivery Report without text");
+        else
+            msg->sms.msgdata = octstr_duplicate(dlr->amsg);
+        octstr_hex_to_binary(msg->sms.msgdata);
+        if (dlr->alphanumeric) {
+            /* obey the NRC (national replacement codes) */
+            if (privdata->alt_charset == EMI_NRC_ISO_21)
+                charset_nrc_iso_21_german_to_gsm(msg->sms.msgdata);
+            charset_gsm_to_utf8(msg->sms.msgdata);
+        }
+        bb_smscconn_receive(dlr->conn, msg);
+    }
+    octstr_destroy(dlr->amsg);
+    gw_free(dlr);
+}
+
+
 /* Return -1 if the connection broke, 0 if the request couldn't be handled
  * (unknown type), or 1 if everything was successful */
 static int handle_operation(SMSCConn *conn, Connection *server,
@@ -586,6 +751,21 @@ static int handle_operation(SMSCConn *conn, Connection *server,
     int st_code;
     PrivData *privdata = conn->data;
 
+    /*
+     * While bearerbox is backlogged refuse MO and notifications with
+     * 04 (operation not allowed), the SMSC retries them later.
+     */
+    if ((emimsg->ot == 01 || emimsg->ot == 52 || emimsg->ot == 53) &&
+            bb_smscconn_receive_throttled(conn)) {
+	reply = emimsg_create_reply(emimsg->ot, emimsg->trn, 0, privdata->name);
+	reply->fields[1] = octstr_create("04");
+	if (emi2_emimsg_send(conn, server, reply) < 0) {
+	    emimsg_destroy(reply);
+	    return -1;
+	}
+	emimsg_destroy(reply);
+	return 1;
+    }
 
     switch(emimsg->ot) {
 
@@ -848,42 +1028,36 @@ static int handle_operation(SMSCConn *conn, Connection *server,
 	switch(st_code)
 	{
 	case 0: /* delivered */
-		msg = dlr_find((conn->id ? conn->id : privdata->name),
-			emimsg->fields[E50_SCTS], /* timestamp */
-			emimsg->fields[E50_OADC], /* destination */
-			DLR_SUCCESS, 1);
+		type = DLR_SUCCESS;
 		break;
 	case 1: /* buffered */
-		msg = dlr_find((conn->id ? conn->id : privdata->name),
-			emimsg->fields[E50_SCTS], /* timestamp */
-			emimsg->fields[E50_OADC], /* destination */
-			DLR_BUFFERED, 1);
+		type = DLR_BUFFERED;
 		break;
 	case 2: /* not delivered */
-		msg = dlr_find((conn->id ? conn->id : privdata->name),
+		type = DLR_FAIL;
+		break;
+	default:
+		type = 0;
+		break;
+	}
+	if (type != 0) {
+	    struct emi2_dlr *dlr = gw_malloc(sizeof(*dlr));
+
+	    dlr->conn = conn;
+	    dlr->amsg = octstr_duplicate(emimsg->fields[E50_AMSG]);
+	    dlr->alphanumeric = (octstr_get_char(emimsg->fields[E50_MT], 0) == '3');
+	    /* the ack never depended on the lookup, so it may run later */
+	    if (conn->dlr_async && dlr_resolver_enabled())
+		dlr_resolve((conn->id ? conn->id : privdata->name),
 			emimsg->fields[E50_SCTS], /* timestamp */
 			emimsg->fields[E50_OADC], /* destination */
-			DLR_FAIL, 1);
-		break;
+			type, 1, privdata->dlr_pending, emi2_dlr_resolved, dlr);
+	    else
+		emi2_dlr_resolved(dlr_find((conn->id ? conn->id : privdata->name),
+			emimsg->fields[E50_SCTS], /* timestamp */
+			emimsg->fields[E50_OADC], /* destination */
+			type, 1), dlr);
 	}
-	if (msg != NULL) {     
-	    /*
-	     * Recode the msg structure with the given msgdata.
-	     * Note: the DLR URL is delivered in msg->sms.dlr_url already.
-	     */
-        if ((emimsg->fields[E50_AMSG]) == NULL)
-            msg->sms.msgdata = octstr_create("Delivery Report without text");
-        else
-            msg->sms.msgdata = octstr_duplicate(emimsg->fields[E50_AMSG]);
-        octstr_hex_to_binary(msg->sms.msgdata);
-        if (octstr_get_char(emimsg->fields[E50_MT], 0) == '3') {
-            /* obey the NRC (national replacement codes) */
-            if (privdata->alt_charset == EMI_NRC_ISO_21)
-                charset_nrc_iso_21_german_to_gsm(msg->sms.msgdata);
-            charset_gsm_to_utf8(msg->sms.msgdata);
-        }
-        bb_smscconn_receive(conn, msg);
-    }
 	reply = emimsg_create_reply(53, emimsg->trn, 1, privdata->name);
 	if (emi2_emimsg_send(conn, server, reply) < 0) {
 	    emimsg_destroy(reply);
@@ -915,20 +1089,21 @@ static int handle_operation(SMSCConn *conn, Connection *server,
 }
 
 /*
- * get all unacknowledged messages from the ringbuffer and queue them
+ * get all unacknowledged messages of a session and queue them
  * for retransmission.
  */
-static void clear_sent(PrivData *privdata)
+static void clear_sent(struct emi2_session *session)
 {
-    int i;
+    PrivData *privdata = PRIVDATA(session->conn);
+    struct emi2_slot *slot;
+
     debug("smsc.emi2", 0, "EMI2[%s]: clear_sent called",
 	  octstr_get_cstr(privdata->name));
-    for (i = 0; i < EMI2_MAX_TRN; i++) {
-	if (privdata->slots[i].sendtime && privdata->slots[i].sendtype == 51)
-	    gw_prioqueue_produce(privdata->outgoing_queue, privdata->slots[i].sendmsg);
-	privdata->slots[i].sendtime = 0;
+    while ((slot = session->oldest) != NULL) {
+	if (slot->sendtype == 51)
+	    gw_prioqueue_produce(privdata->outgoing_queue, slot->sendmsg);
+	emi2_slot_release(session, slot - session->slots);
     }
-    privdata->unacked = 0;
 }
 
 /*
@@ -936,64 +1111,49 @@ static void clear_sent(PrivData *privdata)
  * on the SMSC main connection, an error or timeout) and tell the caller
  * what happened.
  */
-static EMI2Event emi2_wait (SMSCConn *conn, Connection *server, double seconds)
+static EMI2Event emi2_wait (struct emi2_session *session, Connection *server, double seconds)
 {
-    if (emi2_can_send(conn) && gw_prioqueue_len(PRIVDATA(conn)->outgoing_queue)) {
+    PrivData *privdata = PRIVDATA(session->conn);
+
+    if (emi2_can_send(session) && gw_prioqueue_len(privdata->outgoing_queue)) {
 	return EMI2_SENDREQ;
     }
     
     if (server != NULL) {
 	switch (conn_wait(server, seconds)) {
-	case 1: return gw_prioqueue_len(PRIVDATA(conn)->outgoing_queue) ? EMI2_SENDREQ : EMI2_TIMEOUT;
+	case 1: return gw_prioqueue_len(privdata->outgoing_queue) ? EMI2_SENDREQ : EMI2_TIMEOUT;
 	case 0: return EMI2_SMSCREQ;
 	default: return EMI2_CONNERR;
 	}
     } else {
 	gwthread_sleep(seconds);
-	return gw_prioqueue_len(PRIVDATA(conn)->outgoing_queue) ? EMI2_SENDREQ : EMI2_TIMEOUT;
+	return gw_prioqueue_len(privdata->outgoing_queue) ? EMI2_SENDREQ : EMI2_TIMEOUT;
     }
 }
 
-/*
- * obtain the next free TRN.
- */
-static int emi2_next_trn (SMSCConn *conn)
-{
-#define INC_TRN(x) ((x)=((x) + 1) % EMI2_MAX_TRN)
-    int result;
-    
-    while (SLOTBUSY(conn,PRIVDATA(conn)->priv_nexttrn))
-	INC_TRN(PRIVDATA(conn)->priv_nexttrn); /* pick unused TRN */
-    
-    result = PRIVDATA(conn)->priv_nexttrn;
-    INC_TRN(PRIVDATA(conn)->priv_nexttrn);
-
-    return result;
-#undef INC_TRN
-}
-
 /*
  * send an EMI type 31 message when required.
  */
-static int emi2_keepalive_handling (SMSCConn *conn, Connection *server)
+static int emi2_keepalive_handling (struct emi2_session *session, Connection *server)
 {
     struct emimsg *emimsg;
-    int nexttrn = emi2_next_trn (conn);
+    int nexttrn;
     
-    emimsg = make_emi31(PRIVDATA(conn), nexttrn);
+    if ((nexttrn = emi2_slot_take(session, 31, NULL)) == -1)
+	return 0;
+
+    emimsg = make_emi31(PRIVDATA(session->conn), nexttrn);
     if(emimsg) {
-        PRIVDATA(conn)->slots[nexttrn].sendtype= 31;
-        PRIVDATA(conn)->slots[nexttrn].sendtime = time(NULL);
-        PRIVDATA(conn)->unacked++;
-	
-        if (emi2_emimsg_send(conn, server, emimsg) == -1) {
+        if (emi2_emimsg_send(session->conn, server, emimsg) == -1) {
            emimsg_destroy(emimsg);
            return -1;
         }
+        session->last_activity_time = gw_clock_mono();
         emimsg_destroy(emimsg);
-    }
+    } else
+	emi2_slot_release(session, nexttrn);
 	
-    PRIVDATA(conn)->can_write = 0;
+    session->can_write = 0;
 
     return 0;
 }
@@ -1002,32 +1162,29 @@ static int emi2_keepalive_handling (SMSCConn *conn, Connection *server)
 /*
  * the actual send logic: Send all queued messages in a burst.
  */
-static int emi2_do_send(SMSCConn *conn, Connection *server)
+static int emi2_do_send(struct emi2_session *session, Connection *server)
 {
+    SMSCConn *conn = session->conn;
     struct emimsg *emimsg;
     Msg *msg;
-    double delay = 0;
 
-    if (conn->throughput > 0) {
-        delay = 1.0 / conn->throughput;
-    }
-    
     /* Send messages if there's room in the sending window */
-    while (emi2_can_send(conn) &&
+    while (emi2_can_send(session) &&
            (msg = gw_prioqueue_remove(PRIVDATA(conn)->outgoing_queue)) != NULL) {
-        int nexttrn = emi2_next_trn(conn);
+        int nexttrn;
 
-        if (conn->throughput > 0)
-            gwthread_sleep(delay);
+        /* obey throughput speed limit, if any */
+        if (smscconn_shaper_wait(conn) == -1) {
+            gw_prioqueue_produce(PRIVDATA(conn)->outgoing_queue, msg);
+            return 0;
+        }
+
+        /* remember the message for retransmission or DLR */
+        nexttrn = emi2_slot_take(session, 51, msg);
 
         /* convert the generic Kannel message into an EMI type message */
         emimsg = msg_to_emimsg(msg, nexttrn, PRIVDATA(conn));
 
-        /* remember the message for retransmission or DLR */
-        PRIVDATA(conn)->slots[nexttrn].sendmsg = msg;
-        PRIVDATA(conn)->slots[nexttrn].sendtype = 51;
-        PRIVDATA(conn)->slots[nexttrn].sendtime = time(NULL);
-
         /* send the message */
         if (emi2_emimsg_send(conn, server, emimsg) == -1) {
             emimsg_destroy(emimsg);
@@ -1035,7 +1192,7 @@ static int emi2_do_send(SMSCConn *conn, Connection *server)
         }
 
         /* we just sent a message */
-        PRIVDATA(conn)->unacked++;
+        session->last_activity_time = gw_clock_mono();
 
         emimsg_destroy(emimsg);
 
@@ -1044,17 +1201,19 @@ static int emi2_do_send(SMSCConn *conn, Connection *server)
          * FIXME: couldn't this be done with the unacked field as well? After
          * all stop-wait is just a window of size 1.
          */
-        PRIVDATA(conn)->can_write = 0;
+        session->can_write = 0;
     }
 
     return 0;
 }
 
-static int emi2_handle_smscreq(SMSCConn *conn, Connection *server)
+static int emi2_handle_smscreq(struct emi2_session *session, Connection *server)
 {
+    SMSCConn *conn = session->conn;
     Octstr *str;
     struct emimsg *emimsg;
     PrivData *privdata = conn->data;
+    Msg *m;
     
     /* Read acks/nacks/ops from the server */
     while ((str = conn_read_packet(server, 2, 3))) {
@@ -1083,14 +1242,14 @@ static int emi2_handle_smscreq(SMSCConn *conn, Connection *server)
 		     octstr_get_cstr(privdata->name));
 	    }
 	} else {   /* Already checked to be 'O' or 'R' */
-	    if (!SLOTBUSY(conn,emimsg->trn) ||
-		emimsg->ot != PRIVDATA(conn)->slots[emimsg->trn].sendtype) {
+	    if (!SLOTBUSY(session,emimsg->trn) ||
+		emimsg->ot != session->slots[emimsg->trn].sendtype) {
 		error(0, "EMI2[%s]: Got ack for TRN %d, don't remember sending O?",
 		      octstr_get_cstr(privdata->name), emimsg->trn);
 	    } else {
-		PRIVDATA(conn)->can_write = 1;
-		PRIVDATA(conn)->slots[emimsg->trn].sendtime = 0;
-		PRIVDATA(conn)->unacked--;
+		session->can_write = 1;
+		m = session->slots[emimsg->trn].sendmsg;
+		emi2_slot_release(session, emimsg->trn);
 
 		if (emimsg->ot == 51) {
 		    if (octstr_get_char(emimsg->fields[0], 0) == 'A') {
@@ -1098,7 +1257,6 @@ static int emi2_handle_smscreq(SMSCConn *conn, Connection *server)
 			/* timestamp for delivery notifications now */
 			Octstr *ts, *adc;
 			int	i;
-			Msg *m;
 
 			ts = octstr_duplicate(emimsg->fields[2]);
 			if (octstr_len(ts)) {
@@ -1108,7 +1266,6 @@ static int emi2_handle_smscreq(SMSCConn *conn, Connection *server)
 				adc = octstr_duplicate(emimsg->fields[2]);
 				octstr_truncate(adc,i);
 
-				m = PRIVDATA(conn)->slots[emimsg->trn].sendmsg;
 				if(m == NULL) {
 				    info(0,"EMI2[%s]: uhhh m is NULL, very bad",
 					 octstr_get_cstr(privdata->name));
@@ -1124,9 +1281,7 @@ static int emi2_handle_smscreq(SMSCConn *conn, Connection *server)
 			/*
 			 * report the successful transmission to the generic bb code.
 			 */
-			bb_smscconn_sent(conn,
-				PRIVDATA(conn)->slots[emimsg->trn].sendmsg,
-				NULL);
+			bb_smscconn_sent(conn, m, NULL);
 		    } else {
 		        Octstr *reply;
 
@@ -1145,8 +1300,7 @@ static int emi2_handle_smscreq(SMSCConn *conn, Connection *server)
 			}
 
 			else { */
-			    bb_smscconn_send_failed(conn,
-					PRIVDATA(conn)->slots[emimsg->trn].sendmsg,
+			    bb_smscconn_send_failed(conn, m,
 					SMSCCONN_FAILED_REJECTED, reply);
 			/* } */
 		    }
@@ -1185,78 +1339,78 @@ static int emi2_handle_smscreq(SMSCConn *conn, Connection *server)
     return 0;
 }
 
-static void emi2_idleprocessing(SMSCConn *conn, Connection **server)
+static void emi2_idleprocessing(struct emi2_session *session, Connection **server)
 {
-    time_t current_time;
+    long current_time;
     int i;
-    PrivData *privdata = conn->data;
+    struct emi2_slot *slot, *next;
+    PrivData *privdata = PRIVDATA(session->conn);
     
     /*
      * Check whether there are messages the server hasn't acked in a
-     * reasonable time
+     * reasonable time. The busy slots are in sending order, so stop
+     * at the first one that is not overdue.
      */
-    current_time = time(NULL);
+    current_time = gw_clock_mono();
     
-    if (PRIVDATA(conn)->unacked && (current_time > (PRIVDATA(conn)->check_time + 30))) {
-	PRIVDATA(conn)->check_time = current_time;
-        for (i = 0; i < PRIVDATA(conn)->window; i++) {
-	    if (SLOTBUSY(conn,i)
-		&& PRIVDATA(conn)->slots[i].sendtime < (current_time - PRIVDATA(conn)->waitack)) {
-
-                if (PRIVDATA(conn)->slots[i].sendtype == 51) {
-                    if (PRIVDATA(conn)->waitack_expire == 0x00) {
+    if (session->unacked && (current_time > (session->check_time + 30))) {
+	session->check_time = current_time;
+        for (slot = session->oldest; slot != NULL &&
+             slot->sendtime < (current_time - privdata->waitack); slot = next) {
+	    next = slot->next;
+	    i = slot - session->slots;
+
+                if (slot->sendtype == 51) {
+                    if (privdata->waitack_expire == 0x00) {
                         /* 0x00 - disconnect/reconnect */
                         warning(0, "EMI2[%s]: received neither ACK nor NACK for message %d "
                             "in %d seconds, disconnecting and reconnection",
-                            octstr_get_cstr(privdata->name), i, PRIVDATA(conn)->waitack);
-		PRIVDATA(conn)->slots[i].sendtime = 0;
-		PRIVDATA(conn)->unacked--;
+                            octstr_get_cstr(privdata->name), i, privdata->waitack);
+                        /* clear_sent() requeues the message */
                         info(0, "EMI2[%s]: closing connection.",
                                   octstr_get_cstr(privdata->name));
                         conn_destroy(*server);
                         *server = NULL;
                         break;
-                    } else if (PRIVDATA(conn)->waitack_expire == 0x01) {
+                    } else if (privdata->waitack_expire == 0x01) {
                         /* 0x01 - resend */
 		    warning(0, "EMI2[%s]: received neither ACK nor NACK for message %d " 
 			    "in %d seconds, resending message", octstr_get_cstr(privdata->name),
-			    i, PRIVDATA(conn)->waitack);
-		    gw_prioqueue_produce(PRIVDATA(conn)->outgoing_queue,
-				 PRIVDATA(conn)->slots[i].sendmsg);
-                        PRIVDATA(conn)->slots[i].sendtime = 0;
-                        PRIVDATA(conn)->unacked--;
-		    if (PRIVDATA(conn)->flowcontrol) PRIVDATA(conn)->can_write=1;
+			    i, privdata->waitack);
+		    gw_prioqueue_produce(privdata->outgoing_queue, slot->sendmsg);
+                        emi2_slot_release(session, i);
+		    if (privdata->flowcontrol) session->can_write=1;
 		    /* Wake up this same thread to send again
 		     * (simpler than avoiding sleep) */
-		    gwthread_wakeup(PRIVDATA(conn)->sender_thread);
-                    } else if (PRIVDATA(conn)->waitack_expire == 0x02) {
+		    gwthread_wakeup(session->thread);
+                    } else if (privdata->waitack_expire == 0x02) {
                         /* 0x02 - carry on waiting */
                            warning(0, "EMI2[%s]: received neither ACK nor NACK for message %d "
                                 "in %d seconds, carrying on waiting", octstr_get_cstr(privdata->name),
-                                i, PRIVDATA(conn)->waitack);
+                                i, privdata->waitack);
                     }
-		} else if (PRIVDATA(conn)->slots[i].sendtype == 31) {
+		} else if (slot->sendtype == 31) {
 		    warning(0, "EMI2[%s]: Alert (operation 31) was not "
 			    "ACKed within %d seconds", octstr_get_cstr(privdata->name),
-			    PRIVDATA(conn)->waitack);
-		    if (PRIVDATA(conn)->flowcontrol) PRIVDATA(conn)->can_write=1;
+			    privdata->waitack);
+		    emi2_slot_release(session, i);
+		    if (privdata->flowcontrol) session->can_write=1;
 		} else {
 		    panic(0, "EMI2[%s]: Bug, no timeout handler for sent packet",
 			  octstr_get_cstr(privdata->name));
 		}
-	    }
 	}
     }
 }
 
-static void emi2_idletimeout_handling (SMSCConn *conn, Connection **server)
+static void emi2_idletimeout_handling (struct emi2_session *session, Connection **server)
 {
-    PrivData *privdata = conn->data;
+    PrivData *privdata = PRIVDATA(session->conn);
 
     /*
      * close the connection if there was no activity.
      */
-    if ((*server != NULL) && CONNECTIONIDLE(conn)) {
+    if ((*server != NULL) && CONNECTIONIDLE(session)) {
 	info(0, "EMI2[%s]: closing idle connection.",
 	     octstr_get_cstr(privdata->name));
 	conn_destroy(*server);
@@ -1267,10 +1421,11 @@ static void emi2_idletimeout_handling (SMSCConn *conn, Connection **server)
 /*
  * this function calculates the new timeouttime.
  */
-static double emi2_get_timeouttime (SMSCConn *conn, Connection *server)
+static double emi2_get_timeouttime (struct emi2_session *session, Connection *server)
 {
-    double ka_timeouttime = PRIVDATA(conn)->keepalive ? PRIVDATA(conn)->keepalive + 1 : DBL_MAX;
-    double idle_timeouttime = (PRIVDATA(conn)->idle_timeout && server) ? PRIVDATA(conn)->idle_timeout : DBL_MAX;
+    PrivData *privdata = PRIVDATA(session->conn);
+    double ka_timeouttime = privdata->keepalive ? privdata->keepalive + 1 : DBL_MAX;
+    double idle_timeouttime = (privdata->idle_timeout && server) ? privdata->idle_timeout : DBL_MAX;
     double result = ka_timeouttime < idle_timeouttime ? ka_timeouttime : idle_timeouttime;
 
     if (result == DBL_MAX)
@@ -1282,25 +1437,25 @@ static double emi2_get_timeouttime (SMSCConn *conn, Connection *server)
 /*
  * the main event processing loop.
  */
-static void emi2_send_loop(SMSCConn *conn, Connection **server)
+static void emi2_send_loop(struct emi2_session *session, Connection **server)
 {
-    PrivData *privdata = conn->data;
+    PrivData *privdata = PRIVDATA(session->conn);
 
     for (;;) {
 	double timeouttime;
 	EMI2Event event;
 	
-	if (emi2_needs_keepalive (conn)) {
+	if (emi2_needs_keepalive (session)) {
 	    if (*server == NULL) {
 		return; /* reopen the connection */
 	    }
 	    
-	    emi2_keepalive_handling (conn, *server);
+	    emi2_keepalive_handling (session, *server);
 	}
 	
-	timeouttime = emi2_get_timeouttime (conn, *server);
+	timeouttime = emi2_get_timeouttime (session, *server);
 	
-	event = emi2_wait (conn, *server, timeouttime);
+	event = emi2_wait (session, *server, timeouttime);
 	
 	switch (event) {
 	case EMI2_CONNERR:
@@ -1311,13 +1466,13 @@ static void emi2_send_loop(SMSCConn *conn, Connection **server)
 		return; /* reopen the connection */
 	    }
 	    
-	    if (emi2_do_send (conn, *server) < 0) {
+	    if (emi2_do_send (session, *server) < 0) {
 		return; /* reopen the connection */
 	    }
 	    break;
 	    
 	case EMI2_SMSCREQ:
-	    if (emi2_handle_smscreq (conn, *server) < 0) {
+	    if (emi2_handle_smscreq (session, *server) < 0) {
 		return; /* reopen the connection */
 	    }
 	    break;
@@ -1326,14 +1481,16 @@ static void emi2_send_loop(SMSCConn *conn, Connection **server)
 	    break;
 	}
 
-        if ((*server !=NULL) && (emi2_handle_smscreq (conn, *server) < 0)) {
+        if ((*server !=NULL) && (emi2_handle_smscreq (session, *server) < 0)) {
             return; /* reopen the connection */
         }
 	
-	emi2_idleprocessing (conn, server);
-	emi2_idletimeout_handling (conn, server);
+	emi2_idleprocessing (session, server);
+	if (*server == NULL && session->unacked > 0)
+	    return; /* reopen the connection, clear_sent() requeues */
+	emi2_idletimeout_handling (session, server);
 
-	if (PRIVDATA(conn)->shutdown && (PRIVDATA(conn)->unacked == 0)) {
+	if (privdata->shutdown && (session->unacked == 0)) {
 	    /* shutdown and no open messages */
 	    break;
 	}
@@ -1356,33 +1513,56 @@ static void emi2_send_loop(SMSCConn *conn, Connection **server)
 
 static void emi2_sender(void *arg)
 {
-    SMSCConn *conn = arg;
+    struct emi2_session *session = arg;
+    SMSCConn *conn = session->conn;
     PrivData *privdata = conn->data;
     Msg *msg;
     Connection *server;
+    int i;
 
     /* Make sure we log into our own log-file if defined */
     log_thread_to(conn->log_idx);
 
     while (!privdata->shutdown) {
-	if ((server = open_send_connection(conn)) == NULL) {
+	if ((server = open_send_connection(session)) == NULL) {
 	    privdata->shutdown = 1;
 	    if (privdata->rport > 0)
 		gwthread_wakeup(privdata->receiver_thread);
+	    emi2_wakeup_senders(privdata);
 	    break;
 	}
-	emi2_send_loop(conn, &server);
-	clear_sent(privdata);
+	emi2_send_loop(session, &server);
+	clear_sent(session);
 
 	if (server != NULL) {
 	    conn_destroy(server);
 	}
+	mutex_lock(conn->flow_mutex);
+	session->connected = 0;
+	emi2_update_status(conn);
+	mutex_unlock(conn->flow_mutex);
+    }
+
+    /*
+     * The first session joins all other sessions and cleans up,
+     * the others just end.
+     */
+    if (session != &privdata->sessions[0])
+	return;
+
+    for (i = 1; i < privdata->num_sessions; i++) {
+	if (privdata->sessions[i].thread == -1)
+	    continue;
+	gwthread_wakeup(privdata->sessions[i].thread);
+	gwthread_join(privdata->sessions[i].thread);
     }
 
     while((msg = gw_prioqueue_remove(privdata->outgoing_queue)) != NULL)
 	bb_smscconn_send_failed(conn, msg, SMSCCONN_FAILED_SHUTDOWN, NULL);
     if (privdata->rport > 0)
 	gwthread_join(privdata->receiver_thread);
+    /* notifications still being resolved refer to privdata */
+    dlr_resolve_wait(privdata->dlr_pending);
     mutex_lock(conn->flow_mutex);
 
     conn->status = SMSCCONN_DEAD;
@@ -1401,6 +1581,8 @@ static void emi2_sender(void *arg)
     octstr_destroy(privdata->password);
     octstr_destroy(privdata->npid);
     octstr_destroy(privdata->nadc);
+    gwlist_destroy(privdata->dlr_pending, NULL);
+    gw_free(privdata->sessions);
     gw_free(privdata);
     conn->data = NULL;
 
@@ -1539,7 +1721,7 @@ static void emi2_listener(void *arg)
     if (close(privdata->listening_socket) == -1)
 	warning(errno, "EMI2[%s]: couldn't close listening socket "
 		"at shutdown", octstr_get_cstr(privdata->name));
-    gwthread_wakeup(privdata->sender_thread);
+    emi2_wakeup_senders(privdata);
 }
 
 
@@ -1550,7 +1732,7 @@ static int add_msg_cb(SMSCConn *conn, Msg *sms)
 
     copy = msg_duplicate(sms);
     gw_prioqueue_produce(privdata->outgoing_queue, copy);
-    gwthread_wakeup(privdata->sender_thread);
+    emi2_wakeup_senders(privdata);
 
     return 0;
 }
@@ -1579,6 +1761,7 @@ static int shutdown_cb(SMSCConn *conn, int finish_sending)
 
     if (privdata->rport > 0)
 	gwthread_wakeup(privdata->receiver_thread);
+    emi2_wakeup_senders(privdata);
     return 0;
 }
 
@@ -1615,19 +1798,18 @@ int smsc_emi2_create(SMSCConn *conn, CfgGroup *cfg)
     Octstr *allow_ip, *deny_ip, *host, *alt_host;
     long portno, our_port, keepalive, flowcontrol, waitack, 
          idle_timeout, alt_portno, alt_charset, waitack_expire;
-    long window;
+    long window, sessions;
     	/* has to be long because of cfg_get_integer */
     int i;
 
     allow_ip = deny_ip = host = alt_host = NULL; 
 
     privdata = gw_malloc(sizeof(PrivData));
-    privdata->outgoing_queue = gw_prioqueue_create(sms_priority_compare);
+    privdata->outgoing_queue = gw_prioqueue_create_levels(SMS_PRIORITY_LEVELS, sms_priority_level);
+    privdata->dlr_pending = gwlist_create();
     privdata->listening_socket = -1;
-    privdata->can_write = 1;
-    privdata->priv_nexttrn = 0;
-    privdata->last_activity_time = 0;
-    privdata->check_time = 0;
+    privdata->sessions = NULL;
+    privdata->num_sessions = 0;
     
     host = cfg_get(cfg, octstr_imm("host"));
     if (host == NULL) {
@@ -1738,6 +1920,14 @@ int smsc_emi2_create(SMSCConn *conn, CfgGroup *cfg)
 	privdata->window = EMI2_MAX_TRN;
     }
 
+    if (cfg_get_integer(&sessions, cfg, octstr_imm("sessions")) == -1)
+	sessions = 1;
+    if (sessions < 1) {
+	error(0, "EMI2[%s]: 'sessions' invalid in emi2 configuration.",
+	      octstr_get_cstr(privdata->name));
+	goto error;
+    }
+
     if (cfg_get_integer(&waitack, cfg, octstr_imm("wait-ack")) < 0)
 	privdata->waitack = 60;
     else
@@ -1773,6 +1963,7 @@ int smsc_emi2_create(SMSCConn *conn, CfgGroup *cfg)
     privdata->deny_ip = deny_ip;
 
     if (privdata->rport > 0 && emi2_open_listening_socket(conn,privdata) < 0) {
+	gwlist_destroy(privdata->dlr_pending, NULL);
 	gw_free(privdata);
 	privdata = NULL;
 	goto error;
@@ -1785,19 +1976,32 @@ int smsc_emi2_create(SMSCConn *conn, CfgGroup *cfg)
 
     privdata->shutdown = 0;
 
-    for (i = 0; i < EMI2_MAX_TRN; i++)
-	privdata->slots[i].sendtime = 0;
-    privdata->unacked = 0;
+    privdata->num_sessions = sessions;
+    privdata->sessions = gw_malloc(sessions * sizeof(*privdata->sessions));
+    for (i = 0; i < sessions; i++)
+	emi2_session_init(&privdata->sessions[i], conn);
 
     conn->status = SMSCCONN_CONNECTING;
-    conn->connect_time = time(NULL);
+    conn->connect_time = gw_clock_mono();
 
     if ( privdata->rport > 0 && (privdata->receiver_thread =
 	  gwthread_create(emi2_listener, conn)) == -1)
 	  goto error;
 
-    if ((privdata->sender_thread = gwthread_create(emi2_sender, conn)) == -1) {
+    /* the first session cleans up after the others, so start it last */
+    for (i = sessions - 1; i >= 0; i--) {
+	privdata->sessions[i].thread = gwthread_create(emi2_sender, &privdata->sessions[i]);
+	if (privdata->sessions[i].thread == -1)
+	    break;
+    }
+    if (i >= 0) {
 	privdata->shutdown = 1;
+	for (i = 0; i < sessions; i++) {
+	    if (privdata->sessions[i].thread == -1)
+		continue;
+	    gwthread_wakeup(privdata->sessions[i].thread);
+	    gwthread_join(privdata->sessions[i].thread);
+	}
 	if (privdata->rport > 0) {
 	    gwthread_wakeup(privdata->receiver_thread);
 	    gwthread_join(privdata->receiver_thread);
@@ -1817,6 +2021,8 @@ error:
             (privdata ? octstr_get_cstr(privdata->name) : "-"));
     if (privdata != NULL) {
 	gw_prioqueue_destroy(privdata->outgoing_queue, NULL);
+	gwlist_destroy(privdata->dlr_pending, NULL);
+	gw_free(privdata->sessions);
     }
     gw_free(privdata);
     octstr_destroy(allow_ip);
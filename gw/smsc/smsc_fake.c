@@ -260,11 +260,6 @@ static void main_connection_loop(SMSCConn *conn, Connection *client)
     PrivData *privdata = conn->data;
     Octstr *line;
     Msg	*msg;
-    double delay = 0;
-
-    if (conn->throughput > 0) {
-        delay = 1.0 / conn->throughput;
-    }
 
     while (1) {
         while (!conn->is_stopped && !privdata->shutdown &&
@@ -284,6 +279,12 @@ static void main_connection_loop(SMSCConn *conn, Connection *client)
 
         while ((msg = gwlist_extract_first(privdata->outgoing_queue)) != NULL) {
 
+            /* obey throughput speed limit, if any */
+            if (smscconn_shaper_wait(conn) == -1) {
+                gwlist_insert(privdata->outgoing_queue, 0, msg);
+                break;
+            }
+
             /* pass msg to fakesmsc daemon */            
             if (sms_to_client(client, msg) == 1) {
                 Msg *copy = msg_duplicate(msg);
@@ -327,11 +328,6 @@ static void main_connection_loop(SMSCConn *conn, Connection *client)
 		            SMSCCONN_FAILED_REJECTED, octstr_create("REJECTED"));
                 goto error;
             }
-
-            /* obey throughput speed limit, if any */
-            if (conn->throughput > 0) {
-                gwthread_sleep(delay);
-            }
         }
         if (privdata->shutdown) {
             debug("bb.sms", 0, "smsc_fake shutting down, closing client socket");
@@ -412,7 +408,7 @@ static void fake_listener(void *arg)
         octstr_destroy(ip);
         mutex_lock(conn->flow_mutex);
         conn->status = SMSCCONN_ACTIVE;
-        conn->connect_time = time(NULL);
+        conn->connect_time = gw_clock_mono();
         mutex_unlock(conn->flow_mutex);
         bb_smscconn_connected(conn);
 
@@ -570,7 +566,7 @@ int smsc_fake_create(SMSCConn *conn, CfgGroup *cfg)
     privdata->shutdown = 0;
 
     conn->status = SMSCCONN_CONNECTING;
-    conn->connect_time = time(NULL);
+    conn->connect_time = gw_clock_mono();
 
     if ((privdata->connection_thread = gwthread_create(fake_listener, conn)) == -1)
         goto error;
@@ -283,15 +283,10 @@ static void httpsmsc_sender(void *arg)
     SMSCConn *conn = arg;
     ConnData *conndata = conn->data;
     Msg *msg;
-    double delay = 0;
 
     /* Make sure we log into our own log-file if defined */
     log_thread_to(conn->log_idx);
 
-    if (conn->throughput) {
-        delay = 1.0 / conn->throughput;
-    }
-
     while (conndata->shutdown == 0) {
         /* check if we can send ; otherwise block on semaphore */
         if (conndata->max_pending_sends)
@@ -308,8 +303,11 @@ static void httpsmsc_sender(void *arg)
             break;
 
         /* obey throughput speed limit, if any */
-        if (conn->throughput > 0) {
-            gwthread_sleep(delay);
+        if (smscconn_shaper_wait(conn) == -1) {
+            gwlist_insert(conndata->msg_to_send, 0, msg);
+            if (conndata->max_pending_sends)
+                semaphore_up(conndata->max_pending_sends);
+            break;
         }
         counter_increase(conndata->open_sends);
         if (conndata->callbacks->send_sms(conn, msg) == -1) {
@@ -394,7 +392,7 @@ static void httpsmsc_send_cb(void *arg)
                 /* and now enable routing again */
                 mutex_lock(conn->flow_mutex);
                 conn->status = SMSCCONN_ACTIVE;
-                time(&conn->connect_time);
+                conn->connect_time = gw_clock_mono();
                 mutex_unlock(conn->flow_mutex);
                 /* tell bearerbox core that we are connected again */
                 bb_smscconn_connected(conn);
@@ -411,7 +409,7 @@ static void httpsmsc_send_cb(void *arg)
             if (conn->status != SMSCCONN_ACTIVE) {
                 mutex_lock(conn->flow_mutex);
                 conn->status = SMSCCONN_ACTIVE;
-                time(&conn->connect_time);
+                conn->connect_time = gw_clock_mono();
                 mutex_unlock(conn->flow_mutex);
                 /* tell bearerbox core that we are connected again */
                 bb_smscconn_connected(conn);
@@ -976,7 +974,7 @@ int smsc_http_create(SMSCConn *conn, CfgGroup *cfg)
     }
 
 
-    conn->connect_time = time(NULL);
+    conn->connect_time = gw_clock_mono();
 
     conn->shutdown = httpsmsc_shutdown;
     conn->queued = httpsmsc_queued;
@@ -149,7 +149,7 @@ static int shutdown_cb(SMSCConn *conn, int finish_sending)
 static void start_cb(SMSCConn *conn)
 {
     conn->status = SMSCCONN_ACTIVE;
-    conn->connect_time = time(NULL);
+    conn->connect_time = gw_clock_mono();
 }
 
 
@@ -168,7 +168,7 @@ int smsc_loopback_create(SMSCConn *conn, CfgGroup *cfg)
     conn->name = octstr_format("LOOPBACK:%S", conn->id);
   
     conn->status = SMSCCONN_CONNECTING;
-    conn->connect_time = time(NULL);
+    conn->connect_time = gw_clock_mono();
 
     conn->shutdown = shutdown_cb;
     conn->queued = queued_cb;
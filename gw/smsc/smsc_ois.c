@@ -428,7 +428,7 @@ void ois_delete_queue(SMSCenter *smsc)
     SAY(2, "ois_delete_queue");
 
     while (ois_receive_msg(smsc, &msg) > 0) {
-	gw_free(msg);
+	msg_destroy(msg);
     }
     return;
 }
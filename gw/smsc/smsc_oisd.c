@@ -1370,7 +1370,7 @@ static void io_thread (void *arg)
             }
             mutex_lock(conn->flow_mutex);
             conn->status = SMSCCONN_ACTIVE;
-            conn->connect_time = time(NULL);
+            conn->connect_time = gw_clock_mono();
             bb_smscconn_connected(conn);
             mutex_unlock(conn->flow_mutex);
         }
@@ -793,7 +793,7 @@ static void handle_pdu(SMASI *smasi, Connection *conn,
             *pending_submits = 0;
 
             smasi->conn->status = SMSCCONN_ACTIVE;
-            smasi->conn->connect_time = time(NULL);
+            smasi->conn->connect_time = gw_clock_mono();
 
             bb_smscconn_connected(smasi->conn);
 
@@ -868,14 +868,8 @@ static Connection *open_connection(SMASI *smasi)
 static void send_messages(SMASI *smasi, Connection *conn, 
                           long *pending_submits) 
 {
-    double delay = 0;
-
     if (*pending_submits == -1) return;
 
-    if (smasi->conn->throughput > 0) {
-        delay = 1.0 / smasi->conn->throughput;
-    }
-
     while (*pending_submits < MAX_PENDING_SUBMITS) {
         SMASI_PDU *pdu = NULL;
         /* Get next message, quit if none to be sent. */
@@ -883,6 +877,12 @@ static void send_messages(SMASI *smasi, Connection *conn,
 
         if (msg == NULL) break;
 
+        /* obey throughput speed limit, if any */
+        if (smscconn_shaper_wait(smasi->conn) == -1) {
+            gwlist_insert(smasi->msgs_to_send, 0, msg);
+            break;
+        }
+
         /* Send PDU, record it as waiting for ack from SMSC. */
         pdu = msg_to_pdu(smasi, msg);
 
@@ -893,10 +893,6 @@ static void send_messages(SMASI *smasi, Connection *conn,
 
         smasi_pdu_destroy(pdu);
 
-        /* obey throughput speed limit, if any */
-        if (smasi->conn->throughput > 0)
-            gwthread_sleep(delay);
-
         ++(*pending_submits);
     }
 }
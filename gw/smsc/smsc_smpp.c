@@ -79,7 +79,6 @@
 #include "dlr.h"
 #include "bearerbox.h"
 #include "meta_data.h"
-#include "load.h"
 
 #define SMPP_DEFAULT_CHARSET "UTF-8"
 
@@ -140,13 +139,18 @@ enum smpp_pdu_dump_format {
  */
 
 
+struct smpp_window;
+struct smpp_session;
+struct smpp_loop;
+
 typedef struct {
-    long transmitter;
-    long receiver;
+    struct smpp_session *sessions;
+    long num_sessions;
     gw_prioqueue_t *msgs_to_send;
-    Dict *sent_msgs;
     List *received_msgs;
     Counter *message_id_counter;
+    List *dlr_pending;      /* receipts handed to dlr_resolve() */
+    Counter *running;       /* sessions still on an event loop */
     Octstr *host;
     Octstr *system_type;
     Octstr *username;
@@ -182,7 +186,7 @@ typedef struct {
     int wait_ack_action;
     int esm_class;
     long log_format;
-    Load *load;
+    SMPP_TLV_Table *tlv_table;  /* configured TLVs of this smsc-id */
     SMSCConn *conn;
 } SMPP;
 
@@ -190,6 +194,10 @@ typedef struct {
 struct smpp_msg {
     time_t sent_time;
     Msg *msg;
+    unsigned long sequence_number;
+    struct smpp_msg *hash_next; /* next in window bucket */
+    struct smpp_msg *prev;      /* previous/next sent in window */
+    struct smpp_msg *next;
 };
 
 
@@ -201,7 +209,7 @@ static inline struct smpp_msg* smpp_msg_create(Msg *msg)
     struct smpp_msg *result = gw_malloc(sizeof(struct smpp_msg));
 
     gw_assert(result != NULL);
-    result->sent_time = time(NULL);
+    result->sent_time = gw_clock_mono();
     result->msg = msg;
 
     return result;
@@ -224,6 +232,256 @@ static inline void smpp_msg_destroy(struct smpp_msg *msg, int destroy_msg)
 }
 
 
+/*
+ * Window of submits waiting for their response. Entries are hashed on
+ * the sequence number and also linked in the order they were sent, so
+ * a response is matched without searching and expiry only looks at the
+ * entries that actually timed out. Each session keeps its own window,
+ * since the SMSC answers a submit on the bind it was sent on.
+ */
+struct smpp_window {
+    Mutex *lock;
+    struct smpp_msg **buckets;
+    unsigned long mask;
+    struct smpp_msg *oldest;
+    struct smpp_msg *newest;
+};
+
+
+static struct smpp_window *smpp_window_create(long max_pending_submits)
+{
+    struct smpp_window *w;
+    unsigned long size;
+
+    /* power of two, so the low bits of the sequence number index it */
+    for (size = 16; size < (unsigned long) max_pending_submits; size <<= 1)
+        ;
+
+    w = gw_malloc(sizeof(*w));
+    w->lock = mutex_create();
+    w->buckets = gw_malloc(size * sizeof(*w->buckets));
+    memset(w->buckets, 0, size * sizeof(*w->buckets));
+    w->mask = size - 1;
+    w->oldest = w->newest = NULL;
+
+    return w;
+}
+
+
+/* add msg as the newest entry, msg->sequence_number has to be set */
+static void smpp_window_put(struct smpp_window *w, struct smpp_msg *msg)
+{
+    struct smpp_msg **bucket;
+
+    mutex_lock(w->lock);
+    bucket = &w->buckets[msg->sequence_number & w->mask];
+    msg->hash_next = *bucket;
+    *bucket = msg;
+    msg->next = NULL;
+    msg->prev = w->newest;
+    if (w->newest != NULL)
+        w->newest->next = msg;
+    else
+        w->oldest = msg;
+    w->newest = msg;
+    mutex_unlock(w->lock);
+}
+
+
+/* unlink msg from its bucket and the send order, lock has to be held */
+static void smpp_window_unlink(struct smpp_window *w, struct smpp_msg *msg)
+{
+    struct smpp_msg **p;
+
+    for (p = &w->buckets[msg->sequence_number & w->mask]; *p != msg; p = &(*p)->hash_next)
+        gw_assert(*p != NULL);
+    *p = msg->hash_next;
+
+    if (msg->prev != NULL)
+        msg->prev->next = msg->next;
+    else
+        w->oldest = msg->next;
+    if (msg->next != NULL)
+        msg->next->prev = msg->prev;
+    else
+        w->newest = msg->prev;
+}
+
+
+/* remove and return the entry for sequence_number, NULL if not found */
+static struct smpp_msg *smpp_window_remove(struct smpp_window *w, unsigned long sequence_number)
+{
+    struct smpp_msg *msg;
+
+    mutex_lock(w->lock);
+    for (msg = w->buckets[sequence_number & w->mask]; msg != NULL; msg = msg->hash_next)
+        if (msg->sequence_number == sequence_number)
+            break;
+    if (msg != NULL)
+        smpp_window_unlink(w, msg);
+    mutex_unlock(w->lock);
+
+    return msg;
+}
+
+
+/*
+ * Remove and return the oldest entry if it was sent before the given
+ * time, or any oldest entry if before is -1. NULL if there is none.
+ */
+static struct smpp_msg *smpp_window_remove_oldest(struct smpp_window *w, time_t before)
+{
+    struct smpp_msg *msg;
+
+    mutex_lock(w->lock);
+    msg = w->oldest;
+    if (msg != NULL && (before == -1 || (before - msg->sent_time) > 0))
+        smpp_window_unlink(w, msg);
+    else
+        msg = NULL;
+    mutex_unlock(w->lock);
+
+    return msg;
+}
+
+
+/* return the send time of the oldest entry, -1 if the window is empty */
+static time_t smpp_window_oldest_time(struct smpp_window *w)
+{
+    time_t t;
+
+    mutex_lock(w->lock);
+    t = (w->oldest != NULL ? w->oldest->sent_time : -1);
+    mutex_unlock(w->lock);
+
+    return t;
+}
+
+
+static void smpp_window_destroy(struct smpp_window *w)
+{
+    struct smpp_msg *msg;
+
+    if (w == NULL)
+        return;
+
+    while ((msg = smpp_window_remove_oldest(w, -1)) != NULL)
+        smpp_msg_destroy(msg, 1);
+    gw_free(w->buckets);
+    mutex_destroy(w->lock);
+    gw_free(w);
+}
+
+
+/*
+ * One bind towards the SMSC. An SMPP connection runs 'binds' transmitter
+ * or transceiver sessions and optionally one receiver session. All
+ * transmitting sessions pull from the shared msgs_to_send queue, so a
+ * bind takes messages only while it has room in its window.
+ */
+struct smpp_session {
+    SMPP *smpp;
+    int transmitter;        /* 0 receiver, 1 transmitter, 2 transceiver */
+    long thread;
+    volatile int bound;     /* 1 bound, 0 not yet, -1 rejected or unbound */
+    volatile long pending_submits;
+    struct smpp_window *sent_msgs;
+    Msg *throttled;         /* taken from msgs_to_send, waits for a token */
+    /* the rest is only used when the session runs on an event loop */
+    struct smpp_loop *loop;
+    Mutex *lock;
+    Connection *conn;
+    int state;              /* SMPP_SESSION_* */
+    Octstr *addr;           /* address of smpp->host, see smpp_resolver_thread */
+    volatile int resolved;  /* the resolver is done with addr */
+    long len;               /* length of the PDU being read */
+    volatile int kicked;    /* run again, something happened */
+    volatile int polled;    /* the socket reported an event */
+    double due;             /* next timer to check, see smpp_loop_now() */
+    time_t state_time, last_cleanup, last_enquire_sent, last_response;
+};
+
+/* states of a session on an event loop */
+#define SMPP_SESSION_IDLE        0  /* waiting to (re)connect */
+#define SMPP_SESSION_RESOLVING   1  /* host name being looked up */
+#define SMPP_SESSION_CONNECTING  2  /* non-blocking connect in progress */
+#define SMPP_SESSION_OPEN        3  /* bind sent or bound */
+#define SMPP_SESSION_UNBINDING   4  /* unbind sent, reading until unbind_resp */
+#define SMPP_SESSION_DONE        5  /* shut down, the loop drops it */
+
+/* a transmitting session has something to send */
+#define SMPP_HAS_WORK(smpp, session) \
+    ((session)->throttled != NULL || gw_prioqueue_len((smpp)->msgs_to_send) > 0)
+
+static void smpp_session_wakeup(struct smpp_session *session);
+
+
+/*
+ * Derive the SMSCConn status from all sessions: active while any
+ * transmitting session is bound, receive only if just the receiver is,
+ * 'unbound' otherwise. Caller has to hold conn->flow_mutex.
+ */
+static void smpp_update_status(SMPP *smpp, int unbound)
+{
+    struct smpp_session *session;
+    int tx = 0, rx = 0;
+    long i;
+
+    for (i = 0; i < smpp->num_sessions; i++) {
+        session = &smpp->sessions[i];
+        if (session->bound == 1) {
+            if (session->transmitter)
+                tx++;
+            else
+                rx++;
+        }
+    }
+
+    if (tx > 0) {
+        if (smpp->conn->status != SMSCCONN_ACTIVE) {
+            smpp->conn->status = SMSCCONN_ACTIVE;
+            smpp->conn->connect_time = gw_clock_mono();
+        }
+    } else if (rx > 0) {
+        if (smpp->conn->status != SMSCCONN_ACTIVE_RECV) {
+            smpp->conn->status = SMSCCONN_ACTIVE_RECV;
+            smpp->conn->connect_time = gw_clock_mono();
+        }
+    } else {
+        smpp->conn->status = unbound;
+    }
+}
+
+
+/*
+ * Wake up the bound transmitting session with the most free room in its
+ * window, other than 'self'. Sessions that answer quickly free their
+ * window first, so they also get the most traffic.
+ */
+static void smpp_wakeup_sender(SMPP *smpp, struct smpp_session *self)
+{
+    struct smpp_session *session, *best = NULL;
+    long i, room, best_room = 0;
+
+    for (i = 0; i < smpp->num_sessions; i++) {
+        session = &smpp->sessions[i];
+        if (session == self || !session->transmitter || session->bound != 1)
+            continue;
+        room = smpp->max_pending_submits - session->pending_submits;
+        if (room > best_room) {
+            best = session;
+            best_room = room;
+        }
+    }
+    if (best == NULL)
+        return;
+    if (best->loop != NULL)
+        smpp_session_wakeup(best);
+    else
+        gwthread_wakeup(best->thread);
+}
+
+
 static SMPP *smpp_create(SMSCConn *conn, Octstr *host, int transmit_port,
                          int receive_port, int our_port, int our_receiver_port, Octstr *system_type,
                          Octstr *username, Octstr *password,
@@ -240,14 +498,15 @@ static SMPP *smpp_create(SMSCConn *conn, Octstr *host, int transmit_port,
     SMPP *smpp;
 
     smpp = gw_malloc(sizeof(*smpp));
-    smpp->transmitter = -1;
-    smpp->receiver = -1;
-    smpp->msgs_to_send = gw_prioqueue_create(sms_priority_compare);
-    smpp->sent_msgs = dict_create(max_pending_submits, NULL);
+    smpp->sessions = NULL;
+    smpp->num_sessions = 0;
+    smpp->msgs_to_send = gw_prioqueue_create_levels(SMS_PRIORITY_LEVELS, sms_priority_level);
     gw_prioqueue_add_producer(smpp->msgs_to_send);
     smpp->received_msgs = gwlist_create();
     smpp->message_id_counter = counter_create();
     counter_increase(smpp->message_id_counter);
+    smpp->dlr_pending = gwlist_create();
+    smpp->running = counter_create();
     smpp->host = octstr_duplicate(host);
     smpp->system_type = octstr_duplicate(system_type);
     smpp->our_port = our_port;
@@ -270,6 +529,7 @@ static SMPP *smpp_create(SMSCConn *conn, Octstr *host, int transmit_port,
     smpp->priority = priority;
     smpp->validityperiod = validity;
     smpp->conn = conn;
+    smpp->tlv_table = smpp_pdu_tlv_table(conn->id);
     smpp->throttling_err_time = 0;
     smpp->smpp_msg_id_type = smpp_msg_id_type;
     smpp->autodetect_addr = autodetect_addr;
@@ -282,8 +542,6 @@ static SMPP *smpp_create(SMSCConn *conn, Octstr *host, int transmit_port,
     smpp->bind_addr_npi = 0;
     smpp->use_ssl = 0;
     smpp->ssl_client_certkey_file = NULL;
-    smpp->load = load_create_real(0);
-    load_add_interval(smpp->load, 1);
     smpp->esm_class = esm_class;
 
     return smpp;
@@ -292,11 +550,22 @@ static SMPP *smpp_create(SMSCConn *conn, Octstr *host, int transmit_port,
 
 static void smpp_destroy(SMPP *smpp)
 {
+    long i;
+
     if (smpp != NULL) {
         gw_prioqueue_destroy(smpp->msgs_to_send, msg_destroy_item);
-        dict_destroy(smpp->sent_msgs);
+        for (i = 0; i < smpp->num_sessions; i++) {
+            smpp_window_destroy(smpp->sessions[i].sent_msgs);
+            msg_destroy(smpp->sessions[i].throttled);
+            octstr_destroy(smpp->sessions[i].addr);
+            if (smpp->sessions[i].lock != NULL)
+                mutex_destroy(smpp->sessions[i].lock);
+        }
+        gw_free(smpp->sessions);
         gwlist_destroy(smpp->received_msgs, msg_destroy_item);
         counter_destroy(smpp->message_id_counter);
+        gwlist_destroy(smpp->dlr_pending, NULL);
+        counter_destroy(smpp->running);
         octstr_destroy(smpp->host);
         octstr_destroy(smpp->username);
         octstr_destroy(smpp->password);
@@ -307,7 +576,6 @@ static void smpp_destroy(SMPP *smpp)
         octstr_destroy(smpp->alt_charset);
         octstr_destroy(smpp->alt_addr_charset);
         octstr_destroy(smpp->ssl_client_certkey_file);
-        load_destroy(smpp->load);
         gw_free(smpp);
     }
 }
@@ -347,7 +615,7 @@ static int read_pdu(SMPP *smpp, Connection *conn, long *len, SMPP_PDU **pdu)
     }
     *len = 0;
 
-    *pdu = smpp_pdu_unpack(smpp->conn->id, os);
+    *pdu = smpp_pdu_unpack_table(smpp->tlv_table, os);
     if (*pdu == NULL) {
         error(0, "SMPP[%s]: PDU unpacking failed.",
               octstr_get_cstr(smpp->conn->id));
@@ -1095,7 +1363,7 @@ static SMPP_PDU *msg_to_pdu(SMPP *smpp, Msg *msg)
     if (msg->sms.validity != SMS_PARAM_UNDEFINED)
     	validity = msg->sms.validity;
     else if (smpp->validityperiod != SMS_PARAM_UNDEFINED)
-    	validity = time(NULL) + smpp->validityperiod * 60;
+    	validity = gw_clock_now() + smpp->validityperiod * 60;
     if (validity != SMS_PARAM_UNDEFINED) {
         struct tm tm = gw_gmtime(validity);
         pdu->u.submit_sm.validity_period = octstr_format("%02d%02d%02d%02d%02d%02d000+",
@@ -1142,13 +1410,13 @@ static int send_enquire_link(SMPP *smpp, Connection *conn, long *last_sent)
     Octstr *os;
     int ret;
 
-    if (difftime(date_universal_now(),*last_sent) < smpp->enquire_link_interval)
+    if ((gw_clock_mono() - *last_sent) < smpp->enquire_link_interval)
         return 0;
-    *last_sent = date_universal_now();
+    *last_sent = gw_clock_mono();
 
     pdu = smpp_pdu_create(enquire_link, counter_increase(smpp->message_id_counter));
     dump_pdu("Sending enquire link:", smpp->conn->id, pdu, smpp->log_format);
-    os = smpp_pdu_pack(smpp->conn->id, pdu);
+    os = smpp_pdu_pack_table(smpp->tlv_table, pdu);
     if (os != NULL)
         ret = conn_write(conn, os); /* Write errors checked by caller. */
     else
@@ -1168,7 +1436,7 @@ static int send_gnack(SMPP *smpp, Connection *conn, long reason, unsigned long s
     pdu = smpp_pdu_create(generic_nack, seq_num);
     pdu->u.generic_nack.command_status = reason;
     dump_pdu("Sending generic_nack:", smpp->conn->id, pdu, smpp->log_format);
-    os = smpp_pdu_pack(smpp->conn->id, pdu);
+    os = smpp_pdu_pack_table(smpp->tlv_table, pdu);
     if (os != NULL)
         ret = conn_write(conn, os);
     else
@@ -1187,7 +1455,7 @@ static int send_unbind(SMPP *smpp, Connection *conn)
 
     pdu = smpp_pdu_create(unbind, counter_increase(smpp->message_id_counter));
     dump_pdu("Sending unbind:", smpp->conn->id, pdu, smpp->log_format);
-    os = smpp_pdu_pack(smpp->conn->id, pdu);
+    os = smpp_pdu_pack_table(smpp->tlv_table, pdu);
     if (os != NULL)
         ret = conn_write(conn, os);
     else
@@ -1205,7 +1473,7 @@ static int send_pdu(Connection *conn, SMPP *smpp, SMPP_PDU *pdu)
     int ret;
 
     dump_pdu("Sending PDU:", smpp->conn->id, pdu, smpp->log_format);
-    os = smpp_pdu_pack(smpp->conn->id, pdu);
+    os = smpp_pdu_pack_table(smpp->tlv_table, pdu);
     if (os) {
         /* Caller checks for write errors later */
         ret = conn_write(conn, os);
@@ -1218,29 +1486,28 @@ static int send_pdu(Connection *conn, SMPP *smpp, SMPP_PDU *pdu)
 }
 
 
-static int send_messages(SMPP *smpp, Connection *conn, long *pending_submits)
+static int send_messages(SMPP *smpp, Connection *conn, struct smpp_session *session)
 {
     Msg *msg;
     SMPP_PDU *pdu;
-    Octstr *os;
 
-    if (*pending_submits == -1)
+    if (session->pending_submits == -1)
         return 0;
 
-    while (*pending_submits < smpp->max_pending_submits) {
-        /* check our throughput */
-        if (smpp->conn->throughput > 0 && load_get(smpp->load, 0) >= smpp->conn->throughput) {
-            debug("bb.sms.smpp", 0, "SMPP[%s]: throughput limit exceeded (%.02f,%.02f)",
-                  octstr_get_cstr(smpp->conn->id), load_get(smpp->load, 0), smpp->conn->throughput);
+    while (session->pending_submits < smpp->max_pending_submits) {
+        /* Get next message, quit if none to be sent */
+        if ((msg = session->throttled) == NULL &&
+            (msg = gw_prioqueue_remove(smpp->msgs_to_send)) == NULL)
             break;
-        }
-        debug("bb.sms.smpp", 0, "SMPP[%s]: throughput (%.02f,%.02f)",
-              octstr_get_cstr(smpp->conn->id), load_get(smpp->load, 0), smpp->conn->throughput);
+        session->throttled = NULL;
 
-        /* Get next message, quit if none to be sent */
-        msg = gw_prioqueue_remove(smpp->msgs_to_send);
-        if (msg == NULL)
+        /* check our throughput, keep the message until the next token */
+        if (smpp->conn->shaper != NULL && !gw_shaper_take(smpp->conn->shaper)) {
+            debug("bb.sms.smpp", 0, "SMPP[%s]: throughput limit exceeded (%.02f)",
+                  octstr_get_cstr(smpp->conn->id), smpp->conn->throughput);
+            session->throttled = msg;
             break;
+        }
 
         /* Send PDU, record it as waiting for ack from SMS center */
         pdu = msg_to_pdu(smpp, msg);
@@ -1251,12 +1518,10 @@ static int send_messages(SMPP *smpp, Connection *conn, long *pending_submits)
         /* check for write errors */
         if (send_pdu(conn, smpp, pdu) == 0) {
             struct smpp_msg *smpp_msg = smpp_msg_create(msg);
-            os = octstr_format("%ld", pdu->u.submit_sm.sequence_number);
-            dict_put(smpp->sent_msgs, os, smpp_msg);
+            smpp_msg->sequence_number = pdu->u.submit_sm.sequence_number;
+            smpp_window_put(session->sent_msgs, smpp_msg);
             smpp_pdu_destroy(pdu);
-            octstr_destroy(os);
-            ++(*pending_submits);
-            load_increase(smpp->load);
+            ++session->pending_submits;
         }
         else { /* write error occurs */
             smpp_pdu_destroy(pdu);
@@ -1265,10 +1530,79 @@ static int send_messages(SMPP *smpp, Connection *conn, long *pending_submits)
         }
     }
 
+    /* our window is full, hand the rest to another bind */
+    if (smpp->num_sessions > 1 && session->pending_submits >= smpp->max_pending_submits &&
+        gw_prioqueue_len(smpp->msgs_to_send) > 0)
+        smpp_wakeup_sender(smpp, session);
+
     return 0;
 }
 
 
+/*
+ * Send the bind PDU for a session of the given type (0 receiver,
+ * 1 transmitter, 2 transceiver). Return -1 for error, 0 for OK.
+ */
+static int send_bind(SMPP *smpp, Connection *conn, int transmitter)
+{
+    SMPP_PDU *bind;
+    int ret;
+
+    if (transmitter == 1) {
+        bind = smpp_pdu_create(bind_transmitter,
+                    counter_increase(smpp->message_id_counter));
+        bind->u.bind_transmitter.system_id = octstr_duplicate(smpp->username);
+        bind->u.bind_transmitter.password = octstr_duplicate(smpp->password);
+        if (smpp->system_type == NULL)
+            bind->u.bind_transmitter.system_type = octstr_create("VMA");
+        else
+            bind->u.bind_transmitter.system_type =
+                octstr_duplicate(smpp->system_type);
+        bind->u.bind_transmitter.interface_version = smpp->version;
+        bind->u.bind_transmitter.address_range =
+            octstr_duplicate(smpp->address_range);
+        bind->u.bind_transmitter.addr_ton = smpp->bind_addr_ton;
+        bind->u.bind_transmitter.addr_npi = smpp->bind_addr_npi;
+    } else if (transmitter == 2) {
+        bind = smpp_pdu_create(bind_transceiver,
+                               counter_increase(smpp->message_id_counter));
+        bind->u.bind_transceiver.system_id = octstr_duplicate(smpp->username);
+        bind->u.bind_transceiver.password = octstr_duplicate(smpp->password);
+        if (smpp->system_type == NULL)
+            bind->u.bind_transceiver.system_type = octstr_create("VMA");
+        else
+            bind->u.bind_transceiver.system_type = octstr_duplicate(smpp->system_type);
+        bind->u.bind_transceiver.interface_version = smpp->version;
+        bind->u.bind_transceiver.address_range = octstr_duplicate(smpp->address_range);
+        bind->u.bind_transceiver.addr_ton = smpp->bind_addr_ton;
+        bind->u.bind_transceiver.addr_npi = smpp->bind_addr_npi;
+    } else {
+        bind = smpp_pdu_create(bind_receiver,
+                    counter_increase(smpp->message_id_counter));
+        bind->u.bind_receiver.system_id = octstr_duplicate(smpp->username);
+        bind->u.bind_receiver.password = octstr_duplicate(smpp->password);
+        if (smpp->system_type == NULL)
+            bind->u.bind_receiver.system_type = octstr_create("VMA");
+        else
+            bind->u.bind_receiver.system_type =
+                octstr_duplicate(smpp->system_type);
+        bind->u.bind_receiver.interface_version = smpp->version;
+        bind->u.bind_receiver.address_range =
+            octstr_duplicate(smpp->address_range);
+        bind->u.bind_receiver.addr_ton = smpp->bind_addr_ton;
+        bind->u.bind_receiver.addr_npi = smpp->bind_addr_npi;
+    }
+
+    ret = send_pdu(conn, smpp, bind);
+    if (ret == -1)
+        error(0, "SMPP[%s]: Couldn't send %s to server.",
+              octstr_get_cstr(smpp->conn->id), bind->type_name);
+    smpp_pdu_destroy(bind);
+
+    return ret;
+}
+
+
 /*
  * Open transmission connection to SMS center. Return NULL for error,
  * open Connection for OK. Caller must set smpp->conn->status correctly
@@ -1276,7 +1610,6 @@ static int send_messages(SMPP *smpp, Connection *conn, long *pending_submits)
  */
 static Connection *open_transmitter(SMPP *smpp)
 {
-    SMPP_PDU *bind;
     Connection *conn;
 
 #ifdef HAVE_LIBSSL
@@ -1296,27 +1629,10 @@ static Connection *open_transmitter(SMPP *smpp)
         return NULL;
     }
 
-    bind = smpp_pdu_create(bind_transmitter,
-                counter_increase(smpp->message_id_counter));
-    bind->u.bind_transmitter.system_id = octstr_duplicate(smpp->username);
-    bind->u.bind_transmitter.password = octstr_duplicate(smpp->password);
-    if (smpp->system_type == NULL)
-        bind->u.bind_transmitter.system_type = octstr_create("VMA");
-    else
-        bind->u.bind_transmitter.system_type =
-            octstr_duplicate(smpp->system_type);
-    bind->u.bind_transmitter.interface_version = smpp->version;
-    bind->u.bind_transmitter.address_range =
-        octstr_duplicate(smpp->address_range);
-    bind->u.bind_transmitter.addr_ton = smpp->bind_addr_ton;
-    bind->u.bind_transmitter.addr_npi = smpp->bind_addr_npi;
-    if (send_pdu(conn, smpp, bind) == -1) {
-        error(0, "SMPP[%s]: Couldn't send bind_transmitter to server.",
-              octstr_get_cstr(smpp->conn->id));
+    if (send_bind(smpp, conn, 1) == -1) {
         conn_destroy(conn);
         conn = NULL;
     }
-    smpp_pdu_destroy(bind);
 
     return conn;
 }
@@ -1329,7 +1645,6 @@ static Connection *open_transmitter(SMPP *smpp)
  */
 static Connection *open_transceiver(SMPP *smpp)
 {
-    SMPP_PDU *bind;
     Connection *conn;
 
 #ifdef HAVE_LIBSSL
@@ -1349,25 +1664,10 @@ static Connection *open_transceiver(SMPP *smpp)
        return NULL;
     }
 
-    bind = smpp_pdu_create(bind_transceiver,
-                           counter_increase(smpp->message_id_counter));
-    bind->u.bind_transceiver.system_id = octstr_duplicate(smpp->username);
-    bind->u.bind_transceiver.password = octstr_duplicate(smpp->password);
-    if (smpp->system_type == NULL)
-        bind->u.bind_transceiver.system_type = octstr_create("VMA");
-    else
-        bind->u.bind_transceiver.system_type = octstr_duplicate(smpp->system_type);
-    bind->u.bind_transceiver.interface_version = smpp->version;
-    bind->u.bind_transceiver.address_range = octstr_duplicate(smpp->address_range);
-    bind->u.bind_transceiver.addr_ton = smpp->bind_addr_ton;
-    bind->u.bind_transceiver.addr_npi = smpp->bind_addr_npi;
-    if (send_pdu(conn, smpp, bind) == -1) {
-        error(0, "SMPP[%s]: Couldn't send bind_transceiver to server.",
-              octstr_get_cstr(smpp->conn->id));
+    if (send_bind(smpp, conn, 2) == -1) {
         conn_destroy(conn);
         conn = NULL;
     }
-    smpp_pdu_destroy(bind);
 
     return conn;
 }
@@ -1380,7 +1680,6 @@ static Connection *open_transceiver(SMPP *smpp)
  */
 static Connection *open_receiver(SMPP *smpp)
 {
-    SMPP_PDU *bind;
     Connection *conn;
 
 #ifdef HAVE_LIBSSL
@@ -1400,27 +1699,10 @@ static Connection *open_receiver(SMPP *smpp)
         return NULL;
     }
 
-    bind = smpp_pdu_create(bind_receiver,
-                counter_increase(smpp->message_id_counter));
-    bind->u.bind_receiver.system_id = octstr_duplicate(smpp->username);
-    bind->u.bind_receiver.password = octstr_duplicate(smpp->password);
-    if (smpp->system_type == NULL)
-        bind->u.bind_receiver.system_type = octstr_create("VMA");
-    else
-        bind->u.bind_receiver.system_type =
-            octstr_duplicate(smpp->system_type);
-    bind->u.bind_receiver.interface_version = smpp->version;
-    bind->u.bind_receiver.address_range =
-        octstr_duplicate(smpp->address_range);
-    bind->u.bind_receiver.addr_ton = smpp->bind_addr_ton;
-    bind->u.bind_receiver.addr_npi = smpp->bind_addr_npi;
-    if (send_pdu(conn, smpp, bind) == -1) {
-        error(0, "SMPP[%s]: Couldn't send bind_receiver to server.",
-              octstr_get_cstr(smpp->conn->id));
+    if (send_bind(smpp, conn, 0) == -1) {
         conn_destroy(conn);
         conn = NULL;
     }
-    smpp_pdu_destroy(bind);
 
     return conn;
 }
@@ -1454,10 +1736,38 @@ static int error_from_network_error_code(Octstr *network_error_code)
 }
 
 
-static Msg *handle_dlr(SMPP *smpp, Octstr *destination_addr, Octstr *short_message, Octstr *message_payload, Octstr *receipted_message_id, long message_state, Octstr *network_error_code)
+/*
+ * A delivery receipt parsed from a deliver_sm or data_sm PDU, kept
+ * together while its DLR is looked up, possibly by dlr_resolve().
+ */
+struct smpp_dlr {
+    SMPP *smpp;
+    Octstr *msgid;          /* smsc message id as given to dlr_add(), NULL if none */
+    Octstr *source_addr;    /* the receiver of the original message */
+    Octstr *dest_addr;
+    Octstr *respstr;
+    Octstr *network_err;
+    Dict *tlv;
+    int dlrstat;
+};
+
+
+static void smpp_dlr_destroy(struct smpp_dlr *dlr)
 {
-    Msg *dlrmsg = NULL;
-    Octstr *respstr = NULL, *msgid = NULL, *network_err = NULL, *dlr_err = NULL, *tmp;
+    octstr_destroy(dlr->msgid);
+    octstr_destroy(dlr->source_addr);
+    octstr_destroy(dlr->dest_addr);
+    octstr_destroy(dlr->respstr);
+    octstr_destroy(dlr->network_err);
+    dict_destroy(dlr->tlv);
+    gw_free(dlr);
+}
+
+
+static struct smpp_dlr *smpp_dlr_create(SMPP *smpp, Octstr *destination_addr, Octstr *short_message, Octstr *message_payload, Octstr *receipted_message_id, long message_state, Octstr *network_error_code)
+{
+    struct smpp_dlr *dlr;
+    Octstr *respstr = NULL, *msgid = NULL, *network_err = NULL, *dlr_err = NULL, *tmp = NULL;
     int dlrstat = -1;
     int err_int = 0;
 
@@ -1622,15 +1932,8 @@ static Msg *handle_dlr(SMPP *smpp, Octstr *destination_addr, Octstr *short_messa
                 tmp = octstr_format("%llu", strtoll(octstr_get_cstr(msgid), NULL, 10));
             }
         }
-
-        dlrmsg = dlr_find(smpp->conn->id,
-            tmp, /* smsc message id */
-            destination_addr, /* destination */
-            dlrstat, 0);
-
-        octstr_destroy(msgid);
-    } else
-        tmp = octstr_create("");
+    }
+    octstr_destroy(msgid);
 
     if (network_err == NULL && dlr_err != NULL) {
         unsigned char ctmp[3];
@@ -1640,7 +1943,30 @@ static Msg *handle_dlr(SMPP *smpp, Octstr *destination_addr, Octstr *short_messa
         ctmp[2] = (err_int & 0xFF);
         network_err = octstr_create_from_data((char*)ctmp, 3);
     }
-    
+    octstr_destroy(dlr_err);
+
+    dlr = gw_malloc(sizeof(*dlr));
+    dlr->smpp = smpp;
+    dlr->msgid = tmp;
+    dlr->source_addr = octstr_duplicate(destination_addr);
+    dlr->dest_addr = NULL;
+    dlr->respstr = octstr_duplicate(respstr);
+    dlr->network_err = network_err;
+    dlr->tlv = NULL;
+    dlr->dlrstat = dlrstat;
+
+    return dlr;
+}
+
+
+/*
+ * Complete the DLR message found for the receipt, or log that there
+ * was none. Returns the message to pass to the upper layer, if any.
+ */
+static Msg *smpp_dlr_complete(struct smpp_dlr *dlr, Msg *dlrmsg)
+{
+    SMPP *smpp = dlr->smpp;
+
     if (dlrmsg != NULL) {
         /*
          * we found the delivery report in our storage, so recode the
@@ -1648,29 +1974,103 @@ static Msg *handle_dlr(SMPP *smpp, Octstr *destination_addr, Octstr *short_messa
          * The DLR trigger URL is indicated by msg->sms.dlr_url.
          * Add the DLR error code to meta-data.
          */
-        dlrmsg->sms.msgdata = octstr_duplicate(respstr);
+        dlrmsg->sms.msgdata = octstr_duplicate(dlr->respstr);
         dlrmsg->sms.sms_type = report_mo;
         dlrmsg->sms.account = octstr_duplicate(smpp->username);
-        if (network_err != NULL) {
+        if (dlr->network_err != NULL) {
             if (dlrmsg->sms.meta_data == NULL) {
                 dlrmsg->sms.meta_data = octstr_create("");
             }
-            meta_data_set_value(dlrmsg->sms.meta_data, "smpp", octstr_imm("dlr_err"), network_err, 1);
+            meta_data_set_value(dlrmsg->sms.meta_data, "smpp", octstr_imm("dlr_err"), dlr->network_err, 1);
+        }
+        if (dlr->tlv != NULL) {
+            if (dlrmsg->sms.meta_data == NULL)
+                dlrmsg->sms.meta_data = octstr_create("");
+            meta_data_set_values(dlrmsg->sms.meta_data, dlr->tlv, "smpp", 0);
         }
     } else {
         error(0,"SMPP[%s]: got DLR but could not find message or was not interested "
                 "in it id<%s> dst<%s>, type<%d>",
-                octstr_get_cstr(smpp->conn->id), octstr_get_cstr(tmp),
-                octstr_get_cstr(destination_addr), dlrstat);
+                octstr_get_cstr(smpp->conn->id), (dlr->msgid ? octstr_get_cstr(dlr->msgid) : ""),
+                octstr_get_cstr(dlr->source_addr), dlr->dlrstat);
     }
-    octstr_destroy(tmp);
-    octstr_destroy(network_err);
-    octstr_destroy(dlr_err);
 
     return dlrmsg;
 }
 
 
+static Msg *handle_dlr(SMPP *smpp, Octstr *destination_addr, Octstr *short_message, Octstr *message_payload, Octstr *receipted_message_id, long message_state, Octstr *network_error_code)
+{
+    struct smpp_dlr *dlr;
+    Msg *dlrmsg = NULL;
+
+    dlr = smpp_dlr_create(smpp, destination_addr, short_message, message_payload,
+                          receipted_message_id, message_state, network_error_code);
+    if (dlr->msgid != NULL)
+        dlrmsg = dlr_find(smpp->conn->id,
+            dlr->msgid, /* smsc message id */
+            destination_addr, /* destination */
+            dlr->dlrstat, 0);
+    dlrmsg = smpp_dlr_complete(dlr, dlrmsg);
+    smpp_dlr_destroy(dlr);
+
+    return dlrmsg;
+}
+
+
+/*
+ * Called with the result of dlr_resolve() for a receipt that has been
+ * acknowledged already, so the outcome can only be logged.
+ */
+static void smpp_dlr_resolved(Msg *dlrmsg, void *context)
+{
+    struct smpp_dlr *dlr = context;
+    SMPP *smpp = dlr->smpp;
+    Msg *msg;
+
+    dlrmsg = smpp_dlr_complete(dlr, dlrmsg);
+    if (dlrmsg != NULL) {
+        /* passing DLR to upper layer */
+        bb_smscconn_receive(smpp->conn, dlrmsg);
+    } else {
+        /* no DLR will be passed, but we write an access-log entry */
+        msg = msg_create(sms);
+        msg->sms.sms_type = report_mo;
+        msg->sms.sender = octstr_duplicate(dlr->source_addr);
+        msg->sms.receiver = octstr_duplicate(dlr->dest_addr);
+        msg->sms.msgdata = octstr_duplicate(dlr->respstr);
+        msg->sms.smsc_id = octstr_duplicate(smpp->conn->id);
+        msg->sms.account = octstr_duplicate(smpp->username);
+        msg->sms.time = gw_clock_now();
+        bb_alog_sms(smpp->conn, msg, "FAILED Receive DLR");
+        msg_destroy(msg);
+    }
+    smpp_dlr_destroy(dlr);
+}
+
+
+/*
+ * Hand a receipt over to the DLR resolver threads. The caller acks the
+ * PDU right away; the TLVs are taken over from the PDU.
+ */
+static void handle_dlr_async(SMPP *smpp, Octstr *source_addr, Octstr *destination_addr, Octstr *short_message, Octstr *message_payload, Octstr *receipted_message_id, long message_state, Octstr *network_error_code, Dict **tlv)
+{
+    struct smpp_dlr *dlr;
+
+    dlr = smpp_dlr_create(smpp, source_addr, short_message, message_payload,
+                          receipted_message_id, message_state, network_error_code);
+    dlr->dest_addr = octstr_duplicate(destination_addr);
+    dlr->tlv = *tlv;
+    *tlv = NULL;
+
+    if (dlr->msgid != NULL)
+        dlr_resolve(smpp->conn->id, dlr->msgid, source_addr, dlr->dlrstat, 0,
+                    smpp->dlr_pending, smpp_dlr_resolved, dlr);
+    else
+        smpp_dlr_resolved(NULL, dlr);
+}
+
+
 static long smscconn_failure_reason_to_smpp_status(long reason)
 {
     switch (reason) {
@@ -1687,10 +2087,9 @@ static long smscconn_failure_reason_to_smpp_status(long reason)
 
 
 static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
-                      long *pending_submits)
+                      struct smpp_session *session)
 {
     SMPP_PDU *resp = NULL;
-    Octstr *os;
     Msg *msg = NULL, *dlrmsg=NULL;
     struct smpp_msg *smpp_msg = NULL;
     long reason, cmd_stat;
@@ -1700,16 +2099,14 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
      * In order to keep the protocol implementation logically clean,
      * we will obey the required SMPP session state while processing
      * the PDUs, see Table 2-1, SMPP v3.4 spec, section 2.3, page 17.
-     * Therefore we will interpret our abstracted smpp->conn->status
-     * value as SMPP session state here.
+     * The state is kept per session, since each bind has its own.
      */
     switch (pdu->type) {
         case data_sm:
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV)) {
+            if (session->bound != 1) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -1725,12 +2122,27 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                 break;
             }
             mutex_unlock(smpp->conn->flow_mutex);
+
+            /* ask the SMSC to retry later while bearerbox is backlogged */
+            if (bb_smscconn_receive_throttled(smpp->conn)) {
+                resp->u.data_sm_resp.command_status = SMPP_ESME_RTHROTTLED;
+                break;
+            }
             /* got a deliver ack (DLR)?
              * NOTE: following SMPP v3.4. spec. we are interested
              *       only on bits 2-5 (some SMSC's send 0x44, and it's
              *       spec. conforme)
              */
-            if (pdu->u.data_sm.esm_class & (0x04|0x08|0x20)) {
+            if ((pdu->u.data_sm.esm_class & (0x04|0x08|0x20)) &&
+                    smpp->conn->dlr_async && dlr_resolver_enabled()) {
+                 debug("bb.sms.smpp",0,"SMPP[%s] handle_pdu, got DLR",
+                       octstr_get_cstr(smpp->conn->id));
+                 handle_dlr_async(smpp, pdu->u.data_sm.source_addr, pdu->u.data_sm.destination_addr,
+                                  NULL, pdu->u.data_sm.message_payload, pdu->u.data_sm.receipted_message_id,
+                                  pdu->u.data_sm.message_state, pdu->u.data_sm.network_error_code,
+                                  &pdu->u.data_sm.tlv);
+                 resp->u.data_sm_resp.command_status = SMPP_ESME_ROK;
+            } else if (pdu->u.data_sm.esm_class & (0x04|0x08|0x20)) {
                  debug("bb.sms.smpp",0,"SMPP[%s] handle_pdu, got DLR",
                        octstr_get_cstr(smpp->conn->id));
                  dlrmsg = handle_dlr(smpp, pdu->u.data_sm.source_addr, NULL, pdu->u.data_sm.message_payload,
@@ -1764,7 +2176,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                      octstr_destroy(msg->sms.receiver);
                      msg->sms.receiver = octstr_duplicate(smpp->my_number);
                  }
-                 time(&msg->sms.time);
+                 msg->sms.time = gw_clock_now();
                  msg->sms.smsc_id = octstr_duplicate(smpp->conn->id);
                  reason =  bb_smscconn_receive(smpp->conn, msg);
                  resp->u.data_sm_resp.command_status = smscconn_failure_reason_to_smpp_status(reason);
@@ -1775,8 +2187,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV)) {
+            if (session->bound != 1) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -1795,13 +2206,34 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             }
             mutex_unlock(smpp->conn->flow_mutex);
 
+            /* ask the SMSC to retry later while bearerbox is backlogged */
+            if (bb_smscconn_receive_throttled(smpp->conn)) {
+                resp = smpp_pdu_create(deliver_sm_resp,
+                        pdu->u.deliver_sm.sequence_number);
+                resp->u.deliver_sm_resp.command_status = SMPP_ESME_RTHROTTLED;
+                break;
+            }
+
             /* 
              * Got a deliver ack (DLR)?
              * NOTE: following SMPP v3.4. spec. we are interested
              *       only on bits 2-5 (some SMSC's send 0x44, and it's
              *       spec. conforme)
              */
-            if (pdu->u.deliver_sm.esm_class & (0x04|0x08|0x20)) {
+            if ((pdu->u.deliver_sm.esm_class & (0x04|0x08|0x20)) &&
+                    smpp->conn->dlr_async && dlr_resolver_enabled()) {
+
+                debug("bb.sms.smpp",0,"SMPP[%s] handle_pdu, got DLR",
+                      octstr_get_cstr(smpp->conn->id));
+
+                /* ack now, the lookup is done by the DLR resolver threads */
+                handle_dlr_async(smpp, pdu->u.deliver_sm.source_addr, pdu->u.deliver_sm.destination_addr,
+                                 pdu->u.deliver_sm.short_message, pdu->u.deliver_sm.message_payload,
+                                 pdu->u.deliver_sm.receipted_message_id, pdu->u.deliver_sm.message_state,
+                                 pdu->u.deliver_sm.network_error_code, &pdu->u.deliver_sm.tlv);
+                resp = smpp_pdu_create(deliver_sm_resp, pdu->u.deliver_sm.sequence_number);
+                resp->u.deliver_sm_resp.command_status = SMPP_ESME_ROK;
+            } else if (pdu->u.deliver_sm.esm_class & (0x04|0x08|0x20)) {
 
                 debug("bb.sms.smpp",0,"SMPP[%s] handle_pdu, got DLR",
                       octstr_get_cstr(smpp->conn->id));
@@ -1843,7 +2275,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                     msg->sms.receiver = octstr_duplicate(smpp->my_number);
                 }
 
-                time(&msg->sms.time);
+                msg->sms.time = gw_clock_now();
                 msg->sms.smsc_id = octstr_duplicate(smpp->conn->id);
                 msg->sms.account = octstr_duplicate(smpp->username);
                 reason =  bb_smscconn_receive(smpp->conn, msg);
@@ -1855,8 +2287,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV)) {
+            if (session->bound != 1) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -1869,8 +2300,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV)) {
+            if (session->bound != 1) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -1887,15 +2317,13 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE)) {
+            if (session->bound != 1 || !session->transmitter) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
             }
 
-            os = octstr_format("%ld", pdu->u.submit_sm_resp.sequence_number);
-            smpp_msg = dict_remove(smpp->sent_msgs, os);
-            octstr_destroy(os);
+            smpp_msg = smpp_window_remove(session->sent_msgs, pdu->u.submit_sm_resp.sequence_number);
             if (smpp_msg == NULL) {
                 warning(0, "SMPP[%s]: SMSC sent submit_sm_resp PDU "
                         "with wrong sequence number 0x%08lx",
@@ -1925,13 +2353,13 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                  * sleep for a while
                  */
                 if (pdu->u.submit_sm_resp.command_status == SMPP_ESME_RTHROTTLED)
-                    time(&(smpp->throttling_err_time));
+                    smpp->throttling_err_time = gw_clock_mono();
                 else
                     smpp->throttling_err_time = 0;
 
                 bb_smscconn_send_failed(smpp->conn, msg, reason, octstr_format("0x%08lx/%s", pdu->u.submit_sm_resp.command_status,
                                         smpp_error_to_string(pdu->u.submit_sm_resp.command_status)));
-                --(*pending_submits);
+                --session->pending_submits;
             }
             else if (pdu->u.submit_sm_resp.message_id != NULL) {
                 Octstr *tmp;
@@ -1967,7 +2395,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                 }
 
                 bb_smscconn_sent(smpp->conn, msg, NULL);
-                --(*pending_submits);
+                --session->pending_submits;
             } /* end if for SMSC ACK */
             else {
                 error(0, "SMPP[%s]: SMSC returned error code 0x%08lx (%s) "
@@ -1976,7 +2404,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                       pdu->u.submit_sm_resp.command_status,
                       smpp_error_to_string(pdu->u.submit_sm_resp.command_status));
                 bb_smscconn_sent(smpp->conn, msg, NULL);
-                --(*pending_submits);
+                --session->pending_submits;
             }
             break;
 
@@ -1984,8 +2412,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV) {
+            if (session->bound == 1) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -1997,7 +2424,8 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                       pdu->u.bind_transmitter_resp.command_status,
                 smpp_error_to_string(pdu->u.bind_transmitter_resp.command_status));
                 mutex_lock(smpp->conn->flow_mutex);
-                smpp->conn->status = SMSCCONN_DISCONNECTED;
+                session->bound = -1;
+                smpp_update_status(smpp, SMSCCONN_DISCONNECTED);
                 mutex_unlock(smpp->conn->flow_mutex);
                 if (pdu->u.bind_transmitter_resp.command_status == SMPP_ESME_RINVSYSID ||
                     pdu->u.bind_transmitter_resp.command_status == SMPP_ESME_RINVPASWD ||
@@ -2005,10 +2433,10 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                     smpp->quitting = 1;
                 }
             } else {
-                *pending_submits = 0;
+                session->pending_submits = 0;
                 mutex_lock(smpp->conn->flow_mutex);
-                smpp->conn->status = SMSCCONN_ACTIVE;
-                time(&smpp->conn->connect_time);
+                session->bound = 1;
+                smpp_update_status(smpp, SMSCCONN_DISCONNECTED);
                 mutex_unlock(smpp->conn->flow_mutex);
                 bb_smscconn_connected(smpp->conn);
             }
@@ -2018,8 +2446,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV) {
+            if (session->bound == 1) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -2031,7 +2458,8 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                       pdu->u.bind_transceiver_resp.command_status,
                  smpp_error_to_string(pdu->u.bind_transceiver_resp.command_status));
                  mutex_lock(smpp->conn->flow_mutex);
-                 smpp->conn->status = SMSCCONN_DISCONNECTED;
+                 session->bound = -1;
+                 smpp_update_status(smpp, SMSCCONN_DISCONNECTED);
                  mutex_unlock(smpp->conn->flow_mutex);
                  if (pdu->u.bind_transceiver_resp.command_status == SMPP_ESME_RINVSYSID ||
                      pdu->u.bind_transceiver_resp.command_status == SMPP_ESME_RINVPASWD ||
@@ -2039,10 +2467,10 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                      smpp->quitting = 1;
                  }
             } else {
-                *pending_submits = 0;
+                session->pending_submits = 0;
                 mutex_lock(smpp->conn->flow_mutex);
-                smpp->conn->status = SMSCCONN_ACTIVE;
-                time(&smpp->conn->connect_time);
+                session->bound = 1;
+                smpp_update_status(smpp, SMSCCONN_DISCONNECTED);
                 mutex_unlock(smpp->conn->flow_mutex);
                 bb_smscconn_connected(smpp->conn);
             }
@@ -2052,8 +2480,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV) {
+            if (session->bound == 1) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -2065,7 +2492,8 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                       pdu->u.bind_receiver_resp.command_status,
                  smpp_error_to_string(pdu->u.bind_receiver_resp.command_status));
                  mutex_lock(smpp->conn->flow_mutex);
-                 smpp->conn->status = SMSCCONN_DISCONNECTED;
+                 session->bound = -1;
+                 smpp_update_status(smpp, SMSCCONN_DISCONNECTED);
                  mutex_unlock(smpp->conn->flow_mutex);
                  if (pdu->u.bind_receiver_resp.command_status == SMPP_ESME_RINVSYSID ||
                      pdu->u.bind_receiver_resp.command_status == SMPP_ESME_RINVPASWD ||
@@ -2073,12 +2501,10 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                      smpp->quitting = 1;
                  }
             } else {
-                /* set only receive status if no transmit is bind */
+                /* status is only receive if no transmit is bind */
                 mutex_lock(smpp->conn->flow_mutex);
-                if (smpp->conn->status != SMSCCONN_ACTIVE) {
-                    smpp->conn->status = SMSCCONN_ACTIVE_RECV;
-                    time(&smpp->conn->connect_time);
-                }
+                session->bound = 1;
+                smpp_update_status(smpp, SMSCCONN_DISCONNECTED);
                 mutex_unlock(smpp->conn->flow_mutex);
             }
             break;
@@ -2087,31 +2513,31 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV)) {
+            if (session->bound != 1) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
             }
             resp = smpp_pdu_create(unbind_resp, pdu->u.unbind.sequence_number);
             mutex_lock(smpp->conn->flow_mutex);
-            smpp->conn->status = SMSCCONN_DISCONNECTED;
+            session->bound = -1;
+            smpp_update_status(smpp, SMSCCONN_DISCONNECTED);
             mutex_unlock(smpp->conn->flow_mutex);
-            *pending_submits = -1;
+            session->pending_submits = -1;
             break;
 
         case unbind_resp:
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV)) {
+            if (session->bound != 1) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
             }
             mutex_lock(smpp->conn->flow_mutex);
-            smpp->conn->status = SMSCCONN_DISCONNECTED;
+            session->bound = -1;
+            smpp_update_status(smpp, SMSCCONN_DISCONNECTED);
             mutex_unlock(smpp->conn->flow_mutex);
             break;
 
@@ -2119,8 +2545,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV)) {
+            if (session->bound != 1) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -2128,9 +2553,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
 
             cmd_stat  = pdu->u.generic_nack.command_status;
 
-            os = octstr_format("%ld", pdu->u.generic_nack.sequence_number);
-            smpp_msg = dict_remove(smpp->sent_msgs, os);
-            octstr_destroy(os);
+            smpp_msg = smpp_window_remove(session->sent_msgs, pdu->u.generic_nack.sequence_number);
 
             if (smpp_msg == NULL) {
                 error(0, "SMPP[%s]: SMSC rejected last command, code 0x%08lx (%s).",
@@ -2151,14 +2574,14 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                  * sleep for a while
                  */
                 if (cmd_stat == SMPP_ESME_RTHROTTLED)
-                    time(&(smpp->throttling_err_time));
+                    smpp->throttling_err_time = gw_clock_mono();
                 else
                     smpp->throttling_err_time = 0;
 
                 reason = smpp_status_to_smscconn_failure_reason(cmd_stat);
                 bb_smscconn_send_failed(smpp->conn, msg, reason,
                                         octstr_format("0x%08lx/%s", cmd_stat, smpp_error_to_string(cmd_stat)));
-                --(*pending_submits);
+                --session->pending_submits;
             }
             break;
         
@@ -2182,114 +2605,154 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
 }
 
 
-struct io_arg {
-    SMPP *smpp;
-    int transmitter;
-};
-
-
-static struct io_arg *io_arg_create(SMPP *smpp, int transmitter)
-{
-    struct io_arg *io_arg;
-
-    io_arg = gw_malloc(sizeof(*io_arg));
-    io_arg->smpp = smpp;
-    io_arg->transmitter = transmitter;
-    return io_arg;
-}
-
-
 /*
  * sent queue cleanup.
  * @return 1 if io_thread should reconnect; 0 if not
  */
-static int do_queue_cleanup(SMPP *smpp, long *pending_submits)
+static int do_queue_cleanup(SMPP *smpp, struct smpp_session *session)
 {
-    List *keys;
-    Octstr *key;
     struct smpp_msg *smpp_msg;
-    time_t now = time(NULL);
+    time_t now = gw_clock_mono(), oldest;
 
-    if (*pending_submits <= 0)
+    if (session->pending_submits <= 0)
         return 0;
 
     /* check if action set to wait ack for ever */
     if (smpp->wait_ack_action == SMPP_WAITACK_NEVER_EXPIRE)
         return 0;
 
-    keys = dict_keys(smpp->sent_msgs);
-    if (keys == NULL)
-        return 0;
-
-    while ((key = gwlist_extract_first(keys)) != NULL) {
-        smpp_msg = dict_get(smpp->sent_msgs, key);
-        if (smpp_msg != NULL && difftime(now, smpp_msg->sent_time) > smpp->wait_ack) {
-            switch(smpp->wait_ack_action) {
-                case SMPP_WAITACK_RECONNECT: /* reconnect */
-                    /* found at least one not acked msg */
-                    warning(0, "SMPP[%s]: Not ACKED message found, reconnecting.",
-                                   octstr_get_cstr(smpp->conn->id));
-                    octstr_destroy(key);
-                    gwlist_destroy(keys, octstr_destroy_item);
-                    return 1; /* io_thread will reconnect */
-                case SMPP_WAITACK_REQUEUE: /* requeue */
-                    smpp_msg = dict_remove(smpp->sent_msgs, key);
-                    if (smpp_msg != NULL) {
-                        warning(0, "SMPP[%s]: Not ACKED message found, will retransmit."
-                                   " SENT<%ld>sec. ago, SEQ<%s>, DST<%s>",
-                                   octstr_get_cstr(smpp->conn->id),
-                                   (long)difftime(now, smpp_msg->sent_time) ,
-                                   octstr_get_cstr(key),
-                                   octstr_get_cstr(smpp_msg->msg->sms.receiver));
-                        bb_smscconn_send_failed(smpp->conn, smpp_msg->msg, SMSCCONN_FAILED_TEMPORARILY,NULL);
-                        smpp_msg_destroy(smpp_msg, 0);
-                        (*pending_submits)--;
-                    }
-                    break;
-                default:
-                    error(0, "SMPP[%s] Unknown clenup action defined 0x%02x.",
-                          octstr_get_cstr(smpp->conn->id), smpp->wait_ack_action);
-                    octstr_destroy(key);
-                    gwlist_destroy(keys, octstr_destroy_item);
-                    return 0;
+    /* the window is in send order, so only the expired ones are visited */
+    switch(smpp->wait_ack_action) {
+        case SMPP_WAITACK_RECONNECT: /* reconnect */
+            oldest = smpp_window_oldest_time(session->sent_msgs);
+            if (oldest != -1 && (now - oldest) > smpp->wait_ack) {
+                /* found at least one not acked msg */
+                warning(0, "SMPP[%s]: Not ACKED message found, reconnecting.",
+                               octstr_get_cstr(smpp->conn->id));
+                return 1; /* io_thread will reconnect */
             }
-        }
-        octstr_destroy(key);
+            break;
+        case SMPP_WAITACK_REQUEUE: /* requeue */
+            while ((smpp_msg = smpp_window_remove_oldest(session->sent_msgs,
+                                                         now - smpp->wait_ack)) != NULL) {
+                warning(0, "SMPP[%s]: Not ACKED message found, will retransmit."
+                           " SENT<%ld>sec. ago, SEQ<%lu>, DST<%s>",
+                           octstr_get_cstr(smpp->conn->id),
+                           (long)(now - smpp_msg->sent_time) ,
+                           smpp_msg->sequence_number,
+                           octstr_get_cstr(smpp_msg->msg->sms.receiver));
+                bb_smscconn_send_failed(smpp->conn, smpp_msg->msg, SMSCCONN_FAILED_TEMPORARILY,NULL);
+                smpp_msg_destroy(smpp_msg, 0);
+                session->pending_submits--;
+            }
+            break;
+        default:
+            error(0, "SMPP[%s] Unknown clenup action defined 0x%02x.",
+                  octstr_get_cstr(smpp->conn->id), smpp->wait_ack_action);
+            break;
     }
-    gwlist_destroy(keys, octstr_destroy_item);
 
     return 0;
 }
 
 
+/*
+ * Bookkeeping after a session lost its connection: update the status and
+ * hand back the messages it can no longer send.
+ */
+static void smpp_session_disconnected(struct smpp_session *session)
+{
+    SMPP *smpp = session->smpp;
+
+    /*
+     * set reconnecting status first so that core don't put msgs into our queue,
+     * unless another bind of ours is still up
+     */
+    mutex_lock(smpp->conn->flow_mutex);
+    session->bound = 0;
+    if (!smpp->quitting)
+        smpp_update_status(smpp, SMSCCONN_RECONNECTING);
+    mutex_unlock(smpp->conn->flow_mutex);
+    if (!smpp->quitting) {
+        error(0, "SMPP[%s]: Couldn't connect to SMS center (retrying in %ld seconds).",
+              octstr_get_cstr(smpp->conn->id), smpp->conn->reconnect_delay);
+    }
+    /*
+     * put all queued messages back into global queue,so if
+     * we have another link running than messages will be delivered
+     * quickly. The shared queue is kept while another bind can
+     * still send it, only our own window is given back.
+     */
+    if (session->transmitter) {
+        Msg *msg;
+        struct smpp_msg *smpp_msg;
+
+        long reason = (smpp->quitting?SMSCCONN_FAILED_SHUTDOWN:SMSCCONN_FAILED_TEMPORARILY);
+
+        if (session->throttled != NULL) {
+            gw_prioqueue_produce(smpp->msgs_to_send, session->throttled);
+            session->throttled = NULL;
+        }
+
+        if (smpp->conn->status != SMSCCONN_ACTIVE || smpp->quitting) {
+            while((msg = gw_prioqueue_remove(smpp->msgs_to_send)) != NULL)
+                bb_smscconn_send_failed(smpp->conn, msg, reason, NULL);
+        }
+
+        while((smpp_msg = smpp_window_remove_oldest(session->sent_msgs, -1)) != NULL) {
+            bb_smscconn_send_failed(smpp->conn, smpp_msg->msg, reason, NULL);
+            smpp_msg_destroy(smpp_msg, 0);
+        }
+    }
+}
+
+
+/*
+ * Last step of the shutdown, once all sessions have ended.
+ */
+static void smpp_finish(SMPP *smpp)
+{
+    /* receipts still being resolved refer to smpp */
+    dlr_resolve_wait(smpp->dlr_pending);
+    debug("bb.smpp", 0, "SMSCConn %s shut down.",
+          octstr_get_cstr(smpp->conn->name));
+
+    mutex_lock(smpp->conn->flow_mutex);
+    smpp->conn->status = SMSCCONN_DEAD;
+    smpp->conn->data = NULL;
+    mutex_unlock(smpp->conn->flow_mutex);
+
+    smpp_destroy(smpp);
+    bb_smscconn_killed();
+}
+
+
 /*
  * This is the main function for the background thread for doing I/O on
- * one SMPP connection (the one for transmitting or receiving messages).
+ * one SMPP session (one for transmitting or receiving messages).
  * It makes the initial connection to the SMPP server and re-connects
  * if there are I/O errors or other errors that require it.
  */
 static void io_thread(void *arg)
 {
     SMPP *smpp;
-    struct io_arg *io_arg;
+    struct smpp_session *session;
     int transmitter;
     Connection *conn;
     int ret;
-    long pending_submits;
-    long len;
+    long i, len;
     SMPP_PDU *pdu;
     double timeout;
     time_t last_cleanup, last_enquire_sent, last_response, now;
 
-    io_arg = arg;
-    smpp = io_arg->smpp;
-    transmitter = io_arg->transmitter;
-    gw_free(io_arg);
+    session = arg;
+    smpp = session->smpp;
+    transmitter = session->transmitter;
 
     /* Make sure we log into our own log-file if defined */
     log_thread_to(smpp->conn->log_idx);
 
-#define IS_ACTIVE (smpp->conn->status == SMSCCONN_ACTIVE || smpp->conn->status == SMSCCONN_ACTIVE_RECV)
+#define IS_ACTIVE (session->bound == 1)
 
     conn = NULL;
     while (!smpp->quitting) {
@@ -2300,9 +2763,9 @@ static void io_thread(void *arg)
         else
             conn = open_receiver(smpp);
         
-        pending_submits = -1;
+        session->pending_submits = -1;
         len = 0;
-        last_response = last_cleanup = last_enquire_sent = time(NULL);
+        last_response = last_cleanup = last_enquire_sent = gw_clock_mono();
         while(conn != NULL) {
             ret = read_pdu(smpp, conn, &len, &pdu);
             if (ret == -1) { /* connection broken */
@@ -2320,7 +2783,7 @@ static void io_thread(void *arg)
             } else if (ret == 1) { /* data available */
                 /* Deal with the PDU we just got */
                 dump_pdu("Got PDU:", smpp->conn->id, pdu, smpp->log_format);
-                ret = handle_pdu(smpp, conn, pdu, &pending_submits);
+                ret = handle_pdu(smpp, conn, pdu, session);
                 smpp_pdu_destroy(pdu);
                 if (ret == -1) {
                     error(0, "SMPP[%s]: I/O error or other error. Re-connecting.",
@@ -2330,10 +2793,10 @@ static void io_thread(void *arg)
                 
                 /*
                  * check if we are still connected
-                 * Note: Function handle_pdu will set status to SMSCCONN_DISCONNECTED
-                 * when unbind was received.
+                 * Note: Function handle_pdu will mark the session as unbound
+                 * when unbind was received or the bind was rejected.
                  */
-                if (smpp->conn->status == SMSCCONN_DISCONNECTED)
+                if (session->bound == -1)
                     break;
                 
                 /*
@@ -2346,7 +2809,7 @@ static void io_thread(void *arg)
                     /*
                      * Store last response time.
                      */
-                    time(&last_response);
+                    last_response = gw_clock_mono();
                 }
             } else { /* no data available */
                 /* check last enquire_resp, if difftime > as idle_timeout
@@ -2355,24 +2818,25 @@ static void io_thread(void *arg)
                  * in reality is broken, because no responses received.
                  */
                 if (smpp->connection_timeout > 0 &&
-                    difftime(time(NULL), last_response) > smpp->connection_timeout) {
+                    (gw_clock_mono() - last_response) > smpp->connection_timeout) {
                     /* connection seems to be broken */
                     warning(0, "Got no responses within %ld sec., reconnecting...",
-                            (long) difftime(time(NULL), last_response));
+                            (long) (gw_clock_mono() - last_response));
                     break;
                 }
                 
-                time(&now);
+                now = gw_clock_mono();
                 timeout = last_enquire_sent + smpp->enquire_link_interval - now;
                 if (!IS_ACTIVE && timeout <= 0)
                     timeout = smpp->enquire_link_interval;
-                if (transmitter && gw_prioqueue_len(smpp->msgs_to_send) > 0 &&
-                    smpp->throttling_err_time > 0 && pending_submits < smpp->max_pending_submits) {
+                if (transmitter && SMPP_HAS_WORK(smpp, session) &&
+                    smpp->throttling_err_time > 0 && session->pending_submits < smpp->max_pending_submits) {
                     time_t tr_timeout = smpp->throttling_err_time + SMPP_THROTTLING_SLEEP_TIME - now;
                     timeout = timeout > tr_timeout ? tr_timeout : timeout;
-                } else if (transmitter && gw_prioqueue_len(smpp->msgs_to_send) > 0 && smpp->conn->throughput > 0 &&
-                           smpp->max_pending_submits > pending_submits) {
-                    double t = 1.0 / smpp->conn->throughput;
+                } else if (transmitter && SMPP_HAS_WORK(smpp, session) && smpp->conn->shaper != NULL &&
+                           smpp->max_pending_submits > session->pending_submits) {
+                    /* wake up exactly when the next token is due */
+                    double t = gw_shaper_delay(smpp->conn->shaper);
                     timeout = t < timeout ? t : timeout;
                 }
                 /* sleep a while */
@@ -2385,16 +2849,16 @@ static void io_thread(void *arg)
                 break;
             
             /* cleanup sent queue */
-            if (transmitter && difftime(time(NULL), last_cleanup) > smpp->wait_ack) {
-                if (do_queue_cleanup(smpp, &pending_submits))
+            if (transmitter && (gw_clock_mono() - last_cleanup) > smpp->wait_ack) {
+                if (do_queue_cleanup(smpp, session))
                     break; /* reconnect */
-                time(&last_cleanup);
+                last_cleanup = gw_clock_mono();
             }
             
             /* make sure we send */
-            if (transmitter && difftime(time(NULL), smpp->throttling_err_time) > SMPP_THROTTLING_SLEEP_TIME) {
+            if (transmitter && (gw_clock_mono() - smpp->throttling_err_time) > SMPP_THROTTLING_SLEEP_TIME) {
                 smpp->throttling_err_time = 0;
-                if (send_messages(smpp, conn, &pending_submits) == -1)
+                if (send_messages(smpp, conn, session) == -1)
                     break;
             }
             
@@ -2405,12 +2869,12 @@ static void io_thread(void *arg)
             if (smpp->quitting) {
                 if (!IS_ACTIVE || send_unbind(smpp, conn) == -1)
                     break;
-                time(&last_response);
+                last_response = gw_clock_mono();
                 while(conn_wait(conn, 1.00) != -1 && IS_ACTIVE &&
-                      difftime(time(NULL), last_response) < SMPP_DEFAULT_SHUTDOWN_TIMEOUT) {
+                      (gw_clock_mono() - last_response) < SMPP_DEFAULT_SHUTDOWN_TIMEOUT) {
                     if (read_pdu(smpp, conn, &len, &pdu) == 1) {
                         dump_pdu("Got PDU:", smpp->conn->id, pdu, smpp->log_format);
-                        handle_pdu(smpp, conn, pdu, &pending_submits);
+                        handle_pdu(smpp, conn, pdu, session);
                         smpp_pdu_destroy(pdu);
                     }
                 }
@@ -2425,67 +2889,584 @@ static void io_thread(void *arg)
             conn_destroy(conn);
             conn = NULL;
         }
-        /* set reconnecting status first so that core don't put msgs into our queue */
-        if (!smpp->quitting) {
-            error(0, "SMPP[%s]: Couldn't connect to SMS center (retrying in %ld seconds).",
-                  octstr_get_cstr(smpp->conn->id), smpp->conn->reconnect_delay);
-            mutex_lock(smpp->conn->flow_mutex);
-            smpp->conn->status = SMSCCONN_RECONNECTING;
-            mutex_unlock(smpp->conn->flow_mutex);
+        smpp_session_disconnected(session);
+        if (!smpp->quitting)
             gwthread_sleep(smpp->conn->reconnect_delay);
+    }
+    
+#undef IS_ACTIVE
+    
+    /*
+     * Shutdown sequence as follow: the first session joins all other
+     * sessions and frees SMPP, the others just end.
+     */
+    if (session == &smpp->sessions[0]) {
+        for (i = 1; i < smpp->num_sessions; i++) {
+            if (smpp->sessions[i].thread == -1)
+                continue;
+            gwthread_wakeup(smpp->sessions[i].thread);
+            gwthread_join(smpp->sessions[i].thread);
         }
-        /*
-         * put all queued messages back into global queue,so if
-         * we have another link running than messages will be delivered
-         * quickly
-         */
-        if (transmitter) {
-            Msg *msg;
-            struct smpp_msg *smpp_msg;
-            List *noresp;
-            Octstr *key;
+        smpp_finish(smpp);
+    }
+}
 
-            long reason = (smpp->quitting?SMSCCONN_FAILED_SHUTDOWN:SMSCCONN_FAILED_TEMPORARILY);
 
-            while((msg = gw_prioqueue_remove(smpp->msgs_to_send)) != NULL)
-                bb_smscconn_send_failed(smpp->conn, msg, reason, NULL);
+/***********************************************************************
+ * Event loops. With 'smpp-event-loops' set in the core group the
+ * sessions of all SMPP connections are spread over that many loops
+ * instead of running a thread each. A loop is an FDSet, whose thread
+ * reads the sockets, plus a timer thread that runs the enquire_link,
+ * wait-ack, throttling and reconnect timers and the wakeups from the
+ * core. PDUs are handled by the same code as in io_thread().
+ *
+ * A session is run by whichever thread gets its lock first. No thread
+ * ever waits for a session lock: if it is taken, the session is marked
+ * 'kicked' and the holder runs it once more before letting go. This
+ * matters because the FDSet calls wait for the FDSet thread, which may
+ * itself be trying to run the session.
+ */
 
-            noresp = dict_keys(smpp->sent_msgs);
-            while((key = gwlist_extract_first(noresp)) != NULL) {
-                smpp_msg = dict_remove(smpp->sent_msgs, key);
-                if (smpp_msg != NULL) {
-                    bb_smscconn_send_failed(smpp->conn, smpp_msg->msg, reason, NULL);
-                    smpp_msg_destroy(smpp_msg, 0);
-                }
-                octstr_destroy(key);
+struct smpp_loop {
+    FDSet *fdset;
+    long thread;
+    Mutex *lock;            /* protects sessions */
+    List *sessions;
+    volatile int quitting;
+};
+
+static struct smpp_loop *smpp_loops = NULL;
+static long smpp_num_loops = 0;
+static Counter *smpp_next_loop = NULL;
+
+/* sessions waiting for their host name to be resolved */
+static List *smpp_resolve_queue = NULL;
+static long smpp_resolve_thread = -1;
+
+/* upper bound for the timer thread's sleep, wakeups cut it short */
+#define SMPP_LOOP_MAX_SLEEP  10.0
+
+
+static double smpp_loop_now(void)
+{
+    return gw_clock_mono_ns() / 1e9;
+}
+
+
+/*
+ * Ask the timer thread to run the session. Safe to call from any thread.
+ */
+static void smpp_session_wakeup(struct smpp_session *session)
+{
+    session->kicked = 1;
+    gwthread_wakeup(session->loop->thread);
+}
+
+
+/*
+ * Give up the connection and either wait to reconnect or, when
+ * shutting down, mark the session as done.
+ */
+static void smpp_session_close(struct smpp_session *session)
+{
+    SMPP *smpp = session->smpp;
+
+    if (session->conn != NULL) {
+        conn_destroy(session->conn);
+        session->conn = NULL;
+    }
+    smpp_session_disconnected(session);
+    if (smpp->quitting) {
+        session->state = SMPP_SESSION_DONE;
+        smpp_session_wakeup(session);
+    } else {
+        session->state = SMPP_SESSION_IDLE;
+        session->due = smpp_loop_now() + smpp->conn->reconnect_delay;
+        if (gwthread_self() != session->loop->thread)
+            gwthread_wakeup(session->loop->thread);
+    }
+}
+
+
+static void smpp_session_cb(Connection *conn, void *data);
+
+/*
+ * Look up the host names of sessions about to connect, so that a slow
+ * name server does not stop the loops.
+ */
+static void smpp_resolver_thread(void *arg)
+{
+    struct smpp_session *session;
+    struct hostent ent;
+    char *buff;
+
+    while ((session = gwlist_consume(smpp_resolve_queue)) != NULL) {
+        octstr_destroy(session->addr);
+        session->addr = NULL;
+        if (gw_gethostbyname(&ent, octstr_get_cstr(session->smpp->host), &buff) == 0) {
+            session->addr = gw_netaddr_to_octstr(AF_INET, ent.h_addr);
+            gw_free(buff);
+        }
+        session->resolved = 1;
+        smpp_session_wakeup(session);
+    }
+}
+
+
+/*
+ * Start a non-blocking connect to the address the resolver found. The
+ * bind is sent as soon as the FDSet reports the socket connected.
+ */
+static void smpp_session_open(struct smpp_session *session)
+{
+    SMPP *smpp = session->smpp;
+    Connection *conn = NULL;
+    int port, our_port;
+
+    port = (session->transmitter ? smpp->transmit_port : smpp->receive_port);
+    our_port = (session->transmitter ? smpp->our_port : smpp->our_receiver_port);
+
+    if (session->addr == NULL)
+        error(0, "SMPP[%s]: Couldn't resolve host <%s>.",
+              octstr_get_cstr(smpp->conn->id), octstr_get_cstr(smpp->host));
+#ifdef HAVE_LIBSSL
+    else if (smpp->use_ssl)
+        conn = conn_open_ssl_nb(session->addr, port, smpp->ssl_client_certkey_file, smpp->conn->our_host);
+#endif
+    else
+        conn = conn_open_tcp_nb_with_port(session->addr, port, our_port, smpp->conn->our_host);
+
+    if (conn == NULL) {
+        error(0, "SMPP[%s]: Couldn't connect to server.",
+              octstr_get_cstr(smpp->conn->id));
+        smpp_session_close(session);
+        return;
+    }
+
+    session->conn = conn;
+    session->len = 0;
+    session->polled = 0;
+    session->pending_submits = -1;
+    session->state_time = session->last_response = session->last_cleanup =
+        session->last_enquire_sent = gw_clock_mono();
+    if (conn_is_connected(conn) == 0) {
+        if (send_bind(smpp, conn, session->transmitter) == -1) {
+            smpp_session_close(session);
+            return;
+        }
+        session->state = SMPP_SESSION_OPEN;
+    } else
+        session->state = SMPP_SESSION_CONNECTING;
+
+    conn_register(conn, session->loop->fdset, smpp_session_cb, session);
+}
+
+
+/*
+ * Do the I/O and timer work of an open session, like one pass of the
+ * loop in io_thread(). Return -1 if the connection has to be closed.
+ */
+static int smpp_session_io(struct smpp_session *session)
+{
+    SMPP *smpp = session->smpp;
+    Connection *conn = session->conn;
+    SMPP_PDU *pdu;
+    int ret;
+
+    if (session->state == SMPP_SESSION_CONNECTING) {
+        if (!session->polled) {
+            if (smpp->connection_timeout > 0 &&
+                (gw_clock_mono() - session->state_time) > smpp->connection_timeout) {
+                error(0, "SMPP[%s]: Couldn't connect to server (timed out).",
+                      octstr_get_cstr(smpp->conn->id));
+                return -1;
             }
-            gwlist_destroy(noresp, NULL);
+            return 0;
         }
+        if (conn_get_connect_result(conn) != 0) {
+            error(0, "SMPP[%s]: Couldn't connect to server.",
+                  octstr_get_cstr(smpp->conn->id));
+            return -1;
+        }
+        if (send_bind(smpp, conn, session->transmitter) == -1)
+            return -1;
+        session->state = SMPP_SESSION_OPEN;
+        session->last_response = gw_clock_mono();
     }
-    
-#undef IS_ACTIVE
-    
-    /*
-     * Shutdown sequence as follow:
-     *    1) if this is TX session so join receiver and free SMPP
-     *    2) if RX session available but no TX session so nothing to join then free SMPP
-     */
-    if (transmitter && smpp->receiver != -1) {
-        gwthread_wakeup(smpp->receiver);
-        gwthread_join(smpp->receiver);
+    session->polled = 0;
+
+    while ((ret = read_pdu(smpp, conn, &session->len, &pdu)) != 0) {
+        if (ret == -1) { /* connection broken */
+            error(0, "SMPP[%s]: I/O error or other error. Re-connecting.",
+                  octstr_get_cstr(smpp->conn->id));
+            return -1;
+        } else if (ret == -2) {
+            /* wrong pdu length , send gnack */
+            session->len = 0;
+            if (send_gnack(smpp, conn, SMPP_ESME_RINVCMDLEN, 0) == -1) {
+                error(0, "SMPP[%s]: I/O error or other error. Re-connecting.",
+                      octstr_get_cstr(smpp->conn->id));
+                return -1;
+            }
+            continue;
+        }
+        dump_pdu("Got PDU:", smpp->conn->id, pdu, smpp->log_format);
+        ret = handle_pdu(smpp, conn, pdu, session);
+        smpp_pdu_destroy(pdu);
+        if (ret == -1) {
+            error(0, "SMPP[%s]: I/O error or other error. Re-connecting.",
+                  octstr_get_cstr(smpp->conn->id));
+            return -1;
+        }
+        /* unbound or bind rejected, see io_thread() */
+        if (session->bound == -1)
+            return -1;
+        if (session->bound == 1)
+            session->last_response = gw_clock_mono();
     }
-    if (transmitter || smpp->transmitter == -1) {
-        debug("bb.smpp", 0, "SMSCConn %s shut down.",
-              octstr_get_cstr(smpp->conn->name));
-        
-        mutex_lock(smpp->conn->flow_mutex);
-        smpp->conn->status = SMSCCONN_DEAD;
-        smpp->conn->data = NULL;
-        mutex_unlock(smpp->conn->flow_mutex);
-        
-        smpp_destroy(smpp);
-        bb_smscconn_killed();
+
+    /* waiting for unbind_resp */
+    if (session->state == SMPP_SESSION_UNBINDING)
+        return (session->bound != 1 || (gw_clock_mono() - session->state_time) >=
+                SMPP_DEFAULT_SHUTDOWN_TIMEOUT) ? -1 : 0;
+
+    if (smpp->connection_timeout > 0 &&
+        (gw_clock_mono() - session->last_response) > smpp->connection_timeout) {
+        warning(0, "Got no responses within %ld sec., reconnecting...",
+                (long) (gw_clock_mono() - session->last_response));
+        return -1;
+    }
+
+    if (session->bound == 1 && send_enquire_link(smpp, conn, &session->last_enquire_sent) == -1)
+        return -1;
+
+    if (session->transmitter && (gw_clock_mono() - session->last_cleanup) > smpp->wait_ack) {
+        if (do_queue_cleanup(smpp, session))
+            return -1;
+        session->last_cleanup = gw_clock_mono();
+    }
+
+    if (session->transmitter && (gw_clock_mono() - smpp->throttling_err_time) > SMPP_THROTTLING_SLEEP_TIME) {
+        smpp->throttling_err_time = 0;
+        if (send_messages(smpp, conn, session) == -1)
+            return -1;
+    }
+
+    if (smpp->quitting) {
+        if (session->bound != 1 || send_unbind(smpp, conn) == -1)
+            return -1;
+        session->state = SMPP_SESSION_UNBINDING;
+        session->state_time = gw_clock_mono();
+    }
+
+    return 0;
+}
+
+
+/*
+ * Work out when the session has to run next if nothing happens on its
+ * socket. These are the same timeouts io_thread() uses for conn_wait().
+ */
+static void smpp_session_schedule(struct smpp_session *session)
+{
+    SMPP *smpp = session->smpp;
+    double now, due, old_due;
+
+    now = smpp_loop_now();
+    old_due = session->due;
+
+    switch (session->state) {
+    case SMPP_SESSION_RESOLVING:
+        /* the resolver wakes us up */
+        due = now + SMPP_LOOP_MAX_SLEEP;
+        break;
+    case SMPP_SESSION_CONNECTING:
+        due = now + smpp->enquire_link_interval;
+        if (smpp->connection_timeout > 0)
+            due = session->state_time + smpp->connection_timeout + 1;
+        break;
+    case SMPP_SESSION_OPEN:
+        if (session->bound == 1)
+            due = session->last_enquire_sent + smpp->enquire_link_interval;
+        else
+            due = now + smpp->enquire_link_interval;
+        if (smpp->connection_timeout > 0 &&
+            session->last_response + smpp->connection_timeout + 1 < due)
+            due = session->last_response + smpp->connection_timeout + 1;
+        if (session->transmitter && session->pending_submits > 0 &&
+            session->last_cleanup + smpp->wait_ack + 1 < due)
+            due = session->last_cleanup + smpp->wait_ack + 1;
+        if (session->transmitter && SMPP_HAS_WORK(smpp, session) &&
+            session->pending_submits < smpp->max_pending_submits) {
+            if (smpp->throttling_err_time > 0) {
+                if (smpp->throttling_err_time + SMPP_THROTTLING_SLEEP_TIME + 1 < due)
+                    due = smpp->throttling_err_time + SMPP_THROTTLING_SLEEP_TIME + 1;
+            } else if (smpp->conn->shaper != NULL) {
+                /* wake up exactly when the next token is due */
+                double t = gw_shaper_delay(smpp->conn->shaper);
+                if (now + t < due)
+                    due = now + t;
+            }
+        }
+        break;
+    case SMPP_SESSION_UNBINDING:
+        due = session->state_time + SMPP_DEFAULT_SHUTDOWN_TIMEOUT;
+        break;
+    default:
+        /* idle sessions keep their reconnect time */
+        return;
+    }
+
+    session->due = due;
+    /* the timer thread may be sleeping past the new time */
+    if (due < old_due && gwthread_self() != session->loop->thread)
+        gwthread_wakeup(session->loop->thread);
+}
+
+
+/*
+ * Run the session: connect if it is time to, handle what arrived and
+ * the timers, send what we may, and reschedule.
+ */
+static void smpp_session_run(struct smpp_session *session)
+{
+    SMPP *smpp = session->smpp;
+
+    switch (session->state) {
+    case SMPP_SESSION_IDLE:
+        if (smpp->quitting) {
+            /* fail what is still queued */
+            smpp_session_disconnected(session);
+            session->state = SMPP_SESSION_DONE;
+            return;
+        }
+        if (smpp_loop_now() < session->due)
+            return;
+        session->state = SMPP_SESSION_RESOLVING;
+        session->resolved = 0;
+        gwlist_produce(smpp_resolve_queue, session);
+        break;
+    case SMPP_SESSION_RESOLVING:
+        if (!session->resolved)
+            return;
+        if (smpp->quitting)
+            smpp_session_close(session);
+        else
+            smpp_session_open(session);
+        break;
+    case SMPP_SESSION_DONE:
+        return;
+    default:
+        if (smpp_session_io(session) == -1) {
+            debug("bb.sms.smpp", 0, "SMPP[%s]: closing session.",
+                  octstr_get_cstr(smpp->conn->id));
+            smpp_session_close(session);
+        }
+        break;
+    }
+    smpp_session_schedule(session);
+}
+
+
+/*
+ * Run the session now if nobody else does, otherwise leave it to the
+ * thread that does. A done session is not touched after the unlock,
+ * the timer thread may free it.
+ */
+static void smpp_session_kick(struct smpp_session *session)
+{
+    int done;
+
+    session->kicked = 1;
+    while (mutex_trylock(session->lock) == 0) {
+        while (session->kicked && session->state != SMPP_SESSION_DONE) {
+            session->kicked = 0;
+            smpp_session_run(session);
+        }
+        done = (session->state == SMPP_SESSION_DONE);
+        mutex_unlock(session->lock);
+        if (done || !session->kicked)
+            break;
+    }
+}
+
+
+/*
+ * Called by the FDSet thread when the socket can be read or the
+ * connect finished.
+ */
+static void smpp_session_cb(Connection *conn, void *data)
+{
+    struct smpp_session *session = data;
+
+    session->polled = 1;
+    smpp_session_kick(session);
+}
+
+
+/*
+ * Finish an SMPP connection whose receipts are still being resolved,
+ * without holding up the loop it ran on.
+ */
+static void smpp_finish_thread(void *arg)
+{
+    smpp_finish(arg);
+}
+
+
+/*
+ * Timer thread of a loop. Runs the sessions that are due or were woken
+ * up, drops the ones that are done and finishes an SMPP connection once
+ * its last session is gone.
+ */
+static void smpp_loop_thread(void *arg)
+{
+    struct smpp_loop *loop = arg;
+    struct smpp_session *session;
+    List *finished;
+    SMPP *smpp;
+    double now, next;
+    long i;
+
+    finished = gwlist_create();
+    while (!loop->quitting) {
+        now = smpp_loop_now();
+        next = now + SMPP_LOOP_MAX_SLEEP;
+
+        mutex_lock(loop->lock);
+        for (i = 0; i < gwlist_len(loop->sessions); ) {
+            session = gwlist_get(loop->sessions, i);
+            if (session->kicked || session->due <= now)
+                smpp_session_kick(session);
+            if (session->state == SMPP_SESSION_DONE &&
+                mutex_trylock(session->lock) == 0) {
+                mutex_unlock(session->lock);
+                gwlist_delete(loop->sessions, i, 1);
+                if (counter_decrease(session->smpp->running) == 1)
+                    gwlist_append(finished, session->smpp);
+                continue;
+            }
+            if (session->due < next)
+                next = session->due;
+            i++;
+        }
+        mutex_unlock(loop->lock);
+
+        while ((smpp = gwlist_extract_first(finished)) != NULL) {
+            if (gwlist_producer_count(smpp->dlr_pending) == 0 ||
+                    gwthread_create(smpp_finish_thread, smpp) == -1)
+                smpp_finish(smpp);
+        }
+
+        now = smpp_loop_now();
+        if (next > now)
+            gwthread_sleep(next - now);
+    }
+    gwlist_destroy(finished, NULL);
+}
+
+
+/*
+ * Hand the sessions of an SMPP connection to the loops, round robin.
+ */
+static void smpp_loops_add(SMPP *smpp)
+{
+    struct smpp_session *session;
+    struct smpp_loop *loop;
+    long i;
+
+    for (i = 0; i < smpp->num_sessions; i++) {
+        session = &smpp->sessions[i];
+        loop = &smpp_loops[counter_increase(smpp_next_loop) % smpp_num_loops];
+        session->loop = loop;
+        session->lock = mutex_create();
+        session->state = SMPP_SESSION_IDLE;
+        session->due = 0;
+        counter_increase(smpp->running);
+        mutex_lock(loop->lock);
+        gwlist_append(loop->sessions, session);
+        mutex_unlock(loop->lock);
+        gwthread_wakeup(loop->thread);
+    }
+}
+
+
+int smsc_smpp_loops_init(Cfg *cfg)
+{
+    CfgGroup *grp;
+    long loops, i;
+
+    grp = cfg_get_single_group(cfg, octstr_imm("core"));
+    if (cfg_get_integer(&loops, grp, octstr_imm("smpp-event-loops")) == -1 || loops <= 0)
+        return 0;
+
+    smpp_resolve_queue = gwlist_create();
+    gwlist_add_producer(smpp_resolve_queue);
+    smpp_resolve_thread = gwthread_create(smpp_resolver_thread, NULL);
+    if (smpp_resolve_thread == -1) {
+        error(0, "SMPP: Couldn't start resolver thread.");
+        gwlist_destroy(smpp_resolve_queue, NULL);
+        smpp_resolve_queue = NULL;
+        return -1;
+    }
+
+    smpp_loops = gw_malloc(loops * sizeof(*smpp_loops));
+    smpp_next_loop = counter_create();
+    for (i = 0; i < loops; i++) {
+        struct smpp_loop *loop = &smpp_loops[i];
+
+        loop->fdset = fdset_create();
+        loop->lock = mutex_create();
+        loop->sessions = gwlist_create();
+        loop->quitting = 0;
+        loop->thread = gwthread_create(smpp_loop_thread, loop);
+        if (loop->thread == -1) {
+            error(0, "SMPP: Couldn't start event loop thread.");
+            smpp_num_loops = i + 1;
+            smsc_smpp_loops_shutdown();
+            return -1;
+        }
+        smpp_num_loops = i + 1;
     }
+    info(0, "SMPP: Running binds on %ld event loops.", smpp_num_loops);
+
+    return 0;
+}
+
+
+void smsc_smpp_loops_shutdown(void)
+{
+    long i;
+
+    if (smpp_loops == NULL)
+        return;
+
+    for (i = 0; i < smpp_num_loops; i++) {
+        struct smpp_loop *loop = &smpp_loops[i];
+
+        if (loop->thread != -1) {
+            loop->quitting = 1;
+            gwthread_wakeup(loop->thread);
+            gwthread_join(loop->thread);
+        }
+        if (gwlist_len(loop->sessions) > 0)
+            warning(0, "SMPP: %ld sessions left on event loop %ld.",
+                    gwlist_len(loop->sessions), i);
+        gwlist_destroy(loop->sessions, NULL);
+        mutex_destroy(loop->lock);
+        fdset_destroy(loop->fdset);
+    }
+    gw_free(smpp_loops);
+    smpp_loops = NULL;
+    smpp_num_loops = 0;
+    counter_destroy(smpp_next_loop);
+    smpp_next_loop = NULL;
+
+    gwlist_remove_producer(smpp_resolve_queue);
+    gwthread_join(smpp_resolve_thread);
+    gwlist_destroy(smpp_resolve_queue, NULL);
+    smpp_resolve_queue = NULL;
+    smpp_resolve_thread = -1;
 }
 
 
@@ -2511,7 +3492,7 @@ static int send_msg_cb(SMSCConn *conn, Msg *msg)
 
     smpp = conn->data;
     gw_prioqueue_produce(smpp->msgs_to_send, msg_duplicate(msg));
-    gwthread_wakeup(smpp->transmitter);
+    smpp_wakeup_sender(smpp, NULL);
     return 0;
 }
 
@@ -2519,6 +3500,7 @@ static int send_msg_cb(SMSCConn *conn, Msg *msg)
 static int shutdown_cb(SMSCConn *conn, int finish_sending)
 {
     SMPP *smpp;
+    long i;
 
     if (conn == NULL)
         return -1;
@@ -2538,11 +3520,12 @@ static int shutdown_cb(SMSCConn *conn, int finish_sending)
     }
 
     smpp->quitting = 1;
-    if  (smpp->transmitter != -1)
-        gwthread_wakeup(smpp->transmitter);
-
-    if (smpp->receiver != -1)
-        gwthread_wakeup(smpp->receiver);
+    for (i = 0; i < smpp->num_sessions; i++) {
+        if (smpp->sessions[i].loop != NULL)
+            smpp_session_wakeup(&smpp->sessions[i]);
+        else if (smpp->sessions[i].thread != -1)
+            gwthread_wakeup(smpp->sessions[i].thread);
+    }
 
     mutex_unlock(conn->flow_mutex);
 
@@ -2589,6 +3572,7 @@ int smsc_smpp_create(SMSCConn *conn, CfgGroup *grp)
     Octstr *alt_addr_charset;
     long connection_timeout, wait_ack, wait_ack_action;
     long esm_class;
+    long binds, i;
 
     my_number = alt_addr_charset = alt_charset = NULL;
     transceiver_mode = 0;
@@ -2634,6 +3618,8 @@ int smsc_smpp_create(SMSCConn *conn, CfgGroup *grp)
     if (cfg_get_integer(&max_pending_submits, grp,
                         octstr_imm("max-pending-submits")) == -1)
         max_pending_submits = SMPP_MAX_PENDING_SUBMITS;
+    if (cfg_get_integer(&binds, grp, octstr_imm("binds")) == -1)
+        binds = 1;
 
     /* Check that config is OK */
     ok = 1;
@@ -2671,6 +3657,10 @@ int smsc_smpp_create(SMSCConn *conn, CfgGroup *grp)
         warning(0, "SMPP: receive-port for transceiver mode defined, ignoring.");
         receive_port = 0;
     } 
+    if (binds < 1) {
+        error(0, "SMPP: binds must be at least 1.");
+        ok = 0;
+    }
 
     if (!ok)
         return -1;
@@ -2799,25 +3789,46 @@ int smsc_smpp_create(SMSCConn *conn, CfgGroup *grp)
      * I/O threads are only started if the corresponding ports
      * have been configured with positive numbers. Use 0 to
      * disable the creation of the corresponding thread.
+     * The transmitting side runs 'binds' sessions.
      */
-    if (port != 0)
-        smpp->transmitter = gwthread_create(io_thread, io_arg_create(smpp,
-                                           (transceiver_mode ? 2 : 1)));
-    if (receive_port != 0)
-        smpp->receiver = gwthread_create(io_thread, io_arg_create(smpp, 0));
-
-    if ((port != 0 && smpp->transmitter == -1) ||
-        (receive_port != 0 && smpp->receiver == -1)) {
+    smpp->num_sessions = (port != 0 ? binds : 0) + (receive_port != 0 ? 1 : 0);
+    smpp->sessions = gw_malloc(smpp->num_sessions * sizeof(*smpp->sessions));
+    for (i = 0; i < smpp->num_sessions; i++) {
+        struct smpp_session *session = &smpp->sessions[i];
+
+        session->smpp = smpp;
+        session->transmitter = (port != 0 && i < binds ? (transceiver_mode ? 2 : 1) : 0);
+        session->thread = -1;
+        session->bound = 0;
+        session->pending_submits = -1;
+        session->sent_msgs = smpp_window_create(max_pending_submits);
+        session->throttled = NULL;
+        session->addr = NULL;
+        session->loop = NULL;
+        session->lock = NULL;
+        session->conn = NULL;
+    }
+    ok = 1;
+    if (smpp_num_loops > 0) {
+        /* all sessions run on the shared event loops */
+        smpp_loops_add(smpp);
+    } else {
+        for (i = 0; ok && i < smpp->num_sessions; i++) {
+            smpp->sessions[i].thread = gwthread_create(io_thread, &smpp->sessions[i]);
+            ok = (smpp->sessions[i].thread != -1);
+        }
+    }
+
+    if (!ok) {
         error(0, "SMPP[%s]: Couldn't start I/O threads.",
               octstr_get_cstr(smpp->conn->id));
         smpp->quitting = 1;
-        if (smpp->transmitter != -1) {
-            gwthread_wakeup(smpp->transmitter);
-            gwthread_join(smpp->transmitter);
-        }
-        if (smpp->receiver != -1) {
-            gwthread_wakeup(smpp->receiver);
-            gwthread_join(smpp->receiver);
+        /* the first session joins the others and frees SMPP */
+        if (smpp->sessions[0].thread != -1) {
+            for (i = 0; i < smpp->num_sessions; i++)
+                if (smpp->sessions[i].thread != -1)
+                    gwthread_wakeup(smpp->sessions[i].thread);
+            gwthread_join(smpp->sessions[0].thread);
         }
         smpp_destroy(conn->data);
         conn->data = NULL;
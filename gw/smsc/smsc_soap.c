@@ -486,7 +486,7 @@ int smsc_soap_create(SMSCConn *conn, CfgGroup *cfg)
 
     /* init status vars */
     conn->status = SMSCCONN_CONNECTING;
-    conn->connect_time = time(NULL);
+    conn->connect_time = gw_clock_mono();
 
     /* set up call backs for bearerbox */
     conn->shutdown = soap_shutdown_cb;
@@ -2019,7 +2019,7 @@ static ClientData* soap_client_have_response(List* client_list)
 
     for (index = gwlist_len(client_list) - 1; index >= 0; --index) {
         cd = gwlist_get(client_list,index);
-        if (gwlist_len(cd->caller)) {
+        if (gw_queue_len(cd->caller)) {
 
             gwlist_unlock(client_list);
             return gwlist_get(client_list, index);
@@ -865,12 +865,13 @@ static void conndata_destroy(ConnData *conndata)
 static int httpsmsc_send(SMSCConn *conn, Msg *msg)
 {
     ConnData *conndata = conn->data;
-    Msg *sms = msg_duplicate(msg);
-    double delay = 0;
+    Msg *sms;
 
-    if (conn->throughput > 0) {
-        delay = 1.0 / conn->throughput;
-    }
+    /* obey throughput speed limit, if any, the core requeues msg else */
+    if (smscconn_shaper_wait(conn) == -1)
+        return -1;
+
+    sms = msg_duplicate(msg);
 
     /* convert character encoding if required */
     if (conndata->alt_charset && 
@@ -882,10 +883,6 @@ static int httpsmsc_send(SMSCConn *conn, Msg *msg)
     conndata->open_sends++;
     conndata->send_sms(conn, sms);
 
-    /* obey throughput speed limit, if any */
-    if (conn->throughput > 0)
-        gwthread_sleep(delay);
-
     return 0;
 }
 
@@ -1005,7 +1002,7 @@ int smsc_soap_parlayx_create(SMSCConn *conn, CfgGroup *cfg)
 #endif
     
     /* setup MT queue */
-    conndata->msgs_to_send = gw_prioqueue_create(sms_priority_compare);
+    conndata->msgs_to_send = gw_prioqueue_create_levels(SMS_PRIORITY_LEVELS, sms_priority_level);
     
     /* assign our SOAP operations */
     conndata->receive_sms = soap_receive_sms;
@@ -1018,7 +1015,7 @@ int smsc_soap_parlayx_create(SMSCConn *conn, CfgGroup *cfg)
     conn->data = conndata;
     conn->name = octstr_create("SOAP");
     conn->status = SMSCCONN_ACTIVE;
-    conn->connect_time = time(NULL);
+    conn->connect_time = gw_clock_mono();
 
     conn->shutdown = httpsmsc_shutdown;
     conn->queued = httpsmsc_queued;
@@ -130,7 +130,7 @@ static int reconnect(SMSCConn *conn)
 	    info(0, "Re-open of %s succeeded.", octstr_get_cstr(conn->name));
 	    mutex_lock(conn->flow_mutex);
 	    conn->status = SMSCCONN_ACTIVE;
-	    conn->connect_time = time(NULL);
+	    conn->connect_time = gw_clock_mono();
 	    mutex_unlock(conn->flow_mutex);
 	    bb_smscconn_connected(conn);
 	    break;
@@ -421,7 +421,7 @@ int smsc_wrapper_create(SMSCConn *conn, CfgGroup *cfg)
 
     conn->name = octstr_create(smsc_name(wrap->smsc));
     conn->status = SMSCCONN_ACTIVE;
-    conn->connect_time = time(NULL);
+    conn->connect_time = gw_clock_mono();
 
     if (conn->is_stopped)
 	gwlist_add_producer(wrap->stopped);
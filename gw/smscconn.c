@@ -292,6 +292,24 @@ SMSCConn *smscconn_create(CfgGroup *grp, int start_as_stopped)
         octstr_destroy(tmp);
         info(0, "Set throughput to %.3f for smsc id <%s>", conn->throughput, octstr_get_cstr(conn->id));
     }
+    if (conn->throughput > 0) {
+        double burst = 1;
+        Octstr *throughput_id;
+
+        if ((tmp = cfg_get(grp, octstr_imm("throughput-burst"))) != NULL) {
+            if (octstr_parse_double(&burst, tmp, 0) == -1 || burst < 1)
+                burst = 1;
+            octstr_destroy(tmp);
+        }
+        /* smsc groups with the same throughput-id share one token bucket */
+        throughput_id = cfg_get(grp, octstr_imm("throughput-id"));
+        if (throughput_id != NULL) {
+            conn->shaper = gw_shaper_get_shared(throughput_id, conn->throughput, burst);
+            octstr_destroy(throughput_id);
+        } else {
+            conn->shaper = gw_shaper_create(conn->throughput, burst);
+        }
+    }
     /* Sets the admin_id. Equals to connection id if empty */
     GET_OPTIONAL_VAL(conn->admin_id, "smsc-admin-id");
     if (conn->admin_id == NULL)
@@ -309,6 +327,10 @@ SMSCConn *smscconn_create(CfgGroup *grp, int start_as_stopped)
     if (cfg_get_bool(&conn->dead_start, grp, octstr_imm("dead-start")) == -1)
         conn->dead_start = 0;	/* default to connect at start-up time */
 
+    /* only takes effect if the core group runs dlr-resolver-threads */
+    if (cfg_get_bool(&conn->dlr_async, grp, octstr_imm("dlr-async")) == -1)
+        conn->dlr_async = 1;
+
     /* open a smsc-id specific log-file in exlusive mode */
     if (conn->log_file)
         conn->log_idx = log_open(octstr_get_cstr(conn->log_file), 
@@ -403,6 +425,19 @@ void smscconn_shutdown(SMSCConn *conn, int finish_sending)
 }
 
 
+int smscconn_shaper_wait(SMSCConn *conn)
+{
+    if (conn->shaper == NULL)
+        return 0;
+
+    while (!gw_shaper_wait(conn->shaper))
+        if (conn->why_killed != SMSCCONN_ALIVE)
+            return -1;
+
+    return 0;
+}
+
+
 int smscconn_destroy(SMSCConn *conn)
 {
     if (conn == NULL)
@@ -421,6 +456,7 @@ int smscconn_destroy(SMSCConn *conn)
     load_destroy(conn->incoming_dlr_load);
     load_destroy(conn->outgoing_sms_load);
     load_destroy(conn->outgoing_dlr_load);
+    gw_shaper_destroy(conn->shaper);
 
     octstr_destroy(conn->name);
     octstr_destroy(conn->id);
@@ -680,7 +716,7 @@ int smscconn_info(SMSCConn *conn, StatusInfo *infotable)
     infotable->status = conn->status;
     infotable->killed = conn->why_killed;
     infotable->is_stopped = conn->is_stopped;
-    infotable->online = time(NULL) - conn->connect_time;
+    infotable->online = gw_clock_mono() - conn->connect_time;
     
     infotable->sent = counter_value(conn->sent);
     infotable->received = counter_value(conn->received);
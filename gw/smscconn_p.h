@@ -152,7 +152,7 @@ struct smscconn {
     int 	load;	       	/* load factor, 0 = no load */
     smscconn_killed_t why_killed;	/* time to die with reason, set when
 				* shutdown called */
-    time_t 	connect_time;	/* When connection to SMSC was established */
+    time_t 	connect_time;	/* When connection to SMSC was established, see gw_clock_mono */
 
     Mutex 	*flow_mutex;	/* used to lock SMSCConn structure (both
 				 *  in smscconn.c and specific driver) */
@@ -201,6 +201,7 @@ struct smscconn {
     int alt_dcs; /* use alternate DCS 0xFX */
 
     double throughput;     /* message thoughput per sec. to be delivered to SMSC */
+    Shaper *shaper;        /* token bucket enforcing throughput, NULL if unlimited */
 
     /* Stores rerouting information for this specific smsc-id */
     int reroute;                /* simply turn MO into MT and process internally */
@@ -208,6 +209,7 @@ struct smscconn {
     Octstr *reroute_to_smsc;    /* define a smsc-id to reroute to */
     int reroute_dlr;            /* should DLR's are rereouted too? */
     int dead_start;             /* don't connect this SMSC at startup time */
+    int dlr_async;              /* ack receipts before their DLR lookup is done */
 
     long max_sms_octets; /* max allowed octets for this SMSC */
 
@@ -249,6 +251,15 @@ struct smscconn {
     void *data;			/* SMSC specific stuff */
 };
 
+
+/*
+ * Wait for a token of conn's throughput shaper, if any. Return 0 once it
+ * is taken, -1 if conn is killed meanwhile; the caller keeps or requeues
+ * the message it was about to send then.
+ */
+int smscconn_shaper_wait(SMSCConn *conn);
+
+
 /*
  * Initializers for various SMSC connection implementations,
  * each should take same arguments and return an int,
@@ -282,6 +293,9 @@ int smsc_http_create(SMSCConn *conn, CfgGroup *cfg);
 
 /* Responsible file: smsc/smsc_smpp.c */
 int smsc_smpp_create(SMSCConn *conn, CfgGroup *cfg);
+/* start and stop the event loops shared by SMPP binds, see smpp-event-loops */
+int smsc_smpp_loops_init(Cfg *cfg);
+void smsc_smpp_loops_shutdown(void);
 
 /* Responsible file: smsc/smsc_cgw.c */
 int smsc_cgw_create(SMSCConn *conn, CfgGroup *cfg);
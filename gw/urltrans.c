@@ -100,9 +100,9 @@ struct URLTranslation {
     Octstr *header;	/* string to be inserted to each SMS */
     Octstr *footer;	/* string to be appended to each SMS */
     Octstr *alt_charset; /* alternative charset to use towards service */
-    List *accepted_smsc; /* smsc id's allowed to use this service. If not set,
+    Dict *accepted_smsc; /* smsc id's allowed to use this service. If not set,
 			    all messages can use this service */
-    List *accepted_account; /* account id's allowed to use this service. If not set,
+    Dict *accepted_account; /* account id's allowed to use this service. If not set,
 			    all messages can use this service */
     
     Octstr *name;	/* Translation name */
@@ -132,6 +132,9 @@ struct URLTranslation {
     long dlr_mask;       /* DLR event mask */
 
     regex_t *keyword_regex;       /* the compiled regular expression for the keyword*/
+    List *keywords;     /* lowercase keyword and aliases if all are plain text,
+                           NULL if only keyword_regex can match them */
+    long position;      /* index in URLTranslationList->list */
     regex_t *accepted_smsc_regex;
     regex_t *accepted_account_regex;
     regex_t *allowed_prefix_regex;
@@ -150,6 +153,11 @@ struct URLTranslationList {
     List *list;
     List *defaults; /* List of default sms-services */
     Dict *names;	/* Dict of lowercase Octstr names */
+    Dict *keywords;	/* Dict of lowercase plain keywords, values are lists
+			   of translations in configuration order */
+    long *keyword_lengths; /* distinct lengths of those, ascending */
+    long num_keyword_lengths;
+    List *patterns;	/* translations in list with a non plain keyword */
 };
 
 
@@ -161,6 +169,7 @@ struct URLTranslationList {
 static long count_occurences(Octstr *str, Octstr *pat);
 static URLTranslation *create_onetrans(CfgGroup *grp);
 static void destroy_onetrans(void *ot);
+static void add_keyword_index(URLTranslationList *trans, URLTranslation *ot);
 static URLTranslation *find_translation(URLTranslationList *trans, Msg *msg);
 static URLTranslation *find_default_translation(URLTranslationList *trans,
 						Octstr *smsc, Octstr *sender, Octstr *receiver,
@@ -187,6 +196,10 @@ URLTranslationList *urltrans_create(void)
     trans->list = gwlist_create();
     trans->defaults = gwlist_create();
     trans->names = dict_create(1024, destroy_keyword_list);
+    trans->keywords = dict_create(1024, destroy_keyword_list);
+    trans->keyword_lengths = NULL;
+    trans->num_keyword_lengths = 0;
+    trans->patterns = gwlist_create();
     return trans;
 }
 
@@ -196,6 +209,9 @@ void urltrans_destroy(URLTranslationList *trans)
     gwlist_destroy(trans->list, destroy_onetrans);
     gwlist_destroy(trans->defaults, destroy_onetrans);
     dict_destroy(trans->names);
+    dict_destroy(trans->keywords);
+    gw_free(trans->keyword_lengths);
+    gwlist_destroy(trans->patterns, NULL);
     gw_free(trans);
 }
 
@@ -211,8 +227,11 @@ int urltrans_add_one(URLTranslationList *trans, CfgGroup *grp)
 
     if (ot->type != TRANSTYPE_SENDSMS && ot->keyword_regex == NULL)
         gwlist_append(trans->defaults, ot);
-    else 
+    else {
+        ot->position = gwlist_len(trans->list);
         gwlist_append(trans->list, ot);
+        add_keyword_index(trans, ot);
+    }
     
     list2 = dict_get(trans->names, ot->name);
     if (list2 == NULL) {
@@ -943,6 +962,56 @@ int urltrans_dlr_mask(URLTranslation *t)
 /*
  * Create one URLTranslation. Return NULL for failure, pointer to it for OK.
  */
+/*
+ * Split a ';' separated list of ids into a Dict, so that checking a
+ * message against it does not walk the list.
+ */
+static Dict *create_id_dict(Octstr *ids)
+{
+    Dict *dict;
+    List *list;
+    Octstr *id;
+
+    list = octstr_split(ids, octstr_imm(";"));
+    dict = dict_create(gwlist_len(list) + 1, octstr_destroy_item);
+    while ((id = gwlist_extract_first(list)) != NULL)
+        dict_put(dict, id, id);
+    gwlist_destroy(list, NULL);
+
+    return dict;
+}
+
+
+/*
+ * Add keyword (or alias) to the plain keywords of ot. A keyword that
+ * means more than its text inside the keyword regex makes ot use the
+ * regex only.
+ */
+static void add_plain_keyword(URLTranslation *ot, Octstr *keyword)
+{
+    long i;
+    int c;
+
+    if (ot->keywords == NULL)
+        return;
+
+    for (i = 0; i < octstr_len(keyword); i++) {
+        c = octstr_get_char(keyword, i);
+        if (c < 0x20 || c > 0x7e || strchr("\\^$.|?*+()[]{}", c) != NULL)
+            break;
+    }
+    if (octstr_len(keyword) == 0 || i < octstr_len(keyword)) {
+        gwlist_destroy(ot->keywords, octstr_destroy_item);
+        ot->keywords = NULL;
+        return;
+    }
+
+    keyword = octstr_duplicate(keyword);
+    octstr_convert_range(keyword, 0, octstr_len(keyword), tolower);
+    gwlist_append(ot->keywords, keyword);
+}
+
+
 static URLTranslation *create_onetrans(CfgGroup *grp)
 {
     URLTranslation *ot;
@@ -1056,6 +1125,8 @@ static URLTranslation *create_onetrans(CfgGroup *grp)
 	    /* convert to regex */
 	    regex_flag |= REG_ICASE;
 	    keyword_regex = octstr_format("^[ ]*(%S", tmp);
+	    ot->keywords = gwlist_create();
+	    add_plain_keyword(ot, tmp);
 	    octstr_destroy(tmp);
 
 	    aliases = cfg_get(grp, octstr_imm("aliases"));
@@ -1069,6 +1140,7 @@ static URLTranslation *create_onetrans(CfgGroup *grp)
 	        for (i = 0; i < gwlist_len(l); ++i) {
 	            os = gwlist_get(l, i);
 	            octstr_format_append(keyword_regex, "|%S", os);
+	            add_plain_keyword(ot, os);
 	        }
 	        gwlist_destroy(l, octstr_destroy_item);
 	    }
@@ -1089,12 +1161,12 @@ static URLTranslation *create_onetrans(CfgGroup *grp)
 
 	accepted_smsc = cfg_get(grp, octstr_imm("accepted-smsc"));
 	if (accepted_smsc != NULL) {
-	    ot->accepted_smsc = octstr_split(accepted_smsc, octstr_imm(";"));
+	    ot->accepted_smsc = create_id_dict(accepted_smsc);
 	    octstr_destroy(accepted_smsc);
 	}
 	accepted_account = cfg_get(grp, octstr_imm("accepted-account"));
 	if (accepted_account != NULL) {
-	    ot->accepted_account = octstr_split(accepted_account, octstr_imm(";"));
+	    ot->accepted_account = create_id_dict(accepted_account);
 	    octstr_destroy(accepted_account);
 	}
         accepted_smsc_regex = cfg_get(grp, octstr_imm("accepted-smsc-regex"));
@@ -1267,8 +1339,9 @@ static void destroy_onetrans(void *p)
 	octstr_destroy(ot->header);
 	octstr_destroy(ot->footer);
 	octstr_destroy(ot->alt_charset);
-	gwlist_destroy(ot->accepted_smsc, octstr_destroy_item);
-	gwlist_destroy(ot->accepted_account, octstr_destroy_item);
+	dict_destroy(ot->accepted_smsc);
+	dict_destroy(ot->accepted_account);
+	gwlist_destroy(ot->keywords, octstr_destroy_item);
 	octstr_destroy(ot->name);
 	octstr_destroy(ot->username);
 	octstr_destroy(ot->password);
@@ -1334,7 +1407,7 @@ static int check_allowed_translation(URLTranslation *t,
     /* if smsc_id set and accepted_smsc exist, accept
      * translation only if smsc id is in accept string
      */
-    if (smsc && t->accepted_smsc && !gwlist_search(t->accepted_smsc, smsc, octstr_item_match))
+    if (smsc && t->accepted_smsc && dict_get(t->accepted_smsc, smsc) == NULL)
         return NOT_ALLOWED;
 
     if (smsc && t->accepted_smsc_regex && gw_regex_match_pre( t->accepted_smsc_regex, smsc) == 0)
@@ -1343,7 +1416,7 @@ static int check_allowed_translation(URLTranslation *t,
     /* if account_id set and accepted_account exist, accept
      * translation only if smsc id is in accept string
      */
-    if (account && t->accepted_account && !gwlist_search(t->accepted_account, account, octstr_item_match))
+    if (account && t->accepted_account && dict_get(t->accepted_account, account) == NULL)
         return NOT_ALLOWED;
 
     if (account && t->accepted_account_regex && gw_regex_match_pre( t->accepted_account_regex, account) == 0)
@@ -1408,38 +1481,109 @@ static int check_allowed_translation(URLTranslation *t,
     return IS_ALLOWED;
 };
 
-    
-/* get_matching_translations - iterate over all translations in trans. 
- * for each translation check whether 
- * the translation's keyword has already been interpreted as a regexp. 
- * if not, compile it now,
- * otherwise retrieve compilation result from dictionary.
+
+/*
+ * Make ot found by get_matching_translations(): plain keywords go into
+ * the keyword Dict, everything else is matched by its regex.
+ */
+static void add_keyword_index(URLTranslationList *trans, URLTranslation *ot)
+{
+    List *list;
+    Octstr *keyword;
+    long i, j, len;
+
+    if (ot->keywords == NULL) {
+        if (ot->keyword_regex != NULL)
+            gwlist_append(trans->patterns, ot);
+        return;
+    }
+
+    for (i = 0; i < gwlist_len(ot->keywords); i++) {
+        keyword = gwlist_get(ot->keywords, i);
+
+        list = dict_get(trans->keywords, keyword);
+        if (list == NULL) {
+            list = gwlist_create();
+            dict_put(trans->keywords, keyword, list);
+        }
+        /* an alias may repeat the keyword */
+        if (gwlist_len(list) == 0 || gwlist_get(list, gwlist_len(list) - 1) != ot)
+            gwlist_append(list, ot);
+
+        len = octstr_len(keyword);
+        for (j = 0; j < trans->num_keyword_lengths; j++)
+            if (trans->keyword_lengths[j] >= len)
+                break;
+        if (j < trans->num_keyword_lengths && trans->keyword_lengths[j] == len)
+            continue;
+        trans->keyword_lengths = gw_realloc(trans->keyword_lengths,
+            (trans->num_keyword_lengths + 1) * sizeof(*trans->keyword_lengths));
+        memmove(trans->keyword_lengths + j + 1, trans->keyword_lengths + j,
+                (trans->num_keyword_lengths - j) * sizeof(*trans->keyword_lengths));
+        trans->keyword_lengths[j] = len;
+        trans->num_keyword_lengths++;
+    }
+}
+
+
+static int cmp_position(const void *a, const void *b)
+{
+    const URLTranslation *ta = a, *tb = b;
+
+    return (ta->position > tb->position) - (ta->position < tb->position);
+}
+
+
+/* get_matching_translations - find the translations whose keyword
+ * matches the start of msg.
  *
- * the translations where the word matches the translation's pattern 
- * are returned in a list
- * 
+ * A plain keyword regex "^[ ]*(keyword|alias...)[ ]*" matches if msg
+ * starts with one of them after leading spaces, ignoring case. So for
+ * each length of plain keywords we know, look the lowercased start of
+ * msg up in the keyword Dict. Only translations with a real pattern
+ * have their regex run.
+ *
+ * the matching translations are returned in a list, in configuration
+ * order
  */
 static List *get_matching_translations(URLTranslationList *trans, Octstr *msg) 
 {
-    List *list;
-    long i;
+    List *list, *found;
+    Octstr *word;
+    long i, j, start;
     URLTranslation *t;
 
     gw_assert(trans != NULL && msg != NULL);
 
     list = gwlist_create();
-    for (i = 0; i < gwlist_len(trans->list); ++i) {
-        t = gwlist_get(trans->list, i);
-        
-        if (t->keyword_regex == NULL)
-            continue;
 
-        if (gw_regex_match_pre(t->keyword_regex, msg) == 1) {
-            debug("", 0, "match found: %s", octstr_get_cstr(t->name));
+    for (start = 0; octstr_get_char(msg, start) == ' '; start++)
+        ;
+    for (i = 0; i < trans->num_keyword_lengths &&
+                start + trans->keyword_lengths[i] <= octstr_len(msg); i++) {
+        word = octstr_copy(msg, start, trans->keyword_lengths[i]);
+        octstr_convert_range(word, 0, octstr_len(word), tolower);
+        found = dict_get(trans->keywords, word);
+        for (j = 0; j < gwlist_len(found); j++)
+            gwlist_append(list, gwlist_get(found, j));
+        octstr_destroy(word);
+    }
+
+    for (i = 0; i < gwlist_len(trans->patterns); ++i) {
+        t = gwlist_get(trans->patterns, i);
+        if (gw_regex_match_pre(t->keyword_regex, msg) == 1)
             gwlist_append(list, t);
-        } else {
-            debug("", 0, "no match found: %s", octstr_get_cstr(t->name));
-        }
+    }
+
+    /* back to configuration order, one keyword may prefix another one */
+    gwlist_sort(list, cmp_position);
+    for (i = gwlist_len(list) - 1; i > 0; i--)
+        if (gwlist_get(list, i) == gwlist_get(list, i - 1))
+            gwlist_delete(list, i, 1);
+
+    for (i = 0; i < gwlist_len(list); ++i) {
+        t = gwlist_get(list, i);
+        debug("", 0, "match found: %s", octstr_get_cstr(t->name));
     }
 
     return list;
@@ -1455,15 +1599,18 @@ static URLTranslation *find_translation(URLTranslationList *trans, Msg *msg)
     URLTranslation *t = NULL;
     List *list, *words;
 
-    /* convert tolower and try to match */
-    data = octstr_duplicate(msg->sms.msgdata);
-    i = 0;
-    while((i = octstr_search_char(data, 0, i)) != -1 && i < octstr_len(data) - 1) {
-        octstr_delete(data, i, 1);
+    /* remove NUL chars before matching, copying data only if needed */
+    data = msg->sms.msgdata;
+    i = octstr_search_char(data, 0, 0);
+    if (i != -1 && i < octstr_len(data) - 1) {
+        data = octstr_duplicate(data);
+        while((i = octstr_search_char(data, 0, i)) != -1 && i < octstr_len(data) - 1) {
+            octstr_delete(data, i, 1);
+        }
     }
     
     list = get_matching_translations(trans, data);
-    words = octstr_split_words(data);
+    words = NULL;
 
     /**
      * List now contains all translations where the keyword of the sms 
@@ -1472,15 +1619,22 @@ static URLTranslation *find_translation(URLTranslationList *trans, Msg *msg)
     for (i = 0; i < gwlist_len(list); ++i) {
         t = gwlist_get(list, i);
 
+        if (check_allowed_translation(t, msg->sms.smsc_id, msg->sms.sender, msg->sms.receiver, msg->sms.account) != 0) {
+            t = NULL;
+            continue;
+        }
+
         /* TODO check_num_args, do we really need this??? */
-        if (check_allowed_translation(t, msg->sms.smsc_id, msg->sms.sender, msg->sms.receiver, msg->sms.account) == 0
-            && check_num_args(t, words) == 0)
+        if (words == NULL)
+            words = octstr_split_words(data);
+        if (check_num_args(t, words) == 0)
             break;
 
         t = NULL;
     }
 
-    octstr_destroy(data);
+    if (data != msg->sms.msgdata)
+        octstr_destroy(data);
     gwlist_destroy(words, octstr_destroy_item);
     gwlist_destroy(list, NULL);
     
@@ -1158,6 +1158,57 @@ Octstr *conn_read_line(Connection *conn)
     return result;
 }
 
+/* Search for an empty line (LF LF or LF CR LF, or an empty line at the
+ * very beginning) in the unread part of the input buffer, starting at
+ * offset "from" relative to inbufpos. Return the position of the final
+ * LF or -1. We must already have the inlock. */
+static long unlocked_search_empty_line(Connection *conn, long from)
+{
+    long pos, prev;
+
+    pos = conn->inbufpos + from;
+    while ((pos = octstr_search_char(conn->inbuf, 10, pos)) >= 0) {
+        prev = pos - 1;
+        if (prev >= conn->inbufpos && octstr_get_char(conn->inbuf, prev) == 13)
+            prev--;
+        if (prev < conn->inbufpos || octstr_get_char(conn->inbuf, prev) == 10)
+            return pos;
+        pos++;
+    }
+    return -1;
+}
+
+Octstr *conn_read_header_block(Connection *conn, long *scanned)
+{
+    Octstr *result = NULL;
+    long pos;
+
+    gw_assert(scanned != NULL);
+
+    lock_in(conn);
+    pos = unlocked_search_empty_line(conn, *scanned);
+    if (pos < 0) {
+        /* everything seen so far contains no empty line, so remember
+         * where we stopped, unlocked_read keeps offsets relative to
+         * inbufpos intact */
+        *scanned = unlocked_inbuf_len(conn);
+        unlocked_read(conn);
+        pos = unlocked_search_empty_line(conn, *scanned);
+        if (pos < 0) {
+            *scanned = unlocked_inbuf_len(conn);
+            unlock_in(conn);
+            return NULL;
+        }
+    }
+
+    result = unlocked_get(conn, pos + 1 - conn->inbufpos);
+    gw_claim_area(result);
+    *scanned = 0;
+
+    unlock_in(conn);
+    return result;
+}
+
 Octstr *conn_read_withlen(Connection *conn)
 {
     Octstr *result = NULL;
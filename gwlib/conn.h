@@ -272,6 +272,15 @@ Octstr *conn_read_fixed(Connection *conn, long length);
  */
 Octstr *conn_read_line(Connection *conn);
 
+/* If the input buffer contains a block of lines terminated by an empty
+ * line (as the head of a HTTP message is), then return the whole block
+ * including the line terminators and the empty line, and remove it from
+ * the input buffer. Otherwise return NULL. "scanned" must point to a
+ * variable that is 0 before the first call for a block; it is used to
+ * avoid searching the same input again when more data arrives.
+ */
+Octstr *conn_read_header_block(Connection *conn, long *scanned);
+
 /* Read a standard network long giving the length of the following
  * data, then read the data itself, and pack it into an Octstr and
  * remove it from the input buffer.  Otherwise return NULL.
@@ -78,11 +78,15 @@ struct Item {
 };
 
 
+static gw_slab_t *item_slab;
+#define ITEM_SLAB (gw_slab_get(&item_slab, "Dict Item", sizeof(Item)))
+
+
 static Item *item_create(Octstr *key, void *value)
 {
     Item *item;
     
-    item = gw_malloc(sizeof(*item));
+    item = gw_slab_alloc(ITEM_SLAB);
     item->key = octstr_duplicate(key);
     item->value = value;
     return item;
@@ -94,7 +98,7 @@ static void item_destroy(void *item)
     
     p = item;
     octstr_destroy(p->key);
-    gw_free(p);
+    gw_slab_free(item_slab, p);
 }
 
 
@@ -154,6 +158,7 @@ static int handle_null_value(Dict *dict, Octstr *key, void *value)
 static int dict_put_true(Dict *dict, Octstr *key, void *value)
 {
     Item *p;
+    gw_arena_t *arena;
     long i;
     int item_unique;
 
@@ -162,7 +167,10 @@ static int dict_put_true(Dict *dict, Octstr *key, void *value)
     i = key_to_index(dict, key);
 
     if (dict->tab[i] == NULL) {
+	/* the bucket lives as long as the dict, not in the caller's arena */
+	arena = gw_arena_suspend();
 	dict->tab[i] = gwlist_create();
+	gw_arena_resume(arena);
 	p = NULL;
     } else {
 	p = gwlist_search(dict->tab[i], key, item_has_key);
@@ -241,6 +249,7 @@ void dict_put(Dict *dict, Octstr *key, void *value)
 {
     long i;
     Item *p;
+    gw_arena_t *arena;
 
     if (value == NULL) {
         value = dict_remove(dict, key);
@@ -252,7 +261,10 @@ void dict_put(Dict *dict, Octstr *key, void *value)
     lock(dict);
     i = key_to_index(dict, key);
     if (dict->tab[i] == NULL) {
+	/* the bucket lives as long as the dict, not in the caller's arena */
+	arena = gw_arena_suspend();
 	dict->tab[i] = gwlist_create();
+	gw_arena_resume(arena);
 	p = NULL;
     } else
 	p = gwlist_search(dict->tab[i], key, item_has_key);
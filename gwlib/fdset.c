@@ -84,8 +84,8 @@ struct FDSet
     int size;
     int entries;
     
-    /* Array of times when appropriate fd got any event or events bitmask changed */
-    time_t *times;
+    /* Array of monotonic times (gw_clock_mono) when appropriate fd got any event or events bitmask changed */
+    long *times;
 
     /* timeout for this fdset */
     long timeout;
@@ -148,7 +148,7 @@ struct action
     long timeout;               /* Used by SET_TIMEOUT */
     /* When the request has been handled, an element is produced on this
      * list, so that the submitter can synchronize.  Can be left NULL. */
-    List *done;                 /* Used by LISTEN, UNREGISTER, and DESTROY */
+    List *done;                 /* Used by UNREGISTER and DESTROY */
 };
 
 /* Return a new action structure of the given type, with all fields empty. */
@@ -321,7 +321,7 @@ static void poller(void *arg)
     struct action *action;
     int ret;
     int i;
-    time_t now;
+    long now;
 
     gw_assert(set != NULL);
 
@@ -342,7 +342,7 @@ static void poller(void *arg)
             }
             continue;
         }
-        time(&now);
+        now = gw_clock_mono();
         /* Callbacks may modify the table while we scan it, so be careful. */
         set->scanning = 1;
         for (i = 0; i < set->entries; i++) {
@@ -351,8 +351,8 @@ static void poller(void *arg)
                                 set->pollinfo[i].revents,
                                 set->datafields[i]);
                 /* update event time */
-                time(&set->times[i]);
-            } else if (set->timeout > 0 && difftime(set->times[i] + set->timeout, now) <= 0) {
+                set->times[i] = now;
+            } else if (set->timeout > 0 && set->times[i] + set->timeout <= now) {
                 debug("gwlib.fdset", 0, "Timeout for fd:%d appears.", set->pollinfo[i].fd);
                 set->callbacks[i](set->pollinfo[i].fd, POLLERR, set->datafields[i]);
             }
@@ -464,7 +464,7 @@ void fdset_register(FDSet *set, int fd, int events,
     set->pollinfo[new].revents = 0;
     set->callbacks[new] = callback;
     set->datafields[new] = data;
-    time(&set->times[new]);
+    set->times[new] = gw_clock_mono();
 }
 
 void fdset_listen(FDSet *set, int fd, int mask, int events)
@@ -480,7 +480,7 @@ void fdset_listen(FDSet *set, int fd, int mask, int events)
         action->fd = fd;
 	action->mask = mask;
         action->events = events;
-        submit_action(set, action);
+        submit_action_nosync(set, action);
         return;
     }
 
@@ -504,12 +504,13 @@ void fdset_listen(FDSet *set, int fd, int mask, int events)
             set->pollinfo[entry].revents & (events | ~mask);
     }
     
-    time(&set->times[entry]);
+    set->times[entry] = gw_clock_mono();
 }
 
 void fdset_unregister(FDSet *set, int fd)
 {
     int entry;
+    long i;
 
     gw_assert(set != NULL);
 
@@ -530,6 +531,19 @@ void fdset_unregister(FDSet *set, int fd)
         return;
     }
 
+    /* Changes queued by other threads for this fd are stale now, and
+     * must not hit the next user of the same fd number. Only we take
+     * actions off the list, others just append. */
+    for (i = 0; i < gwlist_len(set->actions); ) {
+        struct action *action = gwlist_get(set->actions, i);
+
+        if (action->type == LISTEN && action->fd == fd) {
+            gwlist_delete(set->actions, i, 1);
+            action_destroy(action);
+        } else
+            i++;
+    }
+
     if (entry == set->entries - 1) {
         /* It's the last entry.  We can safely remove it even while
          * the array is being scanned, because the scan checks set->entries. */
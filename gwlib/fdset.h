@@ -105,9 +105,12 @@ void fdset_register(FDSet *set, int fd, int events,
  * setting will not be changed by this.  If mask were POLLIN|POLLOUT,
  * then the POLLOUT setting would be turned off.
  *
- * The fd must first have been registered.  Locks are used to
- * guarantee that the callback function will not be called for
- * the old events after this function returns.
+ * The fd must first have been registered.  Called from the polling
+ * thread the change is immediate.  From other threads it is queued
+ * like fdset_register() and made before the next poll, so the callback
+ * may still see the old events once.  Waiting for the polling thread
+ * instead would deadlock with a callback that waits for a lock held
+ * by the caller, as Connection does.
  */
 void fdset_listen(FDSet *set, int fd, int mask, int events);
 
@@ -0,0 +1,296 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-arena.c - per-thread allocation arenas.
+ *
+ * A block starts with a reference count biased by ARENA_BIAS while it is
+ * the current block of its arena. The arena counts its allocations from
+ * the block without atomic operations and settles the bias when it moves
+ * on, so only frees touch the count of a block in use.
+ */
+
+#include "gw-config.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "gwlib.h"
+#include "gw-arena.h"
+
+/* size of the blocks an arena allocates from */
+#define ARENA_BLOCK_SIZE 8192
+
+/* allocations larger than this get a block of their own */
+#define ARENA_LARGE (ARENA_BLOCK_SIZE / 4)
+
+#define ARENA_ALIGN 8
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+
+/* reference count of a block held by its arena */
+#define ARENA_BIAS (LONG_MAX / 2)
+
+/*
+ * Atomic operations. Compilers without the __atomic builtins get the
+ * same semantics from one global mutex.
+ */
+#if defined(__clang__) || (defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+
+#define atom_add(p, v) __atomic_add_fetch(p, v, __ATOMIC_ACQ_REL)
+
+#else
+
+static pthread_mutex_t atomic_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long atom_add(long *p, long v)
+{
+    pthread_mutex_lock(&atomic_lock);
+    v = (*p += v);
+    pthread_mutex_unlock(&atomic_lock);
+    return v;
+}
+
+#endif
+
+struct arena_block {
+    long refs;
+};
+
+/* every allocation is preceded by a pointer to its block */
+struct arena_header {
+    struct arena_block *block;
+};
+
+struct gw_arena {
+    struct arena_block *first;  /* block holding this structure */
+    long first_allocs;          /* allocations from 'first' if not current */
+    struct arena_block *block;  /* current block */
+    long allocs;                /* allocations from 'block' */
+    char *next;
+    char *end;
+    gw_arena_t *outer;          /* arena attached before this one */
+};
+
+static pthread_key_t arena_key;
+static int arena_init = 0;
+static long arena_blocks = 0;
+
+
+static struct arena_block *block_create(size_t size, long refs)
+{
+    struct arena_block *block;
+
+    block = gw_malloc(sizeof(*block) + size);
+    block->refs = refs;
+    atom_add(&arena_blocks, 1);
+    return block;
+}
+
+
+static void block_release(struct arena_block *block, long refs)
+{
+    if (atom_add(&block->refs, -refs) == 0) {
+        gw_free(block);
+        atom_add(&arena_blocks, -1);
+    }
+}
+
+
+/* Give up the arena's hold on a block with 'allocs' allocations made */
+static void block_retire(struct arena_block *block, long allocs)
+{
+    block_release(block, ARENA_BIAS - allocs);
+}
+
+
+static void arena_use_block(gw_arena_t *arena, struct arena_block *block,
+                            char *start)
+{
+    arena->block = block;
+    arena->allocs = 0;
+    arena->next = start;
+    arena->end = (char *) (block + 1) + ARENA_BLOCK_SIZE;
+}
+
+
+void gw_arena_init(void)
+{
+    if (pthread_key_create(&arena_key, NULL) != 0)
+        panic(errno, "Could not create arena key.");
+    arena_init = 1;
+}
+
+
+void gw_arena_shutdown(void)
+{
+    arena_init = 0;
+    pthread_key_delete(arena_key);
+    if (gw_arena_blocks() > 0)
+        debug("gwlib.arena", 0, "Arena blocks still in use: %ld.", gw_arena_blocks());
+}
+
+
+gw_arena_t *gw_arena_begin(void)
+{
+#ifdef USE_GWMEM_NATIVE
+    struct arena_block *block;
+    gw_arena_t *arena;
+
+    if (!arena_init)
+        return NULL;
+
+    block = block_create(ARENA_BLOCK_SIZE, ARENA_BIAS);
+    arena = (gw_arena_t *) (block + 1);
+    arena->first = block;
+    arena->first_allocs = 0;
+    arena_use_block(arena, block, (char *) arena + ARENA_ROUND(sizeof(*arena)));
+    arena->outer = pthread_getspecific(arena_key);
+    pthread_setspecific(arena_key, arena);
+    return arena;
+#else
+    return NULL;
+#endif
+}
+
+
+void gw_arena_end(gw_arena_t *arena)
+{
+    struct arena_block *first;
+    long first_allocs;
+
+    if (arena == NULL)
+        return;
+
+    gw_assert(pthread_getspecific(arena_key) == arena);
+    pthread_setspecific(arena_key, arena->outer);
+
+    /* the structure lives in the first block, so retire that one last */
+    first = arena->first;
+    first_allocs = arena->first_allocs;
+    if (arena->block != first)
+        block_retire(arena->block, arena->allocs);
+    else
+        first_allocs = arena->allocs;
+    block_retire(first, first_allocs);
+}
+
+
+gw_arena_t *gw_arena_suspend(void)
+{
+    gw_arena_t *arena;
+
+    if (!arena_init || (arena = pthread_getspecific(arena_key)) == NULL)
+        return NULL;
+    pthread_setspecific(arena_key, NULL);
+    return arena;
+}
+
+
+void gw_arena_resume(gw_arena_t *arena)
+{
+    if (arena == NULL)
+        return;
+
+    gw_assert(pthread_getspecific(arena_key) == NULL);
+    pthread_setspecific(arena_key, arena);
+}
+
+
+void *gw_arena_malloc(size_t size)
+{
+    gw_arena_t *arena;
+    struct arena_header *header;
+    struct arena_block *block;
+
+    if (!arena_init || (arena = pthread_getspecific(arena_key)) == NULL)
+        return NULL;
+
+    size = sizeof(*header) + ARENA_ROUND(size);
+    if (size > ARENA_LARGE) {
+        block = block_create(size, 1);
+        header = (struct arena_header *) (block + 1);
+    } else {
+        if ((size_t) (arena->end - arena->next) < size) {
+            if (arena->block == arena->first)
+                arena->first_allocs = arena->allocs;
+            else
+                block_retire(arena->block, arena->allocs);
+            block = block_create(ARENA_BLOCK_SIZE, ARENA_BIAS);
+            arena_use_block(arena, block, (char *) (block + 1));
+        }
+        block = arena->block;
+        header = (struct arena_header *) arena->next;
+        arena->next += size;
+        arena->allocs++;
+    }
+    header->block = block;
+    return header + 1;
+}
+
+
+void gw_arena_free(void *ptr)
+{
+    if (ptr != NULL)
+        block_release(((struct arena_header *) ptr - 1)->block, 1);
+}
+
+
+long gw_arena_blocks(void)
+{
+    return atom_add(&arena_blocks, 0);
+}
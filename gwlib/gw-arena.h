@@ -0,0 +1,142 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-arena.h - per-thread allocation arenas.
+ *
+ * An arena is a scope of work, such as handling one request, that is
+ * attached to the thread doing it. While it is attached, Octstr and List
+ * take their memory from the arena instead of from gw_malloc: allocating
+ * is bumping a pointer in the current block of the arena, and the blocks
+ * are given back when the scope ends.
+ *
+ * Objects may still outlive the scope or be destroyed by other threads.
+ * Each block counts the allocations made from it and is only freed when
+ * all of them are freed and the arena has moved past it. An object that
+ * escapes the scope thus keeps its block, not just itself, allocated.
+ * So what is made to be kept never comes from an arena: copies made with
+ * octstr_duplicate and http_header_duplicate, and the keys and buckets
+ * of a Dict. Code that creates other objects to outlive the scope
+ * suspends the arena around that with gw_arena_suspend.
+ *
+ * Arenas are only used with the native allocator. With the checking
+ * allocators gw_arena_begin returns NULL and everything comes from
+ * gw_malloc, so that leaks and overruns are still reported per object.
+ */
+
+#ifndef GW_ARENA_H
+#define GW_ARENA_H
+
+#include <stddef.h>
+
+typedef struct gw_arena gw_arena_t;
+
+/**
+ * Initialize and shut down the arena module, from gwlib_init and
+ * gwlib_shutdown.
+ */
+void gw_arena_init(void);
+void gw_arena_shutdown(void);
+
+/**
+ * Create an arena and attach it to the calling thread, until the
+ * matching gw_arena_end. Arenas nest: the arena attached before is
+ * attached again when this one ends.
+ * @return the new arena, or NULL if arenas are not used
+ */
+gw_arena_t *gw_arena_begin(void);
+
+/**
+ * Detach an arena from the calling thread and give back its blocks as
+ * soon as no allocation uses them anymore.
+ * @arena - arena returned by gw_arena_begin in this thread, may be NULL
+ */
+void gw_arena_end(gw_arena_t *arena);
+
+/**
+ * Detach the arena of the calling thread until gw_arena_resume, so that
+ * objects created meanwhile come from gw_malloc.
+ * @return the arena to give to gw_arena_resume, NULL if there is none
+ */
+gw_arena_t *gw_arena_suspend(void);
+
+/**
+ * Attach an arena detached with gw_arena_suspend again.
+ * @arena - arena returned by gw_arena_suspend in this thread, may be NULL
+ */
+void gw_arena_resume(gw_arena_t *arena);
+
+/**
+ * Allocate from the arena attached to the calling thread. Memory is
+ * aligned for pointers and longs, not for every type.
+ * @size - size of the memory area
+ * @return memory to free with gw_arena_free, or NULL if no arena is
+ *         attached
+ */
+void *gw_arena_malloc(size_t size);
+
+/**
+ * Free memory allocated with gw_arena_malloc, from any thread.
+ * @ptr - memory to free, may be NULL
+ */
+void gw_arena_free(void *ptr);
+
+/**
+ * Return the number of arena blocks still allocated.
+ */
+long gw_arena_blocks(void);
+
+#endif
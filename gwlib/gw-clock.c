@@ -0,0 +1,121 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-clock.c - clocks for timestamps, timeouts and intervals.
+ *
+ * See gw-clock.h for a description of the interface.
+ */
+
+#include "gw-config.h"
+
+#include <time.h>
+#include <sys/time.h>
+
+#include "gw-clock.h"
+
+#define NSEC_PER_SEC 1000000000LL
+
+#if defined(CLOCK_REALTIME_COARSE)
+#define CLOCK_NOW CLOCK_REALTIME_COARSE
+#endif
+
+#if defined(CLOCK_MONOTONIC_COARSE)
+#define CLOCK_MONO_SECONDS CLOCK_MONOTONIC_COARSE
+#elif defined(CLOCK_MONOTONIC)
+#define CLOCK_MONO_SECONDS CLOCK_MONOTONIC
+#endif
+
+
+time_t gw_clock_now(void)
+{
+#ifdef CLOCK_NOW
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_NOW, &ts) == 0)
+        return ts.tv_sec;
+#endif
+    return time(NULL);
+}
+
+
+long gw_clock_mono(void)
+{
+#ifdef CLOCK_MONO_SECONDS
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONO_SECONDS, &ts) == 0)
+        return ts.tv_sec;
+#endif
+    return time(NULL);
+}
+
+
+long long gw_clock_mono_ns(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+#endif
+    {
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+        return tv.tv_sec * NSEC_PER_SEC + tv.tv_usec * 1000LL;
+    }
+}
@@ -59,6 +59,11 @@
  *
  * Algorithm ala Robert Sedgewick.
  *
+ * Queues created with gw_prioqueue_create_levels keep a FIFO per level
+ * instead of the heap. Producers push onto a stack per level without
+ * locking, and consumers move the stacks over to the FIFOs under the
+ * queue lock. A bitmap of the FIFOs with items gives the highest level.
+ *
  * Alexander Malysh <amalysh at kannel.org>, 2004, 2008
  */
 
@@ -68,14 +73,37 @@
 #include "gwmem.h"
 #include "gwassert.h"
 #include "gwthread.h"
+#include "gw-slab.h"
 #include "gw-prioqueue.h"
 
+#if defined(__clang__) || (defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#define LEVELS_LOCK_FREE 1
+#endif
+
 
 struct element {
     void *item;
     long long seq;
 };
 
+/* item of a level queue */
+struct node {
+    struct node *next;
+    void *item;
+};
+
+static gw_slab_t *node_slab;
+#define NODE_SLAB (gw_slab_get(&node_slab, "prioqueue node", sizeof(struct node)))
+
+struct level {
+    /* items pushed by producers, newest first */
+    struct node *pushed;
+    /* items moved over from 'pushed', oldest first, under the lock */
+    struct node *head;
+    struct node *tail;
+};
+
 struct gw_prioqueue {
     Mutex *mutex;
     struct element **tab;
@@ -85,6 +113,18 @@ struct gw_prioqueue {
     long long seq;
     pthread_cond_t nonempty;
     int (*cmp)(const void*, const void *);
+    /* the rest is for level queues only, 'levels' is NULL otherwise */
+    struct level *levels;
+    int num_levels;
+    int (*level)(const void *);
+    /* levels with items between head and tail, under the lock */
+    unsigned long ready;
+    /* levels with pushed items, set by producers */
+    unsigned long pushed;
+    /* number of items in the levels */
+    long count;
+    /* number of consumers waiting for an item */
+    long waiting;
 };
 
 
@@ -186,6 +226,7 @@ gw_prioqueue_t *gw_prioqueue_create(int(*cmp)(const void*, const void *))
     ret->len = 0;
     ret->seq = 0;
     ret->cmp = cmp;
+    ret->levels = NULL;
     
     /* put NULL item at pos 0 that is our stop marker */
     make_bigger(ret, 1);
@@ -198,13 +239,187 @@ gw_prioqueue_t *gw_prioqueue_create(int(*cmp)(const void*, const void *))
 }
 
 
+gw_prioqueue_t *gw_prioqueue_create_levels(int levels, int(*level)(const void *))
+{
+    gw_prioqueue_t *ret;
+    int i;
+
+    gw_assert(level != NULL);
+    gw_assert(levels > 0 && levels <= (int) (sizeof(unsigned long) * 8));
+
+    ret = gw_malloc(sizeof(*ret));
+    ret->producers = 0;
+    pthread_cond_init(&ret->nonempty, NULL);
+    ret->mutex = mutex_create();
+    ret->tab = NULL;
+    ret->size = 0;
+    ret->len = 0;
+    ret->seq = 0;
+    ret->cmp = NULL;
+    ret->levels = gw_malloc(levels * sizeof(*ret->levels));
+    for (i = 0; i < levels; i++)
+        ret->levels[i].pushed = ret->levels[i].head = ret->levels[i].tail = NULL;
+    ret->num_levels = levels;
+    ret->level = level;
+    ret->ready = 0;
+    ret->pushed = 0;
+    ret->count = 0;
+    ret->waiting = 0;
+
+    return ret;
+}
+
+
+/**
+ * Push an item onto the stack of its level
+ * @queue - our level queue
+ * @item - item to push
+ */
+static void levels_push(gw_prioqueue_t *queue, void *item)
+{
+    struct node *node;
+    struct level *level;
+    int i;
+
+    i = queue->level(item);
+    if (i < 0)
+        i = 0;
+    else if (i >= queue->num_levels)
+        i = queue->num_levels - 1;
+    level = &queue->levels[i];
+
+    node = gw_slab_alloc(NODE_SLAB);
+    node->item = item;
+
+#ifdef LEVELS_LOCK_FREE
+    node->next = __atomic_load_n(&level->pushed, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&level->pushed, &node->next, node, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    __atomic_fetch_or(&queue->pushed, 1UL << i, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&queue->count, 1, __ATOMIC_RELAXED);
+    /* a consumer that counted itself as waiting before we set the bit
+     * above may not have seen the item, wake it up */
+    if (__atomic_load_n(&queue->waiting, __ATOMIC_SEQ_CST) > 0) {
+        queue_lock(queue);
+        pthread_cond_signal(&queue->nonempty);
+        queue_unlock(queue);
+    }
+#else
+    queue_lock(queue);
+    node->next = level->pushed;
+    level->pushed = node;
+    queue->pushed |= 1UL << i;
+    queue->count++;
+    pthread_cond_signal(&queue->nonempty);
+    queue_unlock(queue);
+#endif
+}
+
+
+/**
+ * Move the pushed items over to the FIFOs of their levels. Called with
+ * the queue locked.
+ * @queue - our level queue
+ */
+static void levels_collect(gw_prioqueue_t *queue)
+{
+    struct level *level;
+    struct node *list, *next, *first;
+    unsigned long pushed;
+    int i;
+
+#ifdef LEVELS_LOCK_FREE
+    pushed = __atomic_exchange_n(&queue->pushed, 0, __ATOMIC_ACQ_REL);
+#else
+    pushed = queue->pushed;
+    queue->pushed = 0;
+#endif
+    while (pushed != 0) {
+        i = __builtin_ctzl(pushed);
+        pushed &= pushed - 1;
+        level = &queue->levels[i];
+#ifdef LEVELS_LOCK_FREE
+        list = __atomic_exchange_n(&level->pushed, NULL, __ATOMIC_ACQUIRE);
+#else
+        list = level->pushed;
+        level->pushed = NULL;
+#endif
+        if (list == NULL)
+            continue;
+
+        /* reverse the stack into insertion order */
+        first = list;
+        for (next = list->next, list->next = NULL; next != NULL; ) {
+            struct node *n = next->next;
+            next->next = list;
+            list = next;
+            next = n;
+        }
+        if (level->tail != NULL)
+            level->tail->next = list;
+        else
+            level->head = list;
+        level->tail = first;
+        queue->ready |= 1UL << i;
+    }
+}
+
+
+/**
+ * Return the first item of the highest level, removing it if 'take'
+ * is set. Called with the queue locked.
+ * @queue - our level queue
+ * @take - whether to remove the item
+ */
+static void *levels_first(gw_prioqueue_t *queue, int take)
+{
+    struct level *level;
+    struct node *node;
+    void *item;
+    int i;
+
+    levels_collect(queue);
+    if (queue->ready == 0)
+        return NULL;
+
+    i = sizeof(queue->ready) * 8 - 1 - __builtin_clzl(queue->ready);
+    level = &queue->levels[i];
+    node = level->head;
+    item = node->item;
+    if (!take)
+        return item;
+
+    level->head = node->next;
+    if (level->head == NULL) {
+        level->tail = NULL;
+        queue->ready &= ~(1UL << i);
+    }
+#ifdef LEVELS_LOCK_FREE
+    __atomic_sub_fetch(&queue->count, 1, __ATOMIC_RELAXED);
+#else
+    queue->count--;
+#endif
+    gw_slab_free(node_slab, node);
+
+    return item;
+}
+
+
 void gw_prioqueue_destroy(gw_prioqueue_t *queue, void(*item_destroy)(void*))
 {
     long i;
+    void *item;
 
     if (queue == NULL)
         return;
     
+    if (queue->levels != NULL) {
+        while ((item = levels_first(queue, 1)) != NULL)
+            if (item_destroy != NULL)
+                item_destroy(item);
+        gw_free(queue->levels);
+    }
     for (i = 0; i < queue->len; i++) {
         if (item_destroy != NULL && queue->tab[i]->item != NULL)
             item_destroy(queue->tab[i]->item);
@@ -224,6 +439,18 @@ long gw_prioqueue_len(gw_prioqueue_t *queue)
     if (queue == NULL)
         return 0;
      
+    if (queue->levels != NULL) {
+#ifdef LEVELS_LOCK_FREE
+        len = __atomic_load_n(&queue->count, __ATOMIC_RELAXED);
+#else
+        queue_lock(queue);
+        len = queue->count;
+        queue_unlock(queue);
+#endif
+        /* a consumer may take an item before its producer counts it */
+        return len > 0 ? len : 0;
+    }
+
     queue_lock(queue);
     len = queue->len - 1;
     queue_unlock(queue);
@@ -237,6 +464,11 @@ void gw_prioqueue_insert(gw_prioqueue_t *queue, void *item)
     gw_assert(queue != NULL);
     gw_assert(item != NULL);
     
+    if (queue->levels != NULL) {
+        levels_push(queue, item);
+        return;
+    }
+
     queue_lock(queue);
     make_bigger(queue, 1);
     queue->tab[queue->len] = gw_malloc(sizeof(**queue->tab));
@@ -252,10 +484,19 @@ void gw_prioqueue_insert(gw_prioqueue_t *queue, void *item)
 void gw_prioqueue_foreach(gw_prioqueue_t *queue, void(*fn)(const void *, long))
 {
     register long i;
+    struct node *node;
+    int level;
 
     gw_assert(queue != NULL && fn != NULL);
     
     queue_lock(queue);
+    if (queue->levels != NULL) {
+        levels_collect(queue);
+        i = 0;
+        for (level = queue->num_levels - 1; level >= 0; level--)
+            for (node = queue->levels[level].head; node != NULL; node = node->next)
+                fn(node->item, i++);
+    }
     for (i = 1; i < queue->len; i++)
         fn(queue->tab[i]->item, i - 1);
     queue_unlock(queue);
@@ -269,6 +510,11 @@ void *gw_prioqueue_remove(gw_prioqueue_t *queue)
     gw_assert(queue != NULL);
     
     queue_lock(queue);
+    if (queue->levels != NULL) {
+        ret = levels_first(queue, 1);
+        queue_unlock(queue);
+        return ret;
+    }
     if (queue->len <= 1) {
         queue_unlock(queue);
         return NULL;
@@ -290,7 +536,9 @@ void *gw_prioqueue_get(gw_prioqueue_t *queue)
     gw_assert(queue != NULL);
     
     queue_lock(queue);
-    if (queue->len > 1)
+    if (queue->levels != NULL)
+        ret = levels_first(queue, 0);
+    else if (queue->len > 1)
         ret = queue->tab[1]->item;
     else
         ret = NULL;
@@ -307,6 +555,29 @@ void *gw_prioqueue_consume(gw_prioqueue_t *queue)
     gw_assert(queue != NULL);
 
     queue_lock(queue);
+    if (queue->levels != NULL) {
+        while ((ret = levels_first(queue, 1)) == NULL && queue->producers > 0) {
+#ifdef LEVELS_LOCK_FREE
+            /* count ourselves as waiting before looking for items again,
+             * producers check the count after pushing */
+            __atomic_add_fetch(&queue->waiting, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&queue->pushed, __ATOMIC_SEQ_CST) != 0) {
+                __atomic_sub_fetch(&queue->waiting, 1, __ATOMIC_SEQ_CST);
+                continue;
+            }
+#endif
+            queue->mutex->owner = -1;
+            pthread_cleanup_push((void(*)(void*))pthread_mutex_unlock, &queue->mutex->mutex);
+            pthread_cond_wait(&queue->nonempty, &queue->mutex->mutex);
+            pthread_cleanup_pop(0);
+            queue->mutex->owner = gwthread_self();
+#ifdef LEVELS_LOCK_FREE
+            __atomic_sub_fetch(&queue->waiting, 1, __ATOMIC_SEQ_CST);
+#endif
+        }
+        queue_unlock(queue);
+        return ret;
+    }
     while (queue->len == 1 && queue->producers > 0) {
         queue->mutex->owner = -1;
         pthread_cleanup_push((void(*)(void*))pthread_mutex_unlock, &queue->mutex->mutex);
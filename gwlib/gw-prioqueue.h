@@ -74,6 +74,18 @@ typedef struct gw_prioqueue gw_prioqueue_t;
  */
 gw_prioqueue_t *gw_prioqueue_create(int(*cmp)(const void*, const void *));
 
+/**
+ * Create priority queue for items with a few priority levels. Each
+ * level is a FIFO: items of a higher level are removed first, and items
+ * of one level in the order they were inserted. Inserting does not take
+ * the queue lock.
+ * @levels - number of levels, at most the number of bits in a long
+ * @level - returns the level of an item, values outside 0..levels-1
+ *          count as the nearest level
+ * @return newly created priority queue
+ */
+gw_prioqueue_t *gw_prioqueue_create_levels(int levels, int(*level)(const void *));
+
 /**
  * Destroy priority queue
  * @queue - queue to destroy
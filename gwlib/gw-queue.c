@@ -0,0 +1,516 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-queue.c - multi-producer multi-consumer FIFO queue.
+ *
+ * The ring is the bounded MPMC queue of Dmitry Vyukov: every slot has a
+ * sequence number telling producers and consumers whose turn it is, so
+ * both sides only race for their position counter.
+ */
+
+#include "gw-config.h"
+
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "gwlib.h"
+#include "gw-queue.h"
+
+/* ring size of unbounded queues, must be a power of two */
+#define UNBOUNDED_RING_SIZE 1024
+
+/* keep the position counters on cache lines of their own */
+#define CACHE_LINE 64
+
+/*
+ * Atomic operations. Compilers without the __atomic builtins get the
+ * same semantics from one global mutex.
+ */
+#if defined(__clang__) || (defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+
+#define atom_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define atom_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define atom_add(p, v) __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST)
+#define atom_cas(p, e, v) \
+    __atomic_compare_exchange_n(p, e, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#define atom_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#else
+
+static pthread_mutex_t atomic_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long atom_load(long *p)
+{
+    long v;
+
+    pthread_mutex_lock(&atomic_lock);
+    v = *p;
+    pthread_mutex_unlock(&atomic_lock);
+    return v;
+}
+
+static void atom_store(long *p, long v)
+{
+    pthread_mutex_lock(&atomic_lock);
+    *p = v;
+    pthread_mutex_unlock(&atomic_lock);
+}
+
+static long atom_add(long *p, long v)
+{
+    pthread_mutex_lock(&atomic_lock);
+    v = (*p += v);
+    pthread_mutex_unlock(&atomic_lock);
+    return v;
+}
+
+static int atom_cas(long *p, long *expected, long v)
+{
+    int ret;
+
+    pthread_mutex_lock(&atomic_lock);
+    if ((ret = (*p == *expected)))
+        *p = v;
+    else
+        *expected = *p;
+    pthread_mutex_unlock(&atomic_lock);
+    return ret;
+}
+
+#define atom_fence() do { } while (0)
+
+#endif
+
+
+struct slot {
+    long seq;
+    void *item;
+};
+
+struct gw_queue {
+    struct slot *ring;
+    long mask;
+    int bounded;
+    char pad0[CACHE_LINE];
+    long head;          /* next position to produce to */
+    char pad1[CACHE_LINE];
+    long tail;          /* next position to consume from */
+    char pad2[CACHE_LINE];
+    long len;
+    long spilled;       /* items on the overflow list */
+    Mutex *overflow_lock;
+    void **overflow;    /* circular, protected by overflow_lock */
+    long overflow_size;
+    long overflow_start;
+    long overflow_len;
+    long producers;
+    long waiters;       /* consumers sleeping or about to */
+    Mutex *mutex;
+    pthread_cond_t nonempty;
+};
+
+
+static int ring_push(gw_queue_t *queue, void *item)
+{
+    struct slot *slot;
+    long pos, dif;
+
+    pos = atom_load(&queue->head);
+    for (;;) {
+        slot = &queue->ring[pos & queue->mask];
+        dif = atom_load(&slot->seq) - pos;
+        if (dif == 0) {
+            if (atom_cas(&queue->head, &pos, pos + 1))
+                break;
+        } else if (dif < 0)
+            return -1;
+        else
+            pos = atom_load(&queue->head);
+    }
+    slot->item = item;
+    atom_store(&slot->seq, pos + 1);
+
+    return 0;
+}
+
+
+static void *ring_pop(gw_queue_t *queue)
+{
+    struct slot *slot;
+    long pos, dif;
+    void *item;
+
+    pos = atom_load(&queue->tail);
+    for (;;) {
+        slot = &queue->ring[pos & queue->mask];
+        dif = atom_load(&slot->seq) - (pos + 1);
+        if (dif == 0) {
+            if (atom_cas(&queue->tail, &pos, pos + 1))
+                break;
+        } else if (dif < 0)
+            return NULL;
+        else
+            pos = atom_load(&queue->tail);
+    }
+    item = slot->item;
+    atom_store(&slot->seq, pos + queue->mask + 1);
+
+    return item;
+}
+
+
+static void overflow_append(gw_queue_t *queue, void *item)
+{
+    long i, size;
+    void **tab;
+
+    mutex_lock(queue->overflow_lock);
+    if (queue->overflow_len == queue->overflow_size) {
+        size = (queue->overflow_size > 0 ? queue->overflow_size * 2 : 1024);
+        tab = gw_malloc(size * sizeof(*tab));
+        for (i = 0; i < queue->overflow_len; i++)
+            tab[i] = queue->overflow[(queue->overflow_start + i) % queue->overflow_size];
+        gw_free(queue->overflow);
+        queue->overflow = tab;
+        queue->overflow_size = size;
+        queue->overflow_start = 0;
+    }
+    queue->overflow[(queue->overflow_start + queue->overflow_len) % queue->overflow_size] = item;
+    queue->overflow_len++;
+    mutex_unlock(queue->overflow_lock);
+}
+
+
+/*
+ * Move items from the overflow list to the ring while there is room.
+ * Consumers only ever take from the ring: a consumer taking from the
+ * list could overtake older items a producer put into the ring after
+ * the consumer found it empty. 'spilled' drops only once an item is in
+ * the ring, so a producer that sees it 0 has nothing left on the list.
+ */
+static void refill(gw_queue_t *queue)
+{
+    long moved = 0;
+
+    mutex_lock(queue->overflow_lock);
+    while (queue->overflow_len > 0 &&
+           ring_push(queue, queue->overflow[queue->overflow_start]) == 0) {
+        queue->overflow_start = (queue->overflow_start + 1) % queue->overflow_size;
+        queue->overflow_len--;
+        moved++;
+    }
+    if (moved > 0)
+        atom_add(&queue->spilled, -moved);
+    mutex_unlock(queue->overflow_lock);
+}
+
+
+/*
+ * Take the first item without sleeping.
+ */
+static void *take(gw_queue_t *queue)
+{
+    void *item;
+
+    item = ring_pop(queue);
+    if (item == NULL && atom_load(&queue->spilled) > 0) {
+        refill(queue);
+        item = ring_pop(queue);
+    }
+    if (item != NULL)
+        atom_add(&queue->len, -1);
+
+    return item;
+}
+
+
+static void wait_nonempty(gw_queue_t *queue, struct timespec *abstime, int *timedout)
+{
+    int rc;
+
+    queue->mutex->owner = -1;
+    pthread_cleanup_push((void(*)(void*))pthread_mutex_unlock, &queue->mutex->mutex);
+    if (abstime != NULL) {
+        rc = pthread_cond_timedwait(&queue->nonempty, &queue->mutex->mutex, abstime);
+        if (rc == ETIMEDOUT)
+            *timedout = 1;
+    } else
+        pthread_cond_wait(&queue->nonempty, &queue->mutex->mutex);
+    pthread_cleanup_pop(0);
+    queue->mutex->owner = gwthread_self();
+}
+
+
+/*
+ * Leave the sleepers, called with the mutex held. A producer wakes only
+ * one sleeper per item, which might have been a thread that does not
+ * take it, so pass the wakeup on while items are left.
+ */
+static void wake_next(gw_queue_t *queue)
+{
+    if (atom_add(&queue->waiters, -1) > 0 && atom_load(&queue->len) > 0)
+        pthread_cond_signal(&queue->nonempty);
+}
+
+
+/*
+ * Sleep until there is an item, the producers are gone or 'abstime'
+ * passed. A consumer about to sleep first announces it in 'waiters'
+ * and then checks the queue again; producers add their item first and then
+ * check 'waiters'. With both sides fenced one of them always sees the
+ * other, so no wakeup is lost.
+ */
+static void *take_or_wait(gw_queue_t *queue, struct timespec *abstime)
+{
+    void *item;
+    int timedout = 0;
+
+    if ((item = take(queue)) != NULL)
+        return item;
+
+    mutex_lock(queue->mutex);
+    atom_add(&queue->waiters, 1);
+    atom_fence();
+    while ((item = take(queue)) == NULL && atom_load(&queue->producers) > 0 && !timedout)
+        wait_nonempty(queue, abstime, &timedout);
+    wake_next(queue);
+    mutex_unlock(queue->mutex);
+
+    return item;
+}
+
+
+gw_queue_t *gw_queue_create(long bound)
+{
+    gw_queue_t *queue;
+    long size, i;
+
+    for (size = (bound > 0 ? 1 : UNBOUNDED_RING_SIZE); size < bound; size <<= 1)
+        ;
+
+    queue = gw_malloc(sizeof(*queue));
+    queue->ring = gw_malloc(size * sizeof(*queue->ring));
+    for (i = 0; i < size; i++) {
+        queue->ring[i].seq = i;
+        queue->ring[i].item = NULL;
+    }
+    queue->mask = size - 1;
+    queue->bounded = (bound > 0);
+    queue->head = queue->tail = 0;
+    queue->len = queue->spilled = 0;
+    queue->overflow_lock = mutex_create();
+    queue->overflow = NULL;
+    queue->overflow_size = queue->overflow_start = queue->overflow_len = 0;
+    queue->producers = 0;
+    queue->waiters = 0;
+    queue->mutex = mutex_create();
+    pthread_cond_init(&queue->nonempty, NULL);
+
+    return queue;
+}
+
+
+void gw_queue_destroy(gw_queue_t *queue, void(*item_destroy)(void*))
+{
+    void *item;
+
+    if (queue == NULL)
+        return;
+
+    while ((item = take(queue)) != NULL) {
+        if (item_destroy != NULL)
+            item_destroy(item);
+    }
+    mutex_destroy(queue->overflow_lock);
+    gw_free(queue->overflow);
+    mutex_destroy(queue->mutex);
+    pthread_cond_destroy(&queue->nonempty);
+    gw_free(queue->ring);
+    gw_free(queue);
+}
+
+
+long gw_queue_len(gw_queue_t *queue)
+{
+    long len;
+
+    if (queue == NULL)
+        return 0;
+
+    /* consumers may account an item before its producer did */
+    len = atom_load(&queue->len);
+    return len > 0 ? len : 0;
+}
+
+
+int gw_queue_produce(gw_queue_t *queue, void *item)
+{
+    gw_assert(queue != NULL);
+    gw_assert(item != NULL);
+
+    if (atom_load(&queue->spilled) > 0 || ring_push(queue, item) == -1) {
+        if (queue->bounded)
+            return -1;
+        /* count it first, see refill() */
+        atom_add(&queue->spilled, 1);
+        overflow_append(queue, item);
+    }
+    atom_add(&queue->len, 1);
+
+    atom_fence();
+    if (atom_load(&queue->waiters) > 0) {
+        mutex_lock(queue->mutex);
+        pthread_cond_signal(&queue->nonempty);
+        mutex_unlock(queue->mutex);
+    }
+
+    return 0;
+}
+
+
+void *gw_queue_extract(gw_queue_t *queue)
+{
+    gw_assert(queue != NULL);
+
+    return take(queue);
+}
+
+
+void *gw_queue_consume(gw_queue_t *queue)
+{
+    gw_assert(queue != NULL);
+
+    return take_or_wait(queue, NULL);
+}
+
+
+void *gw_queue_timed_consume(gw_queue_t *queue, long sec)
+{
+    struct timespec abstime;
+
+    gw_assert(queue != NULL);
+
+    abstime.tv_sec = time(NULL) + sec;
+    abstime.tv_nsec = 0;
+
+    return take_or_wait(queue, &abstime);
+}
+
+
+long gw_queue_consume_batch(gw_queue_t *queue, void **items, long max)
+{
+    long n;
+
+    gw_assert(queue != NULL);
+    gw_assert(max > 0);
+
+    if ((items[0] = take_or_wait(queue, NULL)) == NULL)
+        return 0;
+    for (n = 1; n < max && (items[n] = take(queue)) != NULL; n++)
+        ;
+
+    return n;
+}
+
+
+int gw_queue_wait_until_nonempty(gw_queue_t *queue)
+{
+    int ret;
+
+    gw_assert(queue != NULL);
+
+    mutex_lock(queue->mutex);
+    atom_add(&queue->waiters, 1);
+    atom_fence();
+    while (atom_load(&queue->len) <= 0 && atom_load(&queue->producers) > 0)
+        wait_nonempty(queue, NULL, NULL);
+    ret = (atom_load(&queue->len) > 0 ? 1 : -1);
+    wake_next(queue);
+    mutex_unlock(queue->mutex);
+
+    return ret;
+}
+
+
+void gw_queue_add_producer(gw_queue_t *queue)
+{
+    gw_assert(queue != NULL);
+
+    atom_add(&queue->producers, 1);
+}
+
+
+void gw_queue_remove_producer(gw_queue_t *queue)
+{
+    gw_assert(queue != NULL);
+
+    mutex_lock(queue->mutex);
+    gw_assert(queue->producers > 0);
+    if (atom_add(&queue->producers, -1) == 0)
+        pthread_cond_broadcast(&queue->nonempty);
+    mutex_unlock(queue->mutex);
+}
+
+
+long gw_queue_producer_count(gw_queue_t *queue)
+{
+    gw_assert(queue != NULL);
+
+    return atom_load(&queue->producers);
+}
@@ -0,0 +1,171 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-queue.h - multi-producer multi-consumer FIFO queue.
+ *
+ * A queue for handing items from thread to thread, with the producer
+ * counting of gwlist: consumers sleep until there is an item or until
+ * the last producer is gone. Unlike a List it offers no access to the
+ * items in the middle, in exchange producing and consuming do not take
+ * a lock while the queue is neither empty nor overflowing.
+ *
+ * Items are kept in a ring of slots claimed with compare-and-swap. A
+ * bounded queue refuses items when its ring is full. An unbounded queue
+ * spills them to a locked overflow list instead, which consumers move
+ * back into the ring as it empties. Producers keep adding to the list
+ * until it is drained, so the items of each producer stay in order.
+ *
+ * A producer only takes the lock of the queue if some consumer sleeps
+ * on it, and then wakes one consumer per item, not all of them.
+ */
+
+#ifndef GW_QUEUE_H
+#define GW_QUEUE_H
+
+typedef struct gw_queue gw_queue_t;
+
+/**
+ * Create a queue
+ * @bound - maximum number of items, rounded up to a power of two, or 0
+ *          for an unbounded queue
+ * @return newly created queue
+ */
+gw_queue_t *gw_queue_create(long bound);
+
+/**
+ * Destroy a queue
+ * @queue - queue to destroy
+ * @item_destroy - item destructor, may be NULL
+ */
+void gw_queue_destroy(gw_queue_t *queue, void(*item_destroy)(void*));
+
+/**
+ * Return the number of items in the queue. Producers and consumers
+ * running at the same time make this an estimate.
+ * @queue - the queue
+ */
+long gw_queue_len(gw_queue_t *queue);
+
+/**
+ * Append an item. The item may not be NULL.
+ * @queue - the queue
+ * @item - item to append
+ * @return 0 on success, -1 if a bounded queue is full
+ */
+int gw_queue_produce(gw_queue_t *queue, void *item);
+
+/**
+ * Remove the first item, but do not sleep if the queue is empty
+ * @queue - the queue
+ * @return first item or NULL if the queue is empty
+ */
+void *gw_queue_extract(gw_queue_t *queue);
+
+/**
+ * Remove the first item, sleep until there is one if producers are
+ * registered
+ * @queue - the queue
+ * @return first item or NULL if the queue is empty and has no producers
+ */
+void *gw_queue_consume(gw_queue_t *queue);
+
+/**
+ * Like gw_queue_consume, but sleep at most 'sec' seconds
+ * @queue - the queue
+ * @sec - timeout in seconds
+ * @return first item or NULL if none arrived in time
+ */
+void *gw_queue_timed_consume(gw_queue_t *queue, long sec);
+
+/**
+ * Like gw_queue_consume, but also take up to 'max' - 1 more items that
+ * are available without sleeping
+ * @queue - the queue
+ * @items - array of at least 'max' item pointers to fill
+ * @max - maximum number of items to take
+ * @return number of items taken, 0 if the queue is empty and has no
+ *         producers
+ */
+long gw_queue_consume_batch(gw_queue_t *queue, void **items, long max);
+
+/**
+ * Sleep until the queue is nonempty or has no producers
+ * @queue - the queue
+ * @return 1 if the queue is nonempty, -1 otherwise
+ */
+int gw_queue_wait_until_nonempty(gw_queue_t *queue);
+
+/**
+ * Register a producer
+ * @queue - the queue
+ */
+void gw_queue_add_producer(gw_queue_t *queue);
+
+/**
+ * Unregister a producer. When the last one is gone, all sleeping
+ * consumers wake up.
+ * @queue - the queue
+ */
+void gw_queue_remove_producer(gw_queue_t *queue);
+
+/**
+ * Return the number of registered producers
+ * @queue - the queue
+ */
+long gw_queue_producer_count(gw_queue_t *queue);
+
+#endif
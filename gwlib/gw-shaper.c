@@ -0,0 +1,218 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+
+/*
+ * gw-shaper.c - token bucket throughput shaper.
+ */
+
+#include "gwlib.h"
+
+#define NSEC_PER_SEC 1000000000LL
+
+struct Shaper {
+    Mutex *lock;
+    double rate;
+    double burst;
+    double tokens;
+    long long last;
+    /* set for shared shapers, protected by shared_lock */
+    Octstr *name;
+    long users;
+};
+
+static Dict *shared = NULL;
+static Mutex *shared_lock = NULL;
+
+
+/* Add the tokens earned since the last refill. Caller holds the lock. */
+static void refill(Shaper *shaper)
+{
+    long long now = gw_clock_mono_ns();
+
+    if (now > shaper->last) {
+        shaper->tokens += (now - shaper->last) * shaper->rate / NSEC_PER_SEC;
+        if (shaper->tokens > shaper->burst)
+            shaper->tokens = shaper->burst;
+    }
+    shaper->last = now;
+}
+
+
+void gw_shaper_init(void)
+{
+    shared = dict_create(16, NULL);
+    shared_lock = mutex_create();
+}
+
+
+void gw_shaper_shutdown(void)
+{
+    dict_destroy(shared);
+    mutex_destroy(shared_lock);
+    shared = NULL;
+    shared_lock = NULL;
+}
+
+
+Shaper *gw_shaper_create(double rate, double burst)
+{
+    Shaper *shaper;
+
+    gw_assert(rate > 0);
+
+    shaper = gw_malloc(sizeof(*shaper));
+    shaper->lock = mutex_create();
+    shaper->rate = rate;
+    shaper->burst = (burst < 1 ? 1 : burst);
+    shaper->tokens = shaper->burst;
+    shaper->last = gw_clock_mono_ns();
+    shaper->name = NULL;
+    shaper->users = 1;
+
+    return shaper;
+}
+
+
+Shaper *gw_shaper_get_shared(Octstr *name, double rate, double burst)
+{
+    Shaper *shaper;
+
+    gw_assert(name != NULL);
+
+    mutex_lock(shared_lock);
+    shaper = dict_get(shared, name);
+    if (shaper == NULL) {
+        shaper = gw_shaper_create(rate, burst);
+        shaper->name = octstr_duplicate(name);
+        dict_put(shared, name, shaper);
+    } else {
+        shaper->users++;
+    }
+    mutex_unlock(shared_lock);
+
+    return shaper;
+}
+
+
+void gw_shaper_destroy(Shaper *shaper)
+{
+    if (shaper == NULL)
+        return;
+
+    if (shaper->name != NULL) {
+        mutex_lock(shared_lock);
+        if (--shaper->users > 0) {
+            mutex_unlock(shared_lock);
+            return;
+        }
+        dict_remove(shared, shaper->name);
+        mutex_unlock(shared_lock);
+        octstr_destroy(shaper->name);
+    }
+
+    mutex_destroy(shaper->lock);
+    gw_free(shaper);
+}
+
+
+int gw_shaper_take(Shaper *shaper)
+{
+    int ret = 0;
+
+    gw_assert(shaper != NULL);
+
+    mutex_lock(shaper->lock);
+    refill(shaper);
+    if (shaper->tokens >= 1) {
+        shaper->tokens -= 1;
+        ret = 1;
+    }
+    mutex_unlock(shaper->lock);
+
+    return ret;
+}
+
+
+double gw_shaper_delay(Shaper *shaper)
+{
+    double delay = 0;
+
+    gw_assert(shaper != NULL);
+
+    mutex_lock(shaper->lock);
+    refill(shaper);
+    if (shaper->tokens < 1)
+        delay = (1 - shaper->tokens) / shaper->rate;
+    mutex_unlock(shaper->lock);
+
+    return delay;
+}
+
+
+int gw_shaper_wait(Shaper *shaper)
+{
+    double delay;
+
+    if (gw_shaper_take(shaper))
+        return 1;
+
+    delay = gw_shaper_delay(shaper);
+    if (delay > 0)
+        gwthread_sleep_micro(delay);
+
+    return gw_shaper_take(shaper);
+}
@@ -0,0 +1,121 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+
+/*
+ * gw-shaper.h - token bucket throughput shaper.
+ *
+ * A shaper hands out tokens at a fixed rate (tokens per second) and
+ * lets up to 'burst' of them accumulate while idle. Time is taken
+ * from a monotonic clock with nanosecond resolution, so rates above
+ * one per second are spread evenly instead of being rounded to whole
+ * seconds, and wall clock adjustments do not open or stall the bucket.
+ *
+ * Shapers may be private to one user or looked up by name, in which
+ * case all users of the same name draw from the same bucket. This is
+ * how several SMSC connections share one throughput limit.
+ */
+
+#ifndef GW_SHAPER_H
+#define GW_SHAPER_H
+
+typedef struct Shaper Shaper;
+
+
+void gw_shaper_init(void);
+void gw_shaper_shutdown(void);
+
+/*
+ * Create a shaper passing 'rate' tokens per second with room for
+ * 'burst' tokens. A burst below 1 is raised to 1. The bucket starts
+ * full.
+ */
+Shaper *gw_shaper_create(double rate, double burst);
+
+/*
+ * Return the shaper registered under 'name', creating it with the given
+ * rate and burst if it does not exist yet. If it exists the rate and
+ * burst of the first caller stay in effect. Each call must be paired
+ * with a gw_shaper_destroy.
+ */
+Shaper *gw_shaper_get_shared(Octstr *name, double rate, double burst);
+
+/*
+ * Release a shaper. Shared shapers are freed with their last user.
+ */
+void gw_shaper_destroy(Shaper *shaper);
+
+/*
+ * Take one token if available. Return 1 if taken, 0 otherwise.
+ */
+int gw_shaper_take(Shaper *shaper);
+
+/*
+ * Return the number of seconds until the next token is available,
+ * 0 if one is available now. Does not take the token.
+ */
+double gw_shaper_delay(Shaper *shaper);
+
+/*
+ * Sleep until the next token is due and take it. Return 1 if a token
+ * was taken, 0 if the sleep was interrupted by gwthread_wakeup or
+ * another user got the token first; callers loop on this and check
+ * their own shutdown condition in between. The sleep has microsecond
+ * resolution, see gwthread_sleep_micro.
+ */
+int gw_shaper_wait(Shaper *shaper);
+
+#endif
@@ -0,0 +1,383 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-slab.c - caches of fixed-size objects.
+ *
+ * The thread caches follow the magazine layer of Bonwick and Adams,
+ * "Magazines and Vmem" (USENIX 2001), without the per-CPU part: a
+ * thread owns one magazine per slab and the depot keeps the magazines
+ * with objects and those without.
+ */
+
+#include "gw-config.h"
+
+#include <string.h>
+#include <pthread.h>
+
+#include "gwlib.h"
+#include "gw-slab.h"
+
+/* maximum number of slabs in a process */
+#define SLAB_MAX 32
+
+/* objects per magazine, also the number allocated from the heap at once */
+#define MAGAZINE_SIZE 32
+
+/* full magazines a depot keeps, objects beyond these go back to the heap */
+#define DEPOT_MAX_FULL 128
+
+#define SLAB_ALIGN 16
+
+/*
+ * Slab lookup. Compilers without the __atomic builtins take the lock
+ * for every lookup.
+ */
+#if defined(__clang__) || (defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#define slab_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define slab_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#else
+#define slab_load(p) NULL
+#define slab_store(p, v) (*(p) = (v))
+#endif
+
+struct magazine {
+    struct magazine *next;
+    long count;
+    void *objs[MAGAZINE_SIZE];
+};
+
+struct gw_slab {
+    const char *name;
+    size_t size;
+    int id;
+    pthread_mutex_t lock;
+    struct magazine *full;      /* magazines holding objects */
+    struct magazine *empty;     /* magazines holding none */
+    long num_full;
+    long live;
+    long high;
+    long total;
+};
+
+struct thread_cache {
+    struct magazine *mags[SLAB_MAX];
+    long allocs[SLAB_MAX];      /* allocations minus frees not yet counted */
+};
+
+static struct gw_slab slabs[SLAB_MAX];
+static long num_slabs = 0;
+static pthread_mutex_t slabs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void count_live(gw_slab_t *slab, long n)
+{
+    slab->live += n;
+    if (slab->live > slab->high)
+        slab->high = slab->live;
+}
+
+
+#ifdef USE_GWMEM_NATIVE
+
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+
+/* Give the objects of a magazine back to the heap */
+static void magazine_drain(struct magazine *mag)
+{
+    while (mag->count > 0)
+        gw_free(mag->objs[--mag->count]);
+}
+
+
+/*
+ * Put a magazine holding objects into the depot, with the slab locked.
+ * Return 0 if the depot is full and the caller has to drain it.
+ */
+static int depot_put(gw_slab_t *slab, struct magazine *mag)
+{
+    if (slab->num_full >= DEPOT_MAX_FULL)
+        return 0;
+    mag->next = slab->full;
+    slab->full = mag;
+    slab->num_full++;
+    return 1;
+}
+
+
+/* Give the magazines of an exiting thread to the depots */
+static void thread_cache_destroy(void *arg)
+{
+    struct thread_cache *cache = arg;
+    struct magazine *mag;
+    gw_slab_t *slab;
+    long i;
+
+    for (i = 0; i < SLAB_MAX; ++i) {
+        if ((mag = cache->mags[i]) == NULL && cache->allocs[i] == 0)
+            continue;
+        slab = &slabs[i];
+        pthread_mutex_lock(&slab->lock);
+        count_live(slab, cache->allocs[i]);
+        if (mag != NULL && mag->count > 0 && depot_put(slab, mag))
+            mag = NULL;
+        pthread_mutex_unlock(&slab->lock);
+        if (mag != NULL)
+            magazine_drain(mag);
+        gw_free(mag);
+    }
+    gw_free(cache);
+}
+
+
+static void cache_key_create(void)
+{
+    if (pthread_key_create(&cache_key, thread_cache_destroy) != 0)
+        panic(0, "Could not create slab cache key.");
+}
+
+
+static struct thread_cache *thread_cache(void)
+{
+    struct thread_cache *cache;
+
+    if ((cache = pthread_getspecific(cache_key)) == NULL) {
+        cache = gw_malloc(sizeof(*cache));
+        memset(cache, 0, sizeof(*cache));
+        pthread_setspecific(cache_key, cache);
+    }
+    return cache;
+}
+
+
+/* Take an empty magazine from the depot, with the slab locked */
+static struct magazine *empty_magazine(gw_slab_t *slab)
+{
+    struct magazine *mag;
+
+    if ((mag = slab->empty) != NULL)
+        slab->empty = mag->next;
+    else
+        mag = gw_malloc(sizeof(*mag));
+    mag->count = 0;
+    return mag;
+}
+
+
+/* Replace the empty magazine of the thread by one holding objects */
+static struct magazine *refill(gw_slab_t *slab, struct thread_cache *cache)
+{
+    struct magazine *mag, *old;
+
+    old = cache->mags[slab->id];
+    pthread_mutex_lock(&slab->lock);
+    count_live(slab, cache->allocs[slab->id]);
+    cache->allocs[slab->id] = 0;
+    if ((mag = slab->full) != NULL) {
+        slab->full = mag->next;
+        slab->num_full--;
+        if (old != NULL) {
+            old->next = slab->empty;
+            slab->empty = old;
+        }
+    } else {
+        mag = (old != NULL) ? old : empty_magazine(slab);
+        slab->total += MAGAZINE_SIZE;
+    }
+    pthread_mutex_unlock(&slab->lock);
+
+    /* each object is an allocation of its own, so it can be freed alone */
+    if (mag->count == 0) {
+        while (mag->count < MAGAZINE_SIZE)
+            mag->objs[mag->count++] = gw_malloc(slab->size);
+    }
+
+    cache->mags[slab->id] = mag;
+    return mag;
+}
+
+
+/*
+ * Replace the full magazine of the thread by an empty one. If the depot
+ * already has enough full magazines, the objects of this one are given
+ * back to the heap and the thread keeps it.
+ */
+static struct magazine *flush(gw_slab_t *slab, struct thread_cache *cache)
+{
+    struct magazine *mag, *old;
+
+    old = cache->mags[slab->id];
+    pthread_mutex_lock(&slab->lock);
+    count_live(slab, cache->allocs[slab->id]);
+    cache->allocs[slab->id] = 0;
+    if (old != NULL && !depot_put(slab, old))
+        mag = old;
+    else
+        mag = empty_magazine(slab);
+    pthread_mutex_unlock(&slab->lock);
+
+    if (mag == old)
+        magazine_drain(mag);
+
+    cache->mags[slab->id] = mag;
+    return mag;
+}
+
+#endif
+
+
+gw_slab_t *gw_slab_get(gw_slab_t **slab, const char *name, size_t size)
+{
+    gw_slab_t *s;
+
+    if ((s = slab_load(slab)) != NULL)
+        return s;
+
+    pthread_mutex_lock(&slabs_lock);
+    if ((s = *slab) == NULL) {
+        if (num_slabs == SLAB_MAX)
+            panic(0, "Too many slabs, cannot create one for %s.", name);
+#ifdef USE_GWMEM_NATIVE
+        pthread_once(&cache_key_once, cache_key_create);
+#endif
+        s = &slabs[num_slabs];
+        s->name = name;
+        s->size = (size + SLAB_ALIGN - 1) & ~((size_t) SLAB_ALIGN - 1);
+        s->id = num_slabs;
+        pthread_mutex_init(&s->lock, NULL);
+        s->full = s->empty = NULL;
+        s->num_full = 0;
+        s->live = s->high = s->total = 0;
+        num_slabs++;
+        slab_store(slab, s);
+    }
+    pthread_mutex_unlock(&slabs_lock);
+    return s;
+}
+
+
+void *gw_slab_alloc_real(gw_slab_t *slab, const char *file, long line,
+                         const char *func)
+{
+#ifdef USE_GWMEM_NATIVE
+    struct thread_cache *cache;
+    struct magazine *mag;
+
+    cache = thread_cache();
+    if ((mag = cache->mags[slab->id]) == NULL || mag->count == 0)
+        mag = refill(slab, cache);
+    cache->allocs[slab->id]++;
+    return mag->objs[--mag->count];
+#else
+    pthread_mutex_lock(&slab->lock);
+    count_live(slab, 1);
+    slab->total++;
+    pthread_mutex_unlock(&slab->lock);
+    return gw_malloc_trace(slab->size, file, line, func);
+#endif
+}
+
+
+void gw_slab_free(gw_slab_t *slab, void *ptr)
+{
+#ifdef USE_GWMEM_NATIVE
+    struct thread_cache *cache;
+    struct magazine *mag;
+
+    if (ptr == NULL)
+        return;
+
+    cache = thread_cache();
+    if ((mag = cache->mags[slab->id]) == NULL || mag->count == MAGAZINE_SIZE)
+        mag = flush(slab, cache);
+    mag->objs[mag->count++] = ptr;
+    cache->allocs[slab->id]--;
+#else
+    if (ptr == NULL)
+        return;
+
+    pthread_mutex_lock(&slab->lock);
+    count_live(slab, -1);
+    pthread_mutex_unlock(&slab->lock);
+    gw_free(ptr);
+#endif
+}
+
+
+long gw_slab_stats(struct gw_slab_stats *stats, long max)
+{
+    gw_slab_t *slab;
+    long i, n;
+
+    pthread_mutex_lock(&slabs_lock);
+    n = (num_slabs < max) ? num_slabs : max;
+    pthread_mutex_unlock(&slabs_lock);
+
+    for (i = 0; i < n; ++i) {
+        slab = &slabs[i];
+        pthread_mutex_lock(&slab->lock);
+        stats[i].name = slab->name;
+        stats[i].size = slab->size;
+        stats[i].live = slab->live;
+        stats[i].high = slab->high;
+        stats[i].total = slab->total;
+        pthread_mutex_unlock(&slab->lock);
+    }
+    return n;
+}
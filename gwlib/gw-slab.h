@@ -0,0 +1,130 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-slab.h - caches of fixed-size objects.
+ *
+ * A slab hands out objects of one size, such as struct Octstr or Msg,
+ * which a process allocates and frees at a high rate. Every thread keeps
+ * a magazine of free objects per slab and allocates and frees without
+ * locking until its magazine runs empty or full. Then it exchanges the
+ * magazine with the depot of the slab, which carves new objects from
+ * larger chunks as needed.
+ *
+ * Each object is an allocation of its own. A depot keeps a few full
+ * magazines, the objects of any more are given back to gw_free, so
+ * that a burst of objects does not stay cached for the life of the
+ * process. Slabs are only used with the native allocator;
+ * with the checking allocators each object comes from gw_malloc, so
+ * that leaks and overruns are still reported per object.
+ */
+
+#ifndef GW_SLAB_H
+#define GW_SLAB_H
+
+#include <stddef.h>
+
+typedef struct gw_slab gw_slab_t;
+
+/* allocation statistics of one slab */
+struct gw_slab_stats {
+    const char *name;
+    size_t size;        /* object size */
+    long live;          /* objects allocated and not freed */
+    long high;          /* most objects live at once */
+    long total;         /* objects allocated from the heap */
+};
+
+/**
+ * Return the slab stored in '*slab', creating it on first use. Slabs
+ * exist until the process exits.
+ * @slab - where the slab of the caller is kept, initially NULL
+ * @name - name of the object type, for the statistics
+ * @size - object size
+ * @return the slab
+ */
+gw_slab_t *gw_slab_get(gw_slab_t **slab, const char *name, size_t size);
+
+/**
+ * Allocate an object from a slab.
+ * @slab - the slab
+ * @return the object, never NULL
+ */
+#define gw_slab_alloc(slab) \
+    (gw_slab_alloc_real(slab, __FILE__, __LINE__, __func__))
+#define gw_slab_alloc_trace(slab, file, line, func) \
+    (gw_slab_alloc_real(slab, file, line, func))
+void *gw_slab_alloc_real(gw_slab_t *slab, const char *file, long line,
+                         const char *func);
+
+/**
+ * Free an object, from any thread.
+ * @slab - slab the object was allocated from
+ * @ptr - object to free, may be NULL
+ */
+void gw_slab_free(gw_slab_t *slab, void *ptr);
+
+/**
+ * Fill in the statistics of all slabs. Allocations and frees are only
+ * counted when threads exchange magazines, so 'live' and 'high' may be
+ * off by a magazine per thread.
+ * @stats - array to fill
+ * @max - size of the array
+ * @return number of slabs filled in
+ */
+long gw_slab_stats(struct gw_slab_stats *stats, long max);
+
+#endif
@@ -61,30 +61,11 @@
  */
 
 #include <signal.h>
+#include <limits.h>
 
 #include "gwlib/gwlib.h"
 #include "gw-timer.h"
-
-/*
- * Active timers are stored in a TimerHeap.  It is a partially ordered
- * array.  Each element i is the child of element i/2 (rounded down),
- * and a child never elapses before its parent.  The result is that
- * element 0, the top of the heap, is always the first timer to
- * elapse.  The heap is kept in this partial order by all operations on
- * it.  Maintaining a partial order is much cheaper than maintaining
- * a sorted list.
- * The array will be resized as needed.  The size field is the number
- * of elements for which space is reserved, and the len field is the
- * number of elements actually used.  The elements used will always be
- * at tab[0] through tab[len-1].
- */
-struct TimerHeap
-{
-    Timer **tab;
-    long len;
-    long size;
-};
-typedef struct TimerHeap TimerHeap;
+#include "gw-wheel.h"
 
 struct Timerset
 {
@@ -96,19 +77,25 @@ struct Timerset
      * The entire set is locked for any operation on it.  This is
      * not as expensive as it sounds because usually each set is
      * used by one caller thread and one (internal) timer thread,
-     * and the timer thread does not wake up very often.
+     * the timer thread does not wake up very often, and starting
+     * or stopping a timer takes constant time.  Callers with many
+     * threads can spread their timers over several sets.
      */
     Mutex *mutex;
     /*
-     * Active timers are stored here in a partially ordered structure.
-     * See the definition of TimerHeap, above, for an explanation.
+     * Active timers are stored here.  See gw-wheel.h.
      */
-    TimerHeap *heap;
+    gw_wheel_t *wheel;
     /*
-     * The thread that watches the top of the heap, and processes
+     * The thread that advances the wheel, and processes
      * timers that have elapsed.
      */
     long thread;
+    /*
+     * The time the thread will wake up at.  Starting a timer that
+     * elapses earlier wakes it up.
+     */
+    long wakeup_at;
 };
 
 struct Timer
@@ -131,11 +118,11 @@ struct Timer
      */
     void (*callback) (void* data);
     /*
-     * The timer is set to elapse at this time, expressed in
-     * Unix time format.  This field is set to -1 if the timer
-     * is not active (i.e. in the timer set's heap).
+     * The entry in the timer set's wheel.  It is set to elapse at
+     * entry.elapses, in gw_clock_mono seconds.  This field is
+     * set to -1 if the timer is not active (i.e. in the wheel).
      */
-    long elapses;
+    struct gw_wheel_entry entry;
     /*
      * A duplicate of this event will be put on the output list
      * when the timer elapses.  It can be NULL if the timer has
@@ -149,12 +136,6 @@ struct Timer
      * the list, or if it's confirmed that the event was consumed.
      */
     void *elapsed_data;
-    /*
-     * The index in the timer set's heap.  This field is managed by
-     * the heap operations, and is used to make them faster.
-     * If this timer is not in the heap, this field is -1.
-     */
-    long index;
 };
 
 
@@ -162,12 +143,8 @@ struct Timer
  * Internal functions
  */
 static void abort_elapsed(Timer *timer);
-static TimerHeap *heap_create(void);
-static void heap_destroy(TimerHeap *heap);
-static void heap_delete(TimerHeap *heap, long index);
-static int heap_adjust(TimerHeap *heap, long index);
-static void heap_insert(TimerHeap *heap, Timer *timer);
-static void heap_swap(TimerHeap *heap, long index1, long index2);
+static int activate(Timer *timer, long elapses);
+static void deactivate(Timer *timer);
 static void lock(Timerset *set);
 static void unlock(Timerset *set);
 static void watch_timers(void *arg);   /* The timer thread */
@@ -180,7 +157,8 @@ Timerset *gw_timerset_create(void)
 
 	set = gw_malloc(sizeof(Timerset));
     set->mutex = mutex_create();
-    set->heap = heap_create();
+    set->wheel = gw_wheel_create(gw_clock_mono());
+    set->wakeup_at = LONG_MAX;
     set->stopping = 0;
     set->thread = gwthread_create(watch_timers, set);
 
@@ -189,12 +167,14 @@ Timerset *gw_timerset_create(void)
 
 void gw_timerset_destroy(Timerset *set)
 {
+    struct gw_wheel_entry *entry;
+
 	if (set == NULL)
 		return;
        
     /* Stop all timers. */
-    while (set->heap->len > 0)
-        gw_timer_stop(set->heap->tab[0]);
+    while ((entry = gw_wheel_any(set->wheel)) != NULL)
+        gw_timer_stop(entry->owner);
 
     /* Kill timer thread */
     set->stopping = 1;
@@ -202,7 +182,7 @@ void gw_timerset_destroy(Timerset *set)
     gwthread_join(set->thread);
 
     /* Free resources */
-    heap_destroy(set->heap);
+    gw_wheel_destroy(set->wheel);
     mutex_destroy(set->mutex);
     gw_free(set);
 }
@@ -214,10 +194,11 @@ Timer *gw_timer_create(Timerset *set, List *outputlist, void (*callback) (void*)
 
     t = gw_malloc(sizeof(*t));
     t->timerset = set;
-    t->elapses = -1;
+    t->entry.next = t->entry.prev = NULL;
+    t->entry.elapses = -1;
+    t->entry.owner = t;
     t->data = NULL;
     t->elapsed_data = NULL;
-    t->index = -1;
     t->output = outputlist;
     if (t->output != NULL)
         gwlist_add_producer(outputlist);
@@ -259,31 +240,20 @@ void gw_timer_start(Timer *timer, int interval, void *data)
         
     lock(timer->timerset);
 
-    /* Convert to absolute time */
-    interval += time(NULL);
-
-    if (timer->elapses > 0) {
-        /* Resetting an existing timer.  Move it to its new
-         * position in the heap. */
-        if (interval < timer->elapses && timer->index == 0)
-            wakeup = 1;
-        timer->elapses = interval;
-        gw_assert(timer->index >= 0);
-        gw_assert(timer->timerset->heap->tab[timer->index] == timer);
-        wakeup |= heap_adjust(timer->timerset->heap, timer->index);
+    if (timer->entry.elapses >= 0) {
+        /* Resetting an existing timer.  Take it out of the wheel
+         * to put it in at its new time. */
+        deactivate(timer);
     } else {
         /* Setting a new timer, or resetting an elapsed one.
          * First deal with a possible elapse event that may
          * still be on the output list. */
         abort_elapsed(timer);
-
-        /* Then activate the timer. */
-        timer->elapses = interval;
-        gw_assert(timer->index < 0);
-        heap_insert(timer->timerset->heap, timer);
-        wakeup = timer->index == 0;  /* Do we have a new top? */
     }
 
+    /* Then activate the timer, at absolute time. */
+    wakeup = activate(timer, interval + gw_clock_mono());
+
     if (data != NULL) {
         timer->data = data;
     }
@@ -305,32 +275,21 @@ void gw_timer_elapsed_start(Timer *timer, int interval, void *data)
 
     lock(timer->timerset);
 
-    /* Convert to absolute time */
-    interval += time(NULL);
-
-    if (timer->elapses > 0) {
-        /* Resetting an existing timer.  Move it to its new
-         * position in the heap. */
-        if (interval < timer->elapses && timer->index == 0)
-            wakeup = 1;
-        timer->elapses = interval;
-        gw_assert(timer->index >= 0);
-        gw_assert(timer->timerset->heap->tab[timer->index] == timer);
-        wakeup |= heap_adjust(timer->timerset->heap, timer->index);
+    if (timer->entry.elapses >= 0) {
+        /* Resetting an existing timer.  Take it out of the wheel
+         * to put it in at its new time. */
+        deactivate(timer);
     } else {
         /* Setting a new timer, or resetting an elapsed one.
          * There should be no further elapse event on the
          * output list here. */
         /* abort_elapsed(timer); */
     	timer->elapsed_data = NULL;
-
-        /* Then activate the timer. */
-        timer->elapses = interval;
-        gw_assert(timer->index < 0);
-        heap_insert(timer->timerset->heap, timer);
-        wakeup = timer->index == 0;  /* Do we have a new top? */
     }
 
+    /* Then activate the timer, at absolute time. */
+    wakeup = activate(timer, interval + gw_clock_mono());
+
     if (data != NULL) {
         timer->data = data;
     }
@@ -348,13 +307,10 @@ void gw_timer_stop(Timer *timer)
 
     /*
      * If the timer is active, make it inactive and remove it from
-     * the heap.
+     * the wheel.
      */
-    if (timer->elapses > 0) {
-        timer->elapses = -1;
-        gw_assert(timer->timerset->heap->tab[timer->index] == timer);
-        heap_delete(timer->timerset->heap, timer->index);
-    }
+    if (timer->entry.elapses >= 0)
+        deactivate(timer);
 
     abort_elapsed(timer);
 
@@ -368,13 +324,10 @@ void gw_timer_elapsed_stop(Timer *timer)
 
     /*
      * If the timer is active, make it inactive and remove it from
-     * the heap.
+     * the wheel.
      */
-    if (timer->elapses > 0) {
-        timer->elapses = -1;
-        gw_assert(timer->timerset->heap->tab[timer->index] == timer);
-        heap_delete(timer->timerset->heap, timer->index);
-    }
+    if (timer->entry.elapses >= 0)
+        deactivate(timer);
 
     /* abort_elapsed(timer); */
 	timer->elapsed_data = NULL;
@@ -385,10 +338,11 @@ void gw_timer_elapsed_stop(Timer *timer)
 List *gw_timer_break(Timerset *set)
 {
 	List *ret = NULL;
+	struct gw_wheel_entry *entry;
 
     lock(set);
 
-    if (set->heap->len == 0) {
+    if (gw_wheel_len(set->wheel) == 0) {
         unlock(set);
     	return NULL;
     }
@@ -396,20 +350,14 @@ List *gw_timer_break(Timerset *set)
     ret = gwlist_create();
 
     /* Stop all timers. */
-    while (set->heap->len > 0) {
-    	Timer *timer = set->heap->tab[0];
+    while ((entry = gw_wheel_any(set->wheel)) != NULL) {
+    	Timer *timer = entry->owner;
 
     	gwlist_append(ret, timer);
 
-        /*
-         * If the timer is active, make it inactive and remove it from
-         * the heap.
-         */
-        if (timer->elapses > 0) {
-            timer->elapses = -1;
-            gw_assert(set->heap->tab[timer->index] == timer);
-            heap_delete(set->heap, timer->index);
-        }
+        /* The timer is active, make it inactive and remove it from
+         * the wheel. */
+        deactivate(timer);
 
         abort_elapsed(timer);
     }
@@ -455,160 +403,30 @@ static void abort_elapsed(Timer *timer)
 }
 
 /*
- * Create a new timer heap.
+ * Put an inactive timer into the wheel of its set.  Return 1 if the
+ * timer thread has to wake up earlier for it, otherwise 0.
  */
-static TimerHeap *heap_create(void)
+static int activate(Timer *timer, long elapses)
 {
-    TimerHeap *heap;
-
-    heap = gw_malloc(sizeof(*heap));
-    heap->tab = gw_malloc(sizeof(heap->tab[0]));
-    heap->size = 1;
-    heap->len = 0;
-
-    return heap;
-}
-
-static void heap_destroy(TimerHeap *heap)
-{
-    if (heap == NULL)
-        return;
-
-    gw_free(heap->tab);
-    gw_free(heap);
+    Timerset *set = timer->timerset;
+
+    gw_assert(timer->entry.next == NULL);
+    timer->entry.elapses = elapses;
+    gw_wheel_insert(set->wheel, &timer->entry);
+    if (elapses >= set->wakeup_at)
+        return 0;
+    set->wakeup_at = elapses;
+    return 1;
 }
 
 /*
- * Remove a timer from the heap.  Do this by swapping it with the element
- * in the last position, then shortening the heap, then moving the
- * swapped element up or down to maintain the partial ordering.
+ * Take an active timer out of the wheel of its set.
  */
-static void heap_delete(TimerHeap *heap, long index)
+static void deactivate(Timer *timer)
 {
-    long last;
-
-    gw_assert(index >= 0);
-    gw_assert(index < heap->len);
-    gw_assert(heap->tab[index]->index == index);
-
-    last = heap->len - 1;
-    heap_swap(heap, index, last);
-    heap->tab[last]->index = -1;
-    heap->len--;
-    if (index != last)
-        heap_adjust(heap, index);
-}
-
-/*
- * Add a timer to the heap.  Do this by adding it at the end, then
- * moving it up or down as necessary to achieve partial ordering.
- */
-static void heap_insert(TimerHeap *heap, Timer *timer)
-{
-    heap->len++;
-    if (heap->len > heap->size) {
-        heap->tab = gw_realloc(heap->tab,
-                                heap->len * sizeof(heap->tab[0]));
-        heap->size = heap->len;
-    }
-    heap->tab[heap->len - 1] = timer;
-    timer->index = heap->len - 1;
-    heap_adjust(heap, timer->index);
-}
-
-/*
- * Swap two elements of the heap, and update their index fields.
- * This is the basic heap operation.
- */
-static void heap_swap(TimerHeap *heap, long index1, long index2)
-{
-    Timer *t;
-
-    gw_assert(index1 >= 0);
-    gw_assert(index1 < heap->len);
-    gw_assert(index2 >= 0);
-    gw_assert(index2 < heap->len);
-
-    if (index1 == index2)
-        return;
-
-    t = heap->tab[index1];
-    heap->tab[index1] = heap->tab[index2];
-    heap->tab[index2] = t;
-    heap->tab[index1]->index = index1;
-    heap->tab[index2]->index = index2;
-}
-
-/*
- * The current element has broken the partial ordering of the
- * heap (see explanation in the definition of Timerset), and
- * it has to be moved up or down until the ordering is restored.
- * Return 1 if the timer at the heap's top is now earlier than
- * before this operation, otherwise 0.
- */
-static int heap_adjust(TimerHeap *heap, long index)
-{
-    Timer *t;
-    Timer *parent;
-    long child_index;
-
-    /*
-     * We can assume that the heap was fine before this element's
-     * elapse time was changed.  There are three cases to deal
-     * with:
-     *  - Element's new elapse time is too small; it should be
-     *    moved toward the top.
-     *  - Element's new elapse time is too large; it should be
-     *    moved toward the bottom.
-     *  - Element's new elapse time still fits here, we don't
-     *    have to do anything.
-     */
-
-    gw_assert(index >= 0);
-    gw_assert(index < heap->len);
-
-    /* Move to top? */
-    t = heap->tab[index];
-    parent = heap->tab[index / 2];
-    if (t->elapses < parent->elapses) {
-        /* This will automatically terminate when it reaches
-         * the top, because in that t == parent. */
-        do {
-            heap_swap(heap, index, index / 2);
-            index = index / 2;
-            parent = heap->tab[index / 2];
-        } while (t->elapses < parent->elapses);
-        /* We're done.  Return 1 if we changed the top. */
-        return index == 0;
-    }
-
-    /* Move to bottom? */
-    for (; ; ) {
-        child_index = index * 2;
-        if (child_index >= heap->len)
-            return 0;   /* Already at bottom */
-        if (child_index == heap->len - 1) {
-            /* Only one child */
-            if (heap->tab[child_index]->elapses < t->elapses)
-                heap_swap(heap, index, child_index);
-            break;
-        }
-
-        /* Find out which child elapses first */
-        if (heap->tab[child_index + 1]->elapses <
-            heap->tab[child_index]->elapses) {
-            child_index++;
-        }
-
-        if (heap->tab[child_index]->elapses < t->elapses) {
-            heap_swap(heap, index, child_index);
-            index = child_index;
-        } else {
-            break;
-        }
-    }
-
-    return 0;
+    gw_assert(timer->entry.next != NULL);
+    gw_wheel_remove(timer->timerset->wheel, &timer->entry);
+    timer->entry.elapses = -1;
 }
 
 /*
@@ -623,7 +441,7 @@ static void elapse_timer(Timer *timer)
     gw_assert(timer->elapsed_data == NULL);
 
     timer->elapsed_data = timer->data;
-    timer->elapses = -1;
+    timer->entry.elapses = -1;
     if (timer->output != NULL)
         gwlist_produce(timer->output, timer->elapsed_data);
     if (timer->callback != NULL)
@@ -636,7 +454,8 @@ static void elapse_timer(Timer *timer)
 static void watch_timers(void *arg)
 {
     Timerset *set;
-    long top_time;
+    struct gw_wheel_entry *entry;
+    long next;
     long now;
 
     set = arg;
@@ -644,27 +463,20 @@ static void watch_timers(void *arg)
     while (!set->stopping) {
         lock(set);
 
-        now = time(NULL);
+        now = gw_clock_mono();
 
-        while (set->heap->len > 0 && set->heap->tab[0]->elapses <= now) {
-        	Timer *timer = set->heap->tab[0];
-        	heap_delete(set->heap, 0);
-        	elapse_timer(timer);
-        }
+        while ((entry = gw_wheel_expire(set->wheel, now)) != NULL)
+        	elapse_timer(entry->owner);
 
     	/*
-    	 * Now sleep until the next timer elapses.  If there isn't one,
-    	 * then just sleep very long.  We will get woken up if the
-    	 * top of the heap changes before we wake.
+    	 * Now sleep until the wheel has to advance.  If it is empty,
+    	 * then just sleep very long.  We will get woken up if a timer
+    	 * is started that elapses before we wake.
     	 */
 
-    	if (set->heap->len == 0) {
-    		unlock(set);
-    		gwthread_sleep(1000000.0);
-    	} else {
-    		top_time = set->heap->tab[0]->elapses;
-    		unlock(set);
-    		gwthread_sleep(top_time - now);
-    	}
+    	next = gw_wheel_next(set->wheel);
+    	set->wakeup_at = (next == -1) ? LONG_MAX : next;
+    	unlock(set);
+    	gwthread_sleep(next == -1 ? 1000000.0 : next - now);
     }
 }
@@ -0,0 +1,315 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-wheel.c - hierarchical timing wheel.
+ *
+ * See gw-wheel.h for a description of the interface. The layout follows
+ * Varghese and Lauck, "Hashed and Hierarchical Timing Wheels" (SOSP
+ * 1987), with absolute slot numbers as in the Linux kernel timers.
+ */
+
+#include "gw-config.h"
+
+#include "gwlib.h"
+#include "gw-wheel.h"
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+
+/* first second of the period of 'level' that 't' is in */
+#define PERIOD_START(t, level) ((t) & ~((1L << (WHEEL_BITS * (level))) - 1))
+
+struct gw_wheel {
+    /* all seconds up to this one have been processed */
+    long now;
+    /* number of entries in total, and on the levels and far */
+    long len;
+    long pending;
+    /* entries that have expired, in order */
+    struct gw_wheel_entry due;
+    /* entries too far in the future for the highest level */
+    struct gw_wheel_entry far;
+    /*
+     * Entries that expire in the current period of a level, but not
+     * in the current period of the level below.
+     */
+    struct gw_wheel_entry slots[WHEEL_LEVELS][WHEEL_SLOTS];
+};
+
+
+/* The lists are circular, with the head as sentinel. */
+static void list_init(struct gw_wheel_entry *head)
+{
+    head->next = head->prev = head;
+}
+
+
+static int list_empty(struct gw_wheel_entry *head)
+{
+    return head->next == head;
+}
+
+
+static void list_append(struct gw_wheel_entry *head, struct gw_wheel_entry *entry)
+{
+    entry->prev = head->prev;
+    entry->next = head;
+    head->prev->next = entry;
+    head->prev = entry;
+}
+
+
+static void list_unlink(struct gw_wheel_entry *entry)
+{
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->next = entry->prev = NULL;
+}
+
+
+/* Move all entries of 'from' to the empty 'to'. */
+static void list_move(struct gw_wheel_entry *from, struct gw_wheel_entry *to)
+{
+    if (list_empty(from)) {
+        list_init(to);
+        return;
+    }
+    to->next = from->next;
+    to->prev = from->prev;
+    to->next->prev = to;
+    to->prev->next = to;
+    list_init(from);
+}
+
+
+/*
+ * Put an entry on the lowest level whose current period it expires in,
+ * or on the due list if it has expired.
+ */
+static void place(gw_wheel_t *wheel, struct gw_wheel_entry *entry)
+{
+    long e;
+    int level;
+
+    e = entry->elapses;
+    if (e <= wheel->now) {
+        list_append(&wheel->due, entry);
+        return;
+    }
+    wheel->pending++;
+    for (level = 0; level < WHEEL_LEVELS; ++level) {
+        if ((e >> (WHEEL_BITS * (level + 1))) ==
+                (wheel->now >> (WHEEL_BITS * (level + 1)))) {
+            list_append(&wheel->slots[level][(e >> (WHEEL_BITS * level)) & WHEEL_MASK],
+                        entry);
+            return;
+        }
+    }
+    list_append(&wheel->far, entry);
+}
+
+
+/* Place the entries of a list again, after the wheel has advanced. */
+static void replace(gw_wheel_t *wheel, struct gw_wheel_entry *head)
+{
+    struct gw_wheel_entry list, *entry;
+
+    list_move(head, &list);
+    while (!list_empty(&list)) {
+        entry = list.next;
+        list_unlink(entry);
+        wheel->pending--;
+        place(wheel, entry);
+    }
+}
+
+
+/*
+ * Return the next second after wheel->now at which the wheel has work:
+ * a level 0 slot with entries, or the start of the next period.
+ */
+static long next_tick(gw_wheel_t *wheel)
+{
+    long t, end;
+
+    end = PERIOD_START(wheel->now, 1) + WHEEL_SLOTS;
+    for (t = wheel->now + 1; t < end; ++t)
+        if (!list_empty(&wheel->slots[0][t & WHEEL_MASK]))
+            return t;
+    return end;
+}
+
+
+/* Process second 't': move entries down the levels, expire level 0. */
+static void tick(gw_wheel_t *wheel, long t)
+{
+    int level;
+
+    wheel->now = t;
+    if (PERIOD_START(t, WHEEL_LEVELS) == t)
+        replace(wheel, &wheel->far);
+    for (level = WHEEL_LEVELS - 1; level > 0; --level) {
+        if (PERIOD_START(t, level) == t)
+            replace(wheel, &wheel->slots[level][(t >> (WHEEL_BITS * level)) & WHEEL_MASK]);
+    }
+    replace(wheel, &wheel->slots[0][t & WHEEL_MASK]);
+}
+
+
+static void advance(gw_wheel_t *wheel, long now)
+{
+    long t;
+
+    while (wheel->now < now) {
+        if (wheel->pending == 0 || (t = next_tick(wheel)) > now) {
+            wheel->now = now;
+            break;
+        }
+        tick(wheel, t);
+    }
+}
+
+
+gw_wheel_t *gw_wheel_create(long now)
+{
+    gw_wheel_t *wheel;
+    int level, slot;
+
+    wheel = gw_malloc(sizeof(*wheel));
+    wheel->now = now;
+    wheel->len = 0;
+    wheel->pending = 0;
+    list_init(&wheel->due);
+    list_init(&wheel->far);
+    for (level = 0; level < WHEEL_LEVELS; ++level)
+        for (slot = 0; slot < WHEEL_SLOTS; ++slot)
+            list_init(&wheel->slots[level][slot]);
+    return wheel;
+}
+
+
+void gw_wheel_destroy(gw_wheel_t *wheel)
+{
+    gw_free(wheel);
+}
+
+
+void gw_wheel_insert(gw_wheel_t *wheel, struct gw_wheel_entry *entry)
+{
+    gw_assert(entry->next == NULL);
+    wheel->len++;
+    place(wheel, entry);
+}
+
+
+void gw_wheel_remove(gw_wheel_t *wheel, struct gw_wheel_entry *entry)
+{
+    gw_assert(entry->next != NULL);
+    /* entries that are not due yet expire after wheel->now */
+    if (entry->elapses > wheel->now)
+        wheel->pending--;
+    wheel->len--;
+    list_unlink(entry);
+}
+
+
+struct gw_wheel_entry *gw_wheel_expire(gw_wheel_t *wheel, long now)
+{
+    struct gw_wheel_entry *entry;
+
+    advance(wheel, now);
+    if (list_empty(&wheel->due))
+        return NULL;
+    entry = wheel->due.next;
+    list_unlink(entry);
+    wheel->len--;
+    return entry;
+}
+
+
+long gw_wheel_next(gw_wheel_t *wheel)
+{
+    if (!list_empty(&wheel->due))
+        return wheel->now;
+    if (wheel->pending == 0)
+        return -1;
+    return next_tick(wheel);
+}
+
+
+struct gw_wheel_entry *gw_wheel_any(gw_wheel_t *wheel)
+{
+    int level, slot;
+
+    if (wheel->len == 0)
+        return NULL;
+    if (!list_empty(&wheel->due))
+        return wheel->due.next;
+    for (level = 0; level < WHEEL_LEVELS; ++level)
+        for (slot = 0; slot < WHEEL_SLOTS; ++slot)
+            if (!list_empty(&wheel->slots[level][slot]))
+                return wheel->slots[level][slot].next;
+    return wheel->far.next;
+}
+
+
+long gw_wheel_len(gw_wheel_t *wheel)
+{
+    return wheel->len;
+}
@@ -0,0 +1,142 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gw-wheel.h - hierarchical timing wheel.
+ *
+ * A wheel keeps entries that expire at a given second. Inserting and
+ * removing an entry takes constant time, whatever the number of
+ * entries. Level 0 of the wheel has a slot for every second of the
+ * current 64 second period, and each higher level has a slot for a 64
+ * times longer period. When the wheel reaches a new period, the entries
+ * of the matching higher level slot move down a level, and they reach
+ * level 0 in their last period.
+ *
+ * The wheel does not lock, its users keep it under their own lock.
+ * gw-timer and the WAP timers are built on it.
+ */
+
+#ifndef GW_WHEEL_H
+#define GW_WHEEL_H
+
+typedef struct gw_wheel gw_wheel_t;
+
+/* a wheel entry, embedded in the object that owns it */
+struct gw_wheel_entry {
+    struct gw_wheel_entry *next;
+    struct gw_wheel_entry *prev;
+    long elapses;       /* expiry time, in seconds */
+    void *owner;        /* the object this entry is embedded in */
+};
+
+/**
+ * Create an empty wheel.
+ * @now - current time
+ * @return the wheel
+ */
+gw_wheel_t *gw_wheel_create(long now);
+
+/**
+ * Destroy a wheel. The entries still in it are left alone.
+ * @wheel - the wheel, may be NULL
+ */
+void gw_wheel_destroy(gw_wheel_t *wheel);
+
+/**
+ * Add an entry, which expires at entry->elapses. An entry that should
+ * have expired already expires on the next gw_wheel_expire.
+ * @wheel - the wheel
+ * @entry - entry not in any wheel
+ */
+void gw_wheel_insert(gw_wheel_t *wheel, struct gw_wheel_entry *entry);
+
+/**
+ * Remove an entry before it expires.
+ * @wheel - the wheel
+ * @entry - entry in the wheel
+ */
+void gw_wheel_remove(gw_wheel_t *wheel, struct gw_wheel_entry *entry);
+
+/**
+ * Advance the wheel to 'now' and remove one of the entries that expired.
+ * @wheel - the wheel
+ * @now - current time
+ * @return an expired entry, or NULL if there is none
+ */
+struct gw_wheel_entry *gw_wheel_expire(gw_wheel_t *wheel, long now);
+
+/**
+ * Return the time gw_wheel_expire should be called next. Entries on
+ * higher levels need the wheel to advance before they expire, so this
+ * may be earlier than the first expiry.
+ * @wheel - the wheel
+ * @return the time, or -1 if the wheel is empty
+ */
+long gw_wheel_next(gw_wheel_t *wheel);
+
+/**
+ * Return any entry of the wheel, for stopping them all.
+ * @wheel - the wheel
+ * @return an entry, or NULL if the wheel is empty
+ */
+struct gw_wheel_entry *gw_wheel_any(gw_wheel_t *wheel);
+
+/**
+ * @return number of entries in the wheel
+ */
+long gw_wheel_len(gw_wheel_t *wheel);
+
+#endif
@@ -61,6 +61,7 @@
  */
 
 #include "gwlib.h"
+#include "regex.h"
 
 
 /*
@@ -79,6 +80,7 @@ void gwlib_init(void)
 {
     gw_assert(!init);
     gw_init_mem();
+    gw_arena_init();
     uuid_init();
     octstr_init();
     gwlib_protected_init();
@@ -87,14 +89,18 @@ void gwlib_init(void)
     http_init();
     socket_init();
     charset_init();
+    gw_regex_init();
     cfg_init();
+    gw_shaper_init();
     init = 1;
 }
 
 void gwlib_shutdown(void) 
 {
     gwlib_assert_init();
+    gw_shaper_shutdown();
     charset_shutdown();
+    gw_regex_shutdown();
     http_shutdown();
     socket_shutdown();
     gwthread_shutdown();
@@ -102,6 +108,7 @@ void gwlib_shutdown(void)
     gwlib_protected_shutdown();
     uuid_shutdown();
     cfg_shutdown();
+    gw_arena_shutdown();
     gw_check_leaks();
     log_shutdown();
     gwmem_shutdown();
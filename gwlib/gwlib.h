@@ -81,9 +81,12 @@
 #include "thread.h"
 #include "gwthread.h"
 #include "gwmem.h"
+#include "gw-arena.h"
+#include "gw-slab.h"
 #include "socket.h"
 #include "cfg.h"
 #include "date.h"
+#include "gw-clock.h"
 #include "http.h"
 #include "octstr.h"
 #include "list.h"
@@ -103,6 +106,8 @@
 #include "gw_uuid.h"
 #include "gw-rwlock.h"
 #include "gw-prioqueue.h"
+#include "gw-queue.h"
+#include "gw-shaper.h"
 
 void gwlib_assert_init(void);
 void gwlib_init(void);
@@ -165,20 +165,17 @@ static int read_some_headers(Connection *conn, List *headers)
  * Check that the HTTP version string is valid. Return -1 for invalid,
  * 0 for version 1.0, 1 for 1.x.
  */
-static int parse_http_version(Octstr *version)
+static int parse_http_version_data(const char *version, long len)
 {
-    Octstr *prefix;
-    long prefix_len;
+    static const char prefix[] = "HTTP/1.";
+    long prefix_len = sizeof(prefix) - 1;
     int digit;
-    
-    prefix = octstr_imm("HTTP/1.");
-    prefix_len = octstr_len(prefix);
 
-    if (octstr_ncompare(version, prefix, prefix_len) != 0)
+    if (len != prefix_len + 1)
     	return -1;
-    if (octstr_len(version) != prefix_len + 1)
+    if (memcmp(version, prefix, prefix_len) != 0)
     	return -1;
-    digit = octstr_get_char(version, prefix_len);
+    digit = (unsigned char) version[prefix_len];
     if (!isdigit(digit))
     	return -1;
     if (digit == '0')
@@ -187,6 +184,12 @@ static int parse_http_version(Octstr *version)
 }
 
 
+static int parse_http_version(Octstr *version)
+{
+    return parse_http_version_data(octstr_get_cstr(version), octstr_len(version));
+}
+
+
 /***********************************************************************
  * Proxy support.
  */
@@ -370,12 +373,13 @@ typedef struct {
 
 /*
  * The rules for message bodies (length and presence) are defined
- * in RFC2616 paragraph 4.3 and 4.4.
+ * in RFC2616 paragraph 4.3 and 4.4. The values of the Transfer-Encoding
+ * and Content-Length headers are passed in, content_length is only
+ * consulted if there is no transfer_encoding.
  */
-static void deduce_body_state(HTTPEntity *ent)
+static void entity_set_body_state(HTTPEntity *ent, Octstr *transfer_encoding,
+                                  Octstr *content_length)
 {
-    Octstr *h = NULL;
-
     if (ent->expect_state == expect_no_body) {
         ent->state = entity_done;
         return;
@@ -383,33 +387,29 @@ static void deduce_body_state(HTTPEntity *ent)
 
     ent->state = body_error;  /* safety net */
 
-    h = http_header_find_first(ent->headers, "Transfer-Encoding");
-    if (h != NULL) {
-        octstr_strip_blanks(h);
-        if (octstr_str_compare(h, "chunked") != 0) {
+    if (transfer_encoding != NULL) {
+        octstr_strip_blanks(transfer_encoding);
+        if (octstr_str_compare(transfer_encoding, "chunked") != 0) {
             error(0, "HTTP: Unknown Transfer-Encoding <%s>",
-                  octstr_get_cstr(h));
+                  octstr_get_cstr(transfer_encoding));
             ent->state = body_error;
         } else {
             ent->state = reading_chunked_body_len;
         }
-        octstr_destroy(h);
         return;
     }
 
-    h = http_header_find_first(ent->headers, "Content-Length");
-    if (h != NULL) {
-        if (octstr_parse_long(&ent->expected_body_len, h, 0, 10) == -1 ||
+    if (content_length != NULL) {
+        if (octstr_parse_long(&ent->expected_body_len, content_length, 0, 10) == -1 ||
             ent->expected_body_len < 0) {
             error(0, "HTTP: Content-Length header wrong: <%s>",
-                  octstr_get_cstr(h));
+                  octstr_get_cstr(content_length));
             ent->state = body_error;
         } else if (ent->expected_body_len == 0) {
             ent->state = entity_done;
         } else {
             ent->state = reading_body_with_length;
         }
-        octstr_destroy(h);
         return;
     }
 
@@ -420,6 +420,24 @@ static void deduce_body_state(HTTPEntity *ent)
 }
 
 
+static void deduce_body_state(HTTPEntity *ent)
+{
+    Octstr *te, *cl = NULL;
+
+    if (ent->expect_state == expect_no_body) {
+        ent->state = entity_done;
+        return;
+    }
+
+    te = http_header_find_first(ent->headers, "Transfer-Encoding");
+    if (te == NULL)
+        cl = http_header_find_first(ent->headers, "Content-Length");
+    entity_set_body_state(ent, te, cl);
+    octstr_destroy(te);
+    octstr_destroy(cl);
+}
+
+
 /*
  * Create a HTTPEntity structure suitable for reading the expected
  * result or request message and decoding the transferred entity (if any).
@@ -898,21 +916,21 @@ HTTPCaller *http_caller_create(void)
 {
     HTTPCaller *caller;
     
-    caller = gwlist_create();
-    gwlist_add_producer(caller);
+    caller = gw_queue_create(0);
+    gw_queue_add_producer(caller);
     return caller;
 }
 
 
 void http_caller_destroy(HTTPCaller *caller)
 {
-    gwlist_destroy(caller, server_destroy);
+    gw_queue_destroy(caller, server_destroy);
 }
 
 
 void http_caller_signal_shutdown(HTTPCaller *caller)
 {
-    gwlist_remove_producer(caller);
+    gw_queue_remove_producer(caller);
 }
 
 
@@ -1213,7 +1231,7 @@ static void handle_transaction(Connection *conn, void *data)
 
     } else {
         /* handle this response as usual */
-        gwlist_produce(trans->caller, trans);
+        gw_queue_produce(trans->caller, trans);
     }
     return;
 
@@ -1223,7 +1241,7 @@ error:
     trans->conn = NULL;
     error(0, "Couldn't fetch <%s>", octstr_get_cstr(trans->url));
     trans->status = -1;
-    gwlist_produce(trans->caller, trans);
+    gw_queue_produce(trans->caller, trans);
 }
 
 
@@ -1684,7 +1702,7 @@ static void write_request_thread(void *arg)
         trans->conn = get_connection(trans);
 
         if (trans->conn == NULL)
-            gwlist_produce(trans->caller, trans);
+            gw_queue_produce(trans->caller, trans);
         else if (conn_is_connected(trans->conn) == 0) {
             debug("gwlib.http", 0, "Socket connected at once");
 
@@ -1693,7 +1711,7 @@ static void write_request_thread(void *arg)
                 conn_register(trans->conn, client_fdset, handle_transaction, 
                                 trans);
             } else {
-                gwlist_produce(trans->caller, trans);
+                gw_queue_produce(trans->caller, trans);
             }
 
         } else { /* Socket not connected, wait for connection */
@@ -1775,9 +1793,9 @@ void *http_receive_result_real(HTTPCaller *caller, int *status, Octstr **final_u
     void *request_id;
 
     if (blocking == 0)
-        trans = gwlist_extract_first(caller);
+        trans = gw_queue_extract(caller);
     else
-        trans = gwlist_consume(caller);
+        trans = gw_queue_consume(caller);
     if (trans == NULL)
     	return NULL;
 
@@ -1866,7 +1884,9 @@ struct HTTPClient {
     Octstr *url;
     int use_version_1_0;
     int persistent_conn;
-    unsigned long conn_time; /* store time for timeouting */
+    long conn_time; /* store time for timeouting, see gw_clock_mono */
+    long head_scanned; /* input already searched for end of head */
+    HTTPRequest *parsed; /* request line and headers */
     HTTPEntity *request;
 };
 
@@ -1903,7 +1923,9 @@ static HTTPClient *client_create(int port, Connection *conn, Octstr *ip)
     p->url = NULL;
     p->use_version_1_0 = 0;
     p->persistent_conn = 1;
-    p->conn_time = time(NULL);
+    p->conn_time = gw_clock_mono();
+    p->head_scanned = 0;
+    p->parsed = NULL;
     p->request = NULL;
     debug("gwlib.http", 0, "HTTP: Created HTTPClient area %p.", p);
     
@@ -1944,6 +1966,7 @@ static void client_destroy(void *client)
     conn_destroy(p->conn);
     octstr_destroy(p->ip);
     octstr_destroy(p->url);
+    http_request_destroy(p->parsed);
     entity_destroy(p->request);
     gw_free(p);
 }
@@ -1954,25 +1977,25 @@ static void client_reset(HTTPClient *p)
     debug("gwlib.http", 0, "HTTP: Resetting HTTPClient for `%s'.",
     	  octstr_get_cstr(p->ip));
     p->state = reading_request_line;
-    p->conn_time = time(NULL);
+    p->conn_time = gw_clock_mono();
+    p->head_scanned = 0;
+    gw_assert(p->parsed == NULL);
     gw_assert(p->request == NULL);
 }
 
 
 /*
- * Checks whether the client connection is meant to be persistent or not.
+ * Checks whether the client connection is meant to be persistent or not,
+ * given the value of the Connection header (NULL if there is none).
  * Returns 1 for true, 0 for false.
  */
 
-static int client_is_persistent(List *headers, int use_version_1_0)
+static int client_is_persistent(Octstr *h, int use_version_1_0)
 {
-    Octstr *h = http_header_find_first(headers, "Connection");
-
     if (h == NULL) {
         return !use_version_1_0;
     } else {
         List *values = octstr_split(h, octstr_imm(","));
-        octstr_destroy(h);
         if (!use_version_1_0) {
             if (gwlist_search(values, octstr_imm("keep-alive"), octstr_item_case_match) != NULL) {
                 gwlist_destroy(values, octstr_destroy_item);
@@ -2191,56 +2214,235 @@ static FDSet *port_get_fdset(int port)
 }
 
 
-static int parse_request_line(int *method, Octstr **url,
-                              int *use_version_1_0, Octstr *line)
+/*
+ * A request as read by the server. The request line and the headers are
+ * kept in one Octstr exactly as they were read from the connection. The
+ * parser only records offsets into it; the URL, the header list and the
+ * CGI variables are created from those offsets when someone asks for them.
+ */
+typedef struct {
+    long name;      /* start of the header line */
+    long colon;     /* position of the first ':' on the first line, or -1 */
+    long end;       /* end of the last line, without CR LF */
+    int folded;     /* header continues on the following line(s) */
+} HTTPHeaderField;
+
+struct HTTPRequest {
+    Octstr *head;
+    int method;
+    int use_version_1_0;
+    long url_start;
+    long url_len;       /* without the query part */
+    long query_start;   /* just after the '?', or -1 */
+    long query_len;
+    HTTPHeaderField *fields;
+    long num_fields;
+    long size_fields;
+    List *trailers;     /* headers after a chunked body, or NULL */
+    Octstr *ip;
+    Octstr *url;        /* created on demand */
+    List *headers;      /* created on demand */
+    List *cgivars;      /* created on demand */
+    Octstr *body;
+};
+
+
+/*
+ * Find the end of the line starting at pos. Return the position of the
+ * terminating LF and set *end to the end of the line contents.
+ */
+static long request_line_end(Octstr *head, long pos, long *end)
+{
+    long lf;
+
+    lf = octstr_search_char(head, 10, pos);
+    if (lf == -1)
+        lf = octstr_len(head);
+    *end = lf;
+    if (*end > pos && octstr_get_char(head, *end - 1) == 13)
+        --*end;
+    return lf;
+}
+
+
+static int request_range_is(Octstr *head, long start, long len, char *str)
 {
-    List *words;
-    Octstr *version;
-    Octstr *method_str;
+    return (long) strlen(str) == len &&
+           memcmp(octstr_get_cstr(head) + start, str, len) == 0;
+}
+
+
+/*
+ * Parse the request line and split the headers of a request head read
+ * with conn_read_header_block. Return NULL if the request line is bad.
+ * Takes ownership of head.
+ */
+static HTTPRequest *request_parse(Octstr *head)
+{
+    HTTPRequest *req;
+    HTTPHeaderField *f;
+    long word_start[3], word_len[3];
+    long words, pos, end, lf, query;
     int ret;
 
-    words = octstr_split_words(line);
-    if (gwlist_len(words) != 3) {
-        gwlist_destroy(words, octstr_destroy_item);
-        return -1;
+    /* request line: exactly three words separated by white space */
+    lf = request_line_end(head, 0, &end);
+    words = 0;
+    pos = 0;
+    for (;;) {
+        while (pos < end && isspace(octstr_get_char(head, pos)))
+            ++pos;
+        if (pos >= end)
+            break;
+        if (words == 3)
+            goto error;
+        word_start[words] = pos;
+        while (pos < end && !isspace(octstr_get_char(head, pos)))
+            ++pos;
+        word_len[words] = pos - word_start[words];
+        ++words;
     }
+    if (words != 3)
+        goto error;
 
-    method_str = gwlist_get(words, 0);
-    *url = gwlist_get(words, 1);
-    version = gwlist_get(words, 2);
-    gwlist_destroy(words, NULL);
+    req = gw_malloc(sizeof(*req));
+    req->head = head;
 
-    if (octstr_compare(method_str, octstr_imm("GET")) == 0)
-        *method = HTTP_METHOD_GET;
-    else if (octstr_compare(method_str, octstr_imm("POST")) == 0)
-        *method = HTTP_METHOD_POST;
-    else if (octstr_compare(method_str, octstr_imm("HEAD")) == 0)
-        *method = HTTP_METHOD_HEAD;
-    else
+    if (request_range_is(head, word_start[0], word_len[0], "GET"))
+        req->method = HTTP_METHOD_GET;
+    else if (request_range_is(head, word_start[0], word_len[0], "POST"))
+        req->method = HTTP_METHOD_POST;
+    else if (request_range_is(head, word_start[0], word_len[0], "HEAD"))
+        req->method = HTTP_METHOD_HEAD;
+    else {
+        gw_free(req);
         goto error;
+    }
 
-    ret = parse_http_version(version);
-    if (ret < 0)
+    req->url_start = word_start[1];
+    req->url_len = word_len[1];
+    query = octstr_search_char(head, '?', req->url_start);
+    if (query == -1 || query >= req->url_start + req->url_len) {
+        req->query_start = -1;
+        req->query_len = 0;
+    } else {
+        req->query_start = query + 1;
+        req->query_len = req->url_start + req->url_len - req->query_start;
+        req->url_len = query - req->url_start;
+    }
+
+    ret = parse_http_version_data(octstr_get_cstr(head) + word_start[2],
+                                  word_len[2]);
+    if (ret < 0) {
+        gw_free(req);
         goto error;
-    *use_version_1_0 = !ret;
+    }
+    req->use_version_1_0 = !ret;
+
+    req->fields = NULL;
+    req->num_fields = 0;
+    req->size_fields = 0;
+    req->trailers = NULL;
+    req->ip = NULL;
+    req->url = NULL;
+    req->headers = NULL;
+    req->cgivars = NULL;
+    req->body = NULL;
+
+    /* header lines, up to the empty line */
+    for (pos = lf + 1; pos < octstr_len(head); pos = lf + 1) {
+        lf = request_line_end(head, pos, &end);
+        if (end == pos)
+            break;
+        if (isspace(octstr_get_char(head, pos)) && req->num_fields > 0) {
+            f = &req->fields[req->num_fields - 1];
+            f->end = end;
+            f->folded = 1;
+            continue;
+        }
+        if (req->num_fields == req->size_fields) {
+            req->size_fields = req->size_fields == 0 ? 16 : 2 * req->size_fields;
+            req->fields = gw_realloc(req->fields,
+                                     req->size_fields * sizeof(*req->fields));
+        }
+        f = &req->fields[req->num_fields++];
+        f->name = pos;
+        f->colon = octstr_search_char(head, ':', pos);
+        if (f->colon >= end)
+            f->colon = -1;
+        f->end = end;
+        f->folded = 0;
+    }
 
-    octstr_destroy(method_str);
-    octstr_destroy(version);
-    return 0;
+    return req;
 
 error:
-    octstr_destroy(method_str);
-    octstr_destroy(*url);
-    octstr_destroy(version);
-    *url = NULL;
-    return -1;
+    octstr_destroy(head);
+    return NULL;
+}
+
+
+/*
+ * Create the header line for a field, the same way read_some_headers
+ * would have done: CR LF removed and continuation lines appended.
+ */
+static Octstr *request_field_line(HTTPRequest *req, HTTPHeaderField *f)
+{
+    Octstr *line;
+    long pos, end, lf;
+
+    if (!f->folded)
+        return octstr_copy(req->head, f->name, f->end - f->name);
+
+    line = octstr_create("");
+    pos = f->name;
+    for (;;) {
+        lf = request_line_end(req->head, pos, &end);
+        octstr_append_data(line, octstr_get_cstr(req->head) + pos, end - pos);
+        if (end >= f->end)
+            break;
+        pos = lf + 1;
+    }
+    return line;
+}
+
+
+/*
+ * Same as http_header_find_first, but without creating the header list.
+ */
+static Octstr *request_find_header(HTTPRequest *req, char *name)
+{
+    HTTPHeaderField *f;
+    Octstr *value, *line;
+    long i, name_len;
+
+    name_len = strlen(name);
+    for (i = 0; i < req->num_fields; ++i) {
+        f = &req->fields[i];
+        if (f->colon - f->name != name_len ||
+            strncasecmp(octstr_get_cstr(req->head) + f->name, name, name_len) != 0)
+            continue;
+        if (!f->folded)
+            value = octstr_copy(req->head, f->colon + 1, f->end - f->colon - 1);
+        else {
+            line = request_field_line(req, f);
+            value = octstr_copy(line, name_len + 1, octstr_len(line));
+            octstr_destroy(line);
+        }
+        octstr_strip_blanks(value);
+        return value;
+    }
+
+    if (req->trailers != NULL)
+        return http_header_find_first(req->trailers, name);
+    return NULL;
 }
 
 
 static void receive_request(Connection *conn, void *data)
 {
     HTTPClient *client;
-    Octstr *line;
+    Octstr *head, *te, *cl;
     int ret;
 
     if (run_status != running) {
@@ -2253,17 +2455,19 @@ static void receive_request(Connection *conn, void *data)
     for (;;) {
         switch (client->state) {
             case reading_request_line:
-                line = conn_read_line(conn);
-                if (line == NULL) {
+                /*
+                 * Read request line and headers in one go and parse them
+                 * in a single pass.
+                 */
+                head = conn_read_header_block(conn, &client->head_scanned);
+                if (head == NULL) {
                     if (conn_eof(conn) || conn_error(conn))
                         goto error;
                     return;
                 }
-                ret = parse_request_line(&client->method, &client->url,
-                                         &client->use_version_1_0, line);
-                octstr_destroy(line);
+                client->parsed = request_parse(head);
                 /* client sent bad request? */
-                if (ret == -1) {
+                if (client->parsed == NULL) {
                     /*
                      * mark client as not persistent in order to destroy connection
                      * afterwards
@@ -2274,11 +2478,18 @@ static void receive_request(Connection *conn, void *data)
                     http_send_reply(client, HTTP_BAD_REQUEST, NULL, NULL);
                     return;
                 }
+                client->method = client->parsed->method;
+                client->use_version_1_0 = client->parsed->use_version_1_0;
                 /*
                  * RFC2616 (4.3) says we should read a message body if there
                  * is one, even on GET requests.
                  */
                 client->request = entity_create(expect_body_if_indicated);
+                te = request_find_header(client->parsed, "Transfer-Encoding");
+                cl = te ? NULL : request_find_header(client->parsed, "Content-Length");
+                entity_set_body_state(client->request, te, cl);
+                octstr_destroy(te);
+                octstr_destroy(cl);
                 client->state = reading_request;
                 break;
                 
@@ -2524,58 +2735,50 @@ void http_close_all_ports(void)
 
 
 /*
- * Parse CGI variables from the path given in a GET. Return a list
- * of HTTPCGIvar pointers. Modify the url so that the variables are
- * removed.
+ * Parse CGI variables from the query part of the URL given in a GET,
+ * i.e. the len octets starting at start in str. Return a list of
+ * HTTPCGIvar pointers.
  */
-static List *parse_cgivars(Octstr *url)
+static List *parse_cgivars(Octstr *str, long start, long len)
 {
     HTTPCGIVar *v;
     List *list;
-    int query, et, equals;
-    Octstr *arg, *args;
-
-    query = octstr_search_char(url, '?', 0);
-    if (query == -1)
-        return gwlist_create();
-
-    args = octstr_copy(url, query + 1, octstr_len(url));
-    octstr_truncate(url, query);
+    long end, et, equals;
 
     list = gwlist_create();
+    if (start < 0)
+        return list;
 
-    while (octstr_len(args) > 0) {
-        et = octstr_search_char(args, '&', 0);
-        if (et == -1)
-            et = octstr_len(args);
-        arg = octstr_copy(args, 0, et);
-        octstr_delete(args, 0, et + 1);
+    for (end = start + len; start < end; start = et + 1) {
+        et = octstr_search_char(str, '&', start);
+        if (et == -1 || et > end)
+            et = end;
 
-        equals = octstr_search_char(arg, '=', 0);
-        if (equals == -1)
-            equals = octstr_len(arg);
+        equals = octstr_search_char(str, '=', start);
+        if (equals == -1 || equals > et)
+            equals = et;
 
         v = gw_malloc(sizeof(HTTPCGIVar));
-        v->name = octstr_copy(arg, 0, equals);
-        v->value = octstr_copy(arg, equals + 1, octstr_len(arg));
+        v->name = octstr_copy(str, start, equals - start);
+        if (equals < et)
+            v->value = octstr_copy(str, equals + 1, et - equals - 1);
+        else
+            v->value = octstr_create("");
         octstr_url_decode(v->name);
         octstr_url_decode(v->value);
 
-        octstr_destroy(arg);
-
         gwlist_append(list, v);
     }
-    octstr_destroy(args);
 
     return list;
 }
 
 
-HTTPClient *http_accept_request(int port, Octstr **client_ip, Octstr **url, 
-    	    	    	    	List **headers, Octstr **body, 
-                                List **cgivars)
+HTTPClient *http_accept_request_lazy(int port, HTTPRequest **request)
 {
     HTTPClient *client;
+    HTTPRequest *req;
+    Octstr *h;
     
     do {
         client = port_get_request(port);
@@ -2591,29 +2794,156 @@ HTTPClient *http_accept_request(int port, Octstr **client_ip, Octstr **url,
         }
     } while(client == NULL);
     
-    *client_ip = octstr_duplicate(client->ip);
-    *url = client->url;
-    *headers = client->request->headers;
-    *body = client->request->body;
-    *cgivars = parse_cgivars(client->url);
+    req = client->parsed;
+    client->parsed = NULL;
+    req->ip = octstr_duplicate(client->ip);
     
-    if (client->method != HTTP_METHOD_POST) {
-        octstr_destroy(*body);
-        *body = NULL;
+    if (client->method == HTTP_METHOD_POST) {
+        req->body = client->request->body;
+        client->request->body = NULL;
+    }
+    if (gwlist_len(client->request->headers) > 0) {
+        req->trailers = client->request->headers;
+        client->request->headers = NULL;
     }
     
-    client->persistent_conn = client_is_persistent(client->request->headers,
-                                                   client->use_version_1_0);
+    h = request_find_header(req, "Connection");
+    client->persistent_conn = client_is_persistent(h, client->use_version_1_0);
+    octstr_destroy(h);
     
-    client->url = NULL;
-    client->request->headers = NULL;
-    client->request->body = NULL;
     entity_destroy(client->request);
     client->request = NULL;
     
+    *request = req;
     return client;
 }
 
+
+HTTPClient *http_accept_request(int port, Octstr **client_ip, Octstr **url, 
+    	    	    	    	List **headers, Octstr **body, 
+                                List **cgivars)
+{
+    HTTPClient *client;
+    HTTPRequest *req;
+
+    client = http_accept_request_lazy(port, &req);
+    if (client == NULL)
+        return NULL;
+
+    /* hand over everything the request owns to the caller */
+    *client_ip = req->ip;
+    *url = http_request_path(req);
+    *headers = http_request_headers(req);
+    *body = req->body;
+    *cgivars = http_request_cgivars(req);
+    req->ip = NULL;
+    req->url = NULL;
+    req->headers = NULL;
+    req->body = NULL;
+    req->cgivars = NULL;
+    http_request_destroy(req);
+
+    return client;
+}
+
+
+void http_request_destroy(HTTPRequest *req)
+{
+    if (req == NULL)
+        return;
+
+    octstr_destroy(req->head);
+    gw_free(req->fields);
+    http_destroy_headers(req->trailers);
+    octstr_destroy(req->ip);
+    octstr_destroy(req->url);
+    http_destroy_headers(req->headers);
+    http_destroy_cgiargs(req->cgivars);
+    octstr_destroy(req->body);
+    gw_free(req);
+}
+
+
+int http_request_method(HTTPRequest *req)
+{
+    gw_assert(req != NULL);
+    return req->method;
+}
+
+
+Octstr *http_request_ip(HTTPRequest *req)
+{
+    gw_assert(req != NULL);
+    return req->ip;
+}
+
+
+Octstr *http_request_path(HTTPRequest *req)
+{
+    gw_assert(req != NULL);
+
+    if (req->url == NULL)
+        req->url = octstr_copy(req->head, req->url_start, req->url_len);
+    return req->url;
+}
+
+
+Octstr *http_request_body(HTTPRequest *req)
+{
+    gw_assert(req != NULL);
+    return req->body;
+}
+
+
+Octstr *http_request_header(HTTPRequest *req, char *name)
+{
+    gw_assert(req != NULL);
+    gw_assert(name != NULL);
+
+    if (req->headers != NULL)
+        return http_header_find_first(req->headers, name);
+    return request_find_header(req, name);
+}
+
+
+List *http_request_headers(HTTPRequest *req)
+{
+    Octstr *h;
+    long i;
+
+    gw_assert(req != NULL);
+
+    if (req->headers == NULL) {
+        req->headers = http_create_empty_headers();
+        for (i = 0; i < req->num_fields; ++i)
+            gwlist_append(req->headers, request_field_line(req, &req->fields[i]));
+        if (req->trailers != NULL) {
+            while ((h = gwlist_extract_first(req->trailers)) != NULL)
+                gwlist_append(req->headers, h);
+            gwlist_destroy(req->trailers, NULL);
+            req->trailers = NULL;
+        }
+    }
+    return req->headers;
+}
+
+
+List *http_request_cgivars(HTTPRequest *req)
+{
+    gw_assert(req != NULL);
+
+    if (req->cgivars == NULL)
+        req->cgivars = parse_cgivars(req->head, req->query_start, req->query_len);
+    return req->cgivars;
+}
+
+
+Octstr *http_request_cgi_variable(HTTPRequest *req, char *name)
+{
+    return http_cgi_variable(http_request_cgivars(req), name);
+}
+
+
 /*
  * The http_send_reply(...) uses this function to determinate the
  * reason pahrase for a status code.
@@ -2685,7 +3015,7 @@ void http_send_reply(HTTPClient *client, int status, List *headers,
     octstr_format_append(response, "Server: " GW_NAME "/%s\r\n", GW_VERSION);
     
     /* let's inform the client of our time */
-    date = date_format_http(time(NULL));
+    date = date_format_http(gw_clock_now());
     octstr_format_append(response, "Date: %s\r\n", octstr_get_cstr(date));
     octstr_destroy(date);
     
@@ -2946,6 +3276,7 @@ Octstr *http_header_value(List *headers, Octstr *name)
 List *http_header_duplicate(List *headers)
 {
     List *new;
+    gw_arena_t *arena;
     long i, len;
 
     gwlib_assert_init();
@@ -2953,10 +3284,13 @@ List *http_header_duplicate(List *headers)
     if (headers == NULL)
         return NULL;
 
+    /* like octstr_duplicate, the copy never comes from an arena */
+    arena = gw_arena_suspend();
     new = http_create_empty_headers();
     len = gwlist_len(headers);
     for (i = 0; i < len; ++i)
         gwlist_append(new, octstr_duplicate(gwlist_get(headers, i)));
+    gw_arena_resume(arena);
     return new;
 }
 
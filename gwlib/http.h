@@ -128,6 +128,7 @@
 #define HTTP_H
 
 #include "gwlib/list.h"
+#include "gwlib/gw-queue.h"
 #include "gwlib/octstr.h"
 
 
@@ -320,11 +321,11 @@ int http_get_real(int method, Octstr *url, List *request_headers,
  * http_start_request, and http_receive_result to route results to the right
  * callers.
  *
- * Implementation note: We use a List as the type so that we can use
- * that list for communicating the results. This makes it unnecessary
- * to map the caller identifier to a List internally in the HTTP module.
+ * Implementation note: We use a queue as the type so that we can use
+ * that queue for communicating the results. This makes it unnecessary
+ * to map the caller identifier to a queue internally in the HTTP module.
  */
-typedef List HTTPCaller;
+typedef gw_queue_t HTTPCaller;
 
 
 /*
@@ -430,11 +431,47 @@ int http_open_port_if(int port, int ssl, Octstr *interface);
  * many threads to be fast. The HTTP user should use a single thread,
  * unless requests can block.
  */
-HTTPClient *http_accept_request(int port, Octstr **client_ip, 
+HTTPClient *http_accept_request(int port, Octstr **client_ip,
     	    	    	    	Octstr **url, List **headers, Octstr **body,
 				List **cgivars);
 
 
+/*
+ * A request accepted with http_accept_request_lazy. The request line and
+ * headers are parsed in a single pass when they are read; the URL path,
+ * the list of headers and the CGI variables are only created when they
+ * are asked for with the functions below.
+ */
+typedef struct HTTPRequest HTTPRequest;
+
+
+/*
+ * Same as http_accept_request, but return the request via a HTTPRequest
+ * instead of separate values. The caller must destroy the request with
+ * http_request_destroy. http_accept_request is a wrapper for this.
+ */
+HTTPClient *http_accept_request_lazy(int port, HTTPRequest **request);
+void http_request_destroy(HTTPRequest *request);
+
+/*
+ * Accessors for a HTTPRequest. The values returned by http_request_ip,
+ * http_request_path, http_request_body, http_request_headers,
+ * http_request_cgivars and http_request_cgi_variable belong to the
+ * request and must not be destroyed by the caller. http_request_body
+ * returns NULL unless the method was POST. http_request_header works
+ * like http_header_find_first and returns a new Octstr or NULL, without
+ * creating the whole header list.
+ */
+int http_request_method(HTTPRequest *request);
+Octstr *http_request_ip(HTTPRequest *request);
+Octstr *http_request_path(HTTPRequest *request);
+Octstr *http_request_body(HTTPRequest *request);
+Octstr *http_request_header(HTTPRequest *request, char *name);
+List *http_request_headers(HTTPRequest *request);
+List *http_request_cgivars(HTTPRequest *request);
+Octstr *http_request_cgi_variable(HTTPRequest *request, char *name);
+
+
 /*
  * Send a reply to a previously accepted request. The caller is responsible
  * for destroying the headers and body after the call to http_send_reply
@@ -97,6 +97,8 @@
 #include "log.h"
 #include "thread.h"
 #include "gwmem.h"
+#include "gw-arena.h"
+#include "gw-slab.h"
 
 
 struct List
@@ -110,8 +112,25 @@ struct List
     pthread_cond_t nonempty;
     long num_producers;
     long num_consumers;
+    int arena;
 };
 
+/*
+ * Lists created while an arena is attached to the thread (see gw-arena.h)
+ * take the structure and both mutexes from the arena in one piece. Their
+ * array is allocated from the arena of the growing thread while it has
+ * one, and doubles instead of growing by the items added.
+ */
+#define LIST_ARENA 1        /* structure comes from an arena */
+#define LIST_ARENA_TAB 2    /* array comes from an arena */
+
+/* size of a list with its mutexes */
+#define LIST_SIZE (sizeof(List) + 2 * sizeof(Mutex))
+
+/* other lists take the structure and mutexes from a slab */
+static gw_slab_t *list_slab;
+#define LIST_SLAB (gw_slab_get(&list_slab, "List", LIST_SIZE))
+
 #define INDEX(list, i)	(((list)->start + i) % (list)->tab_size)
 #define GET(list, i)	((list)->tab[INDEX(list, i)])
 
@@ -128,13 +147,18 @@ List *gwlist_create_real(void)
 {
     List *list;
 
-    list = gw_malloc(sizeof(List));
+    if ((list = gw_arena_malloc(LIST_SIZE)) != NULL)
+        list->arena = LIST_ARENA;
+    else {
+        list = gw_slab_alloc(LIST_SLAB);
+        list->arena = 0;
+    }
+    list->single_operation_lock = mutex_init_static((Mutex *) (list + 1));
+    list->permanent_lock = mutex_init_static((Mutex *) (list + 1) + 1);
     list->tab = NULL;
     list->tab_size = 0;
     list->start = 0;
     list->len = 0;
-    list->single_operation_lock = mutex_create();
-    list->permanent_lock = mutex_create();
     pthread_cond_init(&list->nonempty, NULL);
     list->num_producers = 0;
     list->num_consumers = 0;
@@ -158,8 +182,14 @@ void gwlist_destroy(List *list, gwlist_item_destructor_t *destructor)
     mutex_destroy(list->permanent_lock);
     mutex_destroy(list->single_operation_lock);
     pthread_cond_destroy(&list->nonempty);
-    gw_free(list->tab);
-    gw_free(list);
+    if (list->arena & LIST_ARENA_TAB)
+        gw_arena_free(list->tab);
+    else
+        gw_free(list->tab);
+    if (list->arena & LIST_ARENA)
+        gw_arena_free(list);
+    else
+        gw_slab_free(list_slab, list);
 }
 
 
@@ -609,6 +639,29 @@ static void unlock(List *list)
  *
  * Assume list has been locked for a single operation already.
  */
+/* Move the array of an arena list to a new area of 'size' items */
+static void arena_grow(List *list, long size)
+{
+    void **tab;
+    int arena_tab;
+
+    if ((tab = gw_arena_malloc(size * sizeof(void *))) != NULL)
+        arena_tab = LIST_ARENA_TAB;
+    else {
+        tab = gw_malloc(size * sizeof(void *));
+        arena_tab = 0;
+    }
+    if (list->tab_size > 0)
+        memcpy(tab, list->tab, list->tab_size * sizeof(void *));
+    if (list->arena & LIST_ARENA_TAB)
+        gw_arena_free(list->tab);
+    else
+        gw_free(list->tab);
+    list->arena = (list->arena & ~LIST_ARENA_TAB) | arena_tab;
+    list->tab = tab;
+}
+
+
 static void make_bigger(List *list, long items)
 {
     long old_size, new_size;
@@ -619,7 +672,12 @@ static void make_bigger(List *list, long items)
 
     old_size = list->tab_size;
     new_size = old_size + items;
-    list->tab = gw_realloc(list->tab, new_size * sizeof(void *));
+    if ((list->arena & LIST_ARENA) && (list->tab == NULL || (list->arena & LIST_ARENA_TAB))) {
+        if (new_size < 2 * old_size)
+            new_size = 2 * old_size;
+        arena_grow(list, new_size);
+    } else
+        list->tab = gw_realloc(list->tab, new_size * sizeof(void *));
     list->tab_size = new_size;
 
     /*
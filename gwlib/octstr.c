@@ -121,17 +121,84 @@ struct Octstr
     long len;
     long size;
     int immutable;
+    int arena;
 };
 
+/*
+ * Strings created while an arena is attached to the thread (see
+ * gw-arena.h) take the structure from the arena, with the initial data
+ * right after it. When they grow, the data is allocated anew from the
+ * arena of the growing thread, or from the heap if it has none.
+ */
+#define OCTSTR_ARENA 1          /* structure comes from an arena */
+#define OCTSTR_ARENA_DATA 2     /* data allocated separately from an arena */
+
+#define INLINE_DATA(ostr) ((ostr)->data == (unsigned char *) ((ostr) + 1))
+
+/* other strings take the structure from a slab */
+static gw_slab_t *octstr_slab;
+#define OCTSTR_SLAB (gw_slab_get(&octstr_slab, "Octstr", sizeof(Octstr)))
+
+/*
+ * Data from the heap is preceded by a reference count. octstr_duplicate
+ * shares it instead of copying, and every function that modifies a
+ * string first gives it data of its own if the count is above one. The
+ * data of arena strings is copied as before, which is cheap there.
+ * Compilers without the __atomic builtins always copy.
+ */
+#define DATA_REFS(data) ((long *) (data) - 1)
+#define HEAP_DATA(ostr) ((ostr)->data != NULL && !(ostr)->immutable && \
+    !((ostr)->arena & OCTSTR_ARENA_DATA) && !INLINE_DATA(ostr))
+
+#if defined(__clang__) || (defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#define OCTSTR_SHARING 1
+#define refs_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define refs_add(p, v) __atomic_add_fetch(p, v, __ATOMIC_ACQ_REL)
+#else
+#define refs_load(p) (*(p))
+#endif
+
+/*
+ * Define OCTSTR_STATS to count the octets octstr_duplicate and
+ * octstr_copy copy and share; octstr_shutdown reports them.
+ */
+#ifdef OCTSTR_STATS
+static long octets_copied, octets_shared;
+#define count_octets(counter, n) __atomic_add_fetch(&(counter), n, __ATOMIC_RELAXED)
+#else
+#define count_octets(counter, n)
+#endif
+
 
 /**********************************************************************
  * Hash table of immutable octet strings.
+ *
+ * Each bucket is a singly linked chain. Entries are only ever added at
+ * the head of a chain and are never removed before octstr_shutdown, so
+ * with the compiler's atomic builtins readers walk the chains without a
+ * lock and writers publish a new head with compare-and-swap. Other
+ * compilers serialize all access through immutables_mutex.
  */
 
-#define MAX_IMMUTABLES 1024
+#define IMMUTABLE_BUCKETS 4096
+
+struct immutable {
+    Octstr os;                  /* first, so &os is the allocation */
+    struct immutable *next;
+};
 
-static Octstr *immutables[MAX_IMMUTABLES];
+#if defined(__clang__) || (defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#define IMMUTABLES_LOCK_FREE 1
+#define imm_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define imm_cas(p, e, v) __atomic_compare_exchange_n(p, e, v, 0, \
+                             __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)
+#else
 static Mutex immutables_mutex;
+#endif
+
+static struct immutable *immutables[IMMUTABLE_BUCKETS];
 static int immutables_init = 0;
 
 static char is_safe[UCHAR_MAX + 1];
@@ -177,19 +244,118 @@ static void seems_valid_real(const Octstr *ostr, const char *filename, long line
  */
 
 
+static unsigned char *heap_alloc_real(long size, const char *file, long line,
+                                      const char *func)
+{
+    long *refs;
+
+    refs = gw_malloc_trace(sizeof(*refs) + size, file, line, func);
+    *refs = 1;
+    return (unsigned char *) (refs + 1);
+}
+#define heap_alloc(size) (heap_alloc_real(size, __FILE__, __LINE__, __func__))
+
+
+static void heap_release(unsigned char *data)
+{
+#ifdef OCTSTR_SHARING
+    if (refs_load(DATA_REFS(data)) != 1 && refs_add(DATA_REFS(data), -1) != 0)
+        return;
+#endif
+    gw_free(DATA_REFS(data));
+}
+
+
+/* Allocate data for an empty string */
+static unsigned char *data_alloc(Octstr *ostr, long size)
+{
+    unsigned char *data;
+
+    if ((ostr->arena & OCTSTR_ARENA) && (data = gw_arena_malloc(size)) != NULL) {
+        ostr->arena |= OCTSTR_ARENA_DATA;
+        return data;
+    }
+    return heap_alloc(size);
+}
+
+
+static void data_free(Octstr *ostr)
+{
+    if (ostr->arena & OCTSTR_ARENA_DATA)
+        gw_arena_free(ostr->data);
+    else if (ostr->data != NULL && !INLINE_DATA(ostr))
+        heap_release(ostr->data);
+    ostr->arena &= ~OCTSTR_ARENA_DATA;
+}
+
+
+/* Give a string whose data is shared data of its own, before modifying it */
+static void unshare(Octstr *ostr)
+{
+    unsigned char *data;
+
+    if (!HEAP_DATA(ostr) || refs_load(DATA_REFS(ostr->data)) == 1)
+        return;
+
+    data = heap_alloc(ostr->size);
+    memcpy(data, ostr->data, ostr->len + 1);
+    count_octets(octets_copied, ostr->len);
+    heap_release(ostr->data);
+    ostr->data = data;
+}
+
+
+/* Move the data of an arena string to a new area of at least 'size' octets */
+static void arena_grow(Octstr *ostr, long size)
+{
+    unsigned char *data;
+    int arena_data;
+
+    /* grow by doubling, the 1kB chunks would waste the arena blocks */
+    if (size < 2 * ostr->size)
+        size = 2 * ostr->size;
+
+    if ((data = gw_arena_malloc(size)) != NULL)
+        arena_data = OCTSTR_ARENA_DATA;
+    else {
+        size += 1024 - (size % 1024);
+        data = heap_alloc(size);
+        arena_data = 0;
+    }
+    if (ostr->data != NULL)
+        memcpy(data, ostr->data, ostr->len + 1);
+    data_free(ostr);
+    ostr->arena |= arena_data;
+    ostr->data = data;
+    ostr->size = size;
+}
+
+
 /* Reserve space for at least 'size' octets */
 static void octstr_grow(Octstr *ostr, long size)
 {
     gw_assert(!ostr->immutable);
+    unshare(ostr);
     seems_valid(ostr);
     gw_assert(size >= 0);
 
     size++;   /* make room for the invisible terminating NUL */
 
-    if (size > ostr->size) {
+    if (size <= ostr->size)
+        return;
+
+    /* arena strings keep their data off the heap as long as they can */
+    if ((ostr->arena & OCTSTR_ARENA) && (ostr->data == NULL ||
+            INLINE_DATA(ostr) || (ostr->arena & OCTSTR_ARENA_DATA))) {
+        arena_grow(ostr, size);
+    } else {
         /* always reallocate in 1kB chunks */
         size += 1024 - (size % 1024);
-        ostr->data = gw_realloc(ostr->data, size);
+        if (ostr->data == NULL)
+            ostr->data = heap_alloc(size);
+        else
+            ostr->data = (unsigned char *) ((long *) gw_realloc(DATA_REFS(ostr->data),
+                                                 sizeof(long) + size) + 1);
         ostr->size = size;
     }
 }
@@ -216,25 +382,36 @@ static void urlcode_init(void)
 void octstr_init(void)
 {
     urlcode_init();
+#ifndef IMMUTABLES_LOCK_FREE
     mutex_init_static(&immutables_mutex);
+#endif
     immutables_init = 1;
 }
 
 
 void octstr_shutdown(void)
 {
+    struct immutable *imm, *next;
     long i, n;
 
     n = 0;
-    for (i = 0; i < MAX_IMMUTABLES; ++i) {
-        if (immutables[i] != NULL) {
-	    gw_free(immutables[i]);
+    for (i = 0; i < IMMUTABLE_BUCKETS; ++i) {
+        for (imm = immutables[i]; imm != NULL; imm = next) {
+            next = imm->next;
+	    gw_free(imm);
             ++n;
         }
+        immutables[i] = NULL;
     }
     if(n>0)
         debug("gwlib.octstr", 0, "Immutable octet strings: %ld.", n);
+#ifdef OCTSTR_STATS
+    info(0, "Octet strings duplicated: %ld octets copied, %ld shared.",
+         octets_copied, octets_shared);
+#endif
+#ifndef IMMUTABLES_LOCK_FREE
     mutex_destroy(&immutables_mutex);
+#endif
 }
 
 
@@ -245,6 +422,42 @@ Octstr *octstr_create_real(const char *cstr, const char *file, long line,
     return octstr_create_from_data_trace(cstr, strlen(cstr), file, line, func);
 }
 
+/* Allocate the structure, with room for 'extra' octets of data in an arena */
+static Octstr *struct_alloc(long extra, const char *file, long line,
+                            const char *func)
+{
+    Octstr *ostr;
+
+    if ((ostr = gw_arena_malloc(sizeof(*ostr) + extra)) != NULL)
+        ostr->arena = OCTSTR_ARENA;
+    else {
+        ostr = gw_slab_alloc_trace(OCTSTR_SLAB, file, line, func);
+        ostr->arena = 0;
+    }
+    return ostr;
+}
+
+
+#ifdef OCTSTR_SHARING
+/* Create a string sharing the data of 'ostr', which must be on the heap */
+static Octstr *share(const Octstr *ostr, const char *file, long line,
+                     const char *func)
+{
+    Octstr *copy;
+
+    copy = struct_alloc(0, file, line, func);
+    refs_add(DATA_REFS(ostr->data), 1);
+    copy->data = ostr->data;
+    copy->len = ostr->len;
+    copy->size = ostr->size;
+    copy->immutable = 0;
+    count_octets(octets_shared, ostr->len);
+    seems_valid(copy);
+    return copy;
+}
+#endif
+
+
 Octstr *octstr_create_from_data_real(const char *data, long len, const char *file,
                                      long line, const char *func)
 {
@@ -260,7 +473,7 @@ Octstr *octstr_create_from_data_real(const char *data, long len, const char *fil
     if (len < 0 || (data == NULL && len != 0))
         return NULL;
 
-    ostr = gw_malloc_trace(sizeof(*ostr), file, line, func);
+    ostr = struct_alloc(len > 0 ? len + 1 : 0, file, line, func);
     if (len == 0) {
         ostr->len = 0;
         ostr->size = 0;
@@ -268,7 +481,10 @@ Octstr *octstr_create_from_data_real(const char *data, long len, const char *fil
     } else {
         ostr->len = len;
         ostr->size = len + 1;
-        ostr->data = gw_malloc_trace(ostr->size, file, line, func);
+        if (ostr->arena)
+            ostr->data = (unsigned char *) (ostr + 1);
+        else
+            ostr->data = heap_alloc_real(ostr->size, file, line, func);
         memcpy(ostr->data, data, len);
         ostr->data[len] = '\0';
     }
@@ -278,42 +494,75 @@ Octstr *octstr_create_from_data_real(const char *data, long len, const char *fil
 }
 
 
+static Octstr *immutable_find(struct immutable *imm, unsigned char *data)
+{
+    for (; imm != NULL; imm = imm->next)
+        if (imm->os.data == data)
+            return &imm->os;
+    return NULL;
+}
+
+
+static struct immutable *immutable_create(unsigned char *data)
+{
+    struct immutable *imm;
+
+    /*
+     * Can't use octstr_create() because it copies the string,
+     * which would break our hashing.
+     */
+    imm = gw_malloc(sizeof(*imm));
+    imm->os.data = data;
+    imm->os.len = strlen((char *) data);
+    imm->os.size = imm->os.len + 1;
+    imm->os.immutable = 1;
+    imm->os.arena = 0;
+    imm->next = NULL;
+    seems_valid(&imm->os);
+    return imm;
+}
+
+
 Octstr *octstr_imm(const char *cstr)
 {
+    struct immutable **bucket, *imm;
+#ifdef IMMUTABLES_LOCK_FREE
+    struct immutable *head;
+#endif
     Octstr *os;
-    long i, index;
     unsigned char *data;
 
     gw_assert(immutables_init);
     gw_assert(cstr != NULL);
 
-    index = CSTR_TO_LONG(cstr) % MAX_IMMUTABLES;
     data = (unsigned char *) cstr;
-
+    bucket = &immutables[CSTR_TO_LONG(cstr) % IMMUTABLE_BUCKETS];
+
+#ifdef IMMUTABLES_LOCK_FREE
+    head = imm_load(bucket);
+    if ((os = immutable_find(head, data)) != NULL)
+        return os;
+
+    imm = immutable_create(data);
+    imm->next = head;
+    while (!imm_cas(bucket, &imm->next, imm)) {
+        /* the chain grew under us, maybe with this very string */
+        if ((os = immutable_find(imm->next, data)) != NULL) {
+            gw_free(imm);
+            return os;
+        }
+    }
+    os = &imm->os;
+#else
     mutex_lock(&immutables_mutex);
-    i = index;
-    for (; ; ) {
-	if (immutables[i] == NULL || immutables[i]->data == data)
-            break;
-        i = (i + 1) % MAX_IMMUTABLES;
-        if (i == index)
-            panic(0, "Too many immutable strings.");
-    }
-    os = immutables[i];
-    if (os == NULL) {
-	/*
-	 * Can't use octstr_create() because it copies the string,
-	 * which would break our hashing.
-	 */
-	os = gw_malloc(sizeof(*os));
-        os->data = data;
-        os->len = strlen(data);
-        os->size = os->len + 1;
-        os->immutable = 1;
-	immutables[i] = os;
-	seems_valid(os);
+    if ((os = immutable_find(*bucket, data)) == NULL) {
+        imm = immutable_create(data);
+        imm->next = *bucket;
+        *bucket = imm;
+        os = &imm->os;
     }
     mutex_unlock(&immutables_mutex);
+#endif
 
     return os;
 }
@@ -324,8 +573,11 @@ void octstr_destroy(Octstr *ostr)
     if (ostr != NULL) {
         seems_valid(ostr);
 	if (!ostr->immutable) {
-            gw_free(ostr->data);
-            gw_free(ostr);
+            data_free(ostr);
+            if (ostr->arena & OCTSTR_ARENA)
+                gw_arena_free(ostr);
+            else
+                gw_slab_free(octstr_slab, ostr);
         }
     }
 }
@@ -362,6 +614,11 @@ Octstr *octstr_copy_real(const Octstr *ostr, long from, long len, const char *fi
     if (len > ostr->len - from)
         len = ostr->len - from;
 
+#ifdef OCTSTR_SHARING
+    if (from == 0 && len == ostr->len && HEAP_DATA(ostr))
+        return share(ostr, file, line, func);
+#endif
+    count_octets(octets_copied, len);
     return octstr_create_from_data_trace(ostr->data + from, len, file,
                                          line, func);
 }
@@ -371,10 +628,27 @@ Octstr *octstr_copy_real(const Octstr *ostr, long from, long len, const char *fi
 Octstr *octstr_duplicate_real(const Octstr *ostr, const char *file, long line,
                               const char *func)
 {
+    gw_arena_t *arena;
+    Octstr *copy;
+
     if (ostr == NULL)
         return NULL;
     seems_valid_real(ostr, file, line, func);
-    return octstr_create_from_data_trace(ostr->data, ostr->len, file, line, func);
+
+    /* copies are what callers keep, so they must not pin arena blocks */
+    arena = gw_arena_suspend();
+#ifdef OCTSTR_SHARING
+    if (HEAP_DATA(ostr))
+        copy = share(ostr, file, line, func);
+    else
+#endif
+    {
+        count_octets(octets_copied, ostr->len);
+        copy = octstr_create_from_data_trace(ostr->data, ostr->len, file,
+                                             line, func);
+    }
+    gw_arena_resume(arena);
+    return copy;
 }
 
 
@@ -389,7 +663,7 @@ Octstr *octstr_cat(Octstr *ostr1, Octstr *ostr2)
     ostr = octstr_create("");
     ostr->len = ostr1->len + ostr2->len;
     ostr->size = ostr->len + 1;
-    ostr->data = gw_malloc(ostr->size);
+    ostr->data = data_alloc(ostr, ostr->size);
 
     if (ostr1->len > 0)
         memcpy(ostr->data, ostr1->data, ostr1->len);
@@ -415,6 +689,7 @@ void octstr_set_char(Octstr *ostr, long pos, int ch)
 {
     seems_valid(ostr);
     gw_assert(!ostr->immutable);
+    unshare(ostr);
     if (pos < ostr->len)
         ostr->data[pos] = ch;
     seems_valid(ostr);
@@ -453,6 +728,7 @@ void octstr_append_from_hex(Octstr *ostr, char *hex)
 	
     seems_valid(ostr);
     gw_assert(!ostr->immutable);
+    unshare(ostr);
 	
     output = octstr_create(hex);
     octstr_hex_to_binary(output);
@@ -468,6 +744,7 @@ void octstr_binary_to_hex(Octstr *ostr, int uppercase)
 
     seems_valid(ostr);
     gw_assert(!ostr->immutable);
+    unshare(ostr);
     if (ostr->len == 0)
         return;
 
@@ -497,6 +774,7 @@ int octstr_hex_to_binary(Octstr *ostr)
 
     seems_valid(ostr);
     gw_assert(!ostr->immutable);
+    unshare(ostr);
 
     if (ostr->len == 0)
         return 0;
@@ -551,6 +829,7 @@ void octstr_binary_to_base64(Octstr *ostr)
 
     seems_valid(ostr);
     gw_assert(!ostr->immutable);
+    unshare(ostr);
 
     if (ostr->len == 0) {
         /* Always terminate with CR LF */
@@ -670,6 +949,7 @@ void octstr_base64_to_binary(Octstr *ostr)
 
     seems_valid(ostr);
     gw_assert(!ostr->immutable);
+    unshare(ostr);
 
     len = ostr->len;
     data = ostr->data;
@@ -839,6 +1119,7 @@ void octstr_convert_range(Octstr *ostr, long pos, long len,
 
     seems_valid(ostr);
     gw_assert(!ostr->immutable);
+    unshare(ostr);
     gw_assert(len >= 0);
 
     if (pos >= ostr->len)
@@ -1283,6 +1564,7 @@ int octstr_append_from_socket(Octstr *ostr, int socket)
 
     seems_valid(ostr);
     gw_assert(!ostr->immutable);
+    unshare(ostr);
 
 again:
     len = recv(socket, buf, sizeof(buf), 0);
@@ -1308,6 +1590,7 @@ void octstr_insert(Octstr *ostr1, const Octstr *ostr2, long pos)
     seems_valid(ostr2);
     gw_assert(pos <= ostr1->len);
     gw_assert(!ostr1->immutable);
+    unshare(ostr1);
 
     if (ostr2->len == 0)
         return;
@@ -1330,6 +1613,7 @@ void octstr_truncate(Octstr *ostr, int new_len)
         
     seems_valid(ostr);
     gw_assert(!ostr->immutable);
+    unshare(ostr);
     gw_assert(new_len >= 0);
 
     if (new_len >= ostr->len)
@@ -1348,6 +1632,7 @@ void octstr_strip_blanks(Octstr *text)
 
     seems_valid(text);
     gw_assert(!text->immutable);
+    unshare(text);
 
     /* Remove white space from the beginning of the text */
     while (isspace(octstr_get_char(text, start)) && 
@@ -1380,6 +1665,7 @@ void octstr_strip_crlfs(Octstr *text)
 
     seems_valid(text);
     gw_assert(!text->immutable);
+    unshare(text);
 
     /* Remove white space from the beginning of the text */
     while (iscrlf(octstr_get_char(text, start)) && 
@@ -1407,6 +1693,7 @@ void octstr_strip_nonalphanums(Octstr *text)
 
     seems_valid(text);
     gw_assert(!text->immutable);
+    unshare(text);
 
     /* Remove white space from the beginning of the text */
     while (!isalnum(octstr_get_char(text, start)) && 
@@ -1435,6 +1722,7 @@ void octstr_shrink_blanks(Octstr *text)
 
     seems_valid(text);
     gw_assert(!text->immutable);
+    unshare(text);
 
     end = octstr_len(text);
 
@@ -1461,6 +1749,7 @@ void octstr_insert_data(Octstr *ostr, long pos, const char *data, long len)
 {
     seems_valid(ostr);
     gw_assert(!ostr->immutable);
+    unshare(ostr);
     gw_assert(pos <= ostr->len);
 
     if (len == 0)
@@ -1481,6 +1770,7 @@ void octstr_insert_char(Octstr *ostr, long pos, const char c)
 {
     seems_valid(ostr);
     gw_assert(!ostr->immutable);
+    unshare(ostr);
     gw_assert(pos <= ostr->len);
     
     octstr_grow(ostr, ostr->len + 1);
@@ -1527,6 +1817,7 @@ void octstr_delete(Octstr *ostr1, long pos, long len)
 {
     seems_valid(ostr1);
     gw_assert(!ostr1->immutable);
+    unshare(ostr1);
 
     if (pos > ostr1->len)
         pos = ostr1->len;
@@ -1680,6 +1971,7 @@ void octstr_url_encode(Octstr *ostr)
 
     seems_valid(ostr);
     gw_assert(!ostr->immutable);
+    unshare(ostr);
 
     if (ostr->len == 0)
         return;
@@ -1709,7 +2001,7 @@ void octstr_url_encode(Octstr *ostr)
      * NOTE: we don't do if (xxx) ... else ... because conditional jump
      * is not so fast as just compare (alex).
      */
-    res = str2 = (n ? gw_malloc((len = ostr->len + 2 * n + 1)) : ostr->data);
+    res = str2 = (n ? heap_alloc((len = ostr->len + 2 * n + 1)) : ostr->data);
 
     for (i = 0, str = ostr->data; i < ostr->len; i++) {
         c = *str++;
@@ -1732,7 +2024,7 @@ void octstr_url_encode(Octstr *ostr)
     
     /* we made replace in place */
     if (n) {
-        gw_free(ostr->data);
+        data_free(ostr);
         ostr->data = res;
         ostr->size = len;
         ostr->len = len - 1;
@@ -1753,6 +2045,7 @@ int octstr_url_decode(Octstr *ostr)
 
     seems_valid(ostr);
     gw_assert(!ostr->immutable);
+    unshare(ostr);
 
     if (ostr->len == 0)
         return 0;
@@ -1857,6 +2150,7 @@ void octstr_set_bits(Octstr *ostr, long bitpos, int numbits,
 
     seems_valid(ostr);
     gw_assert(!ostr->immutable);
+    unshare(ostr);
     gw_assert(bitpos >= 0);
     gw_assert(numbits <= 32);
     gw_assert(numbits >= 0);
@@ -2563,8 +2857,8 @@ static void seems_valid_real(const Octstr *ostr, const char *filename, long line
                         filename, lineno, function);
         gw_assert_place(ostr->data != NULL,
                         filename, lineno, function);
-	if (!ostr->immutable)
-            gw_assert_allocated(ostr->data,
+	if (HEAP_DATA(ostr))
+            gw_assert_allocated(DATA_REFS(ostr->data),
                                 filename, lineno, function);
         gw_assert_place(ostr->data[ostr->len] == '\0',
                         filename, lineno, function);
@@ -2618,6 +2912,7 @@ void octstr_strip_char(Octstr *text, char ch)
 
     seems_valid(text);
     gw_assert(!text->immutable);
+    unshare(text);
 
     /* Remove char from the beginning of the text */
     while ((ch == octstr_get_char(text, start)) &&
@@ -2681,6 +2976,7 @@ int octstr_symbolize(Octstr *ostr)
 
     seems_valid(ostr);
     gw_assert(!ostr->immutable);
+    unshare(ostr);
 
     if (ostr->len == 0)
         return 0;
@@ -2706,6 +3002,7 @@ void octstr_delete_matching(Octstr *haystack, Octstr *needle)
     seems_valid(haystack);
     seems_valid(needle);
     gw_assert(!haystack->immutable);
+    unshare(haystack);
     len = octstr_len(needle);
 
     while ((p = octstr_search(haystack, needle, p)) != -1) {
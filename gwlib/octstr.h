@@ -143,6 +143,8 @@ Octstr *octstr_create_from_data_real(const char *data, long len, const char *fil
  * octet string is destroyed. The immutable octet string need not be
  * destroyed - it is destroyed automatically when octstr_shutdown is
  * called. In fact, octstr_destroy is a no-op for immutables.
+ * Looking up a literal that was seen before takes no lock, and there
+ * is no limit on the number of immutables.
  */
 Octstr *octstr_imm(const char *cstr);
 
@@ -180,7 +182,9 @@ Octstr *octstr_copy_real(const Octstr *ostr, long from, long len, const char *fi
 
 
 /*
- * Copy all of an octet string.
+ * Copy all of an octet string. The copy shares the data of the original
+ * until either of them is modified, so duplicating long strings is cheap.
+ * The copy never comes from an arena (see gw-arena.h).
  */
 Octstr *octstr_duplicate_real(const Octstr *ostr, const char *file, long line,
                               const char *func);
@@ -68,6 +68,7 @@
  */
 
 #include <ctype.h>
+#include <errno.h>
 
 #include "gwlib/gwlib.h"
 #include "regex.h"
@@ -76,13 +77,205 @@
  * We allow to substitute the POSIX compliant regex routines via PCRE 
  * provided routines if no system own regex implementation is available.
  */
-#if defined(HAVE_REGEX) || defined(HAVE_PCRE)
+#if defined(HAVE_REGEX) || defined(HAVE_PCRE) || defined(HAVE_PCRE2)
+
+/*
+ * Patterns compiled by gw_regex_match() and gw_regex_subst(), keyed by
+ * the pattern. Entries stay until shutdown, so a regex_t taken from the
+ * cache remains valid while it is being used. Beyond REGEX_CACHE_MAX
+ * patterns we compile and throw away again, as we used to do always.
+ */
+#define REGEX_CACHE_MAX 1024
+
+static Dict *regex_cache = NULL;
+
+
+#ifdef HAVE_PCRE2
+
+/*
+ * Match data of the calling thread, big enough for REGEX_MAX_SUB_MATCH
+ * subexpressions. Freed by pthreads when the thread exits.
+ */
+static pthread_key_t match_data_key;
+
+
+static pcre2_match_data *thread_match_data(void)
+{
+    pcre2_match_data *md;
+
+    if ((md = pthread_getspecific(match_data_key)) == NULL) {
+        md = pcre2_match_data_create(REGEX_MAX_SUB_MATCH, NULL);
+        if (md == NULL)
+            panic(0, "Could not allocate PCRE2 match data.");
+        pthread_setspecific(match_data_key, md);
+    }
+    return md;
+}
+
+
+static void match_data_free(void *md)
+{
+    pcre2_match_data_free(md);
+}
+
+#endif
+
+
+void gw_regex_init(void)
+{
+#ifdef HAVE_PCRE2
+    if (pthread_key_create(&match_data_key, match_data_free) != 0)
+        panic(errno, "Could not create PCRE2 match data key.");
+#endif
+    regex_cache = dict_create(64, (void(*)(void *)) gw_regex_destroy);
+}
+
+
+void gw_regex_shutdown(void)
+{
+    dict_destroy(regex_cache);
+    regex_cache = NULL;
+#ifdef HAVE_PCRE2
+    match_data_free(pthread_getspecific(match_data_key));
+    pthread_setspecific(match_data_key, NULL);
+    pthread_key_delete(match_data_key);
+#endif
+}
 
 
 /********************************************************************
  * Generic regular expression functions.
  */
 
+#ifdef HAVE_PCRE2
+
+void gw_regex_destroy(regex_t *preg)
+{
+    if (preg == NULL)
+        return;
+
+    pcre2_code_free(preg->code);
+    gw_free(preg);
+}
+
+
+regex_t *gw_regex_comp_real(const Octstr *pattern, int cflags, const char *file, 
+                            long line, const char *func)
+{
+    regex_t *preg;
+    pcre2_code *code;
+    uint32_t options, nsub;
+    PCRE2_SIZE erroffset;
+    int rc;
+
+    options = 0;
+    if (cflags & REG_ICASE)
+        options |= PCRE2_CASELESS;
+    if (cflags & REG_NEWLINE)
+        options |= PCRE2_MULTILINE;
+
+    code = pcre2_compile((PCRE2_SPTR) (pattern ? octstr_get_cstr(pattern) : ""),
+                         PCRE2_ZERO_TERMINATED, options, &rc, &erroffset, NULL);
+    if (code == NULL) {
+        PCRE2_UCHAR buffer[512];
+        pcre2_get_error_message(rc, buffer, sizeof(buffer));
+        error(0, "%s:%ld: %s: regex compilation `%s' failed at offset %ld: %s "
+                 "(Called from %s:%ld:%s.)",
+              __FILE__, (long) __LINE__, __func__, octstr_get_cstr(pattern),
+              (long) erroffset, buffer, (file), (long) (line), (func));
+        return NULL;
+    }
+
+    /* without JIT support pcre2_match() just runs the interpreter */
+    pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+    pcre2_pattern_info(code, PCRE2_INFO_CAPTURECOUNT, &nsub);
+
+    preg = gw_malloc(sizeof(regex_t));
+    preg->code = code;
+    preg->re_nsub = nsub;
+    preg->cflags = cflags;
+
+    return preg;
+}
+
+
+int gw_regex_exec_real(const regex_t *preg, const Octstr *string, size_t nmatch, 
+                       regmatch_t pmatch[], int eflags, const char *file, long line, 
+                       const char *func)
+{
+    pcre2_match_data *md;
+    PCRE2_SIZE *ovector;
+    uint32_t options;
+    size_t i;
+    int rc;
+
+    gw_assert(preg != NULL);
+
+    if (preg->cflags & REG_NOSUB)
+        nmatch = 0;
+
+    options = 0;
+    if (eflags & REG_NOTBOL)
+        options |= PCRE2_NOTBOL;
+    if (eflags & REG_NOTEOL)
+        options |= PCRE2_NOTEOL;
+
+    /* rarely anyone asks for more, they get match data of their own */
+    if (nmatch > REGEX_MAX_SUB_MATCH)
+        md = pcre2_match_data_create(nmatch, NULL);
+    else
+        md = thread_match_data();
+
+    rc = pcre2_match(preg->code,
+                     (PCRE2_SPTR) (string ? octstr_get_cstr(string) : ""),
+                     octstr_len(string), 0, options, md, NULL);
+
+    /* rc == 0 means there were more subexpressions than match data */
+    if (rc >= 0) {
+        ovector = pcre2_get_ovector_pointer(md);
+        for (i = 0; i < nmatch; i++) {
+            if (i < pcre2_get_ovector_count(md) &&
+                    (rc == 0 || i < (size_t) rc) && ovector[2 * i] != PCRE2_UNSET) {
+                pmatch[i].rm_so = ovector[2 * i];
+                pmatch[i].rm_eo = ovector[2 * i + 1];
+            } else
+                pmatch[i].rm_so = pmatch[i].rm_eo = -1;
+        }
+        rc = 0;
+    } else if (rc == PCRE2_ERROR_NOMATCH) {
+        rc = REG_NOMATCH;
+    } else {
+        PCRE2_UCHAR buffer[512];
+        pcre2_get_error_message(rc, buffer, sizeof(buffer));
+        error(0, "%s:%ld: %s: regex execution on `%s' failed: %s (Called from %s:%ld:%s.)",
+              __FILE__, (long) __LINE__, __func__, octstr_get_cstr(string), buffer,
+              (file), (long) (line), (func));
+        rc = REG_ESPACE;
+    }
+
+    if (nmatch > REGEX_MAX_SUB_MATCH)
+        pcre2_match_data_free(md);
+
+    return rc;
+}
+
+
+Octstr *gw_regex_error(int errcode, const regex_t *preg)
+{
+    switch (errcode) {
+    case 0:
+        return octstr_create("Success");
+    case REG_NOMATCH:
+        return octstr_create("No match");
+    case REG_BADPAT:
+        return octstr_create("Invalid regular expression");
+    default:
+        return octstr_create("Regular expression execution failed");
+    }
+}
+
+#else
+
 void gw_regex_destroy(regex_t *preg)
 {
     if (preg == NULL)
@@ -147,6 +340,8 @@ Octstr *gw_regex_error(int errcode, const regex_t *preg)
     return os;
 }
 
+#endif  /* HAVE_PCRE2 */
+
 
 /* Duplicate a string. */
 static char *pstrdup(const char *s)
@@ -248,21 +443,53 @@ char *gw_regex_sub(const char *input, const char *source,
  * reused and re-matched on variable string patterns.
  */
 
+/*
+ * Get the compiled RE for pattern 're' from the cache, compiling it if
+ * needed. Sets *cached to 0 if the caller has to destroy the result.
+ */
+static regex_t *cache_comp(const Octstr *re, int *cached, const char *file, 
+                           long line, const char *func)
+{
+    regex_t *regexp, *other;
+
+    *cached = 1;
+    if (re != NULL && (regexp = dict_get(regex_cache, (Octstr *) re)) != NULL)
+        return regexp;
+
+    regexp = gw_regex_comp_real(re, REG_EXTENDED|REG_ICASE, file, line, func);
+    if (regexp == NULL || re == NULL ||
+            dict_key_count(regex_cache) >= REGEX_CACHE_MAX) {
+        *cached = 0;
+        return regexp;
+    }
+
+    /* somebody else may have been compiling the same pattern */
+    if (!dict_put_once(regex_cache, (Octstr *) re, regexp)) {
+        other = dict_get(regex_cache, (Octstr *) re);
+        gw_regex_destroy(regexp);
+        regexp = other;
+    }
+
+    return regexp;
+}
+
+
 int gw_regex_match_real(const Octstr *re, const Octstr *os, const char *file, 
                         long line, const char *func)
 {
     regex_t *regexp;
-    int rc;
+    int rc, cached;
 
     /* compile */
-    regexp = gw_regex_comp_real(re, REG_EXTENDED|REG_ICASE, file, line, func);
+    regexp = cache_comp(re, &cached, file, line, func);
     if (regexp == NULL)
         return 0;
 
     /* execute and match */
     rc = gw_regex_exec_real(regexp, os, 0, NULL, 0, file, line, func);
 
-    gw_regex_destroy(regexp);
+    if (!cached)
+        gw_regex_destroy(regexp);
 
     return (rc == 0) ? 1 : 0;
 }
@@ -288,18 +515,19 @@ Octstr *gw_regex_subst_real(const Octstr *re, const Octstr *os, const Octstr *ru
     Octstr *result;
     regex_t *regexp;
     regmatch_t pmatch[REGEX_MAX_SUB_MATCH];
-    int rc;
+    int rc, cached;
     char *rsub;
 
     /* compile */
-    regexp = gw_regex_comp_real(re, REG_EXTENDED|REG_ICASE, file, line, func);
+    regexp = cache_comp(re, &cached, file, line, func);
     if (regexp == NULL)
         return 0;
 
     /* execute and match */
     rc = gw_regex_exec_real(regexp, os, REGEX_MAX_SUB_MATCH, &pmatch[0], 0, 
                             file, line, func);
-    gw_regex_destroy(regexp);
+    if (!cached)
+        gw_regex_destroy(regexp);
 
     /* substitute via rule if matched */
     if (rc != 0)
@@ -346,5 +574,16 @@ Octstr *gw_regex_subst_pre_real(const regex_t *preg, const Octstr *os, const Oct
     return result;
 }
 
-#endif  /* HAVE_REGEX || HAVE_PCRE */
+#else
+
+void gw_regex_init(void)
+{
+}
+
+
+void gw_regex_shutdown(void)
+{
+}
+
+#endif  /* HAVE_REGEX || HAVE_PCRE || HAVE_PCRE2 */
 
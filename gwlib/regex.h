@@ -67,19 +67,80 @@
  * PCRE allows wrapper functions for POSIX regex via an own API. So we
  * use PCRE in favor, before falling back to POSIX regex.
  *
+ * With PCRE2 the functions below use the native PCRE2 API instead: patterns
+ * are JIT compiled where the platform supports it, and each thread reuses
+ * its own match data. regex_t, regmatch_t and the REG_* flags are then
+ * provided here, the way pcreposix.h does, so callers don't need to know
+ * which engine is in use. Basic REs (no REG_EXTENDED) are not supported
+ * by that engine, and extended REs do not always mean the same:
+ *   - alternation is leftmost-first, not leftmost-longest, so "12|123"
+ *     matches "12" of "1234" where POSIX matches "123". Whether a pattern
+ *     matches at all does not change, but the matched part, submatches
+ *     and gw_regex_subst() results can.
+ *   - a backslash inside a bracket expression is an escape, so "[\d]" is
+ *     any digit rather than '\' or 'd'.
+ *   - '.' does not match a newline and '$' also matches before a final
+ *     newline.
+ *   - [[.x.]] and [[=x=]] are errors, and the GNU \< and \> are not
+ *     word boundaries.
+ *
  * Stipe Tolj <stolj@kannel.org>
  */
 
 #ifndef REGEX_H
 #define REGEX_H
 
-#ifdef HAVE_PCRE
+#ifdef HAVE_PCRE2
+# define PCRE2_CODE_UNIT_WIDTH 8
+# include <pcre2.h>
+#elif HAVE_PCRE
 # include <pcreposix.h>
 #elif HAVE_REGEX
 # include <regex.h>
 #endif
 
-#if defined(HAVE_REGEX) || defined(HAVE_PCRE)
+
+/*
+ * Initialize and shut down the module. Called by gwlib_init() and
+ * gwlib_shutdown(), and no-ops when there is no regex support.
+ */
+void gw_regex_init(void);
+void gw_regex_shutdown(void);
+
+
+#if defined(HAVE_REGEX) || defined(HAVE_PCRE) || defined(HAVE_PCRE2)
+
+#ifdef HAVE_PCRE2
+
+typedef struct {
+    size_t re_nsub;         /* number of parenthesized subexpressions */
+    pcre2_code *code;
+    int cflags;
+} regex_t;
+
+typedef int regoff_t;
+
+typedef struct {
+    regoff_t rm_so;
+    regoff_t rm_eo;
+} regmatch_t;
+
+/* cflags for gw_regex_comp() */
+#define REG_EXTENDED    0x0001
+#define REG_ICASE       0x0002
+#define REG_NOSUB       0x0004
+#define REG_NEWLINE     0x0008
+
+/* eflags for gw_regex_exec() */
+#define REG_NOTBOL      0x0001
+#define REG_NOTEOL      0x0002
+
+/* error codes of gw_regex_exec() */
+#define REG_NOMATCH     1
+#define REG_BADPAT      2
+#define REG_ESPACE      3
+
+#endif
 
 
 /*
@@ -145,7 +206,8 @@ char *gw_regex_sub(const char *input, const char *source,
 /*
  * Match directly a given regular expression and a source string. This assumes
  * that the RE has not been pre-compiled and hence perform the compile and 
- * exec step in this matching step.
+ * exec step in this matching step. Compiled REs are cached by pattern, so
+ * repeated calls with the same pattern only compile it once.
  * Return 1 if the regular expression is successfully matching, 0 otherwise.
  */
 int gw_regex_match_real(const Octstr *re, const Octstr *os, const char *file, 
@@ -167,7 +229,8 @@ int gw_regex_match_pre_real(const regex_t *preg, const Octstr *os, const char *f
 
 /*
  * Match directly a given regular expression and a source string. RE has not
- * been precompiled. Apply substitution rule accoding to Octstr 'rule' and
+ * been precompiled, but is looked up in the same cache as gw_regex_match()
+ * uses. Apply substitution rule accoding to Octstr 'rule' and
  * return the substituted Ocstr as result. Return NULL if failed.
  * Use \$0 up to \$9 as escape codes for subexpression matchings in the rule.
  * Ie. os="+4914287756", re="^(00|\+)([0-9]{6,20})$" rule="\$2" would cause
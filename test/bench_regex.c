@@ -0,0 +1,215 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * bench_regex.c - measure the per message cost of routing regexes
+ *
+ * Runs the kind of regexes bearerbox evaluates for every message (smsc
+ * allowed/denied/preferred prefixes, allowed/denied smsc-id, white and
+ * black lists) against varying receivers from a number of threads, and
+ * reports the time spent per message. With -s it also times
+ * gw_regex_subst(), which compiles its pattern on the fly.
+ *
+ * Build once with and once without --enable-pcre2 to compare engines.
+ */
+
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "gwlib/gwlib.h"
+#include "gwlib/regex.h"
+
+#if defined(HAVE_REGEX) || defined(HAVE_PCRE) || defined(HAVE_PCRE2)
+
+static char *patterns[] = {
+    "^(\\+?49|0049)(15[0-9]|16[0-9]|17[0-9])[0-9]{7,8}$",   /* allowed-prefix */
+    "^(\\+?49|0049)(900|180)",                              /* denied-prefix */
+    "^(\\+?49|0049)17[0-9]",                                /* preferred-prefix */
+    "^(smsc-[a-z]+-[0-9]+|backup)$",                        /* allowed-smsc-id */
+    "^test-",                                               /* denied-smsc-id */
+    "^(\\+|00)?[1-9][0-9]{6,14}$",                          /* white-list */
+    "^(\\+|00)?49(1234567|7654321)[0-9]*$",                 /* black-list */
+};
+#define NUM_PATTERNS (sizeof(patterns) / sizeof(patterns[0]))
+
+/* receivers and smsc-ids are set up front, so only the regexes are timed */
+#define NUM_ADDRESSES 1024
+
+static regex_t *compiled[NUM_PATTERNS];
+static Octstr *receivers[NUM_ADDRESSES];
+static Octstr *smsc_ids[NUM_ADDRESSES];
+static long messages = 100000;
+static int subst = 0;
+
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+static void route_messages(void *arg)
+{
+    Octstr *receiver, *smsc_id, *res, *re, *rule;
+    long i, matched;
+    unsigned int j;
+
+    re = octstr_imm("^(00|\\+)([0-9]{6,20})$");
+    rule = octstr_imm("$2");
+    matched = 0;
+    for (i = 0; i < messages; i++) {
+        receiver = receivers[i % NUM_ADDRESSES];
+        smsc_id = smsc_ids[i % NUM_ADDRESSES];
+        for (j = 0; j < NUM_PATTERNS; j++)
+            matched += gw_regex_match_pre(compiled[j], j == 3 || j == 4 ?
+                                          smsc_id : receiver);
+        if (subst) {
+            res = gw_regex_subst(re, receiver, rule);
+            octstr_destroy(res);
+        }
+    }
+    debug("test.regex", 0, "%ld regex matches", matched);
+}
+
+
+static void help(void)
+{
+    info(0, "Usage: bench_regex [options]");
+    info(0, "where options are:");
+    info(0, "-n number      messages per thread (default 100000)");
+    info(0, "-t number      threads (default 1)");
+    info(0, "-s             also time gw_regex_subst() per message");
+}
+
+
+int main(int argc, char **argv)
+{
+    int opt;
+    long i, threads, *ids;
+    double start, elapsed;
+    Octstr *os;
+
+    gwlib_init();
+
+    threads = 1;
+    while ((opt = getopt(argc, argv, "hv:n:t:s")) != EOF) {
+        switch (opt) {
+        case 'v':
+            log_set_output_level(atoi(optarg));
+            break;
+        case 'n':
+            messages = atol(optarg);
+            break;
+        case 't':
+            threads = atol(optarg);
+            break;
+        case 's':
+            subst = 1;
+            break;
+        case 'h':
+        default:
+            help();
+            exit(0);
+        }
+    }
+
+    for (i = 0; i < (long) NUM_PATTERNS; i++) {
+        os = octstr_create(patterns[i]);
+        if ((compiled[i] = gw_regex_comp(os, REG_EXTENDED)) == NULL)
+            panic(0, "Could not compile `%s'.", patterns[i]);
+        octstr_destroy(os);
+    }
+
+    for (i = 0; i < NUM_ADDRESSES; i++) {
+        receivers[i] = octstr_format("+491%02ld%07ld", i % 100, i * 7919);
+        smsc_ids[i] = octstr_format("smsc-route-%ld", i % 8);
+    }
+
+    ids = gw_malloc(threads * sizeof(*ids));
+    start = now();
+    for (i = 0; i < threads; i++)
+        ids[i] = gwthread_create(route_messages, NULL);
+    for (i = 0; i < threads; i++)
+        gwthread_join(ids[i]);
+    elapsed = now() - start;
+
+    info(0, "%ld messages, %ld threads, %d regexes%s: %.3f secs, %.2f usec/msg",
+         messages * threads, threads, (int) NUM_PATTERNS,
+         subst ? " + subst" : "", elapsed, elapsed * 1e6 / (messages * threads));
+
+    gw_free(ids);
+    for (i = 0; i < NUM_ADDRESSES; i++) {
+        octstr_destroy(receivers[i]);
+        octstr_destroy(smsc_ids[i]);
+    }
+    for (i = 0; i < (long) NUM_PATTERNS; i++)
+        gw_regex_destroy(compiled[i]);
+    gwlib_shutdown();
+    return 0;
+}
+
+#else
+
+int main(void)
+{
+    panic(0, "No regex support compiled in.");
+    return 1;
+}
+
+#endif
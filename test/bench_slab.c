@@ -0,0 +1,227 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * bench_slab.c - compare slab caches with the native allocator
+ *
+ * Mimics how bearerbox handles messages: producer threads allocate a
+ * message worth of fixed-size objects (an Msg, a List, a few Octstr
+ * headers and Dict items), keep a window of them alive and hand the
+ * rest to consumer threads through a queue, which free them. Objects
+ * thus mostly die in other threads than they were born in.
+ *
+ * Run once with -m slab and once with -m malloc and compare the time
+ * per message and the maximum resident set size.
+ */
+
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "gwlib/gwlib.h"
+
+/* object sizes of one message, roughly those of bearerbox on 64 bits */
+static size_t sizes[] = { 640, 208, 32, 32, 32, 32, 32, 16, 16 };
+#define NUM_OBJECTS (sizeof(sizes) / sizeof(sizes[0]))
+
+/* messages a producer keeps alive before handing them on */
+#define WINDOW 256
+
+/* messages waiting for the consumers at most */
+#define QUEUE_BOUND 4096
+
+struct message {
+    void *objs[NUM_OBJECTS];
+};
+
+static gw_slab_t *slabs[NUM_OBJECTS];
+static gw_queue_t *queue;
+static long messages = 1000000;
+static int use_slab = 1;
+
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+static struct message *message_create(void)
+{
+    struct message *msg;
+    unsigned int i;
+
+    msg = gw_malloc(sizeof(*msg));
+    for (i = 0; i < NUM_OBJECTS; i++) {
+        msg->objs[i] = use_slab ? gw_slab_alloc(slabs[i]) : gw_malloc(sizes[i]);
+        memset(msg->objs[i], 0, sizes[i]);
+    }
+    return msg;
+}
+
+
+static void message_destroy(void *arg)
+{
+    struct message *msg = arg;
+    unsigned int i;
+
+    for (i = 0; i < NUM_OBJECTS; i++) {
+        if (use_slab)
+            gw_slab_free(slabs[i], msg->objs[i]);
+        else
+            gw_free(msg->objs[i]);
+    }
+    gw_free(msg);
+}
+
+
+static void producer(void *arg)
+{
+    struct message *window[WINDOW];
+    long i;
+
+    for (i = 0; i < messages; i++) {
+        if (i >= WINDOW)
+            while (gw_queue_produce(queue, window[i % WINDOW]) == -1)
+                sched_yield();
+        window[i % WINDOW] = message_create();
+    }
+    for (i = 0; i < WINDOW && i < messages; i++)
+        message_destroy(window[i]);
+    gw_queue_remove_producer(queue);
+}
+
+
+static void consumer(void *arg)
+{
+    struct message *msg;
+
+    while ((msg = gw_queue_consume(queue)) != NULL)
+        message_destroy(msg);
+}
+
+
+static void help(void)
+{
+    info(0, "Usage: bench_slab [options]");
+    info(0, "where options are:");
+    info(0, "-n number      messages per producer (default 1000000)");
+    info(0, "-t number      producers and consumers each (default 2)");
+    info(0, "-m slab|malloc allocate objects from slabs or gw_malloc (default slab)");
+}
+
+
+int main(int argc, char **argv)
+{
+    int opt;
+    long i, threads;
+    double start, elapsed;
+    struct rusage usage;
+    static char names[NUM_OBJECTS][16];
+
+    gwlib_init();
+
+    threads = 2;
+    while ((opt = getopt(argc, argv, "hv:n:t:m:")) != EOF) {
+        switch (opt) {
+        case 'v':
+            log_set_output_level(atoi(optarg));
+            break;
+        case 'n':
+            messages = atol(optarg);
+            break;
+        case 't':
+            threads = atol(optarg);
+            break;
+        case 'm':
+            use_slab = (strcmp(optarg, "malloc") != 0);
+            break;
+        case 'h':
+        default:
+            help();
+            exit(0);
+        }
+    }
+
+    for (i = 0; i < (long) NUM_OBJECTS; i++) {
+        sprintf(names[i], "bench-%ld", i);
+        gw_slab_get(&slabs[i], names[i], sizes[i]);
+    }
+
+    queue = gw_queue_create(QUEUE_BOUND);
+    start = now();
+    for (i = 0; i < threads; i++) {
+        gw_queue_add_producer(queue);
+        gwthread_create(producer, NULL);
+        gwthread_create(consumer, NULL);
+    }
+    gwthread_join_every(producer);
+    gwthread_join_every(consumer);
+    elapsed = now() - start;
+    gw_queue_destroy(queue, NULL);
+
+    getrusage(RUSAGE_SELF, &usage);
+    info(0, "%s: %ld messages, %ld threads: %.3f secs, %.3f usec/msg, max RSS %ld kB",
+         use_slab ? "slab" : "malloc", messages * threads, threads * 2,
+         elapsed, elapsed * 1e6 / (messages * threads), usage.ru_maxrss);
+
+    gwlib_shutdown();
+    return 0;
+}
@@ -0,0 +1,242 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+
+/*
+ * bench_smpp_pdu.c - micro benchmark for the SMPP PDU codec
+ *
+ * Packs and unpacks submit_sm and deliver_sm PDUs in a loop, checks that
+ * the round trip gives back the same PDU and reports the rate. Give a
+ * configuration file with smpp-tlv groups to include configured TLVs.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "gwlib/gwlib.h"
+#include "gw/smsc/smpp_pdu.h"
+
+static void help(void)
+{
+    info(0, "Usage: bench_smpp_pdu [-n count] [-i smsc-id] [-t name=value] [config]\n"
+            "where -n is the number of round trips per PDU type (default 100000),\n"
+            "-i the smsc-id used for smpp-tlv lookups and -t adds a configured\n"
+            "TLV to each PDU (may be given several times).");
+}
+
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+static SMPP_PDU *make_pdu(unsigned long type, List *tlvs)
+{
+    SMPP_PDU *pdu;
+    Octstr *name, *value;
+    long i;
+
+    pdu = smpp_pdu_create(type, 1);
+    switch (type) {
+    case submit_sm:
+        pdu->u.submit_sm.source_addr = octstr_create("12345");
+        pdu->u.submit_sm.destination_addr = octstr_create("358401234567");
+        pdu->u.submit_sm.short_message =
+            octstr_create("The quick brown fox jumps over the lazy dog 0123456789");
+        pdu->u.submit_sm.registered_delivery = 1;
+        pdu->u.submit_sm.user_message_reference = 42;
+        for (i = 0; i < gwlist_len(tlvs); i += 2) {
+            name = gwlist_get(tlvs, i);
+            value = gwlist_get(tlvs, i + 1);
+            dict_put(pdu->u.submit_sm.tlv, name, octstr_duplicate(value));
+        }
+        break;
+    case deliver_sm:
+        pdu->u.deliver_sm.source_addr = octstr_create("358401234567");
+        pdu->u.deliver_sm.destination_addr = octstr_create("12345");
+        pdu->u.deliver_sm.short_message =
+            octstr_create("id:0123456789 sub:001 dlvrd:001 submit date:0610161200 "
+                          "done date:0610161201 stat:DELIVRD err:000 text:hello");
+        pdu->u.deliver_sm.esm_class = 0x04;
+        pdu->u.deliver_sm.receipted_message_id = octstr_create("0123456789");
+        pdu->u.deliver_sm.message_state = 2;
+        for (i = 0; i < gwlist_len(tlvs); i += 2) {
+            name = gwlist_get(tlvs, i);
+            value = gwlist_get(tlvs, i + 1);
+            dict_put(pdu->u.deliver_sm.tlv, name, octstr_duplicate(value));
+        }
+        break;
+    }
+
+    return pdu;
+}
+
+
+static void bench(Octstr *smsc_id, unsigned long type, List *tlvs, long count)
+{
+    SMPP_PDU *pdu, *pdu2;
+    SMPP_TLV_Table *tlv_table;
+    Octstr *os, *os2, *body;
+    double start, packed, unpacked;
+    long i;
+
+    pdu = make_pdu(type, tlvs);
+    tlv_table = smpp_pdu_tlv_table(smsc_id);
+
+    /* one round trip has to give the same octets */
+    os = smpp_pdu_pack(smsc_id, pdu);
+    body = octstr_copy(os, 4, octstr_len(os) - 4);
+    pdu2 = smpp_pdu_unpack(smsc_id, body);
+    if (pdu2 == NULL)
+        panic(0, "%s: could not unpack packed PDU", pdu->type_name);
+    os2 = smpp_pdu_pack(smsc_id, pdu2);
+    if (octstr_compare(os, os2) != 0) {
+        octstr_dump(os, 0);
+        octstr_dump(os2, 0);
+        panic(0, "%s: round trip gave a different PDU", pdu->type_name);
+    }
+    smpp_pdu_destroy(pdu2);
+    octstr_destroy(os2);
+    octstr_destroy(os);
+
+    /* time it the way smsc_smpp uses it, with the table looked up once */
+    start = now();
+    for (i = 0; i < count; i++)
+        octstr_destroy(smpp_pdu_pack_table(tlv_table, pdu));
+    packed = now();
+    for (i = 0; i < count; i++)
+        smpp_pdu_destroy(smpp_pdu_unpack_table(tlv_table, body));
+    unpacked = now();
+
+    info(0, "%s (%ld octets): pack %.0f/s, unpack %.0f/s", pdu->type_name,
+         octstr_len(body) + 4, count / (packed - start), count / (unpacked - packed));
+
+    octstr_destroy(body);
+    smpp_pdu_destroy(pdu);
+}
+
+
+int main(int argc, char **argv)
+{
+    int opt;
+    long count;
+    Octstr *smsc_id, *name;
+    List *tlvs;
+    Cfg *cfg;
+
+    gwlib_init();
+
+    count = 100000;
+    smsc_id = NULL;
+    tlvs = gwlist_create();
+
+    while ((opt = getopt(argc, argv, "hn:i:t:")) != EOF) {
+        switch (opt) {
+        case 'n':
+            count = atol(optarg);
+            break;
+        case 'i':
+            octstr_destroy(smsc_id);
+            smsc_id = octstr_create(optarg);
+            break;
+        case 't': {
+            Octstr *arg = octstr_create(optarg);
+            long eq = octstr_search_char(arg, '=', 0);
+
+            if (eq == -1)
+                panic(0, "TLV has to be given as name=value.");
+            gwlist_append(tlvs, octstr_copy(arg, 0, eq));
+            gwlist_append(tlvs, octstr_copy(arg, eq + 1, octstr_len(arg)));
+            octstr_destroy(arg);
+            break;
+        }
+        case 'h':
+            help();
+            exit(0);
+        case '?':
+        default:
+            error(0, "Invalid option %c", opt);
+            help();
+            panic(0, "Stopping.");
+        }
+    }
+
+    name = octstr_create(optind < argc ? argv[optind] : "");
+    cfg = cfg_create(name);
+    octstr_destroy(name);
+    if (optind < argc && cfg_read(cfg) == -1)
+        panic(0, "Couldn't read configuration file.");
+    if (smpp_pdu_init(cfg) == -1)
+        panic(0, "Couldn't read smpp-tlv groups.");
+
+    /* the decoder logs every optional parameter at debug level */
+    log_set_output_level(GW_INFO);
+
+    bench(smsc_id, submit_sm, tlvs, count);
+    bench(smsc_id, deliver_sm, tlvs, count);
+
+    smpp_pdu_shutdown();
+    cfg_destroy(cfg);
+    gwlist_destroy(tlvs, octstr_destroy_item);
+    octstr_destroy(smsc_id);
+    gwlib_shutdown();
+    return 0;
+}
@@ -0,0 +1,1038 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0
+ *
+ * Copyright (c) 2001-2014 Kannel Group
+ * Copyright (c) 1998-2001 WapIT Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The end-user documentation included with the redistribution,
+ *    if any, must include the following acknowledgment:
+ *       "This product includes software developed by the
+ *        Kannel Group (http://www.kannel.org/)."
+ *    Alternately, this acknowledgment may appear in the software itself,
+ *    if and wherever such third-party acknowledgments normally appear.
+ *
+ * 4. The names "Kannel" and "Kannel Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please
+ *    contact org@kannel.org.
+ *
+ * 5. Products derived from this software may not be called "Kannel",
+ *    nor may "Kannel" appear in their name, without prior written
+ *    permission of the Kannel Group.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Kannel Group.  For more information on
+ * the Kannel Group, please see <http://www.kannel.org/>.
+ *
+ * Portions of this software are based upon software originally written at
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.
+ */
+
+/*
+ * smpp_sim.c - SMPP 3.4 SMS center simulator and load generator
+ *
+ * Accepts any number of binds from bearerbox. Each submit_sm is answered
+ * after a configurable latency, a given percentage of them with an error
+ * status, and a delivery report is sent for every submit that asks for
+ * one. MO messages are generated at a fixed rate over the receiving
+ * binds, and sendsms requests can be made at a fixed rate as well.
+ *
+ * Every generated message carries its own number as text. The submit_sm
+ * that brings the number back (the reply to the MO, or the MT itself)
+ * completes it, so the time in between is the end-to-end latency through
+ * bearerbox and smsbox. Throughput and latency percentiles are logged
+ * when all messages are done or nothing has happened for a while.
+ */
+
+
+#include <errno.h>
+#include <signal.h>
+#include <math.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gwlib/gwlib.h"
+#include "gw/smsc/smpp_pdu.h"
+
+
+/***********************************************************************
+ * Configurable stuff.
+ */
+
+static int port = 2345;
+static long num_mo = 0;		/* MO messages to generate */
+static double mo_rate = 0;	/* MO messages per second, 0 = no limit */
+static long mo_window = 100;	/* MO messages without deliver_sm_resp */
+static Octstr *sendsms_url = NULL;
+static long num_mt = 0;		/* sendsms requests to make */
+static double mt_rate = 0;	/* sendsms requests per second, 0 = no limit */
+/*
+ * sendsms requests without a reply. More connections at once than the
+ * listen backlog of gwlib (10) leads to SYN retransmits, which show up
+ * as latency of seconds.
+ */
+static long mt_window = 10;
+static double resp_delay = 0;	/* seconds before submit_sm_resp */
+static double error_percent = 0; /* submits answered with error_status */
+static long error_status = SMPP_ESME_RSUBMITFAIL;
+static double dlr_delay = 1;	/* seconds from submit_sm_resp to DLR */
+static long dlr_port = 0;	/* HTTP port for dlr-url callbacks, 0 = none */
+static double idle_timeout = 10; /* give up after this many idle seconds */
+static double start_delay = 1;	/* seconds from the first bind to the load */
+static Octstr *data_file = NULL; /* per message latencies */
+
+
+/***********************************************************************
+ * State.
+ */
+
+static volatile sig_atomic_t quitting = 0;
+static List *esmes;		/* all binds, never shrinks */
+static Counter *seq_counter;
+static Counter *msgid_counter;
+static Counter *num_to_esme;	/* deliver_sm with MO */
+static Counter *num_deliver_resp;
+static Counter *num_deliver_nack;
+static Counter *num_submits;
+static Counter *num_submit_errors;
+static Counter *num_dlrs;
+static Counter *num_http_ok;
+static Counter *num_http_failed;
+static Counter *num_dlr_callbacks;
+
+static Mutex *times_lock;
+static double *sent_time;	/* when message i was generated */
+static double *latency;		/* -1 until message i is completed */
+#define REFUSED -2		/* latency of a message refused by us */
+static long num_done;
+static long num_refused;
+static double first_sent = -1;
+static double last_done = -1;
+static double last_event;
+
+static long mo_thread_id = -1;
+static long mt_thread_id = -1;
+static double first_bind = -1;
+static List *resp_queue;	/* delayed submit_sm_resp */
+static List *dlr_queue;		/* delayed delivery reports */
+
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+static void quit(void)
+{
+    quitting = 1;
+    gwthread_wakeup_all();
+}
+
+
+/***********************************************************************
+ * Binds.
+ */
+
+typedef struct {
+    Connection *conn;
+    long thread;
+    int transmitter;
+    int receiver;
+    long version;
+    long pending;	/* MO messages sent but not answered */
+} ESME;
+
+
+static ESME *esme_create(Connection *conn)
+{
+    ESME *esme;
+
+    esme = gw_malloc(sizeof(*esme));
+    esme->conn = conn;
+    esme->thread = -1;
+    esme->transmitter = 0;
+    esme->receiver = 0;
+    esme->version = 0;
+    esme->pending = 0;
+    return esme;
+}
+
+
+static void esme_destroy(void *p)
+{
+    ESME *esme = p;
+
+    conn_destroy(esme->conn);
+    gw_free(esme);
+}
+
+
+static void esme_send(ESME *esme, SMPP_PDU *pdu)
+{
+    Octstr *os;
+
+    os = smpp_pdu_pack(NULL, pdu);
+    if (os != NULL)
+        conn_write(esme->conn, os);
+    octstr_destroy(os);
+    smpp_pdu_destroy(pdu);
+}
+
+
+/*
+ * A PDU to send to an ESME once its time has come.
+ */
+typedef struct {
+    ESME *esme;
+    SMPP_PDU *pdu;
+    double due;
+} Delayed;
+
+
+static void delay_pdu(List *queue, ESME *esme, SMPP_PDU *pdu, double delay)
+{
+    Delayed *d;
+
+    if (delay <= 0) {
+        esme_send(esme, pdu);
+        return;
+    }
+    d = gw_malloc(sizeof(*d));
+    d->esme = esme;
+    d->pdu = pdu;
+    d->due = now() + delay;
+    gwlist_produce(queue, d);
+}
+
+
+/*
+ * Each queue has one delay, so the PDUs in it are due in order.
+ */
+static void delayed_thread(void *arg)
+{
+    List *queue = arg;
+    Delayed *d;
+    double t;
+
+    while ((d = gwlist_consume(queue)) != NULL) {
+        while (!quitting && (t = d->due - now()) > 0)
+            gwthread_sleep(t);
+        esme_send(d->esme, d->pdu);
+        gw_free(d);
+    }
+}
+
+
+static Octstr *make_dlr_text(Octstr *msgid, Octstr *text)
+{
+    Octstr *date, *head, *res;
+    struct tm tm;
+
+    tm = gw_gmtime(time(NULL));
+    date = octstr_format("%02d%02d%02d%02d%02d", tm.tm_year % 100,
+                         tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min);
+    head = text != NULL ? octstr_copy(text, 0, 20) : octstr_create("");
+    res = octstr_format("id:%S sub:001 dlvrd:001 submit date:%S done date:%S "
+                        "stat:DELIVRD err:000 text:%S", msgid, date, date, head);
+    octstr_destroy(head);
+    octstr_destroy(date);
+    return res;
+}
+
+
+/***********************************************************************
+ * Completion bookkeeping.
+ */
+
+/*
+ * Note that something happened, for the idle timeout.
+ */
+static void touch(void)
+{
+    double t = now();
+
+    mutex_lock(times_lock);
+    last_event = t;
+    mutex_unlock(times_lock);
+}
+
+
+static void message_sent(long id)
+{
+    double t = now();
+
+    mutex_lock(times_lock);
+    sent_time[id] = t;
+    if (first_sent < 0)
+        first_sent = t;
+    last_event = t;
+    mutex_unlock(times_lock);
+}
+
+
+/*
+ * Message with the number in text came back in a submit_sm. If the
+ * submit was refused it counts as done, unless it comes back later.
+ */
+static void message_done(Octstr *text, int refused)
+{
+    long id;
+    double t = now();
+
+    if (text == NULL || octstr_parse_long(&id, text, 0, 10) == -1 || id < 0 ||
+        id >= num_mo + num_mt)
+        return;
+
+    mutex_lock(times_lock);
+    last_event = t;
+    if (sent_time[id] >= 0 && latency[id] < 0) {
+        if (latency[id] == REFUSED)
+            num_refused--;
+        if (refused) {
+            latency[id] = REFUSED;
+            num_refused++;
+        } else {
+            latency[id] = t - sent_time[id];
+            last_done = t;
+            num_done++;
+        }
+    }
+    mutex_unlock(times_lock);
+}
+
+
+/***********************************************************************
+ * PDU handlers.
+ */
+
+static SMPP_PDU *handle_bind_transmitter(ESME *esme, SMPP_PDU *pdu)
+{
+    SMPP_PDU *resp;
+
+    esme->transmitter = 1;
+    esme->version = pdu->u.bind_transmitter.interface_version;
+    resp = smpp_pdu_create(bind_transmitter_resp,
+                           pdu->u.bind_transmitter.sequence_number);
+    resp->u.bind_transmitter_resp.system_id = octstr_create("smpp_sim");
+    return resp;
+}
+
+
+static SMPP_PDU *handle_bind_receiver(ESME *esme, SMPP_PDU *pdu)
+{
+    SMPP_PDU *resp;
+
+    esme->receiver = 1;
+    esme->version = pdu->u.bind_receiver.interface_version;
+    resp = smpp_pdu_create(bind_receiver_resp,
+                           pdu->u.bind_receiver.sequence_number);
+    resp->u.bind_receiver_resp.system_id = octstr_create("smpp_sim");
+    return resp;
+}
+
+
+static SMPP_PDU *handle_bind_transceiver(ESME *esme, SMPP_PDU *pdu)
+{
+    SMPP_PDU *resp;
+
+    esme->transmitter = esme->receiver = 1;
+    esme->version = pdu->u.bind_transceiver.interface_version;
+    resp = smpp_pdu_create(bind_transceiver_resp,
+                           pdu->u.bind_transceiver.sequence_number);
+    resp->u.bind_transceiver_resp.system_id = octstr_create("smpp_sim");
+    return resp;
+}
+
+
+static SMPP_PDU *handle_submit_sm(ESME *esme, SMPP_PDU *pdu)
+{
+    SMPP_PDU *resp, *dlr;
+    Octstr *msgid;
+
+    counter_increase(num_submits);
+    resp = smpp_pdu_create(submit_sm_resp, pdu->u.submit_sm.sequence_number);
+
+    if (error_percent > 0 && gw_rand() % 10000 < error_percent * 100) {
+        counter_increase(num_submit_errors);
+        resp->u.submit_sm_resp.command_status = error_status;
+        delay_pdu(resp_queue, esme, resp, resp_delay);
+        message_done(pdu->u.submit_sm.short_message, 1);
+        return NULL;
+    }
+
+    msgid = octstr_format("%lx", counter_increase(msgid_counter) + 1);
+    resp->u.submit_sm_resp.message_id = octstr_duplicate(msgid);
+    delay_pdu(resp_queue, esme, resp, resp_delay);
+    message_done(pdu->u.submit_sm.short_message, 0);
+
+    if ((pdu->u.submit_sm.registered_delivery & 0x03) && esme->receiver) {
+        dlr = smpp_pdu_create(deliver_sm, counter_increase(seq_counter));
+        dlr->u.deliver_sm.esm_class = ESM_CLASS_DELIVER_SMSC_DELIVER_ACK;
+        dlr->u.deliver_sm.source_addr =
+            octstr_duplicate(pdu->u.submit_sm.destination_addr);
+        dlr->u.deliver_sm.destination_addr =
+            octstr_duplicate(pdu->u.submit_sm.source_addr);
+        dlr->u.deliver_sm.short_message =
+            make_dlr_text(msgid, pdu->u.submit_sm.short_message);
+        if (esme->version > 0x33) {
+            dlr->u.deliver_sm.receipted_message_id = octstr_duplicate(msgid);
+            dlr->u.deliver_sm.message_state = 2; /* DELIVERED */
+        }
+        counter_increase(num_dlrs);
+        delay_pdu(dlr_queue, esme, dlr, resp_delay + dlr_delay);
+    }
+    octstr_destroy(msgid);
+
+    return NULL;
+}
+
+
+static SMPP_PDU *handle_deliver_sm_resp(ESME *esme, SMPP_PDU *pdu)
+{
+    if (pdu->u.deliver_sm_resp.command_status != 0)
+        counter_increase(num_deliver_nack);
+    else
+        counter_increase(num_deliver_resp);
+    gwlist_lock(esmes);
+    if (esme->pending > 0)
+        esme->pending--;
+    gwlist_unlock(esmes);
+    touch();
+    if (mo_thread_id != -1)
+        gwthread_wakeup(mo_thread_id);
+    return NULL;
+}
+
+
+static SMPP_PDU *handle_unbind(ESME *esme, SMPP_PDU *pdu)
+{
+    esme->transmitter = esme->receiver = 0;
+    return smpp_pdu_create(unbind_resp, pdu->u.unbind.sequence_number);
+}
+
+
+static SMPP_PDU *handle_enquire_link(ESME *esme, SMPP_PDU *pdu)
+{
+    return smpp_pdu_create(enquire_link_resp,
+                           pdu->u.enquire_link.sequence_number);
+}
+
+
+static SMPP_PDU *handle_enquire_link_resp(ESME *esme, SMPP_PDU *pdu)
+{
+    return NULL;
+}
+
+
+static struct {
+    unsigned long type;
+    SMPP_PDU *(*handler)(ESME *, SMPP_PDU *);
+} handlers[] = {
+    #define HANDLER(name) { name, handle_ ## name },
+    HANDLER(bind_transmitter)
+    HANDLER(bind_receiver)
+    HANDLER(bind_transceiver)
+    HANDLER(submit_sm)
+    HANDLER(deliver_sm_resp)
+    HANDLER(unbind)
+    HANDLER(enquire_link)
+    HANDLER(enquire_link_resp)
+    #undef HANDLER
+};
+static int num_handlers = sizeof(handlers) / sizeof(handlers[0]);
+
+
+static void handle_pdu(ESME *esme, SMPP_PDU *pdu)
+{
+    SMPP_PDU *resp;
+    int i;
+
+    for (i = 0; i < num_handlers; ++i) {
+        if (handlers[i].type == pdu->type) {
+            resp = handlers[i].handler(esme, pdu);
+            if (resp != NULL)
+                esme_send(esme, resp);
+            return;
+        }
+    }
+
+    error(0, "Unhandled SMPP PDU.");
+    smpp_pdu_dump(octstr_imm(""), pdu);
+    resp = smpp_pdu_create(generic_nack, pdu->u.generic_nack.sequence_number);
+    resp->u.generic_nack.command_status = SMPP_ESME_RINVCMDID;
+    esme_send(esme, resp);
+}
+
+
+static void receive_smpp_thread(void *arg)
+{
+    ESME *esme = arg;
+    Octstr *os;
+    SMPP_PDU *pdu;
+    long len;
+
+    len = 0;
+    while (!quitting && conn_wait(esme->conn, -1.0) != -1) {
+        for (;;) {
+            if (len == 0) {
+                len = smpp_pdu_read_len(esme->conn);
+                if (len == -1) {
+                    error(0, "Client sent garbage, closing connection.");
+                    goto error;
+                } else if (len == 0) {
+                    if (conn_eof(esme->conn) || conn_error(esme->conn))
+                        goto error;
+                    break;
+                }
+            }
+
+            os = smpp_pdu_read_data(esme->conn, len);
+            if (os == NULL) {
+                if (conn_eof(esme->conn) || conn_error(esme->conn))
+                    goto error;
+                break;
+            }
+            len = 0;
+            pdu = smpp_pdu_unpack(NULL, os);
+            if (pdu == NULL) {
+                error(0, "PDU unpacking failed!");
+                octstr_dump(os, 0);
+            } else {
+                handle_pdu(esme, pdu);
+                smpp_pdu_destroy(pdu);
+            }
+            octstr_destroy(os);
+        }
+    }
+
+error:
+    esme->transmitter = esme->receiver = 0;
+    debug("test.smpp", 0, "Bind closed.");
+}
+
+
+/***********************************************************************
+ * Load generators.
+ */
+
+/*
+ * Wait until bearerbox has bound and had start_delay seconds to settle.
+ */
+static void wait_for_start(void)
+{
+    double t;
+
+    while (!quitting && first_bind < 0)
+        gwthread_sleep(1.0);
+    while (!quitting && (t = first_bind + start_delay - now()) > 0)
+        gwthread_sleep(t);
+}
+
+
+/*
+ * Wait until message number i of a stream with the given rate is due.
+ */
+static void pace(double start, long i, double rate)
+{
+    double t;
+
+    if (rate <= 0)
+        return;
+    while (!quitting && (t = start + i / rate - now()) > 0)
+        gwthread_sleep(t);
+}
+
+
+/*
+ * Pick the next bound receiver with room in its window, round robin.
+ */
+static ESME *next_receiver(long *next)
+{
+    ESME *esme;
+    long i, n;
+
+    gwlist_lock(esmes);
+    n = gwlist_len(esmes);
+    for (i = 0; i < n; i++) {
+        esme = gwlist_get(esmes, (*next + i) % n);
+        if (esme->receiver && esme->pending < mo_window) {
+            *next = (*next + i + 1) % n;
+            esme->pending++;
+            gwlist_unlock(esmes);
+            return esme;
+        }
+    }
+    gwlist_unlock(esmes);
+    return NULL;
+}
+
+
+static void mo_thread(void *arg)
+{
+    ESME *esme;
+    SMPP_PDU *pdu;
+    double start;
+    long i, next;
+
+    esme = NULL;
+    next = 0;
+    start = -1;
+    wait_for_start();
+    for (i = 0; i < num_mo && !quitting; i++) {
+        while (!quitting && (esme = next_receiver(&next)) == NULL)
+            gwthread_sleep(1.0);
+        if (quitting)
+            break;
+        if (start < 0)
+            start = now();
+        pace(start, i, mo_rate);
+
+        pdu = smpp_pdu_create(deliver_sm, counter_increase(seq_counter));
+        pdu->u.deliver_sm.source_addr = octstr_format("456%ld", i % 1000);
+        pdu->u.deliver_sm.destination_addr = octstr_create("123");
+        pdu->u.deliver_sm.short_message = octstr_format("%ld", i);
+        message_sent(i);
+        esme_send(esme, pdu);
+        counter_increase(num_to_esme);
+    }
+    info(0, "All MO messages sent to ESME.");
+}
+
+
+static void mt_thread(void *arg)
+{
+    HTTPCaller *caller = arg;
+    Octstr *url;
+    double start;
+    long i, id;
+
+    wait_for_start();
+    start = now();
+    for (i = 0; i < num_mt && !quitting; i++) {
+        pace(start, i, mt_rate);
+        while (!quitting && i - counter_value(num_http_ok) -
+               counter_value(num_http_failed) >= mt_window)
+            gwthread_sleep(1.0);
+        id = num_mo + i;
+        url = octstr_format("%S&text=%ld", sendsms_url, id);
+        message_sent(id);
+        http_start_request(caller, HTTP_METHOD_GET, url, NULL, NULL, 0, caller, NULL);
+        octstr_destroy(url);
+    }
+    info(0, "All sendsms requests made.");
+}
+
+
+static void mt_result_thread(void *arg)
+{
+    HTTPCaller *caller = arg;
+    List *headers;
+    Octstr *final_url, *body;
+    int status;
+
+    while (http_receive_result(caller, &status, &final_url, &headers,
+                               &body) != NULL) {
+        if (status >= 200 && status < 300)
+            counter_increase(num_http_ok);
+        else
+            counter_increase(num_http_failed);
+        touch();
+        gwthread_wakeup(mt_thread_id);
+        octstr_destroy(final_url);
+        octstr_destroy(body);
+        http_destroy_headers(headers);
+    }
+}
+
+
+/*
+ * Answer the dlr-url callbacks smsbox makes for the reports we sent.
+ */
+static void dlr_http_thread(void *arg)
+{
+    HTTPClient *client;
+    Octstr *ip, *url, *body;
+    List *headers, *cgivars;
+
+    while ((client = http_accept_request(dlr_port, &ip, &url, &headers,
+                                         &body, &cgivars)) != NULL) {
+        counter_increase(num_dlr_callbacks);
+        touch();
+        http_send_reply(client, HTTP_OK, NULL, octstr_imm(""));
+        octstr_destroy(ip);
+        octstr_destroy(url);
+        octstr_destroy(body);
+        http_destroy_headers(headers);
+        http_destroy_cgiargs(cgivars);
+    }
+}
+
+
+static void accept_thread(void *arg)
+{
+    int fd, new_fd;
+    socklen_t addrlen;
+    struct sockaddr addr;
+    ESME *esme;
+
+    fd = make_server_socket(port, NULL);
+    if (fd == -1)
+        panic(0, "Couldn't create SMPP listen port.");
+
+    while (!quitting) {
+        if (gwthread_pollfd(fd, POLLIN, -1.0) != POLLIN)
+            continue;
+        addrlen = sizeof(addr);
+        new_fd = accept(fd, &addr, &addrlen);
+        if (new_fd == -1)
+            continue;
+        esme = esme_create(conn_wrap_fd(new_fd, 0));
+        gwlist_append(esmes, esme);
+        esme->thread = gwthread_create(receive_smpp_thread, esme);
+        if (first_bind < 0)
+            first_bind = now();
+    }
+    close(fd);
+}
+
+
+/***********************************************************************
+ * Reporting.
+ */
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+static double percentile(double *sorted, long n, double p)
+{
+    long i;
+
+    if (n == 0)
+        return 0;
+    i = (long) ceil(p / 100 * n) - 1;
+    return sorted[i < 0 ? 0 : i];
+}
+
+
+static void report(void)
+{
+    double *sorted, run_time;
+    long i, n, total;
+    FILE *f;
+
+    total = num_mo + num_mt;
+    sorted = gw_malloc((total > 0 ? total : 1) * sizeof(*sorted));
+    f = NULL;
+    if (data_file != NULL &&
+        (f = fopen(octstr_get_cstr(data_file), "w")) == NULL)
+        error(errno, "Couldn't open <%s>", octstr_get_cstr(data_file));
+    for (i = n = 0; i < total; i++) {
+        if (latency[i] < 0)
+            continue;
+        sorted[n++] = latency[i];
+        if (f != NULL)
+            fprintf(f, "%ld %.6f %.6f\n", i, sent_time[i] + latency[i] - first_sent,
+                    latency[i]);
+    }
+    if (f != NULL)
+        fclose(f);
+    qsort(sorted, n, sizeof(*sorted), compare_double);
+
+    run_time = (first_sent >= 0 && last_done > first_sent) ?
+        last_done - first_sent : 0;
+
+    info(0, "Binds accepted: %ld", gwlist_len(esmes));
+    info(0, "MO messages sent to ESME: %ld, deliver_sm_resp ok %ld, "
+         "failed %ld", counter_value(num_to_esme),
+         counter_value(num_deliver_resp), counter_value(num_deliver_nack));
+    info(0, "sendsms requests: %ld, accepted %ld, failed %ld",
+         num_mt, counter_value(num_http_ok), counter_value(num_http_failed));
+    info(0, "submit_sm received: %ld, answered with error %ld, DLRs sent %ld, "
+         "dlr-url calls %ld", counter_value(num_submits),
+         counter_value(num_submit_errors), counter_value(num_dlrs),
+         counter_value(num_dlr_callbacks));
+    info(0, "Messages completed: %ld of %ld, refused %ld", n, total, num_refused);
+    info(0, "Time: %.3f secs", run_time);
+    info(0, "Throughput: %.1f msgs/sec", run_time > 0 ? n / run_time : 0);
+    info(0, "Latency: min %.3f, p50 %.3f, p90 %.3f, p99 %.3f, max %.3f secs",
+         n ? sorted[0] : 0, percentile(sorted, n, 50),
+         percentile(sorted, n, 90), percentile(sorted, n, 99),
+         n ? sorted[n - 1] : 0);
+    gw_free(sorted);
+}
+
+
+static void handler(int signal)
+{
+    quitting = 1;
+}
+
+
+static void help(void)
+{
+    info(0, "smpp_sim [-h] [-v level] [-l logfile] [-c config] [-p port]");
+    info(0, "         [-m mo_msgs] [-r mo_rate] [-w mo_window]");
+    info(0, "         [-u sendsms_url] [-n mt_msgs] [-R mt_rate] [-W mt_window]");
+    info(0, "         [-d resp_delay] [-e error_percent] [-E error_status]");
+    info(0, "         [-D dlr_delay] [-H dlr_http_port] [-s start_delay]");
+    info(0, "         [-t idle_timeout] [-o datafile]");
+    info(0, "Delays and timeouts are in seconds, rates in messages per");
+    info(0, "second (0 means as fast as possible). Message texts are sent");
+    info(0, "back by the sms-service and by sendsms, the url must end in");
+    info(0, "a query string that takes '&text=' appended.");
+}
+
+
+int main(int argc, char **argv)
+{
+    struct sigaction act;
+    HTTPCaller *caller;
+    long accept_id, mt_id, mt_result_id, resp_id, dlr_id, dlr_http_id, i;
+    int opt;
+    char *log_file, *config_file;
+    Cfg *cfg;
+    Octstr *tmp;
+
+    gwlib_init();
+
+    act.sa_handler = handler;
+    sigemptyset(&act.sa_mask);
+    act.sa_flags = 0;
+    sigaction(SIGTERM, &act, NULL);
+    sigaction(SIGINT, &act, NULL);
+
+    log_file = config_file = NULL;
+
+    while ((opt = getopt(argc, argv, "hv:l:c:p:m:r:w:u:n:R:W:d:e:E:D:H:s:t:o:")) != EOF) {
+        switch (opt) {
+        case 'v':
+            log_set_output_level(atoi(optarg));
+            break;
+        case 'h':
+            help();
+            exit(0);
+        case 'l':
+            log_file = optarg;
+            break;
+        case 'c':
+            config_file = optarg;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'm':
+            num_mo = atol(optarg);
+            break;
+        case 'r':
+            mo_rate = atof(optarg);
+            break;
+        case 'w':
+            mo_window = atol(optarg);
+            break;
+        case 'u':
+            sendsms_url = octstr_create(optarg);
+            break;
+        case 'n':
+            num_mt = atol(optarg);
+            break;
+        case 'R':
+            mt_rate = atof(optarg);
+            break;
+        case 'W':
+            mt_window = atol(optarg);
+            break;
+        case 'd':
+            resp_delay = atof(optarg);
+            break;
+        case 'e':
+            error_percent = atof(optarg);
+            break;
+        case 'E':
+            error_status = strtol(optarg, NULL, 0);
+            break;
+        case 'D':
+            dlr_delay = atof(optarg);
+            break;
+        case 'H':
+            dlr_port = atol(optarg);
+            break;
+        case 's':
+            start_delay = atof(optarg);
+            break;
+        case 't':
+            idle_timeout = atof(optarg);
+            break;
+        case 'o':
+            data_file = octstr_create(optarg);
+            break;
+        case '?':
+        default:
+            error(0, "Invalid option %c", opt);
+            help();
+            panic(0, "Stopping.");
+        }
+    }
+
+    if (num_mt > 0 && sendsms_url == NULL)
+        panic(0, "sendsms requests need an url (-u).");
+    if (mo_window < 1)
+        mo_window = 1;
+    if (mt_window < 1)
+        mt_window = 1;
+
+    if (log_file != NULL)
+        log_open(log_file, GW_DEBUG, GW_NON_EXCL);
+
+    tmp = octstr_create(config_file != NULL ? config_file : "");
+    cfg = cfg_create(tmp);
+    octstr_destroy(tmp);
+    if (config_file != NULL && cfg_read(cfg) == -1)
+        panic(0, "Errors in config file.");
+    smpp_pdu_init(cfg);
+    cfg_destroy(cfg);
+
+    esmes = gwlist_create();
+    seq_counter = counter_create();
+    msgid_counter = counter_create();
+    num_to_esme = counter_create();
+    num_deliver_resp = counter_create();
+    num_deliver_nack = counter_create();
+    num_submits = counter_create();
+    num_submit_errors = counter_create();
+    num_dlrs = counter_create();
+    num_http_ok = counter_create();
+    num_http_failed = counter_create();
+    num_dlr_callbacks = counter_create();
+    times_lock = mutex_create();
+    sent_time = gw_malloc((num_mo + num_mt + 1) * sizeof(*sent_time));
+    latency = gw_malloc((num_mo + num_mt + 1) * sizeof(*latency));
+    for (i = 0; i < num_mo + num_mt; i++)
+        sent_time[i] = latency[i] = -1;
+    num_done = num_refused = 0;
+    last_event = now();
+
+    resp_queue = gwlist_create();
+    dlr_queue = gwlist_create();
+    gwlist_add_producer(resp_queue);
+    gwlist_add_producer(dlr_queue);
+    resp_id = gwthread_create(delayed_thread, resp_queue);
+    dlr_id = gwthread_create(delayed_thread, dlr_queue);
+
+    info(0, "Starting smpp_sim on port %d.", port);
+    accept_id = gwthread_create(accept_thread, NULL);
+    dlr_http_id = -1;
+    if (dlr_port > 0) {
+        if (http_open_port(dlr_port, 0) == -1)
+            panic(0, "Couldn't open HTTP port %ld.", dlr_port);
+        dlr_http_id = gwthread_create(dlr_http_thread, NULL);
+    }
+    if (num_mo > 0)
+        mo_thread_id = gwthread_create(mo_thread, NULL);
+    caller = http_caller_create();
+    mt_id = mt_result_id = -1;
+    if (num_mt > 0) {
+        mt_id = mt_thread_id = gwthread_create(mt_thread, caller);
+        mt_result_id = gwthread_create(mt_result_thread, caller);
+    }
+
+    /* run until everything is done, or nothing moves any more */
+    while (!quitting) {
+        gwthread_sleep(0.2);
+        mutex_lock(times_lock);
+        if (num_done + num_refused == num_mo + num_mt && num_done > 0 &&
+            gwlist_len(dlr_queue) == 0 && (dlr_port == 0 ||
+            counter_value(num_dlr_callbacks) >= counter_value(num_dlrs))) {
+            info(0, "All messages completed.");
+            quitting = 1;
+        } else if (first_sent >= 0 && now() - last_event > idle_timeout) {
+            info(0, "Nothing happened for %.0f secs, giving up.", idle_timeout);
+            quitting = 1;
+        }
+        mutex_unlock(times_lock);
+    }
+
+    /* let the last responses go out before the binds are closed */
+    gwlist_remove_producer(resp_queue);
+    gwlist_remove_producer(dlr_queue);
+    gwthread_join(resp_id);
+    gwthread_join(dlr_id);
+    if (mt_id != -1) {
+        gwthread_join(mt_id);
+        http_caller_signal_shutdown(caller);
+        gwthread_join(mt_result_id);
+    }
+    quit();
+    gwthread_join(accept_id);
+    if (mo_thread_id != -1)
+        gwthread_join(mo_thread_id);
+    for (i = 0; i < gwlist_len(esmes); i++)
+        gwthread_join(((ESME *) gwlist_get(esmes, i))->thread);
+    if (dlr_http_id != -1) {
+        http_close_all_ports();
+        gwthread_join(dlr_http_id);
+    }
+
+    report();
+
+    http_caller_destroy(caller);
+    gwlist_destroy(resp_queue, NULL);
+    gwlist_destroy(dlr_queue, NULL);
+    gwlist_destroy(esmes, esme_destroy);
+    counter_destroy(seq_counter);
+    counter_destroy(msgid_counter);
+    counter_destroy(num_to_esme);
+    counter_destroy(num_deliver_resp);
+    counter_destroy(num_deliver_nack);
+    counter_destroy(num_submits);
+    counter_destroy(num_submit_errors);
+    counter_destroy(num_dlrs);
+    counter_destroy(num_http_ok);
+    counter_destroy(num_http_failed);
+    counter_destroy(num_dlr_callbacks);
+    mutex_destroy(times_lock);
+    gw_free(sent_time);
+    gw_free(latency);
+    octstr_destroy(sendsms_url);
+    octstr_destroy(data_file);
+    smpp_pdu_shutdown();
+
+    gwlib_shutdown();
+    return 0;
+}
@@ -67,7 +67,7 @@
 #include "gwlib/gwlib.h"
 #include "gwlib/regex.h"
 
-#if defined(HAVE_REGEX) || defined(HAVE_PCRE)
+#if defined(HAVE_REGEX) || defined(HAVE_PCRE) || defined(HAVE_PCRE2)
 
 int main(int argc, char **argv)
 {
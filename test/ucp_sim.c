@@ -0,0 +1,997 @@
+/* ====================================================================
+ * The Kannel Software License, Version 1.0
+ *
+ * Copyright (c) 2001-2014 Kannel Group
+ * Copyright (c) 1998-2001 WapIT Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The end-user documentation included with the redistribution,
+ *    if any, must include the following acknowledgment:
+ *       "This product includes software developed by the
+ *        Kannel Group (http://www.kannel.org/)."
+ *    Alternately, this acknowledgment may appear in the software itself,
+ *    if and wherever such third-party acknowledgments normally appear.
+ *
+ * 4. The names "Kannel" and "Kannel Group" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For written permission, please
+ *    contact org@kannel.org.
+ *
+ * 5. Products derived from this software may not be called "Kannel",
+ *    nor may "Kannel" appear in their name, without prior written
+ *    permission of the Kannel Group.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ====================================================================
+ *
+ * This software consists of voluntary contributions made by many
+ * individuals on behalf of the Kannel Group.  For more information on
+ * the Kannel Group, please see <http://www.kannel.org/>.
+ *
+ * Portions of this software are based upon software originally written at
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.
+ */
+
+/*
+ * ucp_sim.c - UCP/EMI SMS center simulator and load generator
+ *
+ * Accepts any number of main connections from the emi driver of
+ * bearerbox. Each OP/51 submit is acknowledged after a configurable
+ * latency, a given percentage of them negatively, and an OP/53
+ * notification is sent for every submit that asks for one. MO messages
+ * are generated as OP/52 at a fixed rate over the connections, and
+ * sendsms requests can be made at a fixed rate as well.
+ *
+ * Every generated message carries its own number as text. The OP/51
+ * that brings the number back (the reply to the MO, or the MT itself)
+ * completes it, so the time in between is the end-to-end latency through
+ * bearerbox and smsbox. Throughput and latency percentiles are logged
+ * when all messages are done or nothing has happened for a while.
+ */
+
+
+#include <errno.h>
+#include <signal.h>
+#include <math.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gwlib/gwlib.h"
+#include "gw/smsc/emimsg.h"
+
+
+/***********************************************************************
+ * Configurable stuff.
+ */
+
+static int port = 2345;
+static long num_mo = 0;		/* MO messages to generate */
+static double mo_rate = 0;	/* MO messages per second, 0 = no limit */
+/*
+ * OP/52 without a reply on one connection. TRNs have two digits, so
+ * this is capped at 99.
+ */
+static long mo_window = 50;
+static Octstr *sendsms_url = NULL;
+static long num_mt = 0;		/* sendsms requests to make */
+static double mt_rate = 0;	/* sendsms requests per second, 0 = no limit */
+/*
+ * sendsms requests without a reply. More connections at once than the
+ * listen backlog of gwlib (10) leads to SYN retransmits, which show up
+ * as latency of seconds.
+ */
+static long mt_window = 10;
+static double ack_delay = 0;	/* seconds before the OP/51 reply */
+static double error_percent = 0; /* submits acknowledged negatively */
+static long error_code = 4;	/* EC of negative acks, "Operation not allowed" */
+static double dlr_delay = 1;	/* seconds from the OP/51 reply to OP/53 */
+static long dlr_port = 0;	/* HTTP port for dlr-url callbacks, 0 = none */
+static double idle_timeout = 10; /* give up after this many idle seconds */
+static double start_delay = 1;	/* seconds from the first connect to the load */
+static Octstr *data_file = NULL; /* per message latencies */
+
+
+/***********************************************************************
+ * State.
+ */
+
+static volatile sig_atomic_t quitting = 0;
+static Octstr *whoami;		/* name for the emimsg functions */
+static List *clients;		/* all connections, never shrinks */
+static Counter *msgid_counter;
+static Counter *num_to_client;	/* OP/52 with MO */
+static Counter *num_deliver_ack;
+static Counter *num_deliver_nack;
+static Counter *num_submits;
+static Counter *num_submit_errors;
+static Counter *num_dlrs;
+static Counter *num_dlr_acks;
+static Counter *num_http_ok;
+static Counter *num_http_failed;
+static Counter *num_dlr_callbacks;
+
+static Mutex *times_lock;
+static double *sent_time;	/* when message i was generated */
+static double *latency;		/* -1 until message i is completed */
+#define REFUSED -2		/* latency of a message refused by us */
+static long num_done;
+static long num_refused;
+static double first_sent = -1;
+static double last_done = -1;
+static double last_event;
+
+static long mo_thread_id = -1;
+static long mt_thread_id = -1;
+static double first_connect = -1;
+static List *ack_queue;		/* delayed OP/51 replies */
+static List *dlr_queue;		/* delayed OP/53 notifications */
+
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+static void quit(void)
+{
+    quitting = 1;
+    gwthread_wakeup_all();
+}
+
+
+/***********************************************************************
+ * Connections.
+ */
+
+typedef struct {
+    Connection *conn;
+    long thread;
+    int connected;
+    long next_trn;	/* for operations we send */
+    long pending;	/* MO messages sent but not answered */
+} Client;
+
+
+static Client *client_create(Connection *conn)
+{
+    Client *client;
+
+    client = gw_malloc(sizeof(*client));
+    client->conn = conn;
+    client->thread = -1;
+    client->connected = 1;
+    client->next_trn = 0;
+    client->pending = 0;
+    return client;
+}
+
+
+static void client_destroy(void *p)
+{
+    Client *client = p;
+
+    conn_destroy(client->conn);
+    gw_free(client);
+}
+
+
+static void client_send(Client *client, struct emimsg *emimsg)
+{
+    emimsg_send(client->conn, emimsg, whoami);
+    emimsg_destroy(emimsg);
+}
+
+
+/*
+ * TRN for the next operation we send. The caller holds the clients lock.
+ */
+static int client_trn(Client *client)
+{
+    int trn;
+
+    trn = client->next_trn;
+    client->next_trn = (client->next_trn + 1) % 100;
+    return trn;
+}
+
+
+/*
+ * An EMI message to send to a client once its time has come.
+ */
+typedef struct {
+    Client *client;
+    struct emimsg *emimsg;
+    double due;
+} Delayed;
+
+
+static void delay_emimsg(List *queue, Client *client, struct emimsg *emimsg,
+                         double delay)
+{
+    Delayed *d;
+
+    if (delay <= 0) {
+        client_send(client, emimsg);
+        return;
+    }
+    d = gw_malloc(sizeof(*d));
+    d->client = client;
+    d->emimsg = emimsg;
+    d->due = now() + delay;
+    gwlist_produce(queue, d);
+}
+
+
+/*
+ * Each queue has one delay, so the messages in it are due in order.
+ */
+static void delayed_thread(void *arg)
+{
+    List *queue = arg;
+    Delayed *d;
+    double t;
+
+    while ((d = gwlist_consume(queue)) != NULL) {
+        while (!quitting && (t = d->due - now()) > 0)
+            gwthread_sleep(t);
+        client_send(d->client, d->emimsg);
+        gw_free(d);
+    }
+}
+
+
+/*
+ * Service centre time stamp, DDMMYYhhmmss.
+ */
+static Octstr *make_scts(void)
+{
+    struct tm tm;
+
+    tm = gw_gmtime(time(NULL));
+    return octstr_format("%02d%02d%02d%02d%02d%02d", tm.tm_mday,
+                         tm.tm_mon + 1, tm.tm_year % 100, tm.tm_hour,
+                         tm.tm_min, tm.tm_sec);
+}
+
+
+/*
+ * IA5 text of an OP/5x, hex encoded with MT=3.
+ */
+static Octstr *make_amsg(Octstr *text)
+{
+    Octstr *amsg;
+
+    amsg = octstr_duplicate(text);
+    octstr_binary_to_hex(amsg, 1);
+    return amsg;
+}
+
+
+/***********************************************************************
+ * Completion bookkeeping.
+ */
+
+/*
+ * Note that something happened, for the idle timeout.
+ */
+static void touch(void)
+{
+    double t = now();
+
+    mutex_lock(times_lock);
+    last_event = t;
+    mutex_unlock(times_lock);
+}
+
+
+static void message_sent(long id)
+{
+    double t = now();
+
+    mutex_lock(times_lock);
+    sent_time[id] = t;
+    if (first_sent < 0)
+        first_sent = t;
+    last_event = t;
+    mutex_unlock(times_lock);
+}
+
+
+/*
+ * Message with the number in text came back in an OP/51. If the submit
+ * was refused it counts as done, unless it comes back later.
+ */
+static void message_done(Octstr *text, int refused)
+{
+    long id;
+    double t = now();
+
+    if (text == NULL || octstr_parse_long(&id, text, 0, 10) == -1 || id < 0 ||
+        id >= num_mo + num_mt)
+        return;
+
+    mutex_lock(times_lock);
+    last_event = t;
+    if (sent_time[id] >= 0 && latency[id] < 0) {
+        if (latency[id] == REFUSED)
+            num_refused--;
+        if (refused) {
+            latency[id] = REFUSED;
+            num_refused++;
+        } else {
+            latency[id] = t - sent_time[id];
+            last_done = t;
+            num_done++;
+        }
+    }
+    mutex_unlock(times_lock);
+}
+
+
+/***********************************************************************
+ * Operation handlers.
+ */
+
+static struct emimsg *handle_login(Client *client, struct emimsg *op)
+{
+    return emimsg_create_reply(60, op->trn, 1, whoami);
+}
+
+
+static struct emimsg *handle_alert(Client *client, struct emimsg *op)
+{
+    return emimsg_create_reply(31, op->trn, 1, whoami);
+}
+
+
+static struct emimsg *handle_submit(Client *client, struct emimsg *op)
+{
+    struct emimsg *ack, *dlr;
+    Octstr *text, *msgid;
+
+    counter_increase(num_submits);
+    text = octstr_duplicate(op->fields[E50_AMSG]);
+    if (text != NULL && octstr_hex_to_binary(text) == -1)
+        octstr_truncate(text, 0);
+
+    if (error_percent > 0 && gw_rand() % 10000 < error_percent * 100) {
+        counter_increase(num_submit_errors);
+        ack = emimsg_create_reply(51, op->trn, 0, whoami);
+        ack->fields[1] = octstr_format("%02ld", error_code);
+        ack->fields[2] = octstr_create("refused by ucp_sim");
+        delay_emimsg(ack_queue, client, ack, ack_delay);
+        message_done(text, 1);
+        octstr_destroy(text);
+        return NULL;
+    }
+
+    /*
+     * The SM of the ack is ADC:SCTS, and bearerbox finds the report by
+     * that SCTS and the recipient. A counter keeps it unique where a real
+     * time stamp would not be.
+     */
+    msgid = octstr_format("%012ld", counter_increase(msgid_counter) + 1);
+    ack = emimsg_create_reply(51, op->trn, 1, whoami);
+    ack->fields[2] = octstr_format("%S:%S", op->fields[E50_ADC], msgid);
+    delay_emimsg(ack_queue, client, ack, ack_delay);
+    message_done(text, 0);
+
+    if (op->fields[E50_NRQ] != NULL &&
+        octstr_get_char(op->fields[E50_NRQ], 0) == '1') {
+        gwlist_lock(clients);
+        dlr = emimsg_create_op(53, client_trn(client), whoami);
+        gwlist_unlock(clients);
+        dlr->fields[E50_ADC] = octstr_duplicate(op->fields[E50_OADC]);
+        dlr->fields[E50_OADC] = octstr_duplicate(op->fields[E50_ADC]);
+        dlr->fields[E50_SCTS] = octstr_duplicate(msgid);
+        dlr->fields[E50_DST] = octstr_create("0");
+        dlr->fields[E50_RSN] = octstr_create("000");
+        dlr->fields[E50_DSCTS] = make_scts();
+        dlr->fields[E50_MT] = octstr_create("3");
+        dlr->fields[E50_AMSG] = make_amsg(octstr_imm("Message delivered"));
+        counter_increase(num_dlrs);
+        delay_emimsg(dlr_queue, client, dlr, ack_delay + dlr_delay);
+    }
+    octstr_destroy(msgid);
+    octstr_destroy(text);
+
+    return NULL;
+}
+
+
+static struct {
+    int ot;
+    struct emimsg *(*handler)(Client *, struct emimsg *);
+} handlers[] = {
+    { 60, handle_login },
+    { 31, handle_alert },
+    { 51, handle_submit },
+};
+static int num_handlers = sizeof(handlers) / sizeof(handlers[0]);
+
+
+static void handle_operation(Client *client, struct emimsg *op)
+{
+    struct emimsg *reply;
+    int i;
+
+    for (i = 0; i < num_handlers; ++i) {
+        if (handlers[i].ot == op->ot) {
+            reply = handlers[i].handler(client, op);
+            if (reply != NULL)
+                client_send(client, reply);
+            return;
+        }
+    }
+
+    error(0, "Unhandled EMI operation %02d.", op->ot);
+}
+
+
+static void handle_reply(Client *client, struct emimsg *reply)
+{
+    int positive;
+
+    positive = octstr_get_char(reply->fields[0], 0) == 'A';
+    if (reply->ot == 52) {
+        counter_increase(positive ? num_deliver_ack : num_deliver_nack);
+        gwlist_lock(clients);
+        if (client->pending > 0)
+            client->pending--;
+        gwlist_unlock(clients);
+        if (mo_thread_id != -1)
+            gwthread_wakeup(mo_thread_id);
+    } else if (reply->ot == 53) {
+        counter_increase(num_dlr_acks);
+    }
+    touch();
+}
+
+
+static void receive_emi_thread(void *arg)
+{
+    Client *client = arg;
+    Octstr *str;
+    struct emimsg *emimsg;
+
+    while (!quitting && conn_wait(client->conn, -1.0) != -1) {
+        while ((str = conn_read_packet(client->conn, 2, 3)) != NULL) {
+            emimsg = get_fields(str, whoami);
+            octstr_destroy(str);
+            if (emimsg == NULL)
+                continue;	/* get_fields logged it */
+            if (emimsg->or == 'O')
+                handle_operation(client, emimsg);
+            else
+                handle_reply(client, emimsg);
+            emimsg_destroy(emimsg);
+        }
+        if (conn_eof(client->conn) || conn_error(client->conn))
+            break;
+    }
+
+    client->connected = 0;
+    debug("test.ucp", 0, "Connection closed.");
+}
+
+
+/***********************************************************************
+ * Load generators.
+ */
+
+/*
+ * Wait until bearerbox has connected and had start_delay seconds to settle.
+ */
+static void wait_for_start(void)
+{
+    double t;
+
+    while (!quitting && first_connect < 0)
+        gwthread_sleep(1.0);
+    while (!quitting && (t = first_connect + start_delay - now()) > 0)
+        gwthread_sleep(t);
+}
+
+
+/*
+ * Wait until message number i of a stream with the given rate is due.
+ */
+static void pace(double start, long i, double rate)
+{
+    double t;
+
+    if (rate <= 0)
+        return;
+    while (!quitting && (t = start + i / rate - now()) > 0)
+        gwthread_sleep(t);
+}
+
+
+/*
+ * Pick the next connection with room in its window, round robin, and
+ * take a TRN on it.
+ */
+static Client *next_client(long *next, int *trn)
+{
+    Client *client;
+    long i, n;
+
+    gwlist_lock(clients);
+    n = gwlist_len(clients);
+    for (i = 0; i < n; i++) {
+        client = gwlist_get(clients, (*next + i) % n);
+        if (client->connected && client->pending < mo_window) {
+            *next = (*next + i + 1) % n;
+            client->pending++;
+            *trn = client_trn(client);
+            gwlist_unlock(clients);
+            return client;
+        }
+    }
+    gwlist_unlock(clients);
+    return NULL;
+}
+
+
+static void mo_thread(void *arg)
+{
+    Client *client;
+    struct emimsg *op;
+    Octstr *text;
+    double start;
+    long i, next;
+    int trn;
+
+    client = NULL;
+    next = 0;
+    trn = 0;
+    start = -1;
+    wait_for_start();
+    for (i = 0; i < num_mo && !quitting; i++) {
+        while (!quitting && (client = next_client(&next, &trn)) == NULL)
+            gwthread_sleep(1.0);
+        if (quitting)
+            break;
+        if (start < 0)
+            start = now();
+        pace(start, i, mo_rate);
+
+        op = emimsg_create_op(52, trn, whoami);
+        op->fields[E50_ADC] = octstr_create("123");
+        op->fields[E50_OADC] = octstr_format("456%ld", i % 1000);
+        op->fields[E50_SCTS] = make_scts();
+        op->fields[E50_MT] = octstr_create("3");
+        text = octstr_format("%ld", i);
+        op->fields[E50_AMSG] = make_amsg(text);
+        octstr_destroy(text);
+        message_sent(i);
+        client_send(client, op);
+        counter_increase(num_to_client);
+    }
+    info(0, "All MO messages sent to bearerbox.");
+}
+
+
+static void mt_thread(void *arg)
+{
+    HTTPCaller *caller = arg;
+    Octstr *url;
+    double start;
+    long i, id;
+
+    wait_for_start();
+    start = now();
+    for (i = 0; i < num_mt && !quitting; i++) {
+        pace(start, i, mt_rate);
+        while (!quitting && i - counter_value(num_http_ok) -
+               counter_value(num_http_failed) >= mt_window)
+            gwthread_sleep(1.0);
+        id = num_mo + i;
+        url = octstr_format("%S&text=%ld", sendsms_url, id);
+        message_sent(id);
+        http_start_request(caller, HTTP_METHOD_GET, url, NULL, NULL, 0, caller, NULL);
+        octstr_destroy(url);
+    }
+    info(0, "All sendsms requests made.");
+}
+
+
+static void mt_result_thread(void *arg)
+{
+    HTTPCaller *caller = arg;
+    List *headers;
+    Octstr *final_url, *body;
+    int status;
+
+    while (http_receive_result(caller, &status, &final_url, &headers,
+                               &body) != NULL) {
+        if (status >= 200 && status < 300)
+            counter_increase(num_http_ok);
+        else
+            counter_increase(num_http_failed);
+        touch();
+        gwthread_wakeup(mt_thread_id);
+        octstr_destroy(final_url);
+        octstr_destroy(body);
+        http_destroy_headers(headers);
+    }
+}
+
+
+/*
+ * Answer the dlr-url callbacks smsbox makes for the reports we sent.
+ */
+static void dlr_http_thread(void *arg)
+{
+    HTTPClient *client;
+    Octstr *ip, *url, *body;
+    List *headers, *cgivars;
+
+    while ((client = http_accept_request(dlr_port, &ip, &url, &headers,
+                                         &body, &cgivars)) != NULL) {
+        counter_increase(num_dlr_callbacks);
+        touch();
+        http_send_reply(client, HTTP_OK, NULL, octstr_imm(""));
+        octstr_destroy(ip);
+        octstr_destroy(url);
+        octstr_destroy(body);
+        http_destroy_headers(headers);
+        http_destroy_cgiargs(cgivars);
+    }
+}
+
+
+static void accept_thread(void *arg)
+{
+    int fd, new_fd;
+    socklen_t addrlen;
+    struct sockaddr addr;
+    Client *client;
+
+    fd = make_server_socket(port, NULL);
+    if (fd == -1)
+        panic(0, "Couldn't create EMI listen port.");
+
+    while (!quitting) {
+        if (gwthread_pollfd(fd, POLLIN, -1.0) != POLLIN)
+            continue;
+        addrlen = sizeof(addr);
+        new_fd = accept(fd, &addr, &addrlen);
+        if (new_fd == -1)
+            continue;
+        client = client_create(conn_wrap_fd(new_fd, 0));
+        gwlist_append(clients, client);
+        client->thread = gwthread_create(receive_emi_thread, client);
+        if (first_connect < 0)
+            first_connect = now();
+    }
+    close(fd);
+}
+
+
+/***********************************************************************
+ * Reporting.
+ */
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+static double percentile(double *sorted, long n, double p)
+{
+    long i;
+
+    if (n == 0)
+        return 0;
+    i = (long) ceil(p / 100 * n) - 1;
+    return sorted[i < 0 ? 0 : i];
+}
+
+
+static void report(void)
+{
+    double *sorted, run_time;
+    long i, n, total;
+    FILE *f;
+
+    total = num_mo + num_mt;
+    sorted = gw_malloc((total > 0 ? total : 1) * sizeof(*sorted));
+    f = NULL;
+    if (data_file != NULL &&
+        (f = fopen(octstr_get_cstr(data_file), "w")) == NULL)
+        error(errno, "Couldn't open <%s>", octstr_get_cstr(data_file));
+    for (i = n = 0; i < total; i++) {
+        if (latency[i] < 0)
+            continue;
+        sorted[n++] = latency[i];
+        if (f != NULL)
+            fprintf(f, "%ld %.6f %.6f\n", i, sent_time[i] + latency[i] - first_sent,
+                    latency[i]);
+    }
+    if (f != NULL)
+        fclose(f);
+    qsort(sorted, n, sizeof(*sorted), compare_double);
+
+    run_time = (first_sent >= 0 && last_done > first_sent) ?
+        last_done - first_sent : 0;
+
+    info(0, "Connections accepted: %ld", gwlist_len(clients));
+    info(0, "MO messages sent to bearerbox: %ld, OP/52 acked %ld, "
+         "nacked %ld", counter_value(num_to_client),
+         counter_value(num_deliver_ack), counter_value(num_deliver_nack));
+    info(0, "sendsms requests: %ld, accepted %ld, failed %ld",
+         num_mt, counter_value(num_http_ok), counter_value(num_http_failed));
+    info(0, "OP/51 received: %ld, nacked %ld, OP/53 sent %ld, acked %ld, "
+         "dlr-url calls %ld", counter_value(num_submits),
+         counter_value(num_submit_errors), counter_value(num_dlrs),
+         counter_value(num_dlr_acks), counter_value(num_dlr_callbacks));
+    info(0, "Messages completed: %ld of %ld, refused %ld", n, total, num_refused);
+    info(0, "Time: %.3f secs", run_time);
+    info(0, "Throughput: %.1f msgs/sec", run_time > 0 ? n / run_time : 0);
+    info(0, "Latency: min %.3f, p50 %.3f, p90 %.3f, p99 %.3f, max %.3f secs",
+         n ? sorted[0] : 0, percentile(sorted, n, 50),
+         percentile(sorted, n, 90), percentile(sorted, n, 99),
+         n ? sorted[n - 1] : 0);
+    gw_free(sorted);
+}
+
+
+static void handler(int signal)
+{
+    quitting = 1;
+}
+
+
+static void help(void)
+{
+    info(0, "ucp_sim [-h] [-v level] [-l logfile] [-p port]");
+    info(0, "        [-m mo_msgs] [-r mo_rate] [-w mo_window]");
+    info(0, "        [-u sendsms_url] [-n mt_msgs] [-R mt_rate] [-W mt_window]");
+    info(0, "        [-d ack_delay] [-e error_percent] [-E error_code]");
+    info(0, "        [-D dlr_delay] [-H dlr_http_port] [-s start_delay]");
+    info(0, "        [-t idle_timeout] [-o datafile]");
+    info(0, "Delays and timeouts are in seconds, rates in messages per");
+    info(0, "second (0 means as fast as possible). Message texts are sent");
+    info(0, "back by the sms-service and by sendsms, the url must end in");
+    info(0, "a query string that takes '&text=' appended.");
+}
+
+
+int main(int argc, char **argv)
+{
+    struct sigaction act;
+    HTTPCaller *caller;
+    long accept_id, mt_id, mt_result_id, ack_id, dlr_id, dlr_http_id, i;
+    int opt;
+    char *log_file;
+
+    gwlib_init();
+
+    act.sa_handler = handler;
+    sigemptyset(&act.sa_mask);
+    act.sa_flags = 0;
+    sigaction(SIGTERM, &act, NULL);
+    sigaction(SIGINT, &act, NULL);
+
+    log_file = NULL;
+
+    while ((opt = getopt(argc, argv, "hv:l:p:m:r:w:u:n:R:W:d:e:E:D:H:s:t:o:")) != EOF) {
+        switch (opt) {
+        case 'v':
+            log_set_output_level(atoi(optarg));
+            break;
+        case 'h':
+            help();
+            exit(0);
+        case 'l':
+            log_file = optarg;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'm':
+            num_mo = atol(optarg);
+            break;
+        case 'r':
+            mo_rate = atof(optarg);
+            break;
+        case 'w':
+            mo_window = atol(optarg);
+            break;
+        case 'u':
+            sendsms_url = octstr_create(optarg);
+            break;
+        case 'n':
+            num_mt = atol(optarg);
+            break;
+        case 'R':
+            mt_rate = atof(optarg);
+            break;
+        case 'W':
+            mt_window = atol(optarg);
+            break;
+        case 'd':
+            ack_delay = atof(optarg);
+            break;
+        case 'e':
+            error_percent = atof(optarg);
+            break;
+        case 'E':
+            error_code = atol(optarg);
+            break;
+        case 'D':
+            dlr_delay = atof(optarg);
+            break;
+        case 'H':
+            dlr_port = atol(optarg);
+            break;
+        case 's':
+            start_delay = atof(optarg);
+            break;
+        case 't':
+            idle_timeout = atof(optarg);
+            break;
+        case 'o':
+            data_file = octstr_create(optarg);
+            break;
+        case '?':
+        default:
+            error(0, "Invalid option %c", opt);
+            help();
+            panic(0, "Stopping.");
+        }
+    }
+
+    if (num_mt > 0 && sendsms_url == NULL)
+        panic(0, "sendsms requests need an url (-u).");
+    if (mo_window < 1)
+        mo_window = 1;
+    if (mo_window > 99)
+        mo_window = 99;
+    if (mt_window < 1)
+        mt_window = 1;
+
+    if (log_file != NULL)
+        log_open(log_file, GW_DEBUG, GW_NON_EXCL);
+
+    whoami = octstr_create("ucp_sim");
+    clients = gwlist_create();
+    msgid_counter = counter_create();
+    num_to_client = counter_create();
+    num_deliver_ack = counter_create();
+    num_deliver_nack = counter_create();
+    num_submits = counter_create();
+    num_submit_errors = counter_create();
+    num_dlrs = counter_create();
+    num_dlr_acks = counter_create();
+    num_http_ok = counter_create();
+    num_http_failed = counter_create();
+    num_dlr_callbacks = counter_create();
+    times_lock = mutex_create();
+    sent_time = gw_malloc((num_mo + num_mt + 1) * sizeof(*sent_time));
+    latency = gw_malloc((num_mo + num_mt + 1) * sizeof(*latency));
+    for (i = 0; i < num_mo + num_mt; i++)
+        sent_time[i] = latency[i] = -1;
+    num_done = num_refused = 0;
+    last_event = now();
+
+    ack_queue = gwlist_create();
+    dlr_queue = gwlist_create();
+    gwlist_add_producer(ack_queue);
+    gwlist_add_producer(dlr_queue);
+    ack_id = gwthread_create(delayed_thread, ack_queue);
+    dlr_id = gwthread_create(delayed_thread, dlr_queue);
+
+    info(0, "Starting ucp_sim on port %d.", port);
+    accept_id = gwthread_create(accept_thread, NULL);
+    dlr_http_id = -1;
+    if (dlr_port > 0) {
+        if (http_open_port(dlr_port, 0) == -1)
+            panic(0, "Couldn't open HTTP port %ld.", dlr_port);
+        dlr_http_id = gwthread_create(dlr_http_thread, NULL);
+    }
+    if (num_mo > 0)
+        mo_thread_id = gwthread_create(mo_thread, NULL);
+    caller = http_caller_create();
+    mt_id = mt_result_id = -1;
+    if (num_mt > 0) {
+        mt_id = mt_thread_id = gwthread_create(mt_thread, caller);
+        mt_result_id = gwthread_create(mt_result_thread, caller);
+    }
+
+    /* run until everything is done, or nothing moves any more */
+    while (!quitting) {
+        gwthread_sleep(0.2);
+        mutex_lock(times_lock);
+        if (num_done + num_refused == num_mo + num_mt && num_done > 0 &&
+            gwlist_len(dlr_queue) == 0 && (dlr_port == 0 ||
+            counter_value(num_dlr_callbacks) >= counter_value(num_dlrs))) {
+            info(0, "All messages completed.");
+            quitting = 1;
+        } else if (first_sent >= 0 && now() - last_event > idle_timeout) {
+            info(0, "Nothing happened for %.0f secs, giving up.", idle_timeout);
+            quitting = 1;
+        }
+        mutex_unlock(times_lock);
+    }
+
+    /* let the last acks go out before the connections are closed */
+    gwlist_remove_producer(ack_queue);
+    gwlist_remove_producer(dlr_queue);
+    gwthread_join(ack_id);
+    gwthread_join(dlr_id);
+    if (mt_id != -1) {
+        gwthread_join(mt_id);
+        http_caller_signal_shutdown(caller);
+        gwthread_join(mt_result_id);
+    }
+    quit();
+    gwthread_join(accept_id);
+    if (mo_thread_id != -1)
+        gwthread_join(mo_thread_id);
+    for (i = 0; i < gwlist_len(clients); i++)
+        gwthread_join(((Client *) gwlist_get(clients, i))->thread);
+    if (dlr_http_id != -1) {
+        http_close_all_ports();
+        gwthread_join(dlr_http_id);
+    }
+
+    report();
+
+    http_caller_destroy(caller);
+    gwlist_destroy(ack_queue, NULL);
+    gwlist_destroy(dlr_queue, NULL);
+    gwlist_destroy(clients, client_destroy);
+    counter_destroy(msgid_counter);
+    counter_destroy(num_to_client);
+    counter_destroy(num_deliver_ack);
+    counter_destroy(num_deliver_nack);
+    counter_destroy(num_submits);
+    counter_destroy(num_submit_errors);
+    counter_destroy(num_dlrs);
+    counter_destroy(num_dlr_acks);
+    counter_destroy(num_http_ok);
+    counter_destroy(num_http_failed);
+    counter_destroy(num_dlr_callbacks);
+    mutex_destroy(times_lock);
+    gw_free(sent_time);
+    gw_free(latency);
+    octstr_destroy(sendsms_url);
+    octstr_destroy(data_file);
+    octstr_destroy(whoami);
+
+    gwlib_shutdown();
+    return 0;
+}
@@ -0,0 +1,117 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * mknumset.c - compile a white/black list into a number set file
+ *
+ * Reads a list of numbers the way bearerbox and smsbox do for their
+ * white and black lists (http:// or file:// URL, one number per line)
+ * and writes it as a number set file. Point the list at the result with
+ * a file:// URL and it is mapped into memory instead of being parsed,
+ * which matters for lists of millions of numbers. The output file is
+ * replaced atomically, so it can be rebuilt while bearerbox is running;
+ * a 'reload-lists' admin command then picks up the new one.
+ */
+
+#include <unistd.h>
+
+#include "gwlib/gwlib.h"
+#include "numhash.h"
+
+static void help(void)
+{
+    info(0, "Usage: mknumset [-v loglevel] <list-url> <number-set-file>");
+}
+
+int main(int argc, char **argv)
+{
+    int opt, ret;
+    Numhash *table;
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "hv:")) != EOF) {
+        switch (opt) {
+            case 'v':
+                log_set_output_level(atoi(optarg));
+                break;
+            case 'h':
+                help();
+                exit(0);
+            case '?':
+            default:
+                error(0, "Invalid option %c", opt);
+                help();
+                panic(0, "Stopping.");
+        }
+    }
+
+    if (argc - optind != 2) {
+        help();
+        exit(1);
+    }
+
+    if ((table = numhash_create(argv[optind])) == NULL)
+        panic(0, "Could not read number list <%s>.", argv[optind]);
+
+    ret = numhash_save(table, argv[optind + 1]);
+    if (ret == 0)
+        info(0, "Wrote %ld numbers to <%s>.", numhash_size(table), argv[optind + 1]);
+    numhash_destroy(table);
+
+    gwlib_shutdown();
+    return ret == 0 ? 0 : 1;
+}
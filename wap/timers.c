@@ -53,7 +53,6 @@
  * Portions of this software are based upon software originally written at  
  * WapIT Ltd., Helsinki, Finland for the Kannel project.  
  */ 
-
 /*
  * timers.c - timers and set of timers, mainly for WTP.
  *
@@ -61,32 +60,13 @@
  */
 
 #include <signal.h>
+#include <limits.h>
 
 #include "gwlib/gwlib.h"
+#include "gwlib/gw-wheel.h"
 #include "wap_events.h"
 #include "timers.h"
 
-/*
- * Active timers are stored in a TimerHeap.  It is a partially ordered
- * array.  Each element i is the child of element i/2 (rounded down),
- * and a child never elapses before its parent.  The result is that
- * element 0, the top of the heap, is always the first timer to
- * elapse.  The heap is kept in this partial order by all operations on
- * it.  Maintaining a partial order is much cheaper than maintaining
- * a sorted list.
- * The array will be resized as needed.  The size field is the number
- * of elements for which space is reserved, and the len field is the
- * number of elements actually used.  The elements used will always be
- * at tab[0] through tab[len-1].
- */
-struct TimerHeap
-{
-    Timer **tab;
-    long len;
-    long size;
-};
-typedef struct TimerHeap TimerHeap;
-
 struct Timerset
 {
     /*
@@ -94,27 +74,34 @@ struct Timerset
      */
     volatile sig_atomic_t stopping;
     /*
-     * The entire set is locked for any operation on it.  This is
-     * not as expensive as it sounds because usually each set is
-     * used by one caller thread and one (internal) timer thread,
-     * and the timer thread does not wake up very often.
+     * The entire set is locked for any operation on it.  Starting
+     * or stopping a timer takes constant time, so the lock is held
+     * only briefly.
      */
     Mutex *mutex;
     /*
-     * Active timers are stored here in a partially ordered structure.
-     * See the definition of TimerHeap, above, for an explanation.
+     * Active timers are stored here.  See gwlib/gw-wheel.h.
      */
-    TimerHeap *heap;
+    gw_wheel_t *wheel;
     /*
-     * The thread that watches the top of the heap, and processes
+     * The thread that advances the wheel, and processes
      * timers that have elapsed.
      */
     long thread;
+    /*
+     * The time the thread will wake up at.  Starting a timer that
+     * elapses earlier wakes it up.
+     */
+    long wakeup_at;
 };
 typedef struct Timerset Timerset;
 
 struct Timer
 {
+    /*
+     * The timer set this timer belongs to.
+     */
+    Timerset *set;
     /*
      * An event is produced on the output list when the
      * timer elapses.  The timer is not considered to have
@@ -125,11 +112,11 @@ struct Timer
      */
     List *output;
     /*
-     * The timer is set to elapse at this time, expressed in
-     * Unix time format.  This field is set to -1 if the timer
-     * is not active (i.e. in the timer set's heap).
+     * The entry in the timer set's wheel.  It is set to elapse at
+     * entry.elapses, in gw_clock_mono seconds.  This field is
+     * set to -1 if the timer is not active (i.e. in the wheel).
      */
-    long elapses;
+    struct gw_wheel_entry entry;
     /*
      * A duplicate of this event will be put on the output list
      * when the timer elapses.  It can be NULL if the timer has
@@ -143,21 +130,22 @@ struct Timer
      * the list, or if it's confirmed that the event was consumed.
      */
     WAPEvent *elapsed_event;
-    /*
-     * Index in the timer set's heap.  This field is managed by
-     * the heap operations, and is used to make them faster.
-     * If this timer is not in the heap, this field is -1.
-     */
-    long index;
 };
 
 /*
- * Currently we have one timerset (and thus one heap and one thread)
- * for all timers.  This might change in the future in order to tune
- * performance.  In that case, it will be necessary to add a "set"
- * field to the Timer structure.
+ * The timers are spread over several timersets, each with its own
+ * lock, wheel and thread, so that the WTP machines of many threads do
+ * not all wait for the same lock.  A timer stays in the set it was
+ * created in.
+ */
+#define TIMERSETS 4
+
+static Timerset *timers[TIMERSETS];
+
+/*
+ * Used to pick the set of the next timer created.
  */
-static Timerset *timers;
+static Counter *timers_created;
 
 /*
  * Used by timer functions to assert that the timer module has been
@@ -169,12 +157,10 @@ static int initialized = 0;
  * Internal functions
  */
 static void abort_elapsed(Timer *timer);
-static TimerHeap *heap_create(void);
-static void heap_destroy(TimerHeap *heap);
-static void heap_delete(TimerHeap *heap, long index);
-static int heap_adjust(TimerHeap *heap, long index);
-static void heap_insert(TimerHeap *heap, Timer *timer);
-static void heap_swap(TimerHeap *heap, long index1, long index2);
+static int activate(Timer *timer, long elapses);
+static void deactivate(Timer *timer);
+static Timerset *timerset_create(void);
+static void timerset_destroy(Timerset *set);
 static void lock(Timerset *set);
 static void unlock(Timerset *set);
 static void watch_timers(void *arg);   /* The timer thread */
@@ -183,41 +169,39 @@ static void elapse_timer(Timer *timer);
 
 void timers_init(void)
 {
+    int i;
+
     if (initialized == 0) {
-        timers = gw_malloc(sizeof(*timers));
-        timers->mutex = mutex_create();
-        timers->heap = heap_create();
-        timers->stopping = 0;
-        timers->thread = gwthread_create(watch_timers, timers);
+        for (i = 0; i < TIMERSETS; ++i)
+            timers[i] = timerset_create();
+        timers_created = counter_create();
     }
     initialized++;
 }
 
 void timers_shutdown(void)
 {
+    long active;
+    int i;
+
     if (initialized > 1) {
         initialized--;
         return;
     }
-       
-    /* Stop all timers. */
-    if (timers->heap->len > 0)
-        warning(0, "Timers shutting down with %ld active timers.",
-                timers->heap->len);
-    while (timers->heap->len > 0)
-        gwtimer_stop(timers->heap->tab[0]);
 
-    /* Kill timer thread */
-    timers->stopping = 1;
-    gwthread_wakeup(timers->thread);
-    gwthread_join(timers->thread);
+    active = 0;
+    for (i = 0; i < TIMERSETS; ++i)
+        active += gw_wheel_len(timers[i]->wheel);
+    if (active > 0)
+        warning(0, "Timers shutting down with %ld active timers.", active);
 
-    initialized = 0;
+    for (i = 0; i < TIMERSETS; ++i) {
+        timerset_destroy(timers[i]);
+        timers[i] = NULL;
+    }
+    counter_destroy(timers_created);
 
-    /* Free resources */
-    heap_destroy(timers->heap);
-    mutex_destroy(timers->mutex);
-    gw_free(timers);
+    initialized = 0;
 }
 
 
@@ -228,10 +212,12 @@ Timer *gwtimer_create(List *outputlist)
     gw_assert(initialized);
 
     t = gw_malloc(sizeof(*t));
-    t->elapses = -1;
+    t->set = timers[counter_increase(timers_created) % TIMERSETS];
+    t->entry.next = t->entry.prev = NULL;
+    t->entry.elapses = -1;
+    t->entry.owner = t;
     t->event = NULL;
     t->elapsed_event = NULL;
-    t->index = -1;
     t->output = outputlist;
     gwlist_add_producer(outputlist);
 
@@ -259,62 +245,82 @@ void gwtimer_start(Timer *timer, int interval, WAPEvent *event)
     gw_assert(timer != NULL);
     gw_assert(event != NULL || timer->event != NULL);
 
-    lock(timers);
-
-    /* Convert to absolute time */
-    interval += time(NULL);
+    lock(timer->set);
 
-    if (timer->elapses > 0) {
-        /* Resetting an existing timer.  Move it to its new
-         * position in the heap. */
-        if (interval < timer->elapses && timer->index == 0)
-            wakeup = 1;
-        timer->elapses = interval;
-        gw_assert(timers->heap->tab[timer->index] == timer);
-        wakeup |= heap_adjust(timers->heap, timer->index);
+    if (timer->entry.elapses >= 0) {
+        /* Resetting an existing timer.  Take it out of the wheel
+         * to put it in at its new time. */
+        deactivate(timer);
     } else {
         /* Setting a new timer, or resetting an elapsed one.
          * First deal with a possible elapse event that may
          * still be on the output list. */
         abort_elapsed(timer);
-
-        /* Then activate the timer. */
-        timer->elapses = interval;
-        gw_assert(timer->index < 0);
-        heap_insert(timers->heap, timer);
-        wakeup = timer->index == 0;  /* Do we have a new top? */
     }
 
+    /* Then activate the timer, at absolute time. */
+    wakeup = activate(timer, interval + gw_clock_mono());
+
     if (event != NULL) {
 	wap_event_destroy(timer->event);
 	timer->event = event;
     }
 
-    unlock(timers);
+    unlock(timer->set);
 
     if (wakeup)
-        gwthread_wakeup(timers->thread);
+        gwthread_wakeup(timer->set->thread);
 }
 
 void gwtimer_stop(Timer *timer)
 {
     gw_assert(initialized);
     gw_assert(timer != NULL);
-    lock(timers);
+    lock(timer->set);
 
     /*
      * If the timer is active, make it inactive and remove it from
-     * the heap.
+     * the wheel.
      */
-    if (timer->elapses > 0) {
-        timer->elapses = -1;
-        gw_assert(timers->heap->tab[timer->index] == timer);
-        heap_delete(timers->heap, timer->index);
-    }
+    if (timer->entry.elapses >= 0)
+        deactivate(timer);
 
     abort_elapsed(timer);
 
-    unlock(timers);
+    unlock(timer->set);
+}
+
+static Timerset *timerset_create(void)
+{
+    Timerset *set;
+
+    set = gw_malloc(sizeof(*set));
+    set->mutex = mutex_create();
+    set->wheel = gw_wheel_create(gw_clock_mono());
+    set->wakeup_at = LONG_MAX;
+    set->stopping = 0;
+    set->thread = gwthread_create(watch_timers, set);
+
+    return set;
+}
+
+static void timerset_destroy(Timerset *set)
+{
+    struct gw_wheel_entry *entry;
+
+    /* Stop all timers. */
+    while ((entry = gw_wheel_any(set->wheel)) != NULL)
+        gwtimer_stop(entry->owner);
+
+    /* Kill timer thread */
+    set->stopping = 1;
+    gwthread_wakeup(set->thread);
+    gwthread_join(set->thread);
+
+    /* Free resources */
+    gw_wheel_destroy(set->wheel);
+    mutex_destroy(set->mutex);
+    gw_free(set);
 }
 
 static void lock(Timerset *set)
@@ -352,160 +358,30 @@ static void abort_elapsed(Timer *timer)
 }
 
 /*
- * Create a new timer heap.
- */
-static TimerHeap *heap_create(void)
-{
-    TimerHeap *heap;
-
-    heap = gw_malloc(sizeof(*heap));
-    heap->tab = gw_malloc(sizeof(heap->tab[0]));
-    heap->size = 1;
-    heap->len = 0;
-
-    return heap;
-}
-
-static void heap_destroy(TimerHeap *heap)
-{
-    if (heap == NULL)
-        return;
-
-    gw_free(heap->tab);
-    gw_free(heap);
-}
-
-/*
- * Remove a timer from the heap.  Do this by swapping it with the element
- * in the last position, then shortening the heap, then moving the
- * swapped element up or down to maintain the partial ordering.
- */
-static void heap_delete(TimerHeap *heap, long index)
-{
-    long last;
-
-    gw_assert(index >= 0);
-    gw_assert(index < heap->len);
-    gw_assert(heap->tab[index]->index == index);
-
-    last = heap->len - 1;
-    heap_swap(heap, index, last);
-    heap->tab[last]->index = -1;
-    heap->len--;
-    if (index != last)
-        heap_adjust(heap, index);
-}
-
-/*
- * Add a timer to the heap.  Do this by adding it at the end, then
- * moving it up or down as necessary to achieve partial ordering.
+ * Put an inactive timer into the wheel of its set.  Return 1 if the
+ * timer thread has to wake up earlier for it, otherwise 0.
  */
-static void heap_insert(TimerHeap *heap, Timer *timer)
+static int activate(Timer *timer, long elapses)
 {
-    heap->len++;
-    if (heap->len > heap->size) {
-        heap->tab = gw_realloc(heap->tab,
-                                heap->len * sizeof(heap->tab[0]));
-        heap->size = heap->len;
-    }
-    heap->tab[heap->len - 1] = timer;
-    timer->index = heap->len - 1;
-    heap_adjust(heap, timer->index);
-}
-
-/*
- * Swap two elements of the heap, and update their index fields.
- * This is the basic heap operation.
- */
-static void heap_swap(TimerHeap *heap, long index1, long index2)
-{
-    Timer *t;
-
-    gw_assert(index1 >= 0);
-    gw_assert(index1 < heap->len);
-    gw_assert(index2 >= 0);
-    gw_assert(index2 < heap->len);
-
-    if (index1 == index2)
-        return;
-
-    t = heap->tab[index1];
-    heap->tab[index1] = heap->tab[index2];
-    heap->tab[index2] = t;
-    heap->tab[index1]->index = index1;
-    heap->tab[index2]->index = index2;
+    Timerset *set = timer->set;
+
+    gw_assert(timer->entry.next == NULL);
+    timer->entry.elapses = elapses;
+    gw_wheel_insert(set->wheel, &timer->entry);
+    if (elapses >= set->wakeup_at)
+        return 0;
+    set->wakeup_at = elapses;
+    return 1;
 }
 
 /*
- * The current element has broken the partial ordering of the
- * heap (see explanation in the definition of Timerset), and
- * it has to be moved up or down until the ordering is restored.
- * Return 1 if the timer at the heap's top is now earlier than
- * before this operation, otherwise 0.
+ * Take an active timer out of the wheel of its set.
  */
-static int heap_adjust(TimerHeap *heap, long index)
+static void deactivate(Timer *timer)
 {
-    Timer *t;
-    Timer *parent;
-    long child_index;
-
-    /*
-     * We can assume that the heap was fine before this element's
-     * elapse time was changed.  There are three cases to deal
-     * with:
-     *  - Element's new elapse time is too small; it should be
-     *    moved toward the top.
-     *  - Element's new elapse time is too large; it should be
-     *    moved toward the bottom.
-     *  - Element's new elapse time still fits here, we don't
-     *    have to do anything.
-     */
-
-    gw_assert(index >= 0);
-    gw_assert(index < heap->len);
-
-    /* Move to top? */
-    t = heap->tab[index];
-    parent = heap->tab[index / 2];
-    if (t->elapses < parent->elapses) {
-        /* This will automatically terminate when it reaches
-         * the top, because in that t == parent. */
-        do {
-            heap_swap(heap, index, index / 2);
-            index = index / 2;
-            parent = heap->tab[index / 2];
-        } while (t->elapses < parent->elapses);
-        /* We're done.  Return 1 if we changed the top. */
-        return index == 0;
-    }
-
-    /* Move to bottom? */
-    for (; ; ) {
-        child_index = index * 2;
-        if (child_index >= heap->len)
-            return 0;   /* Already at bottom */
-        if (child_index == heap->len - 1) {
-            /* Only one child */
-            if (heap->tab[child_index]->elapses < t->elapses)
-                heap_swap(heap, index, child_index);
-            break;
-        }
-
-        /* Find out which child elapses first */
-        if (heap->tab[child_index + 1]->elapses <
-            heap->tab[child_index]->elapses) {
-            child_index++;
-        }
-
-        if (heap->tab[child_index]->elapses < t->elapses) {
-            heap_swap(heap, index, child_index);
-            index = child_index;
-        } else {
-            break;
-        }
-    }
-
-    return 0;
+    gw_assert(timer->entry.next != NULL);
+    gw_wheel_remove(timer->set->wheel, &timer->entry);
+    timer->entry.elapses = -1;
 }
 
 /*
@@ -514,7 +390,7 @@ static int heap_adjust(TimerHeap *heap, long index)
 static void elapse_timer(Timer *timer)
 {
     gw_assert(timer != NULL);
-    gw_assert(timers != NULL);
+    gw_assert(timer->set != NULL);
     /* This must be true because abort_elapsed is always called
      * before a timer is activated. */
     gw_assert(timer->elapsed_event == NULL);
@@ -523,7 +399,7 @@ static void elapse_timer(Timer *timer)
 
     timer->elapsed_event = wap_event_duplicate(timer->event);
     gwlist_produce(timer->output, timer->elapsed_event);
-    timer->elapses = -1;
+    timer->entry.elapses = -1;
 }
 
 /*
@@ -532,7 +408,8 @@ static void elapse_timer(Timer *timer)
 static void watch_timers(void *arg)
 {
     Timerset *set;
-    long top_time;
+    struct gw_wheel_entry *entry;
+    long next;
     long now;
 
     set = arg;
@@ -540,26 +417,20 @@ static void watch_timers(void *arg)
     while (!set->stopping) {
         lock(set);
 
-	now = time(NULL);
+	now = gw_clock_mono();
 
-	while (set->heap->len > 0 && set->heap->tab[0]->elapses <= now) {
-	    elapse_timer(set->heap->tab[0]);
-	    heap_delete(set->heap, 0);
-	}
+	while ((entry = gw_wheel_expire(set->wheel, now)) != NULL)
+	    elapse_timer(entry->owner);
 
 	/*
-	 * Now sleep until the next timer elapses.  If there isn't one,
-	 * then just sleep very long.  We will get woken up if the
-	 * top of the heap changes before we wake.
+	 * Now sleep until the wheel has to advance.  If it is empty,
+	 * then just sleep very long.  We will get woken up if a timer
+	 * is started that elapses before we wake.
 	 */
 
-        if (set->heap->len == 0) {
-            unlock(set);
-            gwthread_sleep(1000000.0);
-        } else {
-	    top_time = set->heap->tab[0]->elapses;
-	    unlock(set);
-	    gwthread_sleep(top_time - now);
-	}
+	next = gw_wheel_next(set->wheel);
+	set->wakeup_at = (next == -1) ? LONG_MAX : next;
+	unlock(set);
+	gwthread_sleep(next == -1 ? 1000000.0 : next - now);
     }
 }